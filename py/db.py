@@ -121,6 +121,27 @@ class DB(utilities.FrozenClass, Facet, apsw_Connection):
 
 	from .util.numbering import recode_alts
 
+	ingest_threads = None
+	# The number of threads used to read arrays from a database file, each
+	# with its own read-only connection. None means the option.threads of the
+	# model being provisioned, or of a new model when there is none.
+
+	def _ingest_threads(self, sort):
+		# Threaded reading puts cases in caseid order, so it is only used
+		# when the arrays are to be sorted anyway.
+		if not sort:
+			return 1
+		if self.ingest_threads:
+			return self.ingest_threads
+		from .core import model_options_t
+		return model_options_t().threads or 1
+
+	@staticmethod
+	def _caseid_range_query(qry, caseid):
+		# The rows of qry, which is a SELECT from a single table, for the
+		# caseids from ?1 to ?2, limited in its own WHERE clause.
+		return "{} WHERE {} BETWEEN ?1 AND ?2".format(qry, caseid)
+
 	def __init__(self, filename=None, readonly=False, load_queries=True, shared=False):
 		import os.path
 		if filename is None:
@@ -195,7 +216,13 @@ class DB(utilities.FrozenClass, Facet, apsw_Connection):
 			fact = ""
 		return "{0:s}{1:s}".format(os.path.basename(self.source_filename),fact)
 
+	def close(self, *args):
+		# SQLite cannot close a connection with statements still prepared
+		self.clear_statement_cache()
+		apsw.Connection.close(self, *args)
+
 	def __del__(self):
+		self.clear_statement_cache()
 		apsw.Connection.close(self)
 
 	def __repr__(self):
@@ -1380,7 +1407,7 @@ class DB(utilities.FrozenClass, Facet, apsw_Connection):
 		case_slots = dict()
 		caseids = numpy.zeros([n_cases,1], dtype='int64')
 		n = 0
-		self._array_idco_reader(qry, None, caseids)
+		self._array_idco_reader(qry, None, caseids, self._ingest_threads(sort), self._caseid_range_query(qry, caseid))
 		if sort:
 			order = numpy.argsort(caseids[:,0])
 			caseids = caseids[order,:]
@@ -1482,7 +1509,7 @@ class DB(utilities.FrozenClass, Facet, apsw_Connection):
 		alt_slots = {a:n for n,a in enumerate(altcodes)}
 		n = 0	
 		result = numpy.zeros([n_cases,n_alts,n_vars], dtype=dtype)
-		self._array_idca_reader(qry, result, caseids, altcodes)
+		self._array_idca_reader(qry, result, caseids, altcodes, self._ingest_threads(sort), self._caseid_range_query(qry, caseid))
 		#for row in self.execute(qry):
 		#	if row[0] not in case_slots:
 		#		c = case_slots[row[0]] = n
@@ -1585,7 +1612,7 @@ class DB(utilities.FrozenClass, Facet, apsw_Connection):
 		caseids = numpy.zeros([n_cases,1], dtype='int64')
 		n = 0
 		result = numpy.zeros([n_cases,n_vars], dtype=dtype)
-		self._array_idco_reader(qry, result, caseids)
+		self._array_idco_reader(qry, result, caseids, self._ingest_threads(sort), self._caseid_range_query(qry, caseid))
 		#for row in self.execute(qry):
 		#	if row[0] not in case_slots:
 		#		c = case_slots[row[0]] = n
@@ -1633,7 +1660,7 @@ class DB(utilities.FrozenClass, Facet, apsw_Connection):
 		n = 0
 		result = numpy.zeros([n_cases,n_vars], dtype=dtype)
 		try:
-			self._array_idco_reader(qry, result, caseids)
+			self._array_idco_reader(qry, result, caseids, self._ingest_threads(sort), self._caseid_range_query(qry, caseid))
 		except:
 			print("result.shape=",result.shape)
 			print("caseids.shape=",caseids.shape)
@@ -1700,7 +1727,7 @@ class DB(utilities.FrozenClass, Facet, apsw_Connection):
 		n = 0	
 		result = numpy.zeros([n_cases,n_alts,n_vars], dtype=dtype)
 		try:
-			self._array_idca_reader(qry, result, caseids, altcodes)
+			self._array_idca_reader(qry, result, caseids, altcodes, self._ingest_threads(sort), self._caseid_range_query(qry, caseid))
 		except:
 			print("result.shape=",result.shape)
 			print("caseids.shape=",caseids.shape)
@@ -1778,7 +1805,7 @@ class DB(utilities.FrozenClass, Facet, apsw_Connection):
 		n = 0	
 		result = numpy.zeros([n_cases,n_alts,n_vars], dtype=dtype)
 		try:
-			self._array_idca_reader(qry, result, caseids, altcodes)
+			self._array_idca_reader(qry, result, caseids, altcodes, self._ingest_threads(sort), self._caseid_range_query(qry, caseid))
 		except:
 			print("result.shape=",result.shape)
 			print("caseids.shape=",caseids.shape)
@@ -1879,7 +1906,14 @@ class DB(utilities.FrozenClass, Facet, apsw_Connection):
 		result.vars = [var,]
 		return result, caseids
 
-	def provision(self, needs, *, idca_avail_ratio_floor=0.1, log=None):
+	def provision(self, needs, *, idca_avail_ratio_floor=0.1, log=None, threads=None):
+		if threads and not self.ingest_threads:
+			# read the arrays on as many threads as the model will use
+			self.ingest_threads = threads
+			try:
+				return self.provision(needs, idca_avail_ratio_floor=idca_avail_ratio_floor, log=log)
+			finally:
+				self.ingest_threads = None
 		from . import Model
 		if isinstance(needs,Model):
 			m = needs
@@ -1,5 +1,5 @@
 
-from .core import Model2, LarchError, _core, ParameterAlias, Facet, Fountain, ProvisioningError, ModelParameter, LinearComponent, LinearFunction
+from .core import Model2, LarchError, LarchCacheError, _core, ParameterAlias, Facet, Fountain, ProvisioningError, ModelParameter, LinearComponent, LinearFunction
 from .array import SymmetricArray
 from .util.pmath import category, pmath, rename
 from .util.categorize import Renamer, Categorizer
@@ -9,7 +9,6 @@ from .util.xhtml import XHTML, XML_Builder
 import math
 from .model_reporter import ModelReporter
 import base64
-from .util.attribute_dict import function_cache
 from .model_shadowmanager import shadow_manager, metaparameter_manager
 from .model_parametermanager import ParameterManager
 from .model_datamanager import DataManager, WorkspaceManager
@@ -39,7 +38,6 @@ class Model(Model2, ModelReporter):
 
 	def __init__(self, *args, **kwargs):
 		super().__init__(*args, **kwargs)
-		self._cached_results = function_cache()
 		self._setweakself(self)
 		if self.option.author == "Chuck Finley":
 			try:
@@ -1577,14 +1575,13 @@ class Model(Model2, ModelReporter):
 			self.parameter_array[self.blp_shares_map] -= mean_shock
 		if cached:
 			try:
-				if self.option.log_turns and self.logger(): self.logger().critical("<LL> {} <= {!s}".format(self._cached_results[self.parameter_array.tobytes()].loglike, self.parameter_array))
-				return self._cached_results[self.parameter_array.tobytes()].loglike
-			except (KeyError, AttributeError):
+				ll = super().loglike_cached()
+				if self.option.log_turns and self.logger(): self.logger().critical("<LL> {} <= {!s}".format(ll, self.parameter_array))
+				return ll
+			except LarchCacheError:
 				pass
-		# otherwise not cached (or not correctly) so calculate anew
+		# otherwise not cached so calculate anew, which also saves it in the cache
 		ll = super().loglike()
-		if ll and isinstance(self._cached_results, function_cache):
-			self._cached_results[self.parameter_array.tobytes()].loglike = ll
 		if numpy.isnan(ll):
 			self.doctor()
 			ll = -numpy.inf
@@ -2231,7 +2228,10 @@ class Model(Model2, ModelReporter):
 					args = (dict(numpy.load(cachefile, 'r')),)
 					cache = False # loaded it, so don't overwrite it
 		if len(args)==0:
-			if hasattr(self,'df') and isinstance(self.df,(DB,DT)):
+			if hasattr(self,'df') and isinstance(self.df,DB):
+				kwargs.setdefault('threads', self.option.threads)
+				args = (self.df.provision(self.needs(), idca_avail_ratio_floor=idca_avail_ratio_floor, log=self.logger(), **kwargs), )
+			elif hasattr(self,'df') and isinstance(self.df,DT):
 				args = (self.df.provision(self.needs(), idca_avail_ratio_floor=idca_avail_ratio_floor, log=self.logger(), **kwargs), )
 			else:
 				raise LarchError('model has no db specified for provisioning')
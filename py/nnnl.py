@@ -305,6 +305,12 @@ class NNNL(MetaModel):
 		if self.work.probability.shape[1] != self.df.nAlts() or self.work.probability.shape[0] != self.df.nCases():
 			self._setUp_NNNL_host(self._ncases or self.df.nCases())
 		m0 = self.sub_model[self.root_id]
+		# loglike may leave the probability arrays of the sub models unwritten
+		for key,m in self.sub_model.items():
+			if key!=self.root_id:
+				m.probability()
+		m0.dataedit.utilityco[numpy.isneginf(m0.dataedit.utilityco)] = -1.79769313e+308
+		m0.probability()
 		for slot,nestcode in enumerate(m0.alternative_codes()):
 			t = m0.work.probability[:,slot]
 			for subslot, altcode in enumerate(self.sub_model[nestcode].alternative_codes()):
@@ -39,6 +39,111 @@ class TestSwigCommmands(ELM_TestCase):
 		self.assertEqual({'a':1.0, 'b':2.0, 'c':3.0}, _swigtest_alpha_dict())
 		self.assertEqual({}, _swigtest_empty_dict())
 
+	def test_simd_masked_logit_row(self):
+		from ..core import _swigtest_masked_logit_row
+		numpy.random.seed(0)
+		for n in (1, 3, 7, 13):
+			av = [int(i) for i in (numpy.random.random(n) > 0.3)]
+			av[0] = 1
+			ch = [0.0]*n
+			ch[0] = 1.0
+			for scale in (1.0, 900.0, -900.0):
+				# beyond +/-700 the utilities are shifted before exponentiating
+				u = list(numpy.random.normal(size=n) + scale)
+				scalar = numpy.array(_swigtest_masked_logit_row(u, av, ch, 0))
+				best = numpy.array(_swigtest_masked_logit_row(u, av, ch, 2))
+				self.assertTrue( numpy.allclose(scalar, best, rtol=1e-12, atol=1e-12) )
+				self.assertAlmostEqual(1.0, scalar[:n].sum(), delta=1e-12)
+				self.assertTrue( numpy.all(scalar[:n][numpy.array(av)==0] == 0) )
+
+	def test_simd_mixed_gemv(self):
+		from ..core import _swigtest_mixed_gemv
+		numpy.random.seed(0)
+		for m, n in ((1,1), (3,5), (4,7), (9,13)):
+			A = numpy.random.normal(size=[m,n]).astype(numpy.float32).astype(numpy.float64)
+			x = numpy.random.normal(size=n)
+			y = numpy.random.normal(size=m)
+			for beta in (0.0, 0.5):
+				scalar = numpy.array(_swigtest_mixed_gemv(m, n, 2.0, list(A.ravel()), list(x), beta, list(y), 0))
+				best = numpy.array(_swigtest_mixed_gemv(m, n, 2.0, list(A.ravel()), list(x), beta, list(y), 2))
+				self.assertTrue( numpy.allclose(scalar, best, rtol=1e-12, atol=1e-12) )
+				self.assertTrue( numpy.allclose(scalar, 2.0*A.dot(x)+beta*y, rtol=1e-12, atol=1e-12) )
+
+	def test_simd_logsum_tile(self):
+		from ..core import _swigtest_logsum_tile
+		numpy.random.seed(0)
+		for m, n in ((1,1), (3,5), (4,7), (6,13)):
+			x = numpy.random.normal(size=[m,n]) * 3
+			x[numpy.random.random([m,n]) < 0.3] = -numpy.inf
+			# the last case has no items other than -inf
+			x[:,-1] = -numpy.inf
+			for mu in (1.0, 0.4, 0.0):
+				scalar = numpy.array(_swigtest_logsum_tile(list(x.ravel()), m, n, mu, 0))
+				best = numpy.array(_swigtest_logsum_tile(list(x.ravel()), m, n, mu, 2))
+				self.assertTrue( numpy.allclose(scalar, best, rtol=1e-12, atol=1e-12) )
+				self.assertEqual(-numpy.inf, scalar[-1])
+				self.assertEqual(-numpy.inf, best[-1])
+				if mu:
+					with numpy.errstate(divide='ignore'):
+						expected = mu * numpy.log(numpy.exp(x/mu).sum(0))
+				else:
+					expected = x.max(0)
+				self.assertTrue( numpy.allclose(scalar, expected, rtol=1e-12, atol=1e-12) )
+
+	def test_simd_prob_scale_tile(self):
+		from ..core import _swigtest_prob_scale_tile
+		numpy.random.seed(0)
+		for m, n in ((1,1), (3,5), (4,7), (6,13)):
+			x = numpy.random.random([m,n])
+			# the last case sums to zero and is left as it is
+			x[:,-1] = 0
+			if n>4:
+				x[1,2] = numpy.nan
+			scalar = numpy.array(_swigtest_prob_scale_tile(list(x.ravel()), m, n, 0))
+			best = numpy.array(_swigtest_prob_scale_tile(list(x.ravel()), m, n, 2))
+			# each case is summed in the same order, so the results are the same
+			self.assertTrue( numpy.array_equal(scalar, best, equal_nan=True) )
+			with numpy.errstate(invalid='ignore'):
+				expected = x / numpy.where(x.sum(0)==0, 1, x.sum(0))
+			self.assertTrue( numpy.allclose(scalar[:m*n].reshape(m,n), expected, rtol=1e-14, equal_nan=True) )
+			self.assertTrue( numpy.allclose(scalar[m*n:], x.sum(0), rtol=1e-14, equal_nan=True) )
+
+	def test_mixed_gemm(self):
+		from ..core import _swigtest_mixed_gemm
+		numpy.random.seed(0)
+		A = numpy.random.normal(size=[3,4]).astype(numpy.float32).astype(numpy.float64)
+		B = numpy.random.normal(size=[4,5])
+		C = numpy.random.normal(size=[3,5])
+		out = numpy.array(_swigtest_mixed_gemm(3, 5, 4, 2.0, list(A.ravel()), list(B.ravel()), 0.5, list(C.ravel()))).reshape(3,5)
+		self.assertTrue( numpy.allclose(out, 2.0*A.dot(B)+0.5*C, rtol=1e-12, atol=1e-12) )
+		# a zero in A still carries a NaN or infinity in B into C, as in BLAS
+		A[:,1] = 0
+		B[1,2] = numpy.nan
+		B[1,3] = numpy.inf
+		out = numpy.array(_swigtest_mixed_gemm(3, 5, 4, 1.0, list(A.ravel()), list(B.ravel()), 0.0, [0.0]*15)).reshape(3,5)
+		self.assertTrue( numpy.all(numpy.isnan(out[:,2:4])) )
+		self.assertTrue( numpy.all(numpy.isfinite(out[:,[0,1,4]])) )
+
+	def test_symmetric_inv(self):
+		from ..core import _swigtest_symmetric_inv
+		numpy.random.seed(0)
+		Q, _ = numpy.linalg.qr(numpy.random.normal(size=[4,4]))
+		def inv(eig):
+			a = (Q * eig).dot(Q.T)
+			return a, numpy.array(_swigtest_symmetric_inv(list(a.ravel()), 4)).reshape(4,4)
+		# well conditioned, definite or not
+		for eig in ([5.0, 2.0, 1.0, 0.5], [5.0, -2.0, 1.0, 0.5]):
+			a, x = inv(eig)
+			self.assertTrue( numpy.allclose(x, numpy.linalg.inv(a), rtol=1e-10, atol=1e-10) )
+		# a tiny eigenvalue gives the pseudo-inverse, which drops it
+		for eig in ([5.0, 2.0, 1.0, 0.0], [5.0, -2.0, 1.0, 1e-11]):
+			a, x = inv(eig)
+			kept = numpy.array([1/e if abs(e)>1e-9 else 0 for e in eig])
+			self.assertTrue( numpy.allclose(x, (Q * kept).dot(Q.T), rtol=1e-8, atol=1e-8) )
+		# a small one that is above the cutoff is kept
+		a, x = inv([5.0, 2.0, 1.0, 1e-4])
+		self.assertTrue( numpy.allclose(x, numpy.linalg.inv(a), rtol=1e-6) )
+
 
 class TestData1(unittest.TestCase):
 	def test_basic_stats(self):
@@ -127,6 +232,99 @@ class TestData1(unittest.TestCase):
 		self.assertFalse(req.satisfied_by(w)==0)
 		self.assertTrue(req.satisfied_by(z)==0)
 
+	def test_darray_file(self):
+		import numpy, tempfile
+		from ..core import save_darray_file, map_darray_file
+		z = Array(numpy.arange(24, dtype=numpy.float64).reshape(2,3,4), vars=['a','b','c','d'])
+		with tempfile.TemporaryDirectory() as tempdir:
+			filename = os.path.join(tempdir, 'z.larchdat')
+			save_darray_file(z, filename)
+			q = map_darray_file(filename)
+			self.assertEqual(q.shape, (2,3,4))
+			self.assertEqual(tuple(q.vars), ('a','b','c','d'))
+			self.assertTrue(numpy.all(q == z))
+			q[0,0,0] = 99
+			self.assertEqual(map_darray_file(filename)[0,0,0], 0)
+			del q
+
+	def test_threaded_ingest(self):
+		import numpy, tempfile
+		with tempfile.TemporaryDirectory() as tempdir:
+			d = DB(os.path.join(tempdir, 'ingest.db'), load_queries=False)
+			d.execute("CREATE TABLE co (caseid INTEGER, x REAL, y REAL)")
+			d.execute("BEGIN TRANSACTION")
+			for i in range(20000):
+				d.execute("INSERT INTO co VALUES (?,?,?)", (20000-i, i*0.5, i%7))
+			d.execute("COMMIT")
+			d.execute("CREATE TABLE ca (caseid INTEGER, altid INTEGER, x REAL)")
+			d.execute("BEGIN TRANSACTION")
+			for i in range(20000):
+				# case i has alternatives 1 to 1+i%3, so some are missing
+				for a in range(1, 2+i%3):
+					d.execute("INSERT INTO ca VALUES (?,?,?)", (20000-i, a, i*0.5+a))
+			d.execute("COMMIT")
+			d.ingest_threads = 1
+			x1, c1 = d.array_idco('x', 'y', table='co')
+			z1, k1 = d.array_idca('x', table='ca', altcodes=(1,2,3))
+			d.ingest_threads = 4
+			x4, c4 = d.array_idco('x', 'y', table='co')
+			z4, k4 = d.array_idca('x', table='ca', altcodes=(1,2,3))
+			self.assertTrue(numpy.all(c1 == c4))
+			self.assertTrue(numpy.all(x1 == x4))
+			self.assertEqual(c4[0,0], 1)
+			self.assertEqual(x4[0,0], 9999.5)
+			self.assertTrue(numpy.all(k1 == k4))
+			self.assertTrue(numpy.array_equal(z1, z4))
+			self.assertEqual(k4[0,0], 1)
+			self.assertEqual(z4[0,0,0], 9999.5+1)
+			self.assertEqual(z4[0,1,0], 9999.5+2)
+			self.assertEqual(z4[0,2,0], 0)
+			d.close()
+
+	def test_fetch_block(self):
+		d = DB()
+		d.execute("CREATE TEMP TABLE fb (caseid INTEGER, altid INTEGER, x REAL, y REAL)")
+		for i in range(23):
+			d.execute("INSERT INTO fb VALUES (?,?,?,?)", (100+i, i%3, None if i%5==0 else i*0.25, None if i%4==1 else -i))
+		sql = "SELECT caseid, altid, x, y FROM fb ORDER BY caseid"
+		rows = numpy.array(d._swigtest_fetch_rows(sql, 2, 2)).reshape(23, 4)
+		self.assertEqual(rows[0,0], 100)
+		self.assertEqual(rows[22,0], 122)
+		self.assertEqual(rows[5,2], 0.0)
+		self.assertEqual(rows[6,2], 1.5)
+		# 23 rows in blocks of 8 ends with a partial block, and in blocks of 23
+		#  with an empty one
+		for block_rows in (1, 8, 23, 50):
+			block = numpy.array(d._swigtest_fetch_block(sql, block_rows, 2, 2)).reshape(23, 4)
+			self.assertTrue(numpy.array_equal(rows, block))
+		block = numpy.array(d._swigtest_fetch_block(sql, 8, 0, 4)).reshape(23, 4)
+		self.assertTrue(numpy.array_equal(rows, block))
+
+	def test_close_after_reading(self):
+		import tempfile
+		with tempfile.TemporaryDirectory() as tempdir:
+			filename = os.path.join(tempdir, 'closing.db')
+			d = DB(filename, load_queries=False)
+			d.execute("CREATE TABLE co (caseid INTEGER, x REAL)")
+			for i in range(10):
+				d.execute("INSERT INTO co VALUES (?,?)", (i+1, i*0.5))
+			x, c = d.array_idco('x', table='co')
+			self.assertEqual(10, len(d._swigtest_fetch_block("SELECT caseid, x FROM co", 4, 1, 1))//2)
+			# the cached statements are finalized, so the connection closes
+			d.close()
+			d2 = DB(filename, load_queries=False)
+			self.assertEqual(d2.eval_integer("SELECT count(*) FROM co"), 10)
+			d2.close()
+
+	def test_statement_cache(self):
+		d = DB()
+		d.execute("CREATE TEMP TABLE sc (x REAL)")
+		for i in range(5):
+			d.execute("INSERT INTO sc VALUES (?)", (i+0.5,))
+		self.assertTrue(d._swigtest_statement_cache_reuse("SELECT x FROM sc ORDER BY x"))
+		self.assertEqual(d.eval_float("SELECT min(x) FROM sc"), 0.5)
+		self.assertEqual(d.eval_float("SELECT min(x) FROM sc"), 0.5)
+
 	def test_export_import_idca(self):
 		from io import StringIO
 		f = StringIO()
@@ -26,7 +26,7 @@ if __name__ == "__main__" and __package__ is None:
     __package__ = "larch.test.test_mnl"
 
 from ..test import TEST_DATA, ELM_TestCase, DEEP_TEST
-from ..core import LarchError, SQLiteError, LarchCacheError
+from ..core import LarchError, SQLiteError, LarchCacheError, OptimizationMethod
 from .. import DB, DT, Model
 from ..model import ModelFamily
 from ..roles import ParameterRef
@@ -734,6 +734,320 @@ class TestMNL(ELM_TestCase):
 		gc = m1.gradient_check(disp=False)
 		self.assertTrue( gc[0] < -6 )
 
+	def test_parallel_finite_diff(self):
+		m = Model.Example()
+		m.setUp()
+		m.option.threads = 4
+		m.option.parallel_finite_diff = False
+		g_serial = numpy.array(m.finite_diff_gradient())
+		m.option.parallel_finite_diff = True
+		g_parallel = numpy.array(m.finite_diff_gradient())
+		self.assertTrue( numpy.allclose(g_serial, g_parallel) )
+
+	def test_out_of_core_provisioning(self):
+		import tempfile, os
+		from ..core import save_darray_file
+		m = Model.Example()
+		m.setUp()
+		ll = m.loglike()
+		g = numpy.array(m.d_loglike())
+		prov = m.df.provision(m.needs())
+		with tempfile.TemporaryDirectory() as tempdir:
+			filename = os.path.join(tempdir, 'utilityca.larchdat')
+			save_darray_file(prov['UtilityCA'], filename)
+			prov['UtilityCA'] = filename
+			m.option.out_of_core_block_mb = 0.01
+			m.provision(prov)
+			m.tearDown()
+			m.setUp()
+			self.assertNearlyEqual(ll, m.loglike(), 12)
+			self.assertTrue( numpy.allclose(g, numpy.array(m.d_loglike())) )
+			m.unprovision()
+
+	def test_float32_provisioning(self):
+		m = Model.Example()
+		m.setUp()
+		ll = m.loglike()
+		g = numpy.array(m.d_loglike())
+		prov = m.df.provision(m.needs())
+		for key in ('UtilityCA', 'UtilityCO'):
+			prov[key] = numpy.asarray(prov[key], dtype=numpy.float32)
+		m.provision(prov)
+		m.tearDown()
+		m.setUp()
+		self.assertAlmostEqual(ll, m.loglike(), delta=abs(ll)*1e-5)
+		self.assertTrue( numpy.allclose(g, numpy.array(m.d_loglike()), rtol=1e-4, atol=1e-4) )
+		m.unprovision()
+
+	def test_float32_choice_refused(self):
+		# Only the utility data is widened from float32, as it is read in
+		#  blocks of cases; the choices are read one case at a time.
+		m = Model.Example()
+		m.setUp()
+		ll = m.loglike()
+		prov = m.df.provision(m.needs())
+		prov['Choice'] = numpy.asarray(prov['Choice'], dtype=numpy.float32)
+		with self.assertRaises(Exception):
+			m.provision(prov)
+		prov['Choice'] = numpy.asarray(prov['Choice'], dtype=numpy.float64)
+		m.provision(prov)
+		m.tearDown()
+		m.setUp()
+		self.assertNearlyEqual(ll, m.loglike(), 12)
+		m.unprovision()
+
+	def test_incremental_utility(self):
+		m = Model.Example()
+		m.setUp()
+		x = numpy.array(m.parameter_values())
+		x[3] = -0.01
+		m.reset_cache_statistics()
+		m.loglike(x, cached=False)
+		self.assertEqual(1, m.cache_statistics()['utility_rebuilds'])
+		x[5] = -0.02
+		ll_incremental = m.loglike(x, cached=False)
+		self.assertEqual(1, m.cache_statistics()['utility_updates'])
+		self.assertEqual(1, m.cache_statistics()['utility_rebuilds'])
+		m.option.incremental_utility = False
+		m.loglike(numpy.zeros_like(x), cached=False)
+		ll_full = m.loglike(x, cached=False)
+		self.assertEqual(1, m.cache_statistics()['utility_updates'])
+		self.assertNearlyEqual(ll_incremental, ll_full, 12)
+
+	def test_result_cache_budget(self):
+		m = Model.Example()
+		m.setUp()
+		m.reset_cache_statistics()
+		x = numpy.array(m.parameter_values())
+		m.loglike(x)
+		m.loglike(x)
+		st = m.cache_statistics()
+		self.assertEqual(1, st['loglike_hits'])
+		self.assertEqual(1, st['loglike_misses'])
+		m.option.cache_budget_mb = 0
+		for i in range(5):
+			x[0] = i*0.01
+			m.loglike(x)
+		st = m.cache_statistics()
+		self.assertEqual(1, st['entries'])
+		self.assertTrue(st['evictions'] >= 4)
+
+	def test_fused_loglike_blocks(self):
+		m = Model.Example()
+		m.setUp()
+		x = numpy.array(m.parameter_values())
+		x[3] = -0.01
+		x[5] = -0.02
+		m.option.fused_block_kb = 0
+		ll_unblocked = m.loglike(x, cached=False)
+		m.option.fused_block_kb = 1
+		self.assertNearlyEqual(ll_unblocked, m.loglike(x, cached=False), 12)
+
+	def test_fused_loglike_thread_independent(self):
+		m = Model.Example()
+		m.option.threads = 1
+		m.setUp()
+		x = numpy.array(m.parameter_values())
+		x[3] = -0.01
+		ll_one = m.loglike(x, cached=False)
+		m.option.threads = 5
+		# the jobs are summed in a fixed order, so the totals match exactly
+		self.assertEqual(ll_one, m.loglike(x, cached=False))
+
+	def test_loglike_only(self):
+		m = Model.Example()
+		m.setUp()
+		x = numpy.array(m.parameter_values())
+		x[3] = -0.01
+		x[5] = -0.02
+		ll = m.loglike(x, cached=False)
+		self.assertNearlyEqual(ll, m.loglike_casewise().sum(), 12)
+		g_casewise = m.d_loglike_casewise().sum(0)
+		g = m.d_loglike(x)
+		for g1, g2 in zip(g, g_casewise):
+			self.assertNearlyEqual(g1, g2, 8)
+
+	def test_minibatch_estimate(self):
+		m = Model.Example()
+		m.option.calc_std_errors = False
+		m.estimate([OptimizationMethod('M', 1e-6, batch=0.05, growth=3.0)])
+		self.assertAlmostEqual(-3626.1862548451313, m.loglike(cached=False), delta=.0001)
+
+	def test_trust_region_estimate(self):
+		m = Model.Example()
+		m.option.calc_std_errors = False
+		r = m.estimate([OptimizationMethod('T', 1e-6)])
+		self.assertAlmostEqual(-3626.1862548451313, m.loglike(cached=False), delta=.0001)
+		self.assertTrue(len(r.evaluations) > 0)
+		self.assertTrue(all(e >= 1 for e in r.evaluations))
+
+	def test_trust_region_estimate_holdfast(self):
+		m0 = Model.Example()
+		m0.option.calc_std_errors = False
+		m0.parameter('tottime', value=-0.05, holdfast=1)
+		m0.estimate()
+		m = Model.Example()
+		m.option.calc_std_errors = False
+		m.parameter('tottime', value=-0.05, holdfast=1)
+		m.estimate([OptimizationMethod('T', 1e-6)])
+		self.assertEqual(-0.05, m.parameter('tottime').value)
+		self.assertAlmostEqual(m0.loglike(cached=False), m.loglike(cached=False), delta=.0001)
+		for name in m.parameter_names():
+			self.assertAlmostEqual(m0.parameter(name).value, m.parameter(name).value, delta=.001)
+
+	def test_bad_step_retract_factor(self):
+		m = Model.Example()
+		m.option.calc_std_errors = False
+		with self.assertRaises(Exception):
+			m.estimate([OptimizationMethod('T', 1e-6, ret=1.0)])
+		with self.assertRaises(Exception):
+			m.estimate([OptimizationMethod('G', 1e-6, ret=2.0)])
+
+	def _assert_analytic_hessian(self, m):
+		# The hessian_matrix is of the negative log likelihood
+		m.calculate_parameter_covariance()
+		h = -numpy.array(m.hessian_matrix)
+		fd = numpy.array(m.finite_diff_hessian())
+		free = (numpy.asarray(m.parameter_holdfast_array)==0)
+		h = h[free,:][:,free]
+		fd = fd[free,:][:,free]
+		self.assertTrue( numpy.allclose(h, fd, rtol=1e-3, atol=1e-5*numpy.abs(fd).max()) )
+
+	def test_analytic_hessian_mnl(self):
+		m = Model.Example()
+		m.option.calc_std_errors = False
+		m.estimate()
+		self._assert_analytic_hessian(m)
+
+	def test_analytic_hessian_mnl_holdfast(self):
+		m = Model.Example()
+		m.option.calc_std_errors = False
+		m.parameter('tottime').holdfast = True
+		m.estimate()
+		self.assertTrue(m.parameter('tottime').holdfast)
+		self._assert_analytic_hessian(m)
+
+	def test_analytic_hessian_nl(self):
+		m = Model.Example(109)
+		m.option.calc_std_errors = False
+		m.estimate()
+		self.assertAlmostEqual(-5236.900, m.loglike(cached=False), delta=.001)
+		self._assert_analytic_hessian(m)
+
+	def test_analytic_hessian_nl_holdfast(self):
+		m = Model.Example(109)
+		m.option.calc_std_errors = False
+		m.parameter('existing', value=0.8, holdfast=1)
+		m.estimate()
+		self._assert_analytic_hessian(m)
+
+	def test_estimate_multistart(self):
+		m = Model.Example()
+		m.option.calc_std_errors = False
+		m.setUp()
+		starts = numpy.zeros([2, len(m.parameter_values())])
+		starts[1,:] = -0.01
+		runs = m.estimate_multistart(starts)
+		self.assertEqual(2, len(runs))
+		self.assertAlmostEqual(-3626.1862548451313, m.loglike(cached=False), delta=.0001)
+
+	def test_estimate_multistart_nested(self):
+		m1 = Model.Example(109)
+		m1.option.calc_std_errors = False
+		m1.estimate()
+		m2 = Model.Example(109)
+		m2.option.calc_std_errors = False
+		m2.option.threads = 4
+		m2.setUp()
+		starts = numpy.zeros([3, len(m2.parameter_values())])
+		starts[:,:] = m2.parameter_values()
+		# the logsum parameters start at one, the others are moved away from zero
+		starts[1,:] = numpy.where(starts[1,:]==0, -0.01, starts[1,:])
+		starts[2,:] = numpy.where(starts[2,:]==0, 0.01, starts[2,:])
+		runs = m2.estimate_multistart(starts)
+		self.assertEqual(3, len(runs))
+		self.assertAlmostEqual(m1.loglike(cached=False), m2.loglike(cached=False), delta=.001)
+		self.assertTrue( numpy.allclose(m1.parameter_values(), m2.parameter_values(), rtol=1e-2, atol=1e-3) )
+
+	def test_mixed_normal(self):
+		m = Model.Example()
+		m.setUp()
+		ll_mnl = m.loglike(cached=False)
+		m.option.mixed_draws = 50
+		m.mixed_normal('cost')
+		m.setUp()
+		self.assertEqual(1, m.mixed_dimensions())
+		# the scale is not started at zero, which is a saddle point
+		self.assertAlmostEqual(0.1, m['cost_sd'].value)
+		m['cost_sd'].value = 0
+		self.assertAlmostEqual(ll_mnl, m.loglike(cached=False), delta=1e-6)
+		# the draws are kept between evaluations, so the simulated log
+		#  likelihood is the same function of the parameters every time
+		m['cost_sd'].value = 0.005
+		ll_sim = m.loglike(cached=False)
+		self.assertNotAlmostEqual(ll_mnl, ll_sim, delta=1e-3)
+		self.assertEqual(ll_sim, m.loglike(cached=False))
+		# a correlated term reuses the draws of cost, adding no dimension
+		m.mixed_correlate('tottime', 'tottime_cost', 'cost')
+		m.setUp()
+		self.assertEqual(1, m.mixed_dimensions())
+		self.assertAlmostEqual(ll_sim, m.loglike(cached=False), delta=1e-8)
+		m['tottime_cost'].value = 0.01
+		self.assertNotAlmostEqual(ll_sim, m.loglike(cached=False), delta=1e-3)
+		# the derivatives of the scales are simulated with the same draws
+		g = numpy.array(m.negative_d_loglike_nocache())
+		fd = numpy.array(m.finite_diff_gradient())
+		names = m.parameter_names()
+		for scale in ('cost_sd', 'tottime_cost'):
+			i = names.index(scale)
+			self.assertAlmostEqual(-fd[i], g[i], delta=1e-3*max(1.0, abs(fd[i])))
+
+	def test_segmented(self):
+		m = Model.Example()
+		m.setUp()
+		m['tottime'].value = -0.05
+		ll_mnl = m.loglike(cached=False)
+		ll_mnl_casewise = numpy.array(m.loglike_casewise()).ravel()
+		m.segment_by('wkccbd', [0,1])
+		m.segment_parameter('tottime')
+		m.setUp()
+		self.assertEqual((0,1), tuple(m.segment_codes()))
+		self.assertTrue(m['tottime'].holdfast)
+		self.assertAlmostEqual(-0.05, m['tottime@0'].value)
+		self.assertAlmostEqual(-0.05, m['tottime@1'].value)
+		self.assertAlmostEqual(ll_mnl, m.loglike(cached=False), delta=1e-6)
+		# moving the parameter of one segment changes only the cases in it
+		m['tottime@1'].value = -0.02
+		ll_casewise = numpy.array(m.loglike_casewise()).ravel()
+		seg1 = (m.df.array_idco('wkccbd')[0][:,0]==1)
+		self.assertTrue(seg1.any() and not seg1.all())
+		self.assertTrue( numpy.allclose(ll_casewise[~seg1], ll_mnl_casewise[~seg1], rtol=0, atol=1e-10) )
+		self.assertFalse( numpy.allclose(ll_casewise[seg1], ll_mnl_casewise[seg1], rtol=0, atol=1e-6) )
+		g = numpy.array(m.negative_d_loglike_nocache())
+		fd = numpy.array(m.finite_diff_gradient())
+		self.assertTrue( numpy.allclose(g, -fd, rtol=1e-3, atol=1e-2) )
+		# the segments are interleaved in the data, so jobs over the segment
+		#  sorted cases give the same results however the cases are split
+		ll_one = m.loglike(cached=False)
+		m.option.threads = 4
+		m.setUp()
+		self.assertAlmostEqual(ll_one, m.loglike(cached=False), delta=1e-8)
+		self.assertTrue( numpy.allclose(g, numpy.array(m.negative_d_loglike_nocache()), rtol=1e-10, atol=1e-10) )
+
+	def test_estimate_in_threads(self):
+		import threading
+		models = [Model.Example(), Model.Example()]
+		for m in models:
+			m.option.calc_std_errors = False
+			m.setUp()
+		threads = [threading.Thread(target=m.estimate) for m in models]
+		for t in threads:
+			t.start()
+		for t in threads:
+			t.join()
+		for m in models:
+			self.assertAlmostEqual(-3626.1862548451313, m.loglike(cached=False), delta=.0001)
+
 	def test_gradient_holdfast_switching(self):
 		m = Model.Example()
 		m.parameter('ASC_SR2').holdfast = True
@@ -758,6 +758,38 @@ class TestNL(ELM_TestCase):
 			self.assertNearlyEqual(z1,z2)
 
 
+	def test_utility_ce_builtin_gradient(self):
+		# The builtin idce data is read through the compressed row map of the
+		#  darray_export_map, in the utility and in the gradient.
+		d = DB.Example('MTC')
+		m = Model(d)
+		m.utility.ca("tottime")
+		m.utility.ca("totcost")
+		m.utility.ca("tottime*totcost", "timecost")
+		m.option.idca_avail_ratio_floor = 0.0
+		m.maximize_loglike()
+		m2 = Model(d)
+		m2.utility.ca("tottime")
+		m2.utility.ca("totcost")
+		m2.utility.ca("tottime*totcost", "timecost")
+		m2.option.idca_avail_ratio_floor = 1.0
+		m2.maximize_loglike()
+		self.assertTrue(m2.Data("UtilityCA") is None)
+		self.assertTrue(m2.Data_UtilityCE_builtin.active())
+		for x in ([-0.05, -0.003, 0.0001], [0.02, 0.01, -0.0002]):
+			x = numpy.asarray(x)
+			self.assertNearlyEqual(m.loglike(x, cached=False), m2.loglike(x, cached=False), sigfigs=10)
+			g = numpy.asarray(m2.d_loglike(x))
+			fd = numpy.zeros_like(g)
+			for i in range(len(x)):
+				h = 1e-4 * abs(x[i])
+				xp = x.copy(); xp[i] += h
+				xm = x.copy(); xm[i] -= h
+				fd[i] = (m2.loglike(xp, cached=False) - m2.loglike(xm, cached=False)) / (2*h)
+			for z1,z2 in zip(g, fd):
+				self.assertNearlyEqual(z1,z2, sigfigs=4)
+
+
 	def test_nnnl(self):
 		from ..nnnl import NNNL
 		d = DT.Example()
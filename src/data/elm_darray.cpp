@@ -21,6 +21,7 @@
 #include <iostream>
 
 #include <cstring>
+#include <algorithm>
 #include "etk.h"
 #include "etk_refcount.h"
 //#include "elm_sql_facet.h"
@@ -76,6 +77,8 @@ std::string elm::darray_req::__str__() const
 	
 	if (dtype==NPY_DOUBLE) {
 		s << " dtype=double";
+	} else if (dtype==NPY_FLOAT) {
+		s << " dtype=float32";
 	} else if (dtype==NPY_INT64) {
 		s << " dtype=int64";
 	} else if (dtype==NPY_BOOL) {
@@ -115,6 +118,8 @@ std::string elm::darray_req::__repr__() const
 	
 	if (dtype==NPY_DOUBLE) {
 		s << " dtype=double";
+	} else if (dtype==NPY_FLOAT) {
+		s << " dtype=float32";
 	} else if (dtype==NPY_INT64) {
 		s << " dtype=int64";
 	} else if (dtype==NPY_BOOL) {
@@ -142,6 +147,7 @@ elm::darray_req::darray_req(int dim, int tp, int nalts)
 , variables      ()
 , n_alts         (nalts)
 , contig         (true)
+, widen_float    (false)
 {
 }
 
@@ -151,6 +157,7 @@ elm::darray_req::darray_req(const elm::darray_req& x)
 , variables      (x.variables)
 , n_alts         (x.n_alts)
 , contig         (x.contig)
+, widen_float    (x.widen_float)
 {
 }
 
@@ -160,6 +167,7 @@ elm::darray_req::darray_req()
 , variables      ()
 , n_alts         (0)
 , contig         (true)
+, widen_float    (false)
 {
 }
 
@@ -171,7 +179,10 @@ elm::darray_req::~darray_req()
 int elm::darray_req::satisfied_by(const elm::darray* x) const
 {
 	if (x->dimty != dimty) return -1;
-	if (x->dtype != dtype) return -2;
+	if (x->dtype != dtype) {
+		// single precision data is widened as it is read, where this is allowed
+		if (!(widen_float && dtype==NPY_DOUBLE && x->dtype==NPY_FLOAT)) return -2;
+	}
 	if ((x->get_variables().size()>0) && (variables.size()>0) && (x->get_variables() != variables)) return -3;
 	if (!contig) return 0;
 	if (contig && x->contig) return 0;
@@ -201,6 +212,7 @@ size_t elm::darray_req::nAlts() const
 
 size_t elm::darray::nCases() const
 {
+	if (_window_total) return _window_total;
 	return _repository.size1();
 }
 
@@ -208,18 +220,24 @@ size_t elm::darray::nCases() const
 elm::darray::darray()
 : elm::darray_req()
 , _repository()
+, _window_first(0)
+, _window_total(0)
 {
 }
 
 elm::darray::darray(const elm::darray& source_arr)
 : elm::darray_req()
 , _repository(source_arr._repository, true)
+, _window_first(0)
+, _window_total(0)
 {
 }
 
 elm::darray::darray(const elm::darray& source_arr, double scale)
 : elm::darray_req()
 , _repository(source_arr._repository.size1(),source_arr._repository.size2(),source_arr._repository.size3())
+, _window_first(0)
+, _window_total(0)
 {
 	cblas_daxpy(_repository.size(), scale, source_arr._repository.ptr(), 1, _repository.ptr(), 1);
 }
@@ -227,6 +245,8 @@ elm::darray::darray(const elm::darray& source_arr, double scale)
 elm::darray::darray(PyObject* source_arr)
 : elm::darray_req()
 , _repository(source_arr)
+, _window_first(0)
+, _window_total(0)
 {
 	if (!PyArray_Check(source_arr)) {
 		OOPS("input must be an array");
@@ -276,18 +296,24 @@ elm::darray::darray(PyObject* source_arr)
 elm::darray::darray(int dtype, int ncases, int nalts, int nvars)
 : elm::darray_req(3,dtype,nalts)
 , _repository("Array",dtype,ncases,nalts,nvars)
+, _window_first(0)
+, _window_total(0)
 {
 }
 
 elm::darray::darray(int dtype, int ncases, int nvars)
 : elm::darray_req(2,dtype)
 , _repository("Array",dtype,ncases,nvars)
+, _window_first(0)
+, _window_total(0)
 {
 }
 
 elm::darray::darray(int dtype, int ncases)
 : elm::darray_req(1,dtype)
 , _repository("Array",dtype,ncases)
+, _window_first(0)
+, _window_total(0)
 {
 }
 
@@ -302,34 +328,65 @@ elm::darray::~darray()
 
 
 
+const float* elm::darray::floatvalues(const unsigned& firstcasenum) const
+{
+	if (dtype!=NPY_FLOAT) OOPS("floatvalues requires a float32 array, this is ",__str__());
+	size_t row = _repository.size() / std::max<size_t>(_repository.size1(),1);
+	return ((const float*)PyArray_DATA(_repository.pool)) + (firstcasenum-_window_first)*row;
+}
+
+const double* elm::darray::_widen(const unsigned& firstcasenum, const size_t& numberofcases) const
+{
+	size_t row = _repository.size() / std::max<size_t>(_repository.size1(),1);
+	size_t first = firstcasenum-_window_first;
+	size_t n = numberofcases ? numberofcases : _repository.size1()-first;
+	// Scratch space for reading as double, one buffer for each thread that
+	//  reads this array, released with the array.
+	std::vector<double>* buffer;
+	{
+		std::lock_guard<std::mutex> lock(_widened_lock);
+		buffer = &_widened[std::this_thread::get_id()];
+	}
+	if (buffer->size() < n*row) buffer->resize(n*row);
+	const float* src = floatvalues(firstcasenum);
+	double* dst = buffer->data();
+	for (size_t i=0; i<n*row; i++) {
+		dst[i] = src[i];
+	}
+	return dst;
+}
+
 etk::ptr_lockout<const double> elm::darray::values(const unsigned& firstcasenum, const size_t& numberofcases)
 {
-	return ptr_lockout<const double>(_repository.ptr(firstcasenum), _repo_lock);
+	if (dtype==NPY_FLOAT) return ptr_lockout<const double>(_widen(firstcasenum,numberofcases), _repo_lock);
+	return ptr_lockout<const double>(_repository.ptr(firstcasenum-_window_first), _repo_lock);
 }
 
 etk::ptr_lockout<const bool> elm::darray::boolvalues(const unsigned& firstcasenum, const size_t& numberofcases)
 {
-	return ptr_lockout<const bool>(_repository.ptr_bool(firstcasenum), _repo_lock);
+	return ptr_lockout<const bool>(_repository.ptr_bool(firstcasenum-_window_first), _repo_lock);
 }
 
 etk::ptr_lockout<const double> elm::darray::values(const unsigned& firstcasenum, const size_t& numberofcases) const
 {
-	return ptr_lockout<const double>(_repository.ptr(firstcasenum), const_cast<elm::darray*>(this)->_repo_lock);
+	if (dtype==NPY_FLOAT) return ptr_lockout<const double>(_widen(firstcasenum,numberofcases), const_cast<elm::darray*>(this)->_repo_lock);
+	return ptr_lockout<const double>(_repository.ptr(firstcasenum-_window_first), const_cast<elm::darray*>(this)->_repo_lock);
 }
 
 etk::ptr_lockout<const bool> elm::darray::boolvalues(const unsigned& firstcasenum, const size_t& numberofcases) const
 {
-	return ptr_lockout<const bool>(_repository.ptr_bool(firstcasenum), const_cast<elm::darray*>(this)->_repo_lock);
+	return ptr_lockout<const bool>(_repository.ptr_bool(firstcasenum-_window_first), const_cast<elm::darray*>(this)->_repo_lock);
 }
 
 const double* elm::darray::values_constptr(const unsigned& firstcasenum) const
 {
-	return _repository.ptr(firstcasenum);
+	if (dtype==NPY_FLOAT) return _widen(firstcasenum,0);
+	return _repository.ptr(firstcasenum-_window_first);
 }
 
 const bool* elm::darray::boolvalues_constptr(const unsigned& firstcasenum) const
 {
-	return _repository.ptr_bool(firstcasenum);
+	return _repository.ptr_bool(firstcasenum-_window_first);
 }
 
 
@@ -353,41 +410,55 @@ bool elm::darray::boolvalue(const unsigned& c, const unsigned& v) const
 }
 
 
+// For float32 arrays the const accessors return the widened value in a per
+//  thread temporary, which is only good until the next such call.
+static thread_local double _widened_value;
+
 const double& elm::darray::value_double    (const size_t& c, const size_t& a, const size_t& v) const 
 {
-	return *_repository.ptr(c,a,v);
+	if (dtype==NPY_FLOAT) {
+		_widened_value = floatvalues(c)[a*nVars()+v];
+		return _widened_value;
+	}
+	return *_repository.ptr(c-_window_first,a,v);
 }
 const double& elm::darray::value_double    (const size_t& c, const size_t& v) const
 {
-	return *_repository.ptr(c,v);
+	if (dtype==NPY_FLOAT) {
+		_widened_value = floatvalues(c)[v];
+		return _widened_value;
+	}
+	return *_repository.ptr(c-_window_first,v);
 }
 
 
 
 double& elm::darray::value_double    (const size_t& c, const size_t& a, const size_t& v)
 {
-	return *_repository.ptr(c,a,v);
+	if (dtype==NPY_FLOAT) OOPS("cannot write double values into a float32 array");
+	return *_repository.ptr(c-_window_first,a,v);
 }
 double& elm::darray::value_double    (const size_t& c, const size_t& v)
 {
-	return *_repository.ptr(c,v);
+	if (dtype==NPY_FLOAT) OOPS("cannot write double values into a float32 array");
+	return *_repository.ptr(c-_window_first,v);
 }
 long long& elm::darray::value_int64    (const size_t& c, const size_t& a, const size_t& v)
 {
-	return *(long long*)_repository.voidptr(c,a,v);
+	return *(long long*)_repository.voidptr(c-_window_first,a,v);
 }
 long long& elm::darray::value_int64    (const size_t& c, const size_t& v)
 {
-	return *(long long*)_repository.voidptr(c,v);
+	return *(long long*)_repository.voidptr(c-_window_first,v);
 }
 
 bool& elm::darray::value_bool    (const size_t& c, const size_t& a, const size_t& v)
 {
-	return *(bool*)_repository.voidptr(c,a,v);
+	return *(bool*)_repository.voidptr(c-_window_first,a,v);
 }
 bool& elm::darray::value_bool    (const size_t& c, const size_t& v)
 {
-	return *(bool*)_repository.voidptr(c,v);
+	return *(bool*)_repository.voidptr(c-_window_first,v);
 }
 
 
@@ -398,7 +469,7 @@ std::string elm::darray::printcase(const unsigned& r) const
 	unsigned x2, x3;
 	char depMarker, colMarker, rowMarker;
 	ret << "["<< nVars() <<" vars, "<<dimty<<" dims]";
-	if (dimty==2 && dtype==NPY_DOUBLE) {
+	if (dimty==2 && (dtype==NPY_DOUBLE || dtype==NPY_FLOAT)) {
 		depMarker = ' ';
 		colMarker = '\t';
 		rowMarker = '\n';
@@ -406,7 +477,7 @@ std::string elm::darray::printcase(const unsigned& r) const
 			ret << value(r,x2) << colMarker;
 		}
 		ret << rowMarker;
-	} else if (dimty==3 && dtype==NPY_DOUBLE) {
+	} else if (dimty==3 && (dtype==NPY_DOUBLE || dtype==NPY_FLOAT)) {
 		depMarker = '\t';
 		colMarker = '\n';
 		rowMarker = '\n';
@@ -530,6 +601,8 @@ std::string elm::darray::__str__() const
 	
 	if (dtype==NPY_DOUBLE) {
 		s << " dtype=double";
+	} else if (dtype==NPY_FLOAT) {
+		s << " dtype=float32";
 	} else if (dtype==NPY_INT64) {
 		s << " dtype=int64";
 	} else if (dtype==NPY_BOOL) {
@@ -569,6 +642,8 @@ std::string elm::darray::__repr__() const
 	
 	if (dtype==NPY_DOUBLE) {
 		s << " dtype=double";
+	} else if (dtype==NPY_FLOAT) {
+		s << " dtype=float32";
 	} else if (dtype==NPY_INT64) {
 		s << " dtype=int64";
 	} else if (dtype==NPY_BOOL) {
@@ -605,6 +680,8 @@ std::string elm::check_darray(const darray* x)
 	
 	if (x->dtype==NPY_DOUBLE) {
 		s << " dtype=double";
+	} else if (x->dtype==NPY_FLOAT) {
+		s << " dtype=float32";
 	} else if (x->dtype==NPY_INT64) {
 		s << " dtype=int64";
 	} else if (x->dtype==NPY_BOOL) {
@@ -644,10 +721,12 @@ std::string elm::check_darray(const darray* x)
 
 
 elm::darray_export_map::darray_export_map(etk::ndarray* caseindexes, etk::ndarray* altindexes, etk::ndarray* data_array, const size_t& n_cases, const size_t& n_alts)
-: _pointer_map()
-, _data_array(nullptr)
+: _data_array(nullptr)
 , _caseindexes(nullptr)
 , _altindexes(nullptr)
+, _row_starts()
+, _row_alts()
+, _alts_sorted(true)
 , n_cases(n_cases)
 , n_alts(n_alts)
 {
@@ -672,29 +751,44 @@ void elm::darray_export_map::maplink(etk::ndarray* caseindexes, etk::ndarray* al
 		_caseindexes = std::make_shared<etk::ndarray>(*caseindexes, true);
 		_altindexes = std::make_shared<etk::ndarray>(*altindexes, true);
 		
-		_casestarts = std::make_shared<etk::ndarray>("Array", NPY_INT64, n_cases);
-		_casestarts->int64_initialize(-1);
-		
-		size_t caseindexticker = 0;
-		_casestarts->int64_at(caseindexticker) = 0;
+		size_t nrows = _data_array->size1();
+		_row_starts.assign(n_cases+1, 0);
+		_row_alts.resize(nrows);
 		
-		for (size_t rowticker=0; rowticker<data_array->size1(); rowticker++) {
-			_pointer_map[two_int64(caseindexes->int64_at(rowticker),altindexes->int64_at(rowticker))] = _data_array->ptr(rowticker);
-			
-			while (caseindexticker<caseindexes->int64_at(rowticker)) {
-				caseindexticker++;
-				_casestarts->int64_at(caseindexticker) = rowticker;
+		long long previous_case = -1;
+		for (size_t rowticker=0; rowticker<nrows; rowticker++) {
+			long long caseindex = _caseindexes->int64_at(rowticker);
+			long long altindex = _altindexes->int64_at(rowticker);
+			if (caseindex<0 || caseindex>=static_cast<long long>(n_cases)) {
+				OOPS("idce data row ",rowticker," has case index ",caseindex,", but there are ",n_cases," cases");
 			}
+			if (altindex<0 || altindex>=static_cast<long long>(n_alts)) {
+				OOPS("idce data row ",rowticker," has alt index ",altindex,", but there are ",n_alts," alternatives");
+			}
+			if (caseindex<previous_case) {
+				OOPS("idce data must be sorted by case, but row ",rowticker," is for case ",caseindex," after case ",previous_case);
+			}
+			if (caseindex==previous_case && altindex<=static_cast<long long>(_row_alts[rowticker-1])) {
+				_alts_sorted = false;
+			}
+			_row_starts[caseindex+1]++;
+			_row_alts[rowticker] = altindex;
+			previous_case = caseindex;
+		}
+		for (size_t c=0; c<n_cases; c++) {
+			_row_starts[c+1] += _row_starts[c];
 		}
 	}
 }
 
 void elm::darray_export_map::clear()
 {
-	_pointer_map.clear();
 	_data_array .reset();
 	_caseindexes .reset();
 	_altindexes .reset();
+	_row_starts.clear();
+	_row_alts.clear();
+	_alts_sorted = true;
 	n_cases=0;
 	n_alts=0;
 }
@@ -702,11 +796,17 @@ void elm::darray_export_map::clear()
 
 const double* elm::darray_export_map::get_ptr_at(const long long& caseindex, const long long& altindex) const
 {
-	auto iter = _pointer_map.find(two_int64(caseindex,altindex));
-	if (iter==_pointer_map.end()) {
+	if (!_data_array || caseindex<0 || caseindex>=static_cast<long long>(n_cases) || altindex<0) {
 		return nullptr;
 	}
-	return iter->second;
+	auto first = _row_alts.begin()+_row_starts[caseindex];
+	auto last  = _row_alts.begin()+_row_starts[caseindex+1];
+	auto iter  = _alts_sorted ? std::lower_bound(first, last, size_t(altindex))
+	                          : std::find(first, last, size_t(altindex));
+	if (iter==last || *iter!=size_t(altindex)) {
+		return nullptr;
+	}
+	return _data_array->ptr(iter-_row_alts.begin());
 }
 
 
@@ -719,6 +819,41 @@ void elm::darray_export_map::export_into (double* ExportTo, const unsigned& c, c
 }
 
 
+void elm::darray_export_map::utility_rows(const size_t& firstcase, const size_t& numberofcases, const double* coef, etk::ndarray* Outcome, const size_t& outcome_offset) const
+{
+	size_t firstrow = _row_starts[firstcase];
+	size_t endrow = _row_starts[firstcase+numberofcases];
+	if (endrow<=firstrow) return;
+	
+	static thread_local std::vector<double> rowutility;
+	rowutility.resize(endrow-firstrow);
+	cblas_dgemv(CblasRowMajor, CblasNoTrans, endrow-firstrow, nvars(), 1, _data_array->ptr(firstrow), nvars(),
+				coef, 1, 0, &rowutility[0], 1);
+	
+	for (size_t c=firstcase; c<firstcase+numberofcases; c++) {
+		for (size_t row=_row_starts[c]; row<_row_starts[c+1]; row++) {
+			*(Outcome->ptr(c-outcome_offset, _row_alts[row])) = rowutility[row-firstrow];
+		}
+	}
+}
+
+
+void elm::darray_export_map::gradient_rows(const size_t& c, const double* weight, const double& alpha, double* grad) const
+{
+	size_t firstrow = _row_starts[c];
+	size_t endrow = _row_starts[c+1];
+	if (endrow<=firstrow) return;
+	
+	static thread_local std::vector<double> rowweight;
+	rowweight.resize(endrow-firstrow);
+	for (size_t row=firstrow; row<endrow; row++) {
+		rowweight[row-firstrow] = weight[_row_alts[row]];
+	}
+	cblas_dgemv(CblasRowMajor, CblasTrans, endrow-firstrow, nvars(), alpha, _data_array->ptr(firstrow), nvars(),
+				&rowweight[0], 1, 1, grad, 1);
+}
+
+
 
 double elm::darray_export_map::get_value_at(const long long& caseindex, const long long& altindex, const long long& varindex) const
 {
@@ -40,7 +40,12 @@
 #endif // SWIG
 
 #ifndef SWIG
+#include <thread>
+#include <mutex>
+#include <exception>
+#include <fstream>
 #include "etk.h"
+#include "etk_workshop.h"
 #endif // ndef SWIG
 
 #ifdef SWIG
@@ -65,6 +70,10 @@ namespace elm {
 		int       dimty;
 		int	      n_alts;
 		bool      contig;
+		bool      widen_float;
+		// When set, a float32 array satisfies a double requirement, and is
+		//  widened as it is read. Only data read in blocks of cases, as the
+		//  utility data is, should set this.
 		
 	protected:
 		etk::strvec variables;
@@ -149,6 +158,7 @@ namespace elm {
 		etk::ptr_lockout<const bool> boolvalues(const unsigned& firstcasenum=0, const size_t& numberofcases=0);
 		etk::ptr_lockout<const bool> boolvalues(const unsigned& firstcasenum=0, const size_t& numberofcases=0) const;
 		const bool* boolvalues_constptr(const unsigned& firstcasenum=0) const;
+		const float* floatvalues(const unsigned& firstcasenum=0) const;
 		// Returns a pointer to memory where the entire block of data is stored
 		//  in contiguous memory. The data is in (case,alt,var) three dimensional
 		//  matrix in row major format. This memory space should remain constant
@@ -159,6 +169,13 @@ namespace elm {
 		//   [nCases * nAlts * nVars] or [numberofcases * nAlts * nVars].
 		//  For idco data, the total size of this array should be 
 		//   [nCases * nVars] or [numberofcases * nVars].
+		//  A float32 array can be read either directly with floatvalues, or as
+		//  double with values, which widens the requested cases into a scratch
+		//  buffer held for this array on the calling thread. That pointer
+		//  remains valid until values is next called for this array on the
+		//  same thread. Each call widens all the cases asked for, so float32
+		//  is only accepted where the cases are read in blocks (see
+		//  darray_req::widen_float).
 			
 		std::string printcase(const unsigned& r) const;
 		std::string printcases(unsigned rstart, const unsigned& rfinish) const;
@@ -174,6 +191,18 @@ namespace elm {
 	public:
 		etk::readlock _repo_lock;
 
+	protected:
+		size_t _window_first;
+		size_t _window_total;
+		// When the repository holds only a window of the cases (see darray_stream),
+		//  the number of the case in its first row, and the total number of cases.
+		//  Otherwise these are both zero.
+
+	private:
+		mutable std::map<std::thread::id, std::vector<double> > _widened;
+		mutable std::mutex _widened_lock;
+		const double* _widen(const unsigned& firstcasenum, const size_t& numberofcases) const;
+
 
 		
 	public:
@@ -203,12 +232,62 @@ namespace elm {
 		
 		PyObject* get_array();
 		
+		//// MARK: Binary Files ////////////////////////////////////////////////////
+		
+		void save_file(const std::string& filename) const;
+		// Write this array to a binary darray file, see save_darray_file.
+		
+		static boosted::shared_ptr<darray> map_file(const std::string& filename);
+		// Attach to a binary darray file by memory mapping it. The file is not
+		//  parsed or copied; pages are read as they are used, and are shared
+		//  with other processes mapping the same file. Writes to the array
+		//  are private to this process and are never written back.
+		
+		std::string source_file;
+		// The binary darray file this array was mapped from, if any.
+		
 		virtual std::string __str__() const;
 		virtual std::string __repr__() const;
 	};
 
 
 
+
+	class darray_stream:
+	public darray,
+	public etk::case_stream
+	{
+		std::string _filename;
+		std::ifstream _file;
+		size_t _data_offset;
+		size_t _case_bytes;
+		size_t _block_cases;
+		size_t _window_length;
+
+		etk::ndarray _fetching;
+		size_t _fetching_first;
+		size_t _fetching_length;
+		std::thread _fetcher;
+		std::exception_ptr _fetch_error;
+
+		void _read(etk::ndarray& into, size_t first, size_t length);
+		void _start_fetch(size_t first, size_t length);
+		void _finish_fetch();
+
+	public:
+		darray_stream(const std::string& filename, size_t block_bytes);
+		// Read a binary darray file in blocks of cases, holding no more than
+		//  two blocks of about block_bytes each in memory at a time.
+		virtual ~darray_stream();
+
+		virtual size_t block_cases() const;
+		virtual void load_block(size_t first, size_t length, size_t next_first, size_t next_length);
+		// Only the cases in the current block can be read. The next block is
+		//  read from disk on a background thread into a second buffer, and
+		//  the buffers are swapped when it is loaded.
+
+		const std::string& filename() const { return _filename; }
+	};
 	
 	typedef boosted::shared_ptr<const elm::darray> darray_ptr;
 
@@ -220,16 +299,18 @@ namespace elm {
 	class darray_export_map
 	{
 	
-		friend class ca_co_packet;
-		friend class workshop_mnl_gradient2;
-	
 	protected:
-		std::map< two_int64, double* > _pointer_map;
 		std::shared_ptr<etk::ndarray> _data_array;
 		std::shared_ptr<etk::ndarray> _caseindexes;
 		std::shared_ptr<etk::ndarray> _altindexes;
 		
-		std::shared_ptr<etk::ndarray> _casestarts;
+		std::vector<size_t> _row_starts;
+		std::vector<size_t> _row_alts;
+		bool _alts_sorted;
+		// The rows are held in compressed sparse row form: the rows for case c
+		//  are _row_starts[c] up to _row_starts[c+1], and the alternative of
+		//  each row is _row_alts[row]. When the alternatives within every case
+		//  are in ascending order they can be found by bisection.
 		
 		size_t n_cases;
 		size_t n_alts;
@@ -244,6 +325,17 @@ namespace elm {
 		const double* get_ptr_at(const long long& caseindex, const long long& altindex) const;
 		void export_into (double* ExportTo, const unsigned& c, const unsigned& a, const unsigned& numberOfVars) const;
 		double get_value_at(const long long& caseindex, const long long& altindex, const long long& varindex) const;
+
+		void utility_rows(const size_t& firstcase, const size_t& numberofcases, const double* coef, etk::ndarray* Outcome, const size_t& outcome_offset=0) const;
+		// Compute the utility of every row for a block of cases with a single
+		//  matrix-vector product, and write each into Outcome(case-outcome_offset,alt).
+		//  Elements of Outcome with no row are not changed.
+		
+		void gradient_rows(const size_t& c, const double* weight, const double& alpha, double* grad) const;
+		// Add to grad alpha times the sum over the rows of case c of each row
+		//  multiplied by weight[alt], using a single matrix-vector product.
+		
+		inline size_t case_rows(const size_t& c) const {return _row_starts[c+1]-_row_starts[c];}
 		inline bool active() const {return bool(_data_array);}
 		inline size_t nvars() const {return _data_array->size2();}
 		inline size_t nrows() const {return _data_array->size1();}
@@ -258,6 +350,15 @@ namespace elm {
 	std::string check_darray(const elm::darray* x);
 
 
+	// A binary darray file holds one array in a form that can be used without
+	//  parsing: a fixed header with the dtype and shape, the variable names,
+	//  and then the data in row major (case,alt,var) order at a page aligned
+	//  offset. Any of these arrays can be given to Model2::provision by file
+	//  name in place of the array itself.
+	void save_darray_file(PyObject* source_arr, const std::string& filename);
+	PyObject* map_darray_file(const std::string& filename);
+
+
 
 	
 } // end namespace elm
@@ -0,0 +1,493 @@
+/*
+ *  elm_darray_file.cpp
+ *
+ *  Copyright 2007-2017 Jeffrey Newman
+ *
+ *  Larch is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Larch is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with Larch.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <iostream>
+#include <fstream>
+#include <cstring>
+#include <cstdint>
+
+#if defined(_WIN32)
+# include <windows.h>
+#else
+# include <sys/mman.h>
+# include <sys/stat.h>
+# include <fcntl.h>
+# include <unistd.h>
+#endif
+
+#include "etk.h"
+#include "elm_darray.h"
+
+using namespace std;
+using namespace etk;
+
+
+
+#define DARRAY_FILE_MAGIC     "LARCHDAT"
+#define DARRAY_FILE_BYTEORDER 0x01020304
+#define DARRAY_FILE_VERSION   1
+
+// The data begins on a multiple of this, which is a whole number of pages on
+//  every platform we build for (and the mapping granularity on Windows).
+#define DARRAY_FILE_ALIGNMENT 65536
+
+namespace {
+
+	// Element types are recorded with our own codes, because numpy type
+	//  numbers for the integer types differ between platforms.
+	enum darray_file_dtype {
+		darray_file_float64 = 1,
+		darray_file_int64   = 2,
+		darray_file_bool    = 3,
+		darray_file_int8    = 4,
+		darray_file_float32 = 5,
+	};
+
+	struct darray_file_header {
+		char     magic[8];
+		uint32_t byteorder;
+		uint32_t version;
+		uint32_t dtype;
+		uint32_t ndim;
+		uint64_t shape[3];
+		uint64_t names_size;   // bytes of nul-terminated variable names following the header
+		uint64_t data_offset;  // from the start of the file
+		uint64_t data_size;
+	};
+
+	uint32_t _file_dtype(const int& npy_type)
+	{
+		switch (npy_type) {
+			case NPY_DOUBLE: return darray_file_float64;
+			case NPY_INT64:  return darray_file_int64;
+			case NPY_BOOL:   return darray_file_bool;
+			case NPY_INT8:   return darray_file_int8;
+			case NPY_FLOAT:  return darray_file_float32;
+		}
+		OOPS("darray files can hold DOUBLE, FLOAT, INT64, BOOL or INT8 arrays only");
+		return 0;
+	}
+
+	int _npy_dtype(const uint32_t& file_type)
+	{
+		switch (file_type) {
+			case darray_file_float64: return NPY_DOUBLE;
+			case darray_file_int64:   return NPY_INT64;
+			case darray_file_bool:    return NPY_BOOL;
+			case darray_file_int8:    return NPY_INT8;
+			case darray_file_float32: return NPY_FLOAT;
+		}
+		OOPS("unknown dtype code ",file_type," in darray file");
+		return 0;
+	}
+
+	size_t _itemsize(const uint32_t& file_type)
+	{
+		switch (file_type) {
+			case darray_file_float64: return 8;
+			case darray_file_int64:   return 8;
+			case darray_file_bool:    return 1;
+			case darray_file_int8:    return 1;
+			case darray_file_float32: return 4;
+		}
+		return 0;
+	}
+
+
+
+	// Check the header at the start of a file of file_size bytes, and copy it into h.
+	void _check_header(const void* start, const size_t& file_size, const std::string& filename, darray_file_header& h)
+	{
+		if (file_size < sizeof(darray_file_header)) {
+			OOPS(filename," is not a darray file");
+		}
+		memcpy(&h, start, sizeof(h));
+		if (memcmp(h.magic, DARRAY_FILE_MAGIC, 8)!=0) {
+			OOPS(filename," is not a darray file");
+		}
+		if (h.byteorder!=DARRAY_FILE_BYTEORDER) {
+			OOPS("darray file ",filename," was written with a different byte order");
+		}
+		if (h.version!=DARRAY_FILE_VERSION) {
+			OOPS("darray file ",filename," has unsupported version ",h.version);
+		}
+		if (h.ndim<1 || h.ndim>3) {
+			OOPS("darray file ",filename," has ",h.ndim," dimensions");
+		}
+		size_t itemsize = _itemsize(h.dtype);
+		if (!itemsize) {
+			OOPS("unknown dtype code ",h.dtype," in darray file ",filename);
+		}
+		if (h.data_size != h.shape[0]*h.shape[1]*h.shape[2]*itemsize
+			|| h.data_offset < sizeof(h)+h.names_size
+			|| h.data_offset + h.data_size > file_size) {
+			OOPS("darray file ",filename," is truncated or damaged");
+		}
+	}
+
+	std::vector<std::string> _read_names(const char* n, const size_t& names_size)
+	{
+		std::vector<std::string> names;
+		const char* n_end = n + names_size;
+		while (n < n_end) {
+			size_t len = strnlen(n, n_end-n);
+			names.push_back(std::string(n, len));
+			n += len+1;
+		}
+		return names;
+	}
+
+
+
+	// A mapped file, owned by the array that uses it through a capsule.
+	struct darray_file_mapping {
+		void*  base;
+		size_t size;
+		#if defined(_WIN32)
+		HANDLE file;
+		HANDLE mapping;
+		#endif
+	};
+
+	void _unmap(darray_file_mapping* m)
+	{
+		if (!m) return;
+		#if defined(_WIN32)
+		if (m->base) UnmapViewOfFile(m->base);
+		if (m->mapping) CloseHandle(m->mapping);
+		if (m->file!=INVALID_HANDLE_VALUE) CloseHandle(m->file);
+		#else
+		if (m->base) munmap(m->base, m->size);
+		#endif
+		delete m;
+	}
+
+	void _release_mapping_capsule(PyObject* capsule)
+	{
+		_unmap(static_cast<darray_file_mapping*>(PyCapsule_GetPointer(capsule, "larch.darray_file")));
+	}
+
+	darray_file_mapping* _map(const std::string& filename)
+	{
+		darray_file_mapping* m = new darray_file_mapping;
+		m->base = nullptr;
+		m->size = 0;
+
+		#if defined(_WIN32)
+		m->file = CreateFileA(filename.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+		m->mapping = nullptr;
+		if (m->file==INVALID_HANDLE_VALUE) {
+			_unmap(m);
+			OOPS("cannot open darray file ",filename);
+		}
+		LARGE_INTEGER filesize;
+		if (!GetFileSizeEx(m->file, &filesize)) {
+			_unmap(m);
+			OOPS("cannot read size of darray file ",filename);
+		}
+		m->size = filesize.QuadPart;
+		m->mapping = CreateFileMappingA(m->file, nullptr, PAGE_WRITECOPY, 0, 0, nullptr);
+		if (m->mapping) m->base = MapViewOfFile(m->mapping, FILE_MAP_COPY, 0, 0, 0);
+		if (!m->base) {
+			_unmap(m);
+			OOPS("cannot map darray file ",filename);
+		}
+		#else
+		int fd = open(filename.c_str(), O_RDONLY);
+		if (fd<0) {
+			_unmap(m);
+			OOPS("cannot open darray file ",filename);
+		}
+		struct stat st;
+		if (fstat(fd, &st)!=0) {
+			close(fd);
+			_unmap(m);
+			OOPS("cannot read size of darray file ",filename);
+		}
+		m->size = st.st_size;
+		if (m->size) {
+			// Private and writable, so the array behaves like any other, but the
+			//  pages stay shared in the page cache until something writes to them.
+			void* base = mmap(nullptr, m->size, PROT_READ|PROT_WRITE, MAP_PRIVATE, fd, 0);
+			if (base!=MAP_FAILED) m->base = base;
+		}
+		close(fd);
+		if (!m->base) {
+			_unmap(m);
+			OOPS("cannot map darray file ",filename);
+		}
+		#endif
+
+		return m;
+	}
+
+} // end anonymous namespace
+
+
+
+
+void elm::darray::save_file(const std::string& filename) const
+{
+	if (dimty<1 || dimty>3 || PyArray_NDIM(_repository.pool)!=dimty) {
+		OOPS("darray files can hold arrays of 1 to 3 dimensions only");
+	}
+
+	darray_file_header h;
+	memset(&h, 0, sizeof(h));
+	memcpy(h.magic, DARRAY_FILE_MAGIC, 8);
+	h.byteorder = DARRAY_FILE_BYTEORDER;
+	h.version = DARRAY_FILE_VERSION;
+	h.dtype = _file_dtype(PyArray_TYPE(_repository.pool));
+	h.ndim = dimty;
+	for (int d=0; d<3; d++) {
+		h.shape[d] = (d<dimty) ? PyArray_DIMS(_repository.pool)[d] : 1;
+	}
+
+	std::string names;
+	for (auto v=variables.begin(); v!=variables.end(); v++) {
+		names += *v;
+		names.push_back('\0');
+	}
+	h.names_size = names.size();
+
+	h.data_size = h.shape[0]*h.shape[1]*h.shape[2]*_itemsize(h.dtype);
+	h.data_offset = sizeof(h) + h.names_size;
+	h.data_offset = ((h.data_offset + DARRAY_FILE_ALIGNMENT - 1) / DARRAY_FILE_ALIGNMENT) * DARRAY_FILE_ALIGNMENT;
+
+	std::ofstream f (filename.c_str(), std::ios::out | std::ios::binary | std::ios::trunc);
+	if (!f) OOPS("cannot open darray file ",filename," for writing");
+
+	f.write(reinterpret_cast<const char*>(&h), sizeof(h));
+	f.write(names.data(), names.size());
+	std::vector<char> padding (h.data_offset - sizeof(h) - h.names_size, 0);
+	if (padding.size()) f.write(&padding[0], padding.size());
+	f.write(static_cast<const char*>(PyArray_DATA(_repository.pool)), h.data_size);
+
+	if (!f) OOPS("error writing darray file ",filename);
+}
+
+
+
+boosted::shared_ptr<elm::darray> elm::darray::map_file(const std::string& filename)
+{
+	PyObject* arr = elm::map_darray_file(filename);
+	boosted::shared_ptr<elm::darray> x;
+	try {
+		x = boosted::make_shared<elm::darray>(arr);
+		x->source_file = filename;
+	} catch (...) {
+		Py_CLEAR(arr);
+		throw;
+	}
+	Py_CLEAR(arr);
+	return x;
+}
+
+
+
+void elm::save_darray_file(PyObject* source_arr, const std::string& filename)
+{
+	elm::darray x (source_arr);
+	x.save_file(filename);
+}
+
+
+
+PyObject* elm::map_darray_file(const std::string& filename)
+{
+	darray_file_mapping* m = _map(filename);
+
+	darray_file_header h;
+	try {
+		_check_header(m->base, m->size, filename, h);
+	} catch (...) {
+		_unmap(m);
+		throw;
+	}
+
+	std::vector<std::string> names = _read_names(static_cast<const char*>(m->base) + sizeof(h), h.names_size);
+
+	etk::python_lock LOCK;
+
+	npy_intp dims [3];
+	for (unsigned d=0; d<h.ndim; d++) dims[d] = h.shape[d];
+
+	PyObject* subtype = etk::get_array_type("Array");
+	PyObject* arr = PyArray_New((PyTypeObject*)subtype, h.ndim, &dims[0], _npy_dtype(h.dtype), nullptr,
+								static_cast<char*>(m->base)+h.data_offset, 0, NPY_ARRAY_CARRAY, nullptr);
+	Py_CLEAR(subtype);
+	if (!arr) {
+		_unmap(m);
+		PYTHON_ERRORCHECK;
+		OOPS("Unknown error creating array for darray file ",filename);
+	}
+
+	// The array owns the mapping from here on
+	PyObject* capsule = PyCapsule_New(m, "larch.darray_file", &_release_mapping_capsule);
+	if (!capsule) {
+		Py_CLEAR(arr);
+		_unmap(m);
+		PYTHON_ERRORCHECK;
+		OOPS("Unknown error creating array for darray file ",filename);
+	}
+	if (PyArray_SetBaseObject((PyArrayObject*)arr, capsule)!=0) {
+		Py_CLEAR(arr); // the base reference is stolen even on failure
+		PYTHON_ERRORCHECK;
+		OOPS("Unknown error creating array for darray file ",filename);
+	}
+
+	if (names.size()) {
+		PyObject* py_vars = PyTuple_New(names.size());
+		for (size_t i=0; i<names.size(); i++) {
+			PyTuple_SET_ITEM(py_vars, i, PyUnicode_FromString(names[i].c_str()));
+		}
+		PyObject_SetAttrString(arr, "vars", py_vars);
+		Py_CLEAR(py_vars);
+	}
+
+	return arr;
+}
+
+
+
+
+elm::darray_stream::darray_stream(const std::string& filename, size_t block_bytes)
+: elm::darray()
+, _filename(filename)
+, _file(filename.c_str(), std::ios::in | std::ios::binary)
+, _data_offset(0)
+, _case_bytes(0)
+, _block_cases(0)
+, _window_length(0)
+, _fetching()
+, _fetching_first(0)
+, _fetching_length(0)
+, _fetcher()
+, _fetch_error()
+{
+	if (!_file) OOPS("cannot open darray file ",filename);
+	_file.seekg(0, std::ios::end);
+	size_t file_size = _file.tellg();
+	_file.seekg(0, std::ios::beg);
+	
+	std::vector<char> start (std::min(file_size, sizeof(darray_file_header)));
+	if (start.size()) _file.read(&start[0], start.size());
+	darray_file_header h;
+	_check_header(start.size() ? &start[0] : nullptr, file_size, filename, h);
+	if (h.shape[0]==0) OOPS("darray file ",filename," has no cases");
+
+	std::vector<char> names (h.names_size);
+	if (names.size()) _file.read(&names[0], names.size());
+	if (!_file) OOPS("error reading darray file ",filename);
+	
+	dimty = h.ndim;
+	dtype = _npy_dtype(h.dtype);
+	contig = true;
+	n_alts = (h.ndim==3) ? h.shape[1] : 0;
+	set_variables(_read_names(names.size() ? &names[0] : nullptr, names.size()));
+	
+	_data_offset = h.data_offset;
+	_case_bytes = h.data_size / h.shape[0];
+	_block_cases = _case_bytes ? block_bytes / _case_bytes : h.shape[0];
+	if (_block_cases < 1) _block_cases = 1;
+	if (_block_cases > h.shape[0]) _block_cases = h.shape[0];
+	_window_total = h.shape[0];
+	_window_first = 0;
+
+	int c = (h.ndim>=2) ? int(h.shape[1]) : -1;
+	int s = (h.ndim>=3) ? int(h.shape[2]) : -1;
+	etk::ndarray block ("Array", dtype, _block_cases, c, s);
+	etk::ndarray spare ("Array", dtype, _block_cases, c, s);
+	std::swap(_repository.pool, block.pool);
+	std::swap(_fetching.pool, spare.pool);
+}
+
+elm::darray_stream::~darray_stream()
+{
+	if (_fetcher.joinable()) _fetcher.join();
+}
+
+size_t elm::darray_stream::block_cases() const
+{
+	return _block_cases;
+}
+
+void elm::darray_stream::_read(etk::ndarray& into, size_t first, size_t length)
+{
+	if (length > _block_cases || first+length > _window_total) {
+		OOPS("cases ",first," to ",first+length," are not a block of darray file ",_filename);
+	}
+	_file.clear();
+	_file.seekg(_data_offset + first*_case_bytes, std::ios::beg);
+	_file.read(static_cast<char*>(PyArray_DATA(into.pool)), length*_case_bytes);
+	if (!_file) OOPS("error reading cases ",first," to ",first+length," from darray file ",_filename);
+}
+
+void elm::darray_stream::_start_fetch(size_t first, size_t length)
+{
+	_fetching_first = first;
+	_fetching_length = length;
+	_fetch_error = nullptr;
+	_fetcher = std::thread([this,first,length](){
+		try {
+			_read(_fetching, first, length);
+		} catch (...) {
+			_fetch_error = std::current_exception();
+		}
+	});
+}
+
+void elm::darray_stream::_finish_fetch()
+{
+	if (_fetcher.joinable()) _fetcher.join();
+	if (_fetch_error) {
+		std::exception_ptr err = _fetch_error;
+		_fetch_error = nullptr;
+		_fetching_length = 0;
+		std::rethrow_exception(err);
+	}
+}
+
+void elm::darray_stream::load_block(size_t first, size_t length, size_t next_first, size_t next_length)
+{
+	if (!(_window_length && first==_window_first && length==_window_length)) {
+		_finish_fetch();
+		if (_fetching_length && first==_fetching_first && length==_fetching_length) {
+			std::swap(_repository.pool, _fetching.pool);
+		} else {
+			_read(_repository, first, length);
+		}
+		_fetching_length = 0;
+		_window_first = first;
+		_window_length = length;
+	}
+	
+	// With no next block, the next pass over the data is most likely to start
+	//  again at the beginning, so fetch that instead.
+	if (!next_length && first) {
+		next_first = 0;
+		next_length = std::min(_block_cases, _window_total);
+	}
+	if (next_length && !(_window_length && next_first==_window_first)
+		&& !(_fetching_length && next_first==_fetching_first && next_length==_fetching_length)) {
+		_finish_fetch();
+		_start_fetch(next_first, next_length);
+	}
+}
@@ -55,11 +55,48 @@ elm::SQLiteDB::~SQLiteDB()
 void elm::SQLiteDB::close ()
 {
 	if (_db) {
+		clear_statement_cache();
 		_db = NULL;
 	}
 
 }
 
+void elm::SQLiteDB::clear_statement_cache()
+{
+	std::lock_guard<std::mutex> lock(_stmt_cache_lock);
+	for (auto& i: _stmt_cache) {
+		sqlite3_finalize(i.second);
+	}
+	_stmt_cache.clear();
+}
+
+sqlite3_stmt* elm::SQLiteDB::_stmt_take(const std::string& sql)
+{
+	std::lock_guard<std::mutex> lock(_stmt_cache_lock);
+	auto i = _stmt_cache.find(sql);
+	if (i==_stmt_cache.end()) return nullptr;
+	sqlite3_stmt* stmt = i->second;
+	_stmt_cache.erase(i);
+	return stmt;
+}
+
+void elm::SQLiteDB::_stmt_return(sqlite3_stmt* stmt)
+{
+	const size_t max_cached_statements = 64;
+	
+	sqlite3_reset(stmt);
+	sqlite3_clear_bindings(stmt);
+	std::lock_guard<std::mutex> lock(_stmt_cache_lock);
+	if (!_db || _stmt_cache.size()>=max_cached_statements) {
+		sqlite3_finalize(stmt);
+		return;
+	}
+	const char* sql = sqlite3_sql(stmt);
+	if (!sql || !_stmt_cache.insert(std::make_pair(std::string(sql), stmt)).second) {
+		sqlite3_finalize(stmt);
+	}
+}
+
 
 
 std::vector<std::string> elm::SQLiteDB::all_table_names() const
@@ -435,7 +472,11 @@ const int& elm::SQLiteStmt::status() const
 void elm::SQLiteStmt::clear()
 {
 	if ( _statement ) {
-		sqlite3_finalize( _statement );
+		if (_sqldb) {
+			_sqldb->_stmt_return( _statement );
+		} else {
+			sqlite3_finalize( _statement );
+		}
 		_statement = NULL;
 		_status = 0;
 	}	
@@ -493,6 +534,12 @@ elm::SQLiteStmt* elm::SQLiteStmt::prepare (string sql)
 	db_check();
 	clear();
 	
+	_statement = _sqldb->_stmt_take(sql);
+	if (_statement) {
+		_status = SQLITE_OK;
+		return this;
+	}
+	
 	BUGGER(_sqldb->msg) << "Preparing SQL: "<<sql;
 	
 	_status = sqlite3_prepare_v2(_sqldb->_db,
@@ -642,6 +689,28 @@ void elm::SQLiteStmt::getBools (int startColumn, const int& endColumn,
 	}
 }
 
+size_t elm::SQLiteStmt::fetch_block (double* into, const size_t& max_rows, const int& first_column, const int& n_columns,
+									 long long* keys)
+{
+	if (_status!=SQLITE_ROW && _status!=SQLITE_DONE) {
+		execute();
+	}
+	size_t rows = 0;
+	while (rows<max_rows && _status==SQLITE_ROW) {
+		if (keys) {
+			for (int k=0; k<first_column; k++) {
+				*(keys++) = sqlite3_column_int64(_statement, k);
+			}
+		}
+		for (int i=first_column; i<first_column+n_columns; i++) {
+			*(into++) = sqlite3_column_double(_statement, i);
+		}
+		rows++;
+		execute();
+	}
+	return rows;
+}
+
 string elm::SQLiteStmt::getText(int column)
 { 
 	if (sqlite3_column_bytes(_statement, column))
@@ -759,3 +828,56 @@ std::vector<std::string> elm::SQLiteDB::eval_string_tuple(const std::string& sql
 }
 
 
+std::vector<double> elm::SQLiteDB::_swigtest_fetch_block(const std::string& sql, const size_t& block_rows,
+                                                         const int& first_column, const int& n_columns)
+{
+	if (!block_rows) OOPS("block_rows must be positive");
+	std::vector<double> ret;
+	std::vector<double> values (block_rows*n_columns);
+	std::vector<long long> keys (block_rows*first_column+1);
+	SQLiteStmtPtr s = sql_statement(sql);
+	size_t n;
+	do {
+		n = s->fetch_block(&values[0], block_rows, first_column, n_columns, first_column ? &keys[0] : nullptr);
+		for (size_t r=0; r<n; r++) {
+			for (int k=0; k<first_column; k++) ret.push_back(keys[r*first_column+k]);
+			for (int i=0; i<n_columns; i++) ret.push_back(values[r*n_columns+i]);
+		}
+	} while (n==block_rows);
+	return ret;
+}
+
+std::vector<double> elm::SQLiteDB::_swigtest_fetch_rows(const std::string& sql,
+                                                        const int& first_column, const int& n_columns)
+{
+	std::vector<double> ret;
+	SQLiteStmtPtr s = sql_statement(sql);
+	s->execute();
+	while (s->status()==SQLITE_ROW) {
+		for (int k=0; k<first_column; k++) ret.push_back(s->getInt64(k));
+		for (int i=first_column; i<first_column+n_columns; i++) ret.push_back(s->getDouble(i));
+		s->execute();
+	}
+	return ret;
+}
+
+bool elm::SQLiteDB::_swigtest_statement_cache_reuse(const std::string& sql)
+{
+	clear_statement_cache();
+	sqlite3_stmt* first_statement;
+	double first_value;
+	{
+		SQLiteStmtPtr s = sql_statement(sql);
+		first_statement = s->_statement;
+		s->execute();
+		if (s->status()!=SQLITE_ROW) OOPS("the test sql must give at least two rows");
+		first_value = s->getDouble(0);
+		s->execute();
+		if (s->status()!=SQLITE_ROW) OOPS("the test sql must give at least two rows");
+	}
+	SQLiteStmtPtr s = sql_statement(sql);
+	if (s->_statement!=first_statement || sqlite3_stmt_busy(s->_statement)) return false;
+	s->execute();
+	return (s->status()==SQLITE_ROW && s->getDouble(0)==first_value);
+}
+
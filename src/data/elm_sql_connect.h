@@ -84,6 +84,7 @@ call this function without any arguments.";
 #ifndef SWIG
 	// In not SWIG, these headers are treated normally
 
+	#include <mutex>
 	#include "etk.h"
 	#include "etk_python.h"
 
@@ -170,6 +171,16 @@ namespace elm {
 								         double* pushLocation, const unsigned& pushIncrement=1);
 		void        getBools (int startColumn, const int& endColumn,
 								        bool* pushLocation, const unsigned& pushIncrement=1);
+
+		size_t      fetch_block (double* into, const size_t& max_rows, const int& first_column, const int& n_columns,
+		                         long long* keys=nullptr);
+		// Read up to max_rows rows, from the current row onwards, putting
+		//  n_columns numeric columns starting at first_column into the
+		//  row major array at into. If keys is given, the columns before
+		//  first_column are put there as integers, in the same row major
+		//  form. Returns the number of rows read; when fewer than max_rows,
+		//  the statement is done. If the statement has not been executed
+		//  yet it is executed first.
 	
 		int         simpleInteger(const std::string& sql, const int& defaultvalue);
 		long long   simpleInt64  (const std::string& sql, const int& defaultvalue);
@@ -205,6 +216,14 @@ namespace elm {
 	protected:	
 		sqlite3*		_db;			// sqlite3 database pointer
 	
+		std::map<std::string, sqlite3_stmt*> _stmt_cache;
+		std::mutex                           _stmt_cache_lock;
+		// Prepared statements that are not in use, keyed by their SQL, so
+		//  that a statement run over and over is only compiled once. Statements
+		//  are taken and given back from several threads at once.
+		sqlite3_stmt* _stmt_take  (const std::string& sql);
+		void          _stmt_return(sqlite3_stmt* stmt);
+	
 	public:
 		// INFO
 		virtual bool is_open() { return (bool(_db)); }
@@ -232,6 +251,7 @@ namespace elm {
 		~SQLiteDB();
 		
 		void close();
+		void clear_statement_cache();
 
 	public:
 		void copy_from_db(const std::string& file_name_);
@@ -267,6 +287,16 @@ namespace elm {
 		std::vector<long long>          eval_int64_tuple(const std::string& sql) const;
 		std::vector<std::string>        eval_string_tuple(const std::string& sql) const;
 
+		// Test hooks for the block reader and the statement cache. The first two
+		//  read the rows of sql, each as its first_column integer keys and then
+		//  n_columns values, through fetch_block in blocks of block_rows or one
+		//  row at a time. The last is true if a statement that is given back
+		//  part way through its rows is reused, reset, for the same sql.
+		std::vector<double> _swigtest_fetch_block(const std::string& sql, const size_t& block_rows,
+		                                          const int& first_column, const int& n_columns);
+		std::vector<double> _swigtest_fetch_rows (const std::string& sql,
+		                                          const int& first_column, const int& n_columns);
+		bool                _swigtest_statement_cache_reuse(const std::string& sql);
 		
 	};
 	
@@ -20,6 +20,9 @@
 
 #include <unordered_map>
 #include <unordered_set>
+#include <algorithm>
+#include <thread>
+#include <exception>
 
 #include "elm_sql_facet.h"
 #include "elm_sql_scrape.h"
@@ -1693,11 +1696,233 @@ elm::datamatrix elm::Facet::matrix_library(size_t n)
 
 
 
-void elm::Facet::_array_idco_reader(const std::string& qry, elm::darray* array, elm::darray* caseids)
+
+namespace {
+
+	// A read-only connection of its own for one ingest thread, on the
+	//  same database file as the Facet.
+	struct ingest_connection {
+		sqlite3*      db;
+		sqlite3_stmt* stmt;
+		ingest_connection(): db(nullptr), stmt(nullptr) {}
+		ingest_connection(const ingest_connection&) = delete;
+		~ingest_connection() {
+			if (stmt) sqlite3_finalize(stmt);
+			if (db) sqlite3_close(db);
+		}
+		bool open(const char* filename, const std::string& sql) {
+			if (sqlite3_open_v2(filename, &db, SQLITE_OPEN_READONLY|SQLITE_OPEN_NOMUTEX, nullptr)!=SQLITE_OK) return false;
+			return sqlite3_prepare_v2(db, sql.c_str(), -1, &stmt, nullptr)==SQLITE_OK;
+		}
+	};
+
+	// The share of one ingest thread: the cases in rows first to last-1 of
+	//  the array, whose caseids run from low to high.
+	struct ingest_range {
+		size_t    first;
+		size_t    last;
+		long long low;
+		long long high;
+	};
+
+	// Read the rows for the cases in range, where sorted holds the caseid of
+	//  every row of the array.
+	void ingest_slab
+	( ingest_connection* conn
+	, const std::vector<long long>* sorted
+	, ingest_range range
+	, elm::darray* array
+	, const std::unordered_map<long long, size_t>* altid_map
+	, std::exception_ptr* error
+	)
+	{
+		try {
+			size_t first = range.first;
+			size_t last = range.last;
+			sqlite3_stmt* stmt = conn->stmt;
+			sqlite3_bind_int64(stmt, 1, range.low);
+			sqlite3_bind_int64(stmt, 2, range.high);
+			
+			size_t first_var = altid_map ? 2 : 1;
+			size_t n_vars = array ? (altid_map ? array->_repository.size3() : array->_repository.size2()) : 0;
+			std::vector<bool> filled (altid_map ? 0 : last-first, false);
+			
+			size_t c = first;
+			size_t a = 0;
+			int status;
+			while ((status = sqlite3_step(stmt))==SQLITE_ROW) {
+				long long current_row_caseid = sqlite3_column_int64(stmt, 0);
+				
+				// Rows usually come in caseid order, so look at the current and
+				//  next case before searching the slab.
+				if ((*sorted)[c]!=current_row_caseid) {
+					if (c+1<last && (*sorted)[c+1]==current_row_caseid) {
+						c++;
+					} else {
+						auto iter = std::lower_bound(sorted->begin()+first, sorted->begin()+last, current_row_caseid);
+						if (iter==sorted->begin()+last || *iter!=current_row_caseid) {
+							OOPS("caseid ",current_row_caseid," was not found when counting cases");
+						}
+						c = iter - sorted->begin();
+					}
+				}
+				
+				if (altid_map) {
+					long long current_row_altid = sqlite3_column_int64(stmt, 1);
+					auto altiter = altid_map->find(current_row_altid);
+					if (altiter == altid_map->end()) {
+						OOPS("table contains unknown altid ",current_row_altid);
+					}
+					a = altiter->second;
+				} else {
+					if (filled[c-first]) {
+						OOPS("duplicate caseid ",current_row_caseid);
+					}
+					filled[c-first] = true;
+				}
+				
+				if (!n_vars) continue;
+				if (array->dtype == NPY_DOUBLE) {
+					double* x = altid_map ? &array->value_double(c,a,0) : &array->value_double(c,0);
+					for (size_t i=0; i<n_vars; i++) {
+						x[i] = sqlite3_column_double(stmt, i+first_var);
+					}
+				} else if (array->dtype == NPY_INT64) {
+					long long* x = altid_map ? &array->value_int64(c,a,0) : &array->value_int64(c,0);
+					for (size_t i=0; i<n_vars; i++) {
+						x[i] = sqlite3_column_int64(stmt, i+first_var);
+					}
+				} else if (array->dtype == NPY_BOOL) {
+					bool* x = altid_map ? &array->value_bool(c,a,0) : &array->value_bool(c,0);
+					for (size_t i=0; i<n_vars; i++) {
+						x[i] = (bool)sqlite3_column_int(stmt, i+first_var);
+					}
+				} else {
+					OOPS("unsupported dtype");
+				}
+			}
+			if (status!=SQLITE_DONE) {
+				OOPS("error in reading table: ",sqlite3_errmsg(conn->db));
+			}
+		} catch (...) {
+			*error = std::current_exception();
+		}
+	}
+
+} // end namespace
+
+
+
+bool elm::Facet::_array_parallel_reader(const std::string& qry, elm::darray* array, elm::darray* caseids, const std::vector<long long>* altids, int n_threads,
+										const std::string& range_qry)
+{
+	// Other connections can only see a database that is in a file, and
+	//  cannot see changes that are not yet committed.
+	if (n_threads<2 || !sqlite3_threadsafe() || !sqlite3_get_autocommit(_db)) return false;
+	const char* filename = sqlite3_db_filename(_db, "main");
+	if (!filename || !filename[0]) return false;
+	if (array && array->dtype!=NPY_DOUBLE && array->dtype!=NPY_INT64 && array->dtype!=NPY_BOOL) return false;
+	
+	size_t n_cases = array? array->_repository.size1() : caseids->_repository.size1();
+	
+	// Each thread should get a decent share of the cases
+	const size_t min_cases_per_thread = 4096;
+	if (size_t(n_threads) > n_cases/min_cases_per_thread) {
+		n_threads = int(n_cases/min_cases_per_thread);
+	}
+	if (n_threads<2) return false;
+	
+	auto stmt = sql_statement_readonly(qry);
+	size_t n_vars = array ? (altids ? array->_repository.size3() : array->_repository.size2()) : 0;
+	size_t n_keys = altids ? 2 : 1;
+	if (stmt->count_columns()-n_keys < n_vars) {
+		OOPS("(vars underflow ) table has ",stmt->count_columns()-n_keys," variables after the case keys, but the array offers space for ",n_vars," variables");
+	}
+	if (stmt->count_columns()-n_keys > n_vars) {
+		OOPS("(vars overflow  ) table has ",stmt->count_columns()-n_keys," variables after the case keys, but the array offers space for ",n_vars," variables");
+	}
+	std::string caseid_column = stmt->column_name(0);
+	stmt.reset();
+	
+	// The caseid to row index, which is also the split among the threads
+	std::vector<long long> sorted;
+	sorted.reserve(n_cases);
+	{
+		std::ostringstream distinct;
+		distinct << "SELECT DISTINCT \"" << caseid_column << "\" FROM (" << qry << ") ORDER BY 1";
+		auto d = sql_statement_readonly(distinct);
+		d->execute();
+		while (d->status()==SQLITE_ROW) {
+			sorted.push_back(d->getInt64(0));
+			if (sorted.size()>n_cases) {
+				OOPS("(cases overflow ) not completed reading table but already filled all ",n_cases," cases");
+			}
+			d->execute();
+		}
+	}
+	if (sorted.size() < n_cases) {
+		OOPS("(cases underflow) completed reading table after ",sorted.size()," cases, array of ",n_cases," not filled");
+	}
+	
+	// The ranges of caseids for the threads are found here, once
+	std::vector<ingest_range> ranges (n_threads);
+	for (int t=0; t<n_threads; t++) {
+		ranges[t].first = (n_cases*t)/n_threads;
+		ranges[t].last  = (n_cases*(t+1))/n_threads;
+		ranges[t].low   = sorted[ranges[t].first];
+		ranges[t].high  = sorted[ranges[t].last-1];
+	}
+	
+	std::string slab_sql = range_qry;
+	if (slab_sql.empty()) {
+		std::ostringstream wrapped;
+		wrapped << "SELECT * FROM (" << qry << ") WHERE \"" << caseid_column << "\" BETWEEN ?1 AND ?2";
+		slab_sql = wrapped.str();
+	}
+	std::vector<ingest_connection> connections (n_threads);
+	for (auto& conn: connections) {
+		// Tables that are temporary or attached, or use functions added to
+		//  this connection, cannot be read from another one.
+		if (!conn.open(filename, slab_sql)) return false;
+	}
+	
+	std::unordered_map<long long, size_t> altid_map;
+	if (altids) {
+		for (size_t j=0; j<altids->size(); j++) {
+			altid_map[(*altids)[j]] = j;
+		}
+	}
+	
+	for (size_t c=0; c<n_cases; c++) {
+		caseids->value_int64(c, 0) = sorted[c];
+	}
+	
+	INFO(msg) << "reading "<<n_cases<<" cases on "<<n_threads<<" threads";
+	
+	std::vector<std::thread> workers;
+	std::vector<std::exception_ptr> errors (n_threads);
+	for (int t=0; t<n_threads; t++) {
+		workers.emplace_back(ingest_slab, &connections[t], &sorted, ranges[t], array,
+							 altids ? &altid_map : nullptr, &errors[t]);
+	}
+	for (auto& w: workers) {
+		w.join();
+	}
+	for (auto& e: errors) {
+		if (e) std::rethrow_exception(e);
+	}
+	return true;
+}
+
+
+void elm::Facet::_array_idco_reader(const std::string& qry, elm::darray* array, elm::darray* caseids, int n_threads,
+									const std::string& range_qry)
 {
 	if (array) assert(array->nCases()==caseids->nCases());
 	assert(caseids->dtype == NPY_INT64);
 	
+	if (_array_parallel_reader(qry, array, caseids, nullptr, n_threads, range_qry)) return;
+	
 	size_t row = 0;
 	clock_t prevmsgtime = clock();
 	clock_t timenow;
@@ -1718,6 +1943,30 @@ void elm::Facet::_array_idco_reader(const std::string& qry, elm::darray* array,
 	std::unordered_set<long long> caseid_set;
 	
 	stmt->execute();
+	
+	if (array && array->dtype == NPY_DOUBLE && n_vars) {
+		// Rows go into the array in order, so read them in blocks straight
+		//  into place.
+		const size_t block_rows = 65536;
+		while ((stmt->status()==SQLITE_ROW) && row<n_cases) {
+			size_t n = stmt->fetch_block(&array->value_double(row, 0), std::min(block_rows, n_cases-row), 1, n_vars,
+										 &caseids->value_int64(row, 0));
+			for (size_t r=row; r<row+n; r++) {
+				if (!caseid_set.insert(caseids->value_int64(r, 0)).second) {
+					OOPS("duplicate caseid ",caseids->value_int64(r, 0));
+				}
+			}
+			row += n;
+			
+			timenow = clock();
+			if (timenow > prevmsgtime + (CLOCKS_PER_SEC * 3)) {
+				INFO(msg) << "reading idco row "<<row<<", "
+					<< 100.0*double(row)/double(n_cases) << "% ..." ;
+				prevmsgtime = clock();
+			}
+		}
+	}
+	
 	while ((stmt->status()==SQLITE_ROW) && row<n_cases) {
 
 		long long current_row_caseid = stmt->getInt64(0);
@@ -1769,11 +2018,15 @@ void elm::Facet::_array_idco_reader(const std::string& qry, elm::darray* array,
 
 
 
-void elm::Facet::_array_idca_reader(const std::string& qry, elm::darray* array, elm::darray* caseids, const std::vector<long long>& altids)
+void elm::Facet::_array_idca_reader(const std::string& qry, elm::darray* array, elm::darray* caseids, const std::vector<long long>& altids, int n_threads,
+									const std::string& range_qry)
 {
 	assert(array->nCases()==caseids->nCases());
 	assert(caseids->dtype == NPY_INT64);
 	
+	if (altids.size() == array->_repository.size2()
+		&& _array_parallel_reader(qry, array, caseids, &altids, n_threads, range_qry)) return;
+	
 	size_t row = 0;
 	size_t max_caserow = 0;
 	clock_t prevmsgtime = clock();
@@ -313,10 +313,28 @@ namespace elm {
 		
 	public:
 		
-		void _array_idco_reader(const std::string& qry, elm::darray* array, elm::darray* caseids);
-		void _array_idca_reader(const std::string& qry, elm::darray* array, elm::darray* caseids, const std::vector<long long>& altids);
+		void _array_idco_reader(const std::string& qry, elm::darray* array, elm::darray* caseids, int n_threads=1,
+								const std::string& range_qry="");
+		void _array_idca_reader(const std::string& qry, elm::darray* array, elm::darray* caseids, const std::vector<long long>& altids, int n_threads=1,
+								const std::string& range_qry="");
+		// When n_threads is more than one and the database is a file with no
+		//  open transaction, the cases are split by caseid among that many
+		//  threads, each reading its own share through a separate read-only
+		//  connection, and the cases are put in ascending order of caseid.
+		//  Otherwise the table is read on this thread, and the cases are put
+		//  in the order in which they are first read. The distinct caseids are
+		//  found once, and each thread is given the range of caseids it reads.
+		//  range_qry is qry limited to caseids from ?1 to ?2, with the limit
+		//  in its own WHERE clause so it can use an index on the table; when
+		//  it is not given, qry is read as a subquery with the limit outside.
 
 		void _array_idca_reader_blind(const std::string& qry, int arraytype, const std::vector<long long>& altids, elm::darray** result_array, elm::darray** result_caseids);
+
+	#ifndef SWIG
+	protected:
+		bool _array_parallel_reader(const std::string& qry, elm::darray* array, elm::darray* caseids, const std::vector<long long>* altids, int n_threads,
+									const std::string& range_qry);
+	#endif // ndef SWIG
 	};
 
 
@@ -150,7 +150,7 @@ void elm::logit_simple_deriv (etk::ndarray* dLLdprobability, etk::ndarray* dLLdu
 
 	size_t nC = dLLdprobability->size1();
 	size_t nA = dLLdprobability->size2();
-	etk::ndarray dPdU (nA,nA);
+	etk::memarray_raw dPdU (nA,nA);
 	double Pi;
 
 	for (size_t c=0; c<nC; c++) {
@@ -249,8 +249,8 @@ void elm::logit_gev_deriv (etk::ndarray* dLLdprobability, etk::ndarray* dLLdutil
 
 	size_t nC = dLLdprobability->size1();
 	size_t nA = dLLdprobability->size2();
-	etk::ndarray dPdU (nA,nA);
-	etk::ndarray sum_term (nA);
+	etk::memarray_raw dPdU (nA,nA);
+	etk::memarray_raw sum_term (nA);
 	double Pi;
 
 	for (size_t c=0; c<nC; c++) {
@@ -423,7 +423,7 @@ void elm::Gi_nested_logit(const etk::ndarray* utility, const etk::ndarray_bool*
 		}
 	}
 	
-	etk::ndarray Y (xylem->size());
+	etk::memarray_raw Y (xylem->size());
 	
 	size_t nC = utility->size1();
 	
@@ -46,6 +46,9 @@ namespace etk {
 		void            make_strap (const unsigned& n_cases);
 		void            set_knife (const unsigned& n_cases);
 		void            set_knife (const double& fraction_cases);	
+		bool            knifed (const unsigned& j) const { return _strap && _strap->at(j) >= _knife; }
+		// Whether case j is left out of the random subset set by make_strap
+		//  and set_knife.
 		autoindex_int()	;
 		~autoindex_int();
 	};
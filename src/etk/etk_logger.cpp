@@ -253,7 +253,7 @@ void etk::logging_service::output_message(const unsigned& level, const std::stri
 {
 	if (logObj) {
 		
-		boosted::lock_guard<boosted::mutex> LOCK(etk::python_global_mutex);
+		etk::python_lock LOCK;
 		
 		int interrupt ( PyErr_CheckSignals() );
 	
@@ -21,8 +21,32 @@
 #include "etk_python.h"
 #include "etk_math.h"
 #include "etk_exception.h"
+#include "etk_memory.h"
+#include <algorithm>
+#include <limits>
+#include <vector>
 
 using namespace etk;
+
+#ifdef __APPLE__
+typedef __CLPK_integer lapack_int_t;
+#else
+typedef int lapack_int_t;
+extern "C" {
+	void dpotrf_(char* uplo, lapack_int_t* n, double* a, lapack_int_t* lda, lapack_int_t* info);
+	void dpotri_(char* uplo, lapack_int_t* n, double* a, lapack_int_t* lda, lapack_int_t* info);
+	void dpocon_(char* uplo, lapack_int_t* n, double* a, lapack_int_t* lda, double* anorm, double* rcond,
+				 double* work, lapack_int_t* iwork, lapack_int_t* info);
+	void dsytrf_(char* uplo, lapack_int_t* n, double* a, lapack_int_t* lda, lapack_int_t* ipiv,
+				 double* work, lapack_int_t* lwork, lapack_int_t* info);
+	void dsytri_(char* uplo, lapack_int_t* n, double* a, lapack_int_t* lda, lapack_int_t* ipiv,
+				 double* work, lapack_int_t* info);
+	void dsycon_(char* uplo, lapack_int_t* n, double* a, lapack_int_t* lda, lapack_int_t* ipiv, double* anorm,
+				 double* rcond, double* work, lapack_int_t* iwork, lapack_int_t* info);
+	void dsyev_(char* jobz, char* uplo, lapack_int_t* n, double* a, lapack_int_t* lda, double* w,
+				double* work, lapack_int_t* lwork, lapack_int_t* info);
+}
+#endif
 /*
 #ifndef __APPLE__
 extern "C" {
@@ -103,6 +127,138 @@ void etk::simple_inplace_element_multiply(const int& N, const double * A, const
 
 
 
+// LAPACK uses column major order, so its lower triangle is the upper
+//  triangle of the same memory read in row major order.
+static void _mirror_upper_to_lower(double* A, const int& n)
+{
+	for (int r=0; r<n; r++) {
+		for (int c=r+1; c<n; c++) {
+			A[c*n+r] = A[r*n+c];
+		}
+	}
+}
+
+static double _symmetric_norm1(const double* A, const int& n)
+{
+	double norm = 0;
+	for (int r=0; r<n; r++) {
+		double row = 0;
+		for (int c=0; c<n; c++) row += fabs(A[r*n+c]);
+		norm = std::max(norm, row);
+	}
+	return norm;
+}
+
+double etk::symmetric_inverse(double* A, const int& n, const double& min_rcond, bool* positive_definite)
+{
+	if (positive_definite) *positive_definite = false;
+	if (n<=0) return 1.0;
+
+	char uplo = 'L';
+	lapack_int_t N = n;
+	lapack_int_t info = 0;
+	double anorm = _symmetric_norm1(A, n);
+	double rcond = 0;
+	
+	// The factors and workspace are scratch from the thread's arena, so
+	//  repeated inversions reuse the same blocks.
+	puddle factor (n*n);
+	puddle work (3*n);
+	std::vector<lapack_int_t> iwork (n);
+	std::vector<lapack_int_t> ipiv (n);
+	
+	cblas_dcopy(n*n, A, 1, *factor, 1);
+	dpotrf_(&uplo, &N, *factor, &N, &info);
+	if (info==0) {
+		if (positive_definite) *positive_definite = true;
+		dpocon_(&uplo, &N, *factor, &N, &anorm, &rcond, *work, &iwork[0], &info);
+		if (info || !(rcond > min_rcond)) return (info ? 0 : rcond);
+		dpotri_(&uplo, &N, *factor, &N, &info);
+		if (info) return 0;
+	} else {
+		// Not positive definite, use the pivoted LDL' factorization
+		cblas_dcopy(n*n, A, 1, *factor, 1);
+		double query = 0;
+		lapack_int_t lwork = -1;
+		dsytrf_(&uplo, &N, *factor, &N, &ipiv[0], &query, &lwork, &info);
+		lwork = std::max(lapack_int_t(query), lapack_int_t(3*n));
+		if (work.size() < unsigned(lwork)) work.resize(lwork, false);
+		dsytrf_(&uplo, &N, *factor, &N, &ipiv[0], *work, &lwork, &info);
+		if (info) return 0;
+		dsycon_(&uplo, &N, *factor, &N, &ipiv[0], &anorm, &rcond, *work, &iwork[0], &info);
+		if (info || !(rcond > min_rcond)) return (info ? 0 : rcond);
+		dsytri_(&uplo, &N, *factor, &N, &ipiv[0], *work, &info);
+		if (info) return 0;
+	}
+	
+	cblas_dcopy(n*n, *factor, 1, A, 1);
+	_mirror_upper_to_lower(A, n);
+	return rcond;
+}
+
+int etk::symmetric_pseudo_inverse(double* A, const int& n, const double& cutoff)
+{
+	if (n<=0) return 0;
+
+	char jobz = 'V';
+	char uplo = 'L';
+	lapack_int_t N = n;
+	lapack_int_t info = 0;
+	puddle vectors (n*n);
+	puddle values (n);
+	
+	cblas_dcopy(n*n, A, 1, *vectors, 1);
+	double query = 0;
+	lapack_int_t lwork = -1;
+	dsyev_(&jobz, &uplo, &N, *vectors, &N, *values, &query, &lwork, &info);
+	lwork = std::max(lapack_int_t(query), lapack_int_t(3*n));
+	puddle work (lwork);
+	dsyev_(&jobz, &uplo, &N, *vectors, &N, *values, *work, &lwork, &info);
+	if (info) OOPS("eigen decomposition of the matrix did not converge");
+	
+	double largest = 0;
+	for (int k=0; k<n; k++) largest = std::max(largest, fabs(values[k]));
+	
+	// The eigenvectors are columns in column major order, so rows here
+	int kept = 0;
+	for (int i=0; i<n*n; i++) A[i] = 0;
+	for (int k=0; k<n; k++) {
+		if (fabs(values[k]) > cutoff*largest) {
+			cblas_dsyr(CblasRowMajor, CblasUpper, n, 1.0/values[k], *vectors+k*n, 1, A, n);
+			kept++;
+		}
+	}
+	_mirror_upper_to_lower(A, n);
+	return kept;
+}
+
+
+double etk::symmetric_min_abs_eigenvalue(const double* A, const int& n)
+{
+	if (n<=0) return std::numeric_limits<double>::infinity();
+
+	char jobz = 'N';
+	char uplo = 'L';
+	lapack_int_t N = n;
+	lapack_int_t info = 0;
+	puddle scratch (n*n);
+	puddle values (n);
+	
+	cblas_dcopy(n*n, A, 1, *scratch, 1);
+	double query = 0;
+	lapack_int_t lwork = -1;
+	dsyev_(&jobz, &uplo, &N, *scratch, &N, *values, &query, &lwork, &info);
+	lwork = std::max(lapack_int_t(query), lapack_int_t(3*n));
+	puddle work (lwork);
+	dsyev_(&jobz, &uplo, &N, *scratch, &N, *values, *work, &lwork, &info);
+	if (info) OOPS("eigen decomposition of the matrix did not converge");
+	
+	double smallest = fabs(values[0]);
+	for (int k=1; k<n; k++) smallest = std::min(smallest, fabs(values[k]));
+	return smallest;
+}
+
+
 void* etk::scipy_dgemm;
 
 void etk::load_scipy_blas_functions()
@@ -115,7 +271,7 @@ void etk::load_scipy_blas_functions()
 
 //	etk::scipy_dgemm = PyCapsule_Import("scipy.linalg.cython_blas.dgemm", 0);
 
-	boosted::lock_guard<boosted::mutex> LOCK(etk::python_global_mutex);
+	etk::python_lock LOCK;
 
 	PyObject* cython_blas = PyImport_ImportModule("scipy.linalg.cython_blas");
 	PyObject* pyx_capi = PyObject_GetAttrString(cython_blas, "__pyx_capi__");
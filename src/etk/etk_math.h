@@ -55,6 +55,25 @@ void simple_element_multiply(const int& N, const double * A, const int& incA,
 
 extern void *scipy_dgemm;
 
+
+// Invert the symmetric n by n matrix A, held in full, in place. A positive
+//  definite matrix is inverted through its Cholesky factorization, and any
+//  other through a pivoted LDL' factorization. Returns an estimate of the
+//  reciprocal condition number, which is zero if A is singular. A is only
+//  replaced when this is greater than min_rcond. If given, positive_definite
+//  is set to show whether the Cholesky factorization succeeded.
+double symmetric_inverse(double* A, const int& n, const double& min_rcond=0, bool* positive_definite=nullptr);
+
+// Replace the symmetric n by n matrix A, held in full, with its pseudo
+//  inverse from an eigen decomposition. Eigenvalues no larger in magnitude
+//  than cutoff times the largest are treated as zero. Returns the number
+//  of eigenvalues kept.
+int symmetric_pseudo_inverse(double* A, const int& n, const double& cutoff);
+
+// The smallest magnitude of any eigenvalue of the symmetric n by n matrix A,
+//  held in full. A is not changed.
+double symmetric_min_abs_eigenvalue(const double* A, const int& n);
+
 //extern void (*scipy_dgemm) (const enum CBLAS_ORDER __Order,
 //        const enum CBLAS_TRANSPOSE __TransA,
 //        const enum CBLAS_TRANSPOSE __TransB, const int __M, const int __N,
@@ -26,6 +26,97 @@ using namespace etk;
 #include <cmath>
 #include <climits>
 #include <cstring>
+#include <cstdlib>
+#include <vector>
+#if defined(_WIN32)
+#include <malloc.h>
+#endif
+
+
+/////// MARK: ARENA
+
+namespace {
+
+	// Size class k holds blocks of 2^k doubles. The smallest is one 64 byte
+	//  cache line, and blocks larger than the largest class (8 MB) are not
+	//  kept. Each thread keeps at most _arena_keep blocks of a class, and at
+	//  most _arena_keep_doubles in all, so a worker holds no more than 16 MB.
+	const size_t _arena_min_class = 3;
+	const size_t _arena_max_class = 20;
+	const size_t _arena_keep = 4;
+	const size_t _arena_keep_doubles = size_t(1)<<21;
+	const size_t _arena_alignment = 64;
+
+	size_t _arena_class(const size_t& n)
+	{
+		size_t k = _arena_min_class;
+		while ((size_t(1)<<k) < n) k++;
+		return k;
+	}
+
+	double* _aligned_doubles(const size_t& n)
+	{
+		void* p = nullptr;
+		#if defined(_WIN32)
+		p = _aligned_malloc(n*sizeof(double), _arena_alignment);
+		#else
+		if (posix_memalign(&p, _arena_alignment, n*sizeof(double))) p = nullptr;
+		#endif
+		if (!p) OOPS("out of memory");
+		return static_cast<double*>(p);
+	}
+
+	void _free_doubles(double* p)
+	{
+		#if defined(_WIN32)
+		::_aligned_free(p);
+		#else
+		free(p);
+		#endif
+	}
+
+	struct _arena_t {
+		std::vector< std::vector<double*> > free_blocks;
+		size_t kept_doubles;
+		_arena_t() : free_blocks(_arena_max_class+1), kept_doubles(0) { }
+		~_arena_t() {
+			for (auto& blocks: free_blocks) for (double* p: blocks) _free_doubles(p);
+		}
+	};
+
+	thread_local _arena_t _arena;
+}
+
+double* etk::arena_acquire(const size_t& n)
+{
+	if (!n) return nullptr;
+	size_t k = _arena_class(n);
+	if (k > _arena_max_class) return _aligned_doubles(n);
+	std::vector<double*>& blocks = _arena.free_blocks[k];
+	if (!blocks.empty()) {
+		double* p = blocks.back();
+		blocks.pop_back();
+		_arena.kept_doubles -= (size_t(1)<<k);
+		return p;
+	}
+	return _aligned_doubles(size_t(1)<<k);
+}
+
+void etk::arena_release(double* block, const size_t& n)
+{
+	if (!block) return;
+	size_t k = _arena_class(n);
+	if (k > _arena_max_class || _arena.free_blocks[k].size() >= _arena_keep
+		|| _arena.kept_doubles + (size_t(1)<<k) > _arena_keep_doubles) {
+		_free_doubles(block);
+		return;
+	}
+	_arena.free_blocks[k].push_back(block);
+	_arena.kept_doubles += (size_t(1)<<k);
+}
+
+
+/////// MARK: PUDDLE
 
 
 puddle::puddle(const unsigned& s)
@@ -47,7 +138,7 @@ puddle::puddle(const etk::puddle& that)
 puddle::~puddle()
 {
 	if (pool) {
-		delete [] pool;
+		arena_release(pool, siz);
 		pool = NULL;
 	}
 }
@@ -77,17 +168,14 @@ double* puddle::ptr(const unsigned& i)
 
 void puddle::resize(const unsigned& s, bool init)
 {
-	if (pool) delete [] pool;
+	if (pool) arena_release(pool, siz);
 	pool = NULL;
-	if (s) try {
-		pool = new double [s];
+	siz = 0;
+	if (s) {
+		pool = arena_acquire(s);
 		siz = s;
 		if (init) memset(pool, 0, s*sizeof(double));
 	}
-	SPOO {
-        pool = NULL;
-		OOPS("out of memory");
-    }
 }
 
 void puddle::initialize(const double& init)
@@ -105,7 +193,7 @@ void puddle::scale(const double& scal)
 
 void puddle::purge()
 {
-	if (pool) delete [] pool;
+	if (pool) arena_release(pool, siz);
 	pool = NULL;
 	siz = 0;
 }
@@ -469,7 +557,7 @@ void memarray_raw::operator= (const memarray_raw& that)
 void memarray_raw::operator= (const ndarray& that)
 {
 	if (siz != that.size()) {
-		resize(that.size(),false);
+		puddle::resize(that.size(),false);
 	}
 	memcpy(pool, that.ptr(), siz*sizeof(double));
 	rows=that.size1();
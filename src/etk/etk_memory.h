@@ -41,6 +41,19 @@
 
 namespace etk {
 
+	// Aligned blocks of doubles for working arrays that are never handed to
+	//  Python. Freed blocks are kept by the thread that frees them, in size
+	//  classes of powers of two, and given out again by the next acquire of
+	//  that class on the same thread, so a temporary made on every call or in
+	//  every workshop costs neither the Python allocator nor the lock around
+	//  it. arena_acquire returns a block of at least n doubles, which must be
+	//  given back to arena_release with the same n.
+	double* arena_acquire(const size_t& n);
+	void    arena_release(double* block, const size_t& n);
+
+	// The storage of a puddle (and so of a memarray_raw) comes from the arena.
+	//  An ndarray or symmetric_matrix still owns a numpy array, which Python
+	//  allocates.
 	class puddle { 
 	protected:
 		unsigned siz;
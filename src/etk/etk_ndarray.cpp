@@ -30,8 +30,11 @@ using namespace etk;
 #include <cmath>
 #include <climits>
 #include <cstring>
+#include <algorithm>
+#include <limits>
 
 #include "etk_arraymath.h"
+#include "etk_simd.h"
 
 #define ROWS PyArray_DIM(pool, 0)
 #define COLS (PyArray_NDIM(pool)>1 ? PyArray_DIM(pool, 1) : 1)
@@ -141,7 +144,7 @@ boosted::mutex ndarray::python_mutex;
 
 void ndarray::same_memory_as(ndarray& x)
 {
-	boosted::lock_guard<boosted::mutex> LOCK(etk::python_global_mutex);
+	etk::python_lock LOCK;
 	Py_CLEAR(pool);
 	pool = x.pool;
 	Py_XINCREF(pool);
@@ -149,7 +152,7 @@ void ndarray::same_memory_as(ndarray& x)
 
 void ndarray::same_ccontig_memory_as(ndarray& x)
 {
-	boosted::lock_guard<boosted::mutex> LOCK(etk::python_global_mutex);
+	etk::python_lock LOCK;
 	Py_CLEAR(pool);
 	pool = x.pool;
 	Py_XINCREF(pool);
@@ -190,7 +193,7 @@ inline void _inline_noop() {
 void ndarray::quick_new(const int& datatype, const char* arrayClass, const int& r,const int& c,const int& s)
 {
 	//boosted::lock_guard<boosted::mutex> pylock(python_mutex);
-	boosted::lock_guard<boosted::mutex> LOCK(etk::python_global_mutex);
+	etk::python_lock LOCK;
 	Py_CLEAR(pool);
 	npy_intp dims [3] = {r,c,s};
 	int ndims = 3;
@@ -269,6 +272,7 @@ ndarray::ndarray(const int& r,const int& c,const int& s, const char* arrayType)
 ndarray::ndarray(const ndarray& that, bool use_same_memory)
 : pool (nullptr)
 {
+	etk::python_lock LOCK;
 	if (use_same_memory) {
 		OOPS("cannot use same memory for const array");
 	} else {
@@ -289,6 +293,7 @@ ndarray::ndarray(const ndarray& that, bool use_same_memory)
 ndarray::ndarray(ndarray& that, bool use_same_memory)
 : pool (nullptr)
 {
+	etk::python_lock LOCK;
 	if (use_same_memory && that.pool) {
 		Py_INCREF(that.pool);
 		pool = that.pool;
@@ -309,12 +314,14 @@ ndarray::ndarray(ndarray& that, bool use_same_memory)
 
 ndarray::~ndarray()
 {
+	etk::python_lock LOCK;
 	Py_CLEAR(pool);
 }
 
 
 void ndarray::resize(const int& r)
 {
+	etk::python_lock LOCK;
 	if (!pool
 		|| PyArray_DESCR(pool)->type_num != NPY_DOUBLE
 		||	ndim() != 1
@@ -351,6 +358,7 @@ void ndarray::resize(const int& r,const int& c)
 
 void ndarray::resize(const int& r,const int& c,const int& s)
 {
+	etk::python_lock LOCK;
 	PyArrayObject* holdover = pool;
 	Py_XINCREF(holdover);
 
@@ -372,6 +380,7 @@ void ndarray::resize(const int& r,const int& c,const int& s)
 
 void ndarray::resize_int8(const int& r)
 {
+	etk::python_lock LOCK;
 	PyArrayObject* holdover = pool;
 	Py_XINCREF(holdover);
 
@@ -394,7 +403,7 @@ void ndarray::resize_int8(const int& r)
 
 void ndarray::resize_bool(const int& r)
 {
-
+	etk::python_lock LOCK;
 	PyArrayObject* holdover = pool;
 	Py_XINCREF(holdover);
 
@@ -437,6 +446,7 @@ void ndarray::resize_bool(const int& r,const int& c,const int& s)
 
 void ndarray::resize(ndarray& prototype)
 {
+	etk::python_lock LOCK;
 	Py_CLEAR(pool);
 	pool = (PyArrayObject*)PyArray_NewLikeArray(prototype.pool, NPY_CORDER, NULL, 1);
 	Py_INCREF(pool);
@@ -842,6 +852,7 @@ long long& ndarray::int64_at(const int& r, const int& c, const int& d)
 
 void ndarray::operator= (const ndarray& that)
 {
+	etk::python_lock LOCK;
 	if (!that.pool) OOPS("Error copying ndarray, source is null");
 	if (!pool || !PyArray_SAMESHAPE(pool, that.pool) || PyArray_DTYPE(pool)!=PyArray_DTYPE(that.pool) ) {
 		Py_CLEAR(pool);
@@ -854,6 +865,7 @@ void ndarray::operator= (const ndarray& that)
 }
 void ndarray::operator= (const symmetric_matrix& that)
 {
+	etk::python_lock LOCK;
 	if (!that.pool) OOPS("Error copying ndarray, source is null");
 	if (!pool || !PyArray_SAMESHAPE(pool, that.pool)) {
 		Py_CLEAR(pool);
@@ -907,33 +919,49 @@ bool ndarray::operator==(const ndarray& that) const
 	return !(memcmp(ptr(), that.ptr(), size()*PyArray_DESCR(pool)->elsize));
 }
 
+// Scale rows rowbegin to rowend-1 of in, over columns colbegin to colend-1 at
+//  depth x3, so each sums to one, and put them in out. A row whose sum is zero
+//  is left as it is. Rows are taken in blocks, transposed so that the rows of
+//  a block are scaled together by the vector kernel.
+static void _prob_scale_rows(ndarray* in, ndarray* out, size_t rowbegin, size_t rowend,
+							 size_t colbegin, size_t colend, size_t x3)
+{
+	const size_t block = 64;
+	const size_t m = colend-colbegin;
+	if (!m) return;
+	etk::simd::prob_scale_tile_t prob_scale_tile = etk::simd::prob_scale_tile();
+	std::vector<double> tile (m*block);
+	std::vector<double> sums (block);
+	for ( size_t first=rowbegin; first<rowend; first+=block ) {
+		size_t n = std::min(block, rowend-first);
+		for ( size_t x1=0; x1<n; x1++ ) {
+			for ( size_t k=0; k<m; k++ ) { tile[k*n+x1] = in->operator()(first+x1,colbegin+k,x3); }
+		}
+		prob_scale_tile(tile.data(), m, n, n, sums.data());
+		for ( size_t x1=0; x1<n; x1++ ) {
+			if (!sums[x1]) continue;
+			if (out==in) {
+				for ( size_t k=0; k<m; k++ ) { out->operator()(first+x1,colbegin+k,x3) = tile[k*n+x1]; }
+			} else {
+				for ( size_t k=0; k<m; k++ ) { out->operator()(first+x1,colbegin+k,x3) /= sums[x1]; }
+			}
+		}
+	}
+}
+
 void ndarray::prob_scale_2 (ndarray* out) {
 	ASSERT_ARRAY_DOUBLE;
 	if (out && out!=this) {
 		if ( !out->pool || !PyArray_SAMESHAPE(pool, out->pool) ) {
+			etk::python_lock LOCK;
 			Py_CLEAR(out->pool);
 			out->pool = (PyArrayObject*)PyArray_NewCopy((PyArrayObject*)pool, NPY_CORDER);
 			Py_INCREF(out->pool);
 		}
 	} else out = this;
-	unsigned x1, x2, x3; double temp;
-	if (PyArray_NDIM(pool)==3) {
-		for ( x1=0; x1<ROWS; x1++ ) {
-			for ( x3=0; x3<DEPS; x3++ ) {
-				temp = 0;
-				for ( x2=0; x2<COLS; x2++ ) { temp += this->operator()(x1,x2,x3); }
-				if (!temp) break;
-				for ( x2=0; x2<COLS; x2++ ) { out->operator()(x1,x2,x3) /= temp; }
-			}
-		}
-	} else if (PyArray_NDIM(pool)==2) {
-		for ( x1=0; x1<ROWS; x1++ ) {
-			{
-				temp = 0;
-				for ( x2=0; x2<COLS; x2++ ) { temp += this->operator()(x1,x2); }
-				if (!temp) break;
-				for ( x2=0; x2<COLS; x2++ ) { out->operator()(x1,x2) /= temp; }
-			}
+	if (PyArray_NDIM(pool)==3 || PyArray_NDIM(pool)==2) {
+		for ( size_t x3=0; x3<DEPS; x3++ ) {
+			_prob_scale_rows(this, out, 0, ROWS, 0, COLS, x3);
 		}
 	}
 }
@@ -942,34 +970,16 @@ void ndarray::sector_prob_scale_2 (const std::vector<unsigned>& sectors, ndarray
 	ASSERT_ARRAY_DOUBLE;
 	if (out && out!=this) {
 		if ( !out->pool || !PyArray_SAMESHAPE(pool, out->pool) ) {
+			etk::python_lock LOCK;
 			Py_CLEAR(out->pool);
 			out->pool = (PyArrayObject*)PyArray_NewCopy((PyArrayObject*)pool, NPY_CORDER);
 			Py_INCREF(out->pool);
 		}
 	} else out = this;
-	unsigned x1, x2, x3, i, sectorbegin, sectorend; double temp;
-	if (PyArray_NDIM(pool)==3) {
-		for ( x1=0; x1<ROWS; x1++ ) {
-			for ( x3=0; x3<DEPS; x3++ ) {
-				for (i=0; i<sectors.size()-1; i++) {
-					sectorbegin = sectors[i];
-					sectorend   = sectors[i+1];
-					temp = 0;
-					for ( x2=sectorbegin; x2<sectorend; x2++ ) { temp += this->operator()(x1,x2,x3); }
-					if (!temp) break;
-					for ( x2=sectorbegin; x2<sectorend; x2++ ) { out->operator()(x1,x2,x3) /= temp; }
-				}
-			}
-		}
-	} else if (PyArray_NDIM(pool)==2) {
-		for ( x1=0; x1<ROWS; x1++ ) {
-			for (i=0; i<sectors.size()-1; i++) {
-				sectorbegin = sectors[i];
-				sectorend   = sectors[i+1];
-				temp = 0;
-				for ( x2=sectorbegin; x2<sectorend; x2++ ) { temp += this->operator()(x1,x2); }
-				if (!temp) break;
-				for ( x2=sectorbegin; x2<sectorend; x2++ ) { out->operator()(x1,x2) /= temp; }
+	if (PyArray_NDIM(pool)==3 || PyArray_NDIM(pool)==2) {
+		for ( size_t x3=0; x3<DEPS; x3++ ) {
+			for ( size_t i=0; i+1<sectors.size(); i++ ) {
+				_prob_scale_rows(this, out, 0, ROWS, sectors[i], sectors[i+1], x3);
 			}
 		}
 	}
@@ -978,30 +988,10 @@ void ndarray::sector_prob_scale_2 (const std::vector<unsigned>& sectors, ndarray
 
 void ndarray::sector_prob_scale_2 (const std::vector<unsigned>& sectors, const unsigned& rowbegin, const unsigned& rowend) {
 	ASSERT_ARRAY_DOUBLE;
-	ndarray* out = this;
-	unsigned x1, x2, x3, i, sectorbegin, sectorend; double temp;
-	if (PyArray_NDIM(pool)==3) {
-		for ( x1=rowbegin; x1<rowend; x1++ ) {
-			for ( x3=0; x3<DEPS; x3++ ) {
-				for (i=0; i<sectors.size()-1; i++) {
-					sectorbegin = sectors[i];
-					sectorend   = sectors[i+1];
-					temp = 0;
-					for ( x2=sectorbegin; x2<sectorend; x2++ ) { temp += this->operator()(x1,x2,x3); }
-					if (!temp) break;
-					for ( x2=sectorbegin; x2<sectorend; x2++ ) { out->operator()(x1,x2,x3) /= temp; }
-				}
-			}
-		}
-	} else if (PyArray_NDIM(pool)==2) {
-		for ( x1=rowbegin; x1<rowend; x1++ ) {
-			for (i=0; i<sectors.size()-1; i++) {
-				sectorbegin = sectors[i];
-				sectorend   = sectors[i+1];
-				temp = 0;
-				for ( x2=sectorbegin; x2<sectorend; x2++ ) { temp += this->operator()(x1,x2); }
-				if (!temp) break;
-				for ( x2=sectorbegin; x2<sectorend; x2++ ) { out->operator()(x1,x2) /= temp; }
+	if (PyArray_NDIM(pool)==3 || PyArray_NDIM(pool)==2) {
+		for ( size_t x3=0; x3<DEPS; x3++ ) {
+			for ( size_t i=0; i+1<sectors.size(); i++ ) {
+				_prob_scale_rows(this, this, rowbegin, rowend, sectors[i], sectors[i+1], x3);
 			}
 		}
 	}
@@ -1015,6 +1005,7 @@ void ndarray::logsums_2 (ndarray* out) {
 		OOPS("cannot calculate logsums in place");
 	}
 	if ( !out->pool || PyArray_NDIM(out->pool)!=1 || PyArray_DIM(out->pool, 0)!=ROWS ) {
+		etk::python_lock LOCK;
 		Py_CLEAR(out->pool);
 		npy_intp dims [1] = {ROWS};
 
@@ -1041,6 +1032,7 @@ void ndarray::logsumexp_2 (ndarray* out, const size_t& siz1, const size_t& siz2)
 		OOPS("cannot calculate logsums in place");
 	}
 	if ( !out->pool || PyArray_NDIM(out->pool)!=1 || PyArray_DIM(out->pool, 0)!=ROWS ) {
+		etk::python_lock LOCK;
 		Py_CLEAR(out->pool);
 		npy_intp dims [1] = {ROWS};
 
@@ -1058,10 +1050,18 @@ void ndarray::logsumexp_2 (ndarray* out, const size_t& siz1, const size_t& siz2)
 //				out->operator()(x1) = ::log(temp);
 //			}
 //		}
-		ThreadPool::ParallelFor0((std::size_t)0, siz1, [&](size_t& x1){
-				double temp =0;
-				for ( unsigned x2=0; x2<siz2; x2++ ) { temp += ::exp(this->operator()(x1,x2)); }
-				out->operator()(x1) = ::log(temp);
+		// Rows are taken in blocks, transposed so that the rows of a block
+		//  are processed together by the vector logsum kernel.
+		const size_t block = 64;
+		etk::simd::logsum_tile_t logsum_tile = etk::simd::logsum_tile();
+		ThreadPool::ParallelFor0((std::size_t)0, (siz1+block-1)/block, [&](size_t& b){
+				size_t first = b*block;
+				size_t n = std::min(block, siz1-first);
+				std::vector<double> tile (siz2*n);
+				for ( size_t x1=0; x1<n; x1++ ) {
+					for ( size_t x2=0; x2<siz2; x2++ ) { tile[x2*n+x1] = this->operator()(first+x1,x2); }
+				}
+				logsum_tile(tile.data(), siz2, n, n, 1.0, &out->operator()(first));
 				} );
 	}
 }
@@ -1348,33 +1348,40 @@ void symmetric_matrix::copy_lowertriangle_to_uppertriangle()
 	}
 }
 
+// As in the former larch.linalg.general_inverse, a matrix with any eigenvalue
+//  smaller in magnitude than this is given a pseudo-inverse instead, in which
+//  eigenvalues no larger than the cutoff times the largest are dropped.
+#define PSEUDO_INVERSE_MIN_EIGENVALUE 0.001
+#define PSEUDO_INVERSE_CUTOFF (1e6*std::numeric_limits<double>::epsilon())
+
 void symmetric_matrix::inv(logging_service* msg_)
 {
 	ASSERT_ARRAY_DOUBLE;
 //	BUGGER_(msg_, "inv received matrix =\n" << printSquare() );
 	copy_uppertriangle_to_lowertriangle();
 //	BUGGER_(msg_, "inv symmetric-ized matrix =\n" << printSquare() );
-	PyObject* linalg = elm::elm_linalg_module; // PyImport_ImportModule("larch.linalg");
-	Py_XINCREF(linalg);
-	if (!linalg) {
-		OOPS("Failed to load larch.linalg");
-	}
-	PyObject* linalg_inv = PyObject_GetAttrString(linalg, "general_inverse");
-	if (!linalg_inv) {
-		Py_CLEAR(linalg);
-		OOPS("Failed to find larch.linalg.general_inverse");
-	}
-	PyObject* result = PyObject_CallFunctionObjArgs(linalg_inv, pool, NULL);
-	Py_CLEAR(linalg_inv);
-	Py_CLEAR(linalg);
-	if (!result) {
-		//OOPS_MATRIXINVERSE(this, "Failed to get inverse");
-		OOPS("Failed to get inverse");
+	int n = size1();
+	double* A = static_cast<double*>(PyArray_DATA(pool));
+	for (int i=0; i<n*n; i++) {
+		if (!isFinite(A[i])) OOPS("Failed to get inverse, nonfinite values in matrix");
+	}
+	double min_eigenvalue = etk::symmetric_min_abs_eigenvalue(A, n);
+	bool positive_definite = false;
+	double rcond = 0;
+	if (min_eigenvalue >= PSEUDO_INVERSE_MIN_EIGENVALUE) {
+		rcond = etk::symmetric_inverse(A, n, 0, &positive_definite);
+	}
+	if (rcond > 0) {
+		if (positive_definite) {
+			BUGGER_(msg_, "matrix inverse by Cholesky factorization, reciprocal condition number "<<rcond);
+		} else {
+			MONITOR_(msg_, "matrix is not positive definite, inverse by pivoted LDL' factorization, reciprocal condition number "<<rcond);
+		}
+	} else {
+		int kept = etk::symmetric_pseudo_inverse(A, n, PSEUDO_INVERSE_CUTOFF);
+		MONITOR_(msg_, "matrix is singular or nearly so (smallest eigenvalue magnitude "<<min_eigenvalue
+				 <<"), pseudo-inverse calculated from "<<kept<<" of "<<n<<" eigenvalues");
 	}
-	Py_CLEAR(pool);
-	pool = (PyArrayObject*)result;
-	Py_INCREF(pool);
-	Py_CLEAR(result);
 }
 
 void symmetric_matrix::inv_bonafide(logging_service* msg_)
@@ -1383,27 +1390,21 @@ void symmetric_matrix::inv_bonafide(logging_service* msg_)
 //	BUGGER_(msg_, "inv received matrix =\n" << printSquare() );
 	copy_uppertriangle_to_lowertriangle();
 //	BUGGER_(msg_, "inv symmetric-ized matrix =\n" << printSquare() );
-	PyObject* linalg = elm::elm_linalg_module; // PyImport_ImportModule("larch.linalg");
-	Py_XINCREF(linalg);
-	if (!linalg) {
-		OOPS("Failed to load larch.linalg");
-	}
-	PyObject* linalg_inv = PyObject_GetAttrString(linalg, "matrix_inverse");
-	if (!linalg_inv) {
-		Py_CLEAR(linalg);
-		OOPS("Failed to find larch.linalg.matrix_inverse");
-	}
-	PyObject* result = PyObject_CallFunctionObjArgs(linalg_inv, pool, NULL);
-	Py_CLEAR(linalg_inv);
-	Py_CLEAR(linalg);
-	if (!result) {
-		//OOPS_MATRIXINVERSE(this, "Failed to get inverse");
-		OOPS("Failed to get inverse");
+	int n = size1();
+	double* A = static_cast<double*>(PyArray_DATA(pool));
+	for (int i=0; i<n*n; i++) {
+		if (!isFinite(A[i])) OOPS("Failed to get inverse, nonfinite values in matrix");
+	}
+	bool positive_definite = false;
+	double rcond = etk::symmetric_inverse(A, n, 0, &positive_definite);
+	if (!(rcond > 0)) {
+		OOPS("Failed to get inverse, matrix is singular");
+	}
+	if (positive_definite) {
+		BUGGER_(msg_, "matrix inverse by Cholesky factorization, reciprocal condition number "<<rcond);
+	} else {
+		MONITOR_(msg_, "matrix is not positive definite, inverse by pivoted LDL' factorization, reciprocal condition number "<<rcond);
 	}
-	Py_CLEAR(pool);
-	pool = (PyArrayObject*)result;
-	Py_INCREF(pool);
-	Py_CLEAR(result);
 }
 
 void symmetric_matrix::initialize_identity()
@@ -1454,6 +1455,7 @@ void symmetric_matrix::operator= (memarray_raw& that)
 
 void symmetric_matrix::operator= (ndarray& that)
 {
+	etk::python_lock LOCK;
 	ASSERT_ARRAY_DOUBLE;
 	PyObject* that_pool = that.get_object();
 	if (!that_pool) {
@@ -1475,6 +1477,7 @@ void symmetric_matrix::operator= (ndarray& that)
 }
 void symmetric_matrix::operator= (const symmetric_matrix& that)
 {
+	etk::python_lock LOCK;
 	ASSERT_ARRAY_DOUBLE;
 	if (!that.pool) OOPS("Error copying ndarray, source is null");
 	if (!pool || !PyArray_SAMESHAPE(pool, that.pool)) {
@@ -1490,6 +1493,7 @@ void symmetric_matrix::operator= (const symmetric_matrix& that)
 
 void symmetric_matrix::resize(const int& r)
 {
+	etk::python_lock LOCK;
 	
 	if (!pool
 		|| PyArray_DESCR(pool)->type_num != NPY_DOUBLE
@@ -1522,6 +1526,7 @@ void symmetric_matrix::resize(const int& r)
 
 void symmetric_matrix::resize_nan(const int& r)
 {
+	etk::python_lock LOCK;
 	
 	if (!pool
 		|| PyArray_DESCR(pool)->type_num != NPY_DOUBLE
@@ -73,6 +73,9 @@ namespace etk {
 	// Constructor & Destructor
 	protected:
 		void quick_new(const int& datatype, const char* arrayClass, const int& r,const int& c=-1,const int& s=-1);
+		// Every ndarray is a numpy array from the start, created holding the
+		//  interpreter lock. Working arrays that never reach Python belong in
+		//  a puddle or memarray_raw, whose storage comes from the thread arena.
 	public:
 		ndarray(const char* arrayType, const int& datatype, const int& r, const int& c=-1, const int& s=-1);
 
@@ -89,12 +92,12 @@ namespace etk {
 		void initialize(const double& init=0);
 		void bool_initialize(const bool& init=false);
 		void int64_initialize(const long long& init);
-		void destroy() {Py_CLEAR(pool);}
+		void destroy() {etk::python_lock LOCK; Py_CLEAR(pool);}
 		void same_memory_as(ndarray&);
 		void same_ccontig_memory_as(ndarray& x);
 		
 	// Direct Access
-		PyObject*  get_object(bool incref=true) {if (incref) Py_XINCREF(pool); return (PyObject*)pool;}
+		PyObject*  get_object(bool incref=true) {etk::python_lock LOCK; if (incref) Py_XINCREF(pool); return (PyObject*)pool;}
 
 	// Unfiltered Access
 		double& operator[](const int& i);
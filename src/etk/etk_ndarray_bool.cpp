@@ -62,6 +62,7 @@ ndarray_bool::ndarray_bool(const int& r)
 : pool (nullptr)
 , flag (0)
 {
+	etk::python_lock LOCK;
 	npy_intp dims [1] = {r};
 	PyObject* subtype = get_array_type("Array");
 	pool = (PyArrayObject*)PyArray_New((PyTypeObject*)subtype, 1, &dims[0], NPY_BOOL, nullptr, nullptr, 0, 0, nullptr);
@@ -78,6 +79,7 @@ ndarray_bool::ndarray_bool(const int& r,const int& c)
 : pool (nullptr)
 , flag (0)
 {
+	etk::python_lock LOCK;
 	npy_intp dims [2] = {r,c};
 	PyObject* subtype = get_array_type("Array");
 	//pool = (PyArrayObject*)PyArray_ZEROS(2, &dims[0], NPY_DOUBLE, 0);
@@ -103,6 +105,7 @@ ndarray_bool::ndarray_bool(const int& r,const int& c,const int& s)
 : pool (nullptr)
 , flag (0)
 {
+	etk::python_lock LOCK;
 	npy_intp dims [3] = {r,c,s};
 	PyObject* subtype = get_array_type("Array");
 	//pool = (PyArrayObject*)PyArray_ZEROS(3, &dims[0], NPY_DOUBLE, 0);
@@ -126,12 +129,14 @@ ndarray_bool::ndarray_bool(const int& r,const int& c,const int& s)
 
 ndarray_bool::~ndarray_bool()
 {
+	etk::python_lock LOCK;
 	Py_CLEAR(pool);
 }
 
 
 void ndarray_bool::resize(const int& r)
 {
+	etk::python_lock LOCK;
 	Py_CLEAR(pool);
 	if (flag & ARRAY_SYMMETRIC) { resize(r,r); } else {
 		npy_intp dims [1] = {r};
@@ -143,6 +148,7 @@ void ndarray_bool::resize(const int& r)
 
 void ndarray_bool::resize(const int& r,const int& c)
 {
+	etk::python_lock LOCK;
 	Py_CLEAR(pool);
 	if (flag & ARRAY_SYMMETRIC && r!=c) OOPS("must be square to be symmetric");
 	npy_intp dims [2] = {r,c};
@@ -153,6 +159,7 @@ void ndarray_bool::resize(const int& r,const int& c)
 
 void ndarray_bool::resize(const int& r,const int& c,const int& s)
 {
+	etk::python_lock LOCK;
 	Py_CLEAR(pool);
 	npy_intp dims [3] = {r,c,s};
 	pool = (PyArrayObject*)PyArray_SimpleNew(3, &dims[0], NPY_BOOL);
@@ -271,6 +278,7 @@ bool& ndarray_bool::operator()(const int& r, const int& c, const int& d)
 
 void ndarray_bool::operator= (const ndarray_bool& that)
 {
+	etk::python_lock LOCK;
 	if (!that.pool) OOPS("Error copying ndarray_bool, source is null");
 	if (!pool || !PyArray_SAMESHAPE(pool, that.pool)) {
 		Py_CLEAR(pool);
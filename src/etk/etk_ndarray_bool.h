@@ -50,11 +50,11 @@ namespace etk {
 		ndarray_bool(PyObject* obj);
 		~ndarray_bool();
 		void initialize(const bool& init=0);
-		void destroy() {Py_CLEAR(pool);}
+		void destroy() {etk::python_lock LOCK; Py_CLEAR(pool);}
 		void make_symmetric() { flag |= ARRAY_SYMMETRIC; }
 		
 	// Direct Access
-		PyObject*  get_object() {Py_XINCREF(pool); return (PyObject*)pool;}
+		PyObject*  get_object() {etk::python_lock LOCK; Py_XINCREF(pool); return (PyObject*)pool;}
 
 	// Unfiltered Access
 		bool& operator[](const int& i);
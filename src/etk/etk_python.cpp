@@ -32,6 +32,51 @@
 
 boosted::mutex etk::python_global_mutex;
 
+thread_local etk::gil_context etk::this_gil_context = etk::gil_held;
+
+static thread_local unsigned _python_lock_depth = 0;
+
+etk::python_lock::python_lock()
+: _mode (gil_held)
+, _state ()
+{
+	if (_python_lock_depth++) return;
+	_mode = this_gil_context;
+	if (_mode==gil_released) {
+		_state = PyGILState_Ensure();
+	} else if (_mode==gil_held_task) {
+		python_global_mutex.lock();
+	}
+}
+
+etk::python_lock::~python_lock()
+{
+	if (_mode==gil_released) {
+		PyGILState_Release(_state);
+	} else if (_mode==gil_held_task) {
+		python_global_mutex.unlock();
+	}
+	_python_lock_depth--;
+}
+
+etk::gil_release::gil_release()
+: _saved (nullptr)
+, _previous (this_gil_context)
+{
+	// Only a thread running for a Python caller holds the lock to release
+	if (_previous!=gil_held || _python_lock_depth) return;
+	this_gil_context = gil_released;
+	_saved = PyEval_SaveThread();
+}
+
+etk::gil_release::~gil_release()
+{
+	if (_saved) {
+		PyEval_RestoreThread(_saved);
+	}
+	this_gil_context = _previous;
+}
+
 std::string etk::discovered_platform_description;
 int etk::number_of_cpu = 1;
 
@@ -171,6 +216,18 @@ int etk::py_add_to_dict(PyObject* d, const std::string& key, const std::vector<s
 	return success;
 }
 
+int etk::py_add_to_dict(PyObject* d, const std::string& key, const std::vector<int>& value)
+{
+	PyObject* item = PyList_New(value.size());
+	Py_ssize_t i=0;
+	for (auto j=value.begin(); j!=value.end(); j++, i++) {
+		PyList_SET_ITEM(item, i, PyInt_FromLong(long(*j)));
+	}
+	int success = PyDict_SetItemString(d,key.c_str(),item);
+	Py_CLEAR(item);
+	return success;
+}
+
 int etk::py_add_to_dict(PyObject* d, const std::string& key, const std::vector< std::chrono::time_point<std::chrono::high_resolution_clock> >& value)
 {
 	PyObject* item = PyList_New(value.size());
@@ -394,6 +451,35 @@ int etk::py_read_from_dict(PyObject* d, const std::string& key,  std::vector<std
 }
 
 
+int etk::py_read_from_dict(PyObject* d, const std::string& key,  std::vector<int>& value)
+{
+	int ret = 0;
+	PyObject* list = PyDict_GetItemString(d,key.c_str());
+	
+	if (list) {
+		value.clear();
+		
+		Py_ssize_t list_size = PyList_Size(list);
+		for (Py_ssize_t i=0; i<list_size; i++) {
+			PyObject* item = PyList_GetItem(list, i);
+			if (item) {
+				long v = PyInt_AsLong(item);
+				if (PyErr_Occurred()) {
+					ret = -1;
+					PyErr_Print();
+				} else {
+					value.push_back(int(v));
+				}
+			}
+		}
+	} else {
+		ret = PY_DICT_KEY_NOT_FOUND;
+	}
+	return ret;
+	
+}
+
+
 int etk::py_read_from_dict(PyObject* d, const std::string& key, std::vector< std::chrono::time_point<std::chrono::high_resolution_clock> >& value)
 {
 	int ret = 0;
@@ -464,6 +550,10 @@ void etk::larch_initialize(const std::string& platform)
 {
 //	std::cerr << "larch_initialize()\n";
 	_larch_init_;
+#if PY_VERSION_HEX < 0x03070000
+	// workshops may take the interpreter lock, see python_lock
+	PyEval_InitThreads();
+#endif
 	sqlite3_bonus_autoinit();
 	sqlite3_haversine_autoinit();
 	initialize_platform(platform);
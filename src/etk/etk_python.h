@@ -62,6 +62,7 @@ int py_add_to_dict(PyObject* d, const std::string& key, const unsigned& value);
 int py_add_to_dict(PyObject* d, const std::string& key, const unsigned long long& value);
 int py_add_to_dict(PyObject* d, const std::string& key, PyObject* value);
 int py_add_to_dict(PyObject* d, const std::string& key, const std::vector<std::string>& value);
+int py_add_to_dict(PyObject* d, const std::string& key, const std::vector<int>& value);
 int py_add_to_dict(PyObject* d, const std::string& key, const std::vector< std::chrono::time_point<std::chrono::high_resolution_clock> >& value);
 
 int py_copydict_from_dict(PyObject* d, const std::string& key, PyObject*& value);
@@ -74,9 +75,48 @@ int py_read_from_dict(PyObject* d, const std::string& key, bool& value);
 int py_read_from_dict(PyObject* d, const std::string& key, unsigned& value);
 int py_read_from_dict(PyObject* d, const std::string& key, unsigned long long& value);
 int py_read_from_dict(PyObject* d, const std::string& key, std::vector<std::string>& value);
+int py_read_from_dict(PyObject* d, const std::string& key, std::vector<int>& value);
 int py_read_from_dict(PyObject* d, const std::string& key, std::vector< std::chrono::time_point<std::chrono::high_resolution_clock> >& value);
 
 extern boosted::mutex python_global_mutex;
+
+
+// The Python global interpreter lock can be released around a long native
+//  computation with a gil_release, so that other Python threads can run in
+//  the meantime. Anything that might be called inside such a computation,
+//  on the releasing thread or in the workshops it dispatches, must hold a
+//  python_lock while it uses the Python API. This takes the interpreter lock
+//  back when it has been released; otherwise, in a workshop of a thread that
+//  kept the interpreter lock, it serializes on python_global_mutex as before.
+//  A python_lock within another on the same thread does nothing.
+enum gil_context {
+	gil_held      = 0, // called from Python, holding the interpreter lock
+	gil_held_task = 1, // a task submitted by a thread holding the interpreter lock
+	gil_released  = 2, // released by this thread, or by the submitter of this task
+};
+extern thread_local gil_context this_gil_context;
+
+class python_lock {
+	int _mode;
+	PyGILState_STATE _state;
+public:
+	python_lock();
+	~python_lock();
+	python_lock(const python_lock&) = delete;
+	python_lock& operator=(const python_lock&) = delete;
+};
+
+class gil_release {
+	PyThreadState* _saved;
+	gil_context _previous;
+public:
+	gil_release();
+	~gil_release();
+	gil_release(const gil_release&) = delete;
+	gil_release& operator=(const gil_release&) = delete;
+};
+
+
 extern std::string discovered_platform_description;
 extern int number_of_cpu;
 extern PyObject* pickle_module;
@@ -21,6 +21,8 @@
 
 #include "etk_random.h"
 #include "etk_exception.h"
+#include <cmath>
+#include <random>
 
 void etk::recallable::burn(const unsigned& n)
 {
@@ -118,6 +120,148 @@ double etk::halton::next()
 	return PreviousReturn;
 }
 
+// Joe and Kuo (2008), new-joe-kuo-6.21201: the degree s and the coefficients
+//  a of a primitive polynomial, and the initial direction numbers m, for each
+//  dimension after the first.
+static const unsigned _sobol_s[] = {1, 2, 3, 3, 4, 4, 5, 5, 5, 5, 5, 5, 6, 6, 6, 6, 6, 6, 7, 7};
+static const unsigned _sobol_a[] = {0, 1, 1, 2, 1, 4, 2, 4, 7,11,13,14, 1,13,16,19,22,25, 1, 4};
+static const unsigned _sobol_m[][7] = {
+	{1},
+	{1, 3},
+	{1, 3, 1},
+	{1, 1, 1},
+	{1, 1, 3, 3},
+	{1, 3, 5, 13},
+	{1, 1, 5, 5, 17},
+	{1, 1, 5, 5, 5},
+	{1, 1, 7, 11, 19},
+	{1, 1, 5, 1, 1},
+	{1, 1, 1, 3, 11},
+	{1, 3, 5, 5, 31},
+	{1, 3, 3, 9, 7, 49},
+	{1, 1, 1, 15, 21, 21},
+	{1, 3, 1, 13, 27, 49},
+	{1, 1, 1, 15, 7, 5},
+	{1, 3, 1, 15, 13, 25},
+	{1, 1, 5, 5, 19, 61},
+	{1, 3, 7, 11, 23, 15, 103},
+	{1, 3, 7, 13, 13, 15, 69},
+};
+
+const unsigned etk::sobol::max_dimension = 1 + sizeof(_sobol_s)/sizeof(_sobol_s[0]);
+
+static uint32_t _parity(uint32_t x)
+{
+	x ^= x >> 16;
+	x ^= x >> 8;
+	x ^= x >> 4;
+	x ^= x >> 2;
+	x ^= x >> 1;
+	return x & 1;
+}
+
+etk::sobol::sobol(const unsigned& dimension, const unsigned& seed)
+: shift (0)
+, state (0)
+, ticker (0)
+{
+	if (dimension >= max_dimension) {
+		OOPS("Sobol sequences are available for only ",max_dimension," dimensions");
+	}
+	
+	// Bit 31 of a direction number is the first binary digit of a point.
+	uint32_t v[32];
+	if (dimension==0) {
+		for (unsigned i=0; i<32; i++) {
+			v[i] = uint32_t(1) << (31-i);
+		}
+	} else {
+		const unsigned& s = _sobol_s[dimension-1];
+		const unsigned& a = _sobol_a[dimension-1];
+		const unsigned* m = _sobol_m[dimension-1];
+		for (unsigned i=0; i<32; i++) {
+			if (i<s) {
+				v[i] = uint32_t(m[i]) << (31-i);
+			} else {
+				v[i] = v[i-s] ^ (v[i-s] >> s);
+				for (unsigned k=1; k<s; k++) {
+					if ((a >> (s-1-k)) & 1) v[i] ^= v[i-k];
+				}
+			}
+		}
+	}
+	
+	// Each digit of a scrambled point is its own digit plus a random
+	//  combination of the digits before it; as this is linear, scrambling the
+	//  direction numbers scrambles every point.
+	std::seed_seq seeder {seed, dimension};
+	std::mt19937 engine (seeder);
+	uint32_t scramble[32];
+	for (unsigned j=0; j<32; j++) {
+		scramble[j] = uint32_t(1) << (31-j);
+		if (j) scramble[j] |= uint32_t(engine()) & (~uint32_t(0) << (32-j));
+	}
+	for (unsigned i=0; i<32; i++) {
+		direction[i] = 0;
+		for (unsigned j=0; j<32; j++) {
+			direction[i] |= _parity(v[i] & scramble[j]) << (31-j);
+		}
+	}
+	shift = uint32_t(engine());
+}
+
+double etk::sobol::next()
+{
+	uint32_t x = state ^ shift;
+	
+	// In Gray code order, each point differs from the one before it by the
+	//  direction number of the lowest zero bit of its predecessor's index.
+	unsigned c = 0;
+	while ((ticker >> c) & 1) c++;
+	if (c >= 32) OOPS("the Sobol sequence is exhausted");
+	state ^= direction[c];
+	ticker++;
+	
+	return (double(x) + 0.5) / 4294967296.0;
+}
+
+
+double etk::normal_quantile(const double& p)
+{
+	if (!(p > 0 && p < 1)) {
+		OOPS("the normal quantile is defined for probabilities between 0 and 1, not ",p);
+	}
+	
+	// Acklam's rational approximation, refined by one step of Halley's method.
+	static const double a[] = {-3.969683028665376e+01,  2.209460984245205e+02, -2.759285104469687e+02,
+	                            1.383577518672690e+02, -3.066479806614716e+01,  2.506628277459239e+00};
+	static const double b[] = {-5.447609879822406e+01,  1.615858368580409e+02, -1.556989798598866e+02,
+	                            6.680131188771972e+01, -1.328068155288572e+01};
+	static const double c[] = {-7.784894002430293e-03, -3.223964580411365e-01, -2.400758277161838e+00,
+	                           -2.549732539343734e+00,  4.374664141464968e+00,  2.938163982698783e+00};
+	static const double d[] = { 7.784695709041462e-03,  3.224671290700398e-01,  2.445134137142996e+00,
+	                            3.754408661907416e+00};
+	static const double p_low = 0.02425;
+	
+	double x, q, r;
+	if (p < p_low) {
+		q = sqrt(-2*log(p));
+		x = (((((c[0]*q+c[1])*q+c[2])*q+c[3])*q+c[4])*q+c[5]) / ((((d[0]*q+d[1])*q+d[2])*q+d[3])*q+1);
+	} else if (p <= 1-p_low) {
+		q = p-0.5;
+		r = q*q;
+		x = (((((a[0]*r+a[1])*r+a[2])*r+a[3])*r+a[4])*r+a[5])*q / (((((b[0]*r+b[1])*r+b[2])*r+b[3])*r+b[4])*r+1);
+	} else {
+		q = sqrt(-2*log(1-p));
+		x = -(((((c[0]*q+c[1])*q+c[2])*q+c[3])*q+c[4])*q+c[5]) / ((((d[0]*q+d[1])*q+d[2])*q+d[3])*q+1);
+	}
+	
+	double e = 0.5 * erfc(-x/sqrt(2.0)) - p;
+	double u = e * 2.5066282746310002 * exp(x*x/2); // sqrt(2 pi)
+	return x - u/(1 + x*u/2);
+}
+
+
 const unsigned& etk::prime (const unsigned& n)
 {				 
 	static const unsigned 
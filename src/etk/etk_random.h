@@ -24,6 +24,7 @@
 
 #include <vector>
 #include <map>
+#include <cstdint>
 #include <stdlib.h>
 
 #ifndef __APPLE__
@@ -69,6 +70,27 @@ namespace etk {
 		virtual ~halton() { }
 	};
 	
+	// The Sobol sequence in one dimension, using the direction numbers of Joe
+	//  and Kuo for dimensions after the first. The points are scrambled with a
+	//  random linear matrix scramble and a random digital shift drawn from the
+	//  seed, which keeps the low discrepancy of the sequence, and no point is
+	//  exactly 0 or 1.
+	class sobol: public recallable {
+		uint32_t direction[32];
+		uint32_t shift;
+		uint32_t state;
+		unsigned ticker;
+	public:
+		virtual double next();
+		sobol(const unsigned& dimension, const unsigned& seed=0);
+		virtual ~sobol() { }
+		
+		static const unsigned max_dimension;
+	};
+	
+	double normal_quantile(const double& p);
+	// The inverse of the standard normal distribution function, for p in (0,1).
+	
 	const unsigned& prime (const unsigned& n);
 	
 	template <class T>
@@ -0,0 +1,607 @@
+/*
+ *  etk_simd.cpp
+ *
+ *  Copyright 2007-2017 Jeffrey Newman
+ *
+ *  Larch is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Larch is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with Larch.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <cmath>
+#include <cstring>
+#include <atomic>
+#include <limits>
+#include "etk_simd.h"
+
+#ifdef ETK_SIMD_X86
+# include <immintrin.h>
+# define ETK_TARGET_AVX2   __attribute__((target("avx2,fma")))
+# define ETK_TARGET_AVX512 __attribute__((target("avx512f")))
+#endif // def ETK_SIMD_X86
+
+
+static std::atomic<int> _isa_limit (etk::simd::isa_avx512);
+
+static etk::simd::isa_t _detect_isa()
+{
+	#ifdef ETK_SIMD_X86
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx512f")) return etk::simd::isa_avx512;
+	if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma")) return etk::simd::isa_avx2;
+	#endif // def ETK_SIMD_X86
+	return etk::simd::isa_scalar;
+}
+
+etk::simd::isa_t etk::simd::best_isa()
+{
+	static const isa_t detected = _detect_isa();
+	int limit = _isa_limit.load();
+	return (detected < limit) ? detected : isa_t(limit);
+}
+
+void etk::simd::limit_isa(isa_t limit)
+{
+	_isa_limit.store(limit);
+}
+
+const char* etk::simd::isa_name(isa_t isa)
+{
+	switch (isa) {
+		case isa_avx512: return "avx512";
+		case isa_avx2:   return "avx2";
+		default:         return "scalar";
+	}
+}
+
+etk::simd::masked_logit_row_t etk::simd::masked_logit_row()
+{
+	switch (best_isa()) {
+		#ifdef ETK_SIMD_X86
+		case isa_avx512: return &masked_logit_row_avx512;
+		case isa_avx2:   return &masked_logit_row_avx2;
+		#endif // def ETK_SIMD_X86
+		default:         return &masked_logit_row_scalar;
+	}
+}
+
+
+etk::simd::mixed_gemv_t etk::simd::mixed_gemv()
+{
+	switch (best_isa()) {
+		#ifdef ETK_SIMD_X86
+		case isa_avx512:
+		case isa_avx2:   return &mixed_gemv_avx2;
+		#endif // def ETK_SIMD_X86
+		default:         return &mixed_gemv_scalar;
+	}
+}
+
+
+
+etk::simd::logsum_tile_t etk::simd::logsum_tile()
+{
+	switch (best_isa()) {
+		#ifdef ETK_SIMD_X86
+		case isa_avx512:
+		case isa_avx2:   return &logsum_tile_avx2;
+		#endif // def ETK_SIMD_X86
+		default:         return &logsum_tile_scalar;
+	}
+}
+
+
+
+etk::simd::prob_scale_tile_t etk::simd::prob_scale_tile()
+{
+	switch (best_isa()) {
+		#ifdef ETK_SIMD_X86
+		case isa_avx512:
+		case isa_avx2:   return &prob_scale_tile_avx2;
+		#endif // def ETK_SIMD_X86
+		default:         return &prob_scale_tile_scalar;
+	}
+}
+
+
+
+void etk::simd::logsum_tile_scalar(const double* x, size_t m, size_t n, size_t ld, double mu, double* out)
+{
+	for (size_t c=0; c<n; c++) {
+		double max = -INFINITY;
+		for (size_t k=0; k<m; k++) {
+			if (x[k*ld+c] > max) max = x[k*ld+c];
+		}
+		if (mu == 0) {
+			out[c] = max;
+			continue;
+		}
+		if (max == -INFINITY) max = 0;
+		max /= mu;
+		double sum = 0.0;
+		for (size_t k=0; k<m; k++) {
+			if (x[k*ld+c] == -INFINITY) continue;
+			sum += ::exp(x[k*ld+c]/mu - max);
+		}
+		out[c] = sum ? (::log(sum) + max) * mu : -INFINITY;
+	}
+}
+
+
+void etk::simd::prob_scale_tile_scalar(double* x, size_t m, size_t n, size_t ld, double* sums)
+{
+	for (size_t c=0; c<n; c++) {
+		double sum = 0.0;
+		for (size_t k=0; k<m; k++) {
+			sum += x[k*ld+c];
+		}
+		sums[c] = sum;
+		if (!sum) continue;
+		for (size_t k=0; k<m; k++) {
+			x[k*ld+c] /= sum;
+		}
+	}
+}
+
+
+double etk::simd::masked_logit_row_scalar(double* u, const bool* av, const double* ch, size_t n, double& caseloglike)
+{
+	double sum_prob = 0.0;
+	double sum_choice = 0.0;
+	caseloglike = 0.0;
+	double shifter = 0.0;
+	double min_av_utility = INFINITY;
+	double max_av_utility = -INFINITY;
+	for (size_t a=0; a<n; a++) {
+		if (av[a]) {
+			if (u[a] > max_av_utility) max_av_utility = u[a];
+			if (u[a] < min_av_utility) min_av_utility = u[a];
+		}
+	}
+	if (max_av_utility>700 || min_av_utility<-700) {
+		shifter = 700-max_av_utility;
+	}
+	for (size_t a=0; a<n; a++) {
+		if (!av[a]) {
+			u[a] = 0.0;
+		} else {
+			u[a] += shifter;
+			if (ch[a]) {
+				caseloglike += u[a] * ch[a];
+				sum_choice += ch[a];
+			}
+			u[a] = ::exp(u[a]);
+			sum_prob += u[a];
+		}
+	}
+	double logsum = ::log(sum_prob);
+	if (sum_prob) {
+		for (size_t a=0; a<n; a++) {
+			u[a] /= sum_prob;
+		}
+		if (sum_choice) {
+			caseloglike -= logsum * sum_choice;
+		}
+	}
+	return logsum;
+}
+
+
+
+void etk::simd::mixed_gemv_scalar(size_t m, size_t n, double alpha, const float* A, size_t lda,
+                                  const double* x, double beta, double* y, size_t incy)
+{
+	for (size_t i=0; i<m; i++) {
+		const float* row = A + i*lda;
+		double sum = 0.0;
+		for (size_t j=0; j<n; j++) {
+			sum += double(row[j]) * x[j];
+		}
+		double* yi = y + i*incy;
+		*yi = beta ? (alpha*sum + beta*(*yi)) : alpha*sum;
+	}
+}
+
+void etk::simd::mixed_gemm(size_t m, size_t n, size_t k, double alpha, const float* A, size_t lda,
+                           const double* B, size_t ldb, double beta, double* C, size_t ldc)
+{
+	for (size_t i=0; i<m; i++) {
+		double* ci = C + i*ldc;
+		if (beta==0) {
+			for (size_t j=0; j<n; j++) ci[j] = 0.0;
+		} else if (beta!=1) {
+			for (size_t j=0; j<n; j++) ci[j] *= beta;
+		}
+		const float* ai = A + i*lda;
+		for (size_t p=0; p<k; p++) {
+			double a = alpha * double(ai[p]);
+			const double* bp = B + p*ldb;
+			for (size_t j=0; j<n; j++) {
+				ci[j] += a * bp[j];
+			}
+		}
+	}
+}
+
+
+
+#ifdef ETK_SIMD_X86
+
+// Arguments outside this range (or NaN) are sent to the scalar exp, so the
+// vector exp never has to deal with overflow, underflow or subnormals.
+#define ETK_SIMD_EXP_LO -708.0
+#define ETK_SIMD_EXP_HI  709.0
+
+// exp(x) = 2^n * exp(r), with n = round(x/ln2) and |r| <= ln2/2. ln2 is split
+// in two so n*ln2_hi is exact, and exp(r) is its Taylor series to degree 13,
+// which is within rounding error of double precision on that interval.
+static const double _exp_ln2_hi = 6.93145751953125E-1;
+static const double _exp_ln2_lo = 1.42860682030941723212E-6;
+static const double _exp_log2e  = 1.4426950408889634073599;
+static const double _exp_taylor[14] = {
+	1.0/6227020800.0, 1.0/479001600.0, 1.0/39916800.0, 1.0/3628800.0,
+	1.0/362880.0, 1.0/40320.0, 1.0/5040.0, 1.0/720.0, 1.0/120.0, 1.0/24.0,
+	1.0/6.0, 1.0/2.0, 1.0, 1.0,
+};
+
+
+
+ETK_TARGET_AVX2
+static inline __m256d _exp_avx2(__m256d x)
+{
+	__m256d n = _mm256_round_pd(_mm256_mul_pd(x, _mm256_set1_pd(_exp_log2e)), _MM_FROUND_TO_NEAREST_INT|_MM_FROUND_NO_EXC);
+	__m256d r = _mm256_fnmadd_pd(n, _mm256_set1_pd(_exp_ln2_hi), x);
+	r = _mm256_fnmadd_pd(n, _mm256_set1_pd(_exp_ln2_lo), r);
+	__m256d p = _mm256_set1_pd(_exp_taylor[0]);
+	for (int k=1; k<14; k++) {
+		p = _mm256_fmadd_pd(p, r, _mm256_set1_pd(_exp_taylor[k]));
+	}
+	__m256i n64 = _mm256_cvtepi32_epi64(_mm256_cvtpd_epi32(n));
+	__m256i scale = _mm256_slli_epi64(_mm256_add_epi64(n64, _mm256_set1_epi64x(1023)), 52);
+	return _mm256_mul_pd(p, _mm256_castsi256_pd(scale));
+}
+
+// All-ones lanes where the four bools at av are true
+ETK_TARGET_AVX2
+static inline __m256d _avail_mask_avx2(const bool* av)
+{
+	int bytes;
+	memcpy(&bytes, av, 4);
+	__m256i wide = _mm256_cvtepu8_epi64(_mm_cvtsi32_si128(bytes));
+	__m256i unavail = _mm256_cmpeq_epi64(wide, _mm256_setzero_si256());
+	return _mm256_castsi256_pd(_mm256_xor_si256(unavail, _mm256_set1_epi64x(-1)));
+}
+
+ETK_TARGET_AVX2
+static inline double _hsum_avx2(__m256d v)
+{
+	__m128d s = _mm_add_pd(_mm256_castpd256_pd128(v), _mm256_extractf128_pd(v, 1));
+	return _mm_cvtsd_f64(_mm_add_sd(s, _mm_unpackhi_pd(s, s)));
+}
+
+ETK_TARGET_AVX2
+double etk::simd::masked_logit_row_avx2(double* u, const bool* av, const double* ch, size_t n, double& caseloglike)
+{
+	const size_t nv = n - (n % 4);
+	size_t a;
+
+	// Masked max and min of available utilities. Candidates go in the first
+	// operand, so a NaN utility is passed over, as in the scalar kernel.
+	__m256d vmax = _mm256_set1_pd(-INFINITY);
+	__m256d vmin = _mm256_set1_pd(INFINITY);
+	for (a=0; a<nv; a+=4) {
+		__m256d m = _avail_mask_avx2(av+a);
+		__m256d x = _mm256_loadu_pd(u+a);
+		vmax = _mm256_max_pd(_mm256_blendv_pd(vmax, x, m), vmax);
+		vmin = _mm256_min_pd(_mm256_blendv_pd(vmin, x, m), vmin);
+	}
+	double buf[4];
+	double max_av_utility = -INFINITY;
+	double min_av_utility = INFINITY;
+	_mm256_storeu_pd(buf, vmax);
+	for (int i=0; i<4; i++) if (buf[i] > max_av_utility) max_av_utility = buf[i];
+	_mm256_storeu_pd(buf, vmin);
+	for (int i=0; i<4; i++) if (buf[i] < min_av_utility) min_av_utility = buf[i];
+	for (a=nv; a<n; a++) {
+		if (av[a]) {
+			if (u[a] > max_av_utility) max_av_utility = u[a];
+			if (u[a] < min_av_utility) min_av_utility = u[a];
+		}
+	}
+	double shifter = 0.0;
+	if (max_av_utility>700 || min_av_utility<-700) {
+		shifter = 700-max_av_utility;
+	}
+
+	// Shift, accumulate the chosen utilities, exponentiate and sum
+	__m256d vshift = _mm256_set1_pd(shifter);
+	__m256d vzero = _mm256_setzero_pd();
+	__m256d vlo = _mm256_set1_pd(ETK_SIMD_EXP_LO);
+	__m256d vhi = _mm256_set1_pd(ETK_SIMD_EXP_HI);
+	__m256d vcll = vzero;
+	__m256d vsum_choice = vzero;
+	__m256d vsum_prob = vzero;
+	for (a=0; a<nv; a+=4) {
+		__m256d m = _avail_mask_avx2(av+a);
+		__m256d x = _mm256_add_pd(_mm256_loadu_pd(u+a), vshift);
+		__m256d c = _mm256_loadu_pd(ch+a);
+		__m256d chosen = _mm256_and_pd(m, _mm256_cmp_pd(c, vzero, _CMP_NEQ_UQ));
+		vcll = _mm256_add_pd(vcll, _mm256_and_pd(chosen, _mm256_mul_pd(x, c)));
+		vsum_choice = _mm256_add_pd(vsum_choice, _mm256_and_pd(chosen, c));
+		__m256d e = _exp_avx2(x);
+		__m256d in_range = _mm256_and_pd(_mm256_cmp_pd(x, vlo, _CMP_GE_OQ), _mm256_cmp_pd(x, vhi, _CMP_LE_OQ));
+		int outliers = _mm256_movemask_pd(_mm256_andnot_pd(in_range, m));
+		if (outliers) {
+			_mm256_storeu_pd(buf, e);
+			double xs[4];
+			_mm256_storeu_pd(xs, x);
+			for (int i=0; i<4; i++) if (outliers & (1<<i)) buf[i] = ::exp(xs[i]);
+			e = _mm256_loadu_pd(buf);
+		}
+		e = _mm256_and_pd(m, e);
+		_mm256_storeu_pd(u+a, e);
+		vsum_prob = _mm256_add_pd(vsum_prob, e);
+	}
+	caseloglike = _hsum_avx2(vcll);
+	double sum_choice = _hsum_avx2(vsum_choice);
+	double sum_prob = _hsum_avx2(vsum_prob);
+	for (a=nv; a<n; a++) {
+		if (!av[a]) {
+			u[a] = 0.0;
+		} else {
+			u[a] += shifter;
+			if (ch[a]) {
+				caseloglike += u[a] * ch[a];
+				sum_choice += ch[a];
+			}
+			u[a] = ::exp(u[a]);
+			sum_prob += u[a];
+		}
+	}
+
+	// Normalize
+	double logsum = ::log(sum_prob);
+	if (sum_prob) {
+		__m256d vdenom = _mm256_set1_pd(sum_prob);
+		for (a=0; a<nv; a+=4) {
+			_mm256_storeu_pd(u+a, _mm256_div_pd(_mm256_loadu_pd(u+a), vdenom));
+		}
+		for (a=nv; a<n; a++) {
+			u[a] /= sum_prob;
+		}
+		if (sum_choice) {
+			caseloglike -= logsum * sum_choice;
+		}
+	}
+	return logsum;
+}
+
+
+
+ETK_TARGET_AVX2
+void etk::simd::mixed_gemv_avx2(size_t m, size_t n, double alpha, const float* A, size_t lda,
+                                const double* x, double beta, double* y, size_t incy)
+{
+	const size_t nv = n - (n % 4);
+	for (size_t i=0; i<m; i++) {
+		const float* row = A + i*lda;
+		__m256d acc = _mm256_setzero_pd();
+		size_t j;
+		for (j=0; j<nv; j+=4) {
+			__m256d a = _mm256_cvtps_pd(_mm_loadu_ps(row+j));
+			acc = _mm256_fmadd_pd(a, _mm256_loadu_pd(x+j), acc);
+		}
+		double sum = _hsum_avx2(acc);
+		for (; j<n; j++) {
+			sum += double(row[j]) * x[j];
+		}
+		double* yi = y + i*incy;
+		*yi = beta ? (alpha*sum + beta*(*yi)) : alpha*sum;
+	}
+}
+
+
+
+ETK_TARGET_AVX2
+void etk::simd::logsum_tile_avx2(const double* x, size_t m, size_t n, size_t ld, double mu, double* out)
+{
+	if (mu == 0) {
+		logsum_tile_scalar(x, m, n, ld, mu, out);
+		return;
+	}
+	const __m256d vmu = _mm256_set1_pd(mu);
+	const __m256d vneginf = _mm256_set1_pd(-INFINITY);
+	const __m256d vzero = _mm256_setzero_pd();
+	const __m256d vlo = _mm256_set1_pd(ETK_SIMD_EXP_LO);
+	const __m256d vhi = _mm256_set1_pd(ETK_SIMD_EXP_HI);
+	double sums[4], shifts[4];
+	size_t c;
+	for (c=0; c+4<=n; c+=4) {
+		// Largest value of each case; a NaN candidate is passed over, as in
+		// the scalar kernel.
+		__m256d vmax = vneginf;
+		for (size_t k=0; k<m; k++) {
+			vmax = _mm256_max_pd(_mm256_loadu_pd(x+k*ld+c), vmax);
+		}
+		vmax = _mm256_blendv_pd(vmax, vzero, _mm256_cmp_pd(vmax, vneginf, _CMP_EQ_OQ));
+		__m256d vshift = _mm256_div_pd(vmax, vmu);
+		
+		// Shifted arguments are at most zero, unless mu is negative or there
+		// is a NaN; those cases are left to the scalar kernel. Arguments below
+		// the vector exp range, including -inf, contribute nothing.
+		__m256d vsum = vzero;
+		int outliers = 0;
+		for (size_t k=0; k<m; k++) {
+			__m256d a = _mm256_sub_pd(_mm256_div_pd(_mm256_loadu_pd(x+k*ld+c), vmu), vshift);
+			outliers |= _mm256_movemask_pd(_mm256_cmp_pd(a, vhi, _CMP_NLE_UQ));
+			__m256d e = _exp_avx2(_mm256_max_pd(a, vlo));
+			vsum = _mm256_add_pd(vsum, _mm256_and_pd(_mm256_cmp_pd(a, vlo, _CMP_GE_OQ), e));
+		}
+		if (outliers) {
+			logsum_tile_scalar(x+c, m, 4, ld, mu, out+c);
+			continue;
+		}
+		_mm256_storeu_pd(sums, vsum);
+		_mm256_storeu_pd(shifts, vshift);
+		for (int i=0; i<4; i++) {
+			out[c+i] = sums[i] ? (::log(sums[i]) + shifts[i]) * mu : -INFINITY;
+		}
+	}
+	if (c<n) {
+		logsum_tile_scalar(x+c, m, n-c, ld, mu, out+c);
+	}
+}
+
+
+
+ETK_TARGET_AVX2
+void etk::simd::prob_scale_tile_avx2(double* x, size_t m, size_t n, size_t ld, double* sums)
+{
+	const __m256d vzero = _mm256_setzero_pd();
+	size_t c;
+	for (c=0; c+4<=n; c+=4) {
+		__m256d vsum = vzero;
+		for (size_t k=0; k<m; k++) {
+			vsum = _mm256_add_pd(vsum, _mm256_loadu_pd(x+k*ld+c));
+		}
+		_mm256_storeu_pd(sums+c, vsum);
+		// A NaN sum is not zero, so it is spread over the case as in the
+		// scalar kernel.
+		__m256d nonzero = _mm256_cmp_pd(vsum, vzero, _CMP_NEQ_UQ);
+		if (!_mm256_movemask_pd(nonzero)) continue;
+		for (size_t k=0; k<m; k++) {
+			__m256d v = _mm256_loadu_pd(x+k*ld+c);
+			_mm256_storeu_pd(x+k*ld+c, _mm256_blendv_pd(v, _mm256_div_pd(v, vsum), nonzero));
+		}
+	}
+	if (c<n) {
+		prob_scale_tile_scalar(x+c, m, n-c, ld, sums+c);
+	}
+}
+
+
+
+ETK_TARGET_AVX512
+static inline __m512d _exp_avx512(__m512d x)
+{
+	__m512d n = _mm512_roundscale_pd(_mm512_mul_pd(x, _mm512_set1_pd(_exp_log2e)), _MM_FROUND_TO_NEAREST_INT|_MM_FROUND_NO_EXC);
+	__m512d r = _mm512_fnmadd_pd(n, _mm512_set1_pd(_exp_ln2_hi), x);
+	r = _mm512_fnmadd_pd(n, _mm512_set1_pd(_exp_ln2_lo), r);
+	__m512d p = _mm512_set1_pd(_exp_taylor[0]);
+	for (int k=1; k<14; k++) {
+		p = _mm512_fmadd_pd(p, r, _mm512_set1_pd(_exp_taylor[k]));
+	}
+	return _mm512_scalef_pd(p, n);
+}
+
+// Lane mask where the eight bools at av are true
+ETK_TARGET_AVX512
+static inline __mmask8 _avail_mask_avx512(const bool* av)
+{
+	__m512i wide = _mm512_cvtepu8_epi64(_mm_loadl_epi64((const __m128i*)av));
+	return _mm512_test_epi64_mask(wide, wide);
+}
+
+ETK_TARGET_AVX512
+double etk::simd::masked_logit_row_avx512(double* u, const bool* av, const double* ch, size_t n, double& caseloglike)
+{
+	const size_t nv = n - (n % 8);
+	size_t a;
+
+	// Masked max and min of available utilities
+	__m512d vmax = _mm512_set1_pd(-INFINITY);
+	__m512d vmin = _mm512_set1_pd(INFINITY);
+	for (a=0; a<nv; a+=8) {
+		__mmask8 m = _avail_mask_avx512(av+a);
+		__m512d x = _mm512_loadu_pd(u+a);
+		vmax = _mm512_mask_max_pd(vmax, m, x, vmax);
+		vmin = _mm512_mask_min_pd(vmin, m, x, vmin);
+	}
+	double max_av_utility = _mm512_reduce_max_pd(vmax);
+	double min_av_utility = _mm512_reduce_min_pd(vmin);
+	for (a=nv; a<n; a++) {
+		if (av[a]) {
+			if (u[a] > max_av_utility) max_av_utility = u[a];
+			if (u[a] < min_av_utility) min_av_utility = u[a];
+		}
+	}
+	double shifter = 0.0;
+	if (max_av_utility>700 || min_av_utility<-700) {
+		shifter = 700-max_av_utility;
+	}
+
+	// Shift, accumulate the chosen utilities, exponentiate and sum
+	__m512d vshift = _mm512_set1_pd(shifter);
+	__m512d vzero = _mm512_setzero_pd();
+	__m512d vlo = _mm512_set1_pd(ETK_SIMD_EXP_LO);
+	__m512d vhi = _mm512_set1_pd(ETK_SIMD_EXP_HI);
+	__m512d vcll = vzero;
+	__m512d vsum_choice = vzero;
+	__m512d vsum_prob = vzero;
+	double buf[8];
+	double xs[8];
+	for (a=0; a<nv; a+=8) {
+		__mmask8 m = _avail_mask_avx512(av+a);
+		__m512d x = _mm512_add_pd(_mm512_loadu_pd(u+a), vshift);
+		__m512d c = _mm512_loadu_pd(ch+a);
+		__mmask8 chosen = _mm512_mask_cmp_pd_mask(m, c, vzero, _CMP_NEQ_UQ);
+		vcll = _mm512_mask_add_pd(vcll, chosen, vcll, _mm512_mul_pd(x, c));
+		vsum_choice = _mm512_mask_add_pd(vsum_choice, chosen, vsum_choice, c);
+		__m512d e = _exp_avx512(x);
+		__mmask8 in_range = _mm512_cmp_pd_mask(x, vlo, _CMP_GE_OQ) & _mm512_cmp_pd_mask(x, vhi, _CMP_LE_OQ);
+		__mmask8 outliers = m & ~in_range;
+		if (outliers) {
+			_mm512_storeu_pd(buf, e);
+			_mm512_storeu_pd(xs, x);
+			for (int i=0; i<8; i++) if (outliers & (1<<i)) buf[i] = ::exp(xs[i]);
+			e = _mm512_loadu_pd(buf);
+		}
+		e = _mm512_maskz_mov_pd(m, e);
+		_mm512_storeu_pd(u+a, e);
+		vsum_prob = _mm512_add_pd(vsum_prob, e);
+	}
+	caseloglike = _mm512_reduce_add_pd(vcll);
+	double sum_choice = _mm512_reduce_add_pd(vsum_choice);
+	double sum_prob = _mm512_reduce_add_pd(vsum_prob);
+	for (a=nv; a<n; a++) {
+		if (!av[a]) {
+			u[a] = 0.0;
+		} else {
+			u[a] += shifter;
+			if (ch[a]) {
+				caseloglike += u[a] * ch[a];
+				sum_choice += ch[a];
+			}
+			u[a] = ::exp(u[a]);
+			sum_prob += u[a];
+		}
+	}
+
+	// Normalize
+	double logsum = ::log(sum_prob);
+	if (sum_prob) {
+		__m512d vdenom = _mm512_set1_pd(sum_prob);
+		for (a=0; a<nv; a+=8) {
+			_mm512_storeu_pd(u+a, _mm512_div_pd(_mm512_loadu_pd(u+a), vdenom));
+		}
+		for (a=nv; a<n; a++) {
+			u[a] /= sum_prob;
+		}
+		if (sum_choice) {
+			caseloglike -= logsum * sum_choice;
+		}
+	}
+	return logsum;
+}
+
+#endif // def ETK_SIMD_X86
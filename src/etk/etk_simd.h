@@ -0,0 +1,139 @@
+/*
+ *  etk_simd.h
+ *
+ *  Copyright 2007-2017 Jeffrey Newman
+ *
+ *  Larch is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Larch is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with Larch.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef __TOOLBOX_SIMD__
+#define __TOOLBOX_SIMD__
+
+#include <cstddef>
+
+// Vector kernels are compiled with per-function target attributes, so the
+// library as a whole needs no special compiler flags, and the instruction set
+// is chosen when the program runs.
+#if (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+# define ETK_SIMD_X86 1
+#endif
+
+namespace etk {
+namespace simd {
+
+	enum isa_t {
+		isa_scalar = 0,
+		isa_avx2   = 1,  // AVX2 with FMA
+		isa_avx512 = 2,  // AVX-512F
+	};
+
+	// The best instruction set available on this processor, within the limit.
+	isa_t best_isa();
+
+	// Restrict the kernels to an instruction set no higher than this, mainly to
+	// compare vector results against the scalar ones.
+	void limit_isa(isa_t limit);
+
+	const char* isa_name(isa_t isa);
+
+	// Convert one case row of utilities into logit probabilities, in place.
+	//
+	//  u      : [n] utilities in, probabilities out; unavailable alternatives become 0
+	//  av     : [n] availability flags
+	//  ch     : [n] choice weights
+	//  caseloglike : set to the log likelihood of the choices for this case
+	//
+	// If any available utility is outside +/-700, all utilities are shifted so
+	// the largest is 700 before exponentiating. Returns the log of the sum of
+	// exponentiated (shifted) utilities.
+	typedef double (*masked_logit_row_t)(double* u, const bool* av, const double* ch, size_t n, double& caseloglike);
+
+	double masked_logit_row_scalar(double* u, const bool* av, const double* ch, size_t n, double& caseloglike);
+	#ifdef ETK_SIMD_X86
+	double masked_logit_row_avx2  (double* u, const bool* av, const double* ch, size_t n, double& caseloglike);
+	double masked_logit_row_avx512(double* u, const bool* av, const double* ch, size_t n, double& caseloglike);
+	#endif // def ETK_SIMD_X86
+
+	// The kernel for best_isa().
+	masked_logit_row_t masked_logit_row();
+
+	// Mixed precision matrix-vector product, for data stored in single precision:
+	//
+	//  y[i*incy] = alpha * sum_j A[i*lda+j] * x[j] + beta * y[i*incy],  i<m, j<n
+	//
+	// Each element of A is widened to double before it is multiplied, and all
+	// sums are in double. As in BLAS, y is not read when beta is zero.
+	typedef void (*mixed_gemv_t)(size_t m, size_t n, double alpha, const float* A, size_t lda,
+	                             const double* x, double beta, double* y, size_t incy);
+
+	void mixed_gemv_scalar(size_t m, size_t n, double alpha, const float* A, size_t lda,
+	                       const double* x, double beta, double* y, size_t incy);
+	#ifdef ETK_SIMD_X86
+	void mixed_gemv_avx2  (size_t m, size_t n, double alpha, const float* A, size_t lda,
+	                       const double* x, double beta, double* y, size_t incy);
+	#endif // def ETK_SIMD_X86
+
+	// The kernel for best_isa().
+	mixed_gemv_t mixed_gemv();
+
+	// Log-sum-exp over a tile of values for a block of cases at once:
+	//
+	//  out[c] = mu * log( sum_k exp(x[k*ld+c] / mu) ),  c<n, k<m
+	//
+	// The tile is item-major, so the values of item k for the n cases are
+	// contiguous and the cases are processed together in vector lanes. Each
+	// case is shifted by its own largest value before exponentiating. Items
+	// at -inf are skipped, and a case with no other items gives -inf. When mu
+	// is zero, out[c] is the largest value.
+	typedef void (*logsum_tile_t)(const double* x, size_t m, size_t n, size_t ld, double mu, double* out);
+
+	void logsum_tile_scalar(const double* x, size_t m, size_t n, size_t ld, double mu, double* out);
+	#ifdef ETK_SIMD_X86
+	void logsum_tile_avx2  (const double* x, size_t m, size_t n, size_t ld, double mu, double* out);
+	#endif // def ETK_SIMD_X86
+
+	// The kernel for best_isa().
+	logsum_tile_t logsum_tile();
+
+	// Scale a tile of values for a block of cases into probabilities, in place:
+	//
+	//  sums[c] = sum_k x[k*ld+c],  x[k*ld+c] /= sums[c],  c<n, k<m
+	//
+	// The tile is item-major, as for logsum_tile, and each case is summed in
+	// item order, so the vector kernel gives the same results as the scalar
+	// one. A case whose sum is zero is left as it is.
+	typedef void (*prob_scale_tile_t)(double* x, size_t m, size_t n, size_t ld, double* sums);
+
+	void prob_scale_tile_scalar(double* x, size_t m, size_t n, size_t ld, double* sums);
+	#ifdef ETK_SIMD_X86
+	void prob_scale_tile_avx2  (double* x, size_t m, size_t n, size_t ld, double* sums);
+	#endif // def ETK_SIMD_X86
+
+	// The kernel for best_isa().
+	prob_scale_tile_t prob_scale_tile();
+
+	// The nested logit utilities take the cases to logsum_tile in blocks of
+	//  this many, so the tile for one nest stays in cache.
+	#define NEST_BLOCK_CASES 64
+
+	// Mixed precision matrix product, C = alpha * A B + beta * C, with A [m,k] in
+	// single precision and B [k,n] and C [m,n] in double, all row major.
+	void mixed_gemm(size_t m, size_t n, size_t k, double alpha, const float* A, size_t lda,
+	                const double* B, size_t ldb, double beta, double* C, size_t ldc);
+
+} // end namespace simd
+} // end namespace etk
+
+#endif // __TOOLBOX_SIMD__
@@ -20,7 +20,9 @@
 
 #include "etk.h"
 #include "etk_pydict.h"
+#include "etk_simd.h"
 #include "etk_test_swig.h"
+#include <memory>
 
 
 
@@ -40,6 +42,95 @@ PyObject* etk::_swigtest_alpha_dict()
 }
 
 
+namespace {
+	// The instruction set limit for one test call, lifted again afterwards.
+	struct _swigtest_isa_limit {
+		_swigtest_isa_limit(const int& limit) {
+			if (limit<etk::simd::isa_scalar || limit>etk::simd::isa_avx512) OOPS("isa limit must be 0, 1 or 2");
+			etk::simd::limit_isa(etk::simd::isa_t(limit));
+		}
+		~_swigtest_isa_limit() { etk::simd::limit_isa(etk::simd::isa_avx512); }
+	};
+}
+
+std::string etk::_swigtest_simd_best_isa()
+{
+	return etk::simd::isa_name(etk::simd::best_isa());
+}
+
+std::vector<double> etk::_swigtest_masked_logit_row(std::vector<double> u, const std::vector<int>& av,
+                                                    const std::vector<double>& ch, const int& isa_limit)
+{
+	size_t n = u.size();
+	if (av.size()!=n || ch.size()!=n) OOPS("u, av and ch must be the same length");
+	std::unique_ptr<bool[]> avail (new bool[n]);
+	for (size_t i=0; i<n; i++) avail[i] = (av[i]!=0);
+	_swigtest_isa_limit limit (isa_limit);
+	double caseloglike = 0;
+	double logsum = etk::simd::masked_logit_row()(u.data(), avail.get(), ch.data(), n, caseloglike);
+	u.push_back(logsum);
+	u.push_back(caseloglike);
+	return u;
+}
+
+std::vector<double> etk::_swigtest_mixed_gemv(const size_t& m, const size_t& n, const double& alpha,
+                                              const std::vector<double>& A, const std::vector<double>& x,
+                                              const double& beta, std::vector<double> y, const int& isa_limit)
+{
+	if (A.size()!=m*n || x.size()!=n || y.size()!=m) OOPS("A must be m by n, x of length n and y of length m");
+	std::vector<float> A_single (A.begin(), A.end());
+	_swigtest_isa_limit limit (isa_limit);
+	etk::simd::mixed_gemv()(m, n, alpha, A_single.data(), n, x.data(), beta, y.data(), 1);
+	return y;
+}
+
+std::vector<double> etk::_swigtest_logsum_tile(const std::vector<double>& x, const size_t& m, const size_t& n,
+                                               const double& mu, const int& isa_limit)
+{
+	if (x.size()!=m*n) OOPS("x must be m items by n cases");
+	std::vector<double> out (n);
+	_swigtest_isa_limit limit (isa_limit);
+	etk::simd::logsum_tile()(x.data(), m, n, n, mu, out.data());
+	return out;
+}
+
+std::vector<double> etk::_swigtest_prob_scale_tile(std::vector<double> x, const size_t& m, const size_t& n,
+                                                   const int& isa_limit)
+{
+	if (x.size()!=m*n) OOPS("x must be m items by n cases");
+	std::vector<double> sums (n);
+	_swigtest_isa_limit limit (isa_limit);
+	etk::simd::prob_scale_tile()(x.data(), m, n, n, sums.data());
+	x.insert(x.end(), sums.begin(), sums.end());
+	return x;
+}
+
+std::vector<double> etk::_swigtest_mixed_gemm(const size_t& m, const size_t& n, const size_t& k, const double& alpha,
+                                              const std::vector<double>& A, const std::vector<double>& B,
+                                              const double& beta, std::vector<double> C)
+{
+	if (A.size()!=m*k || B.size()!=k*n || C.size()!=m*n) OOPS("A must be m by k, B k by n and C m by n");
+	std::vector<float> A_single (A.begin(), A.end());
+	etk::simd::mixed_gemm(m, n, k, alpha, A_single.data(), k, B.data(), n, beta, C.data(), n);
+	return C;
+}
+
+std::vector<double> etk::_swigtest_symmetric_inv(const std::vector<double>& A, const size_t& n)
+{
+	if (A.size()!=n*n) OOPS("A must be n by n");
+	etk::symmetric_matrix M (n);
+	for (size_t i=0; i<n; i++) {
+		for (size_t j=0; j<n; j++) M(i,j) = A[i*n+j];
+	}
+	M.inv();
+	std::vector<double> out (n*n);
+	for (size_t i=0; i<n; i++) {
+		for (size_t j=0; j<n; j++) out[i*n+j] = M(i,j);
+	}
+	return out;
+}
+
+
 
 
 
@@ -24,6 +24,8 @@
 
 #include "etk_python.h"
 #include <iostream>
+#include <string>
+#include <vector>
 
 
 
@@ -32,6 +34,33 @@ namespace etk {
 	PyObject* _swigtest_empty_dict();
 	PyObject* _swigtest_alpha_dict();
 
+	// Run a simd kernel with the instruction set limited to isa_limit (0 for
+	//  scalar, 1 for avx2, 2 for avx512), so the vector results can be
+	//  compared against the scalar ones. The masked logit row returns the
+	//  probabilities followed by the log sum and the case log likelihood, and
+	//  the logsum and probability tiles take the m by n tile item-major. The
+	//  probability tile returns the scaled tile followed by the case sums.
+	std::string _swigtest_simd_best_isa();
+	std::vector<double> _swigtest_masked_logit_row(std::vector<double> u, const std::vector<int>& av,
+	                                               const std::vector<double>& ch, const int& isa_limit);
+	std::vector<double> _swigtest_mixed_gemv(const size_t& m, const size_t& n, const double& alpha,
+	                                         const std::vector<double>& A, const std::vector<double>& x,
+	                                         const double& beta, std::vector<double> y, const int& isa_limit);
+	std::vector<double> _swigtest_logsum_tile(const std::vector<double>& x, const size_t& m, const size_t& n,
+	                                          const double& mu, const int& isa_limit);
+	std::vector<double> _swigtest_prob_scale_tile(std::vector<double> x, const size_t& m, const size_t& n,
+	                                              const int& isa_limit);
+
+	// C = alpha * A B + beta * C through the mixed precision matrix product,
+	//  with A (m by k, stored in single precision), B (k by n) and C row-major.
+	std::vector<double> _swigtest_mixed_gemm(const size_t& m, const size_t& n, const size_t& k, const double& alpha,
+	                                         const std::vector<double>& A, const std::vector<double>& B,
+	                                         const double& beta, std::vector<double> C);
+
+	// Invert the n by n symmetric matrix A, given row-major, as the estimation
+	//  does with symmetric_matrix::inv.
+	std::vector<double> _swigtest_symmetric_inv(const std::vector<double>& A, const size_t& n);
+
 	class ostream_c
 	{
 		std::ostream* _receiver;
@@ -23,6 +23,7 @@
 #include <iostream>
 #include <string>
 #include "etk_thread.h"
+#include "etk_python.h"
 
  
  
@@ -166,6 +167,151 @@ void etk::threadtester()
 	*/
 
 
+
+#ifdef __linux__
+# include <pthread.h>
+# include <sched.h>
+#endif // def __linux__
+
+
+
+bool etk::worker_pool::pin_workers = true;
+
+etk::worker_pool& etk::worker_pool::global()
+{
+	// Leaked on purpose: the workers must not be joined during static destruction,
+	// which may run after the Python interpreter has already gone away.
+	static worker_pool* the_pool = new worker_pool();
+	return *the_pool;
+}
+
+unsigned etk::worker_pool::concurrency()
+{
+	const static unsigned nb_threads_hint = std::thread::hardware_concurrency();
+	return (nb_threads_hint == 0u ? 8u : nb_threads_hint);
+}
+
+etk::worker_pool::worker_pool()
+: workers()
+, batches()
+, queue_mutex()
+, has_work()
+, terminate(false)
+, allowed_cpus()
+{
+	#ifdef __linux__
+	// The mask is read once, here, as a worker started from inside a task
+	//  would otherwise inherit the single core of the worker that started it.
+	cpu_set_t mask;
+	CPU_ZERO(&mask);
+	if (sched_getaffinity(0, sizeof(cpu_set_t), &mask)==0) {
+		for (int cpu=0; cpu<CPU_SETSIZE; cpu++) {
+			if (CPU_ISSET(cpu, &mask)) allowed_cpus.push_back(cpu);
+		}
+	}
+	#endif // def __linux__
+}
+
+etk::worker_pool::~worker_pool()
+{
+	{
+		std::lock_guard<std::mutex> lock(queue_mutex);
+		terminate = true;
+	}
+	has_work.notify_all();
+	for (auto& w: workers) {
+		if (w.joinable()) w.join();
+	}
+}
+
+unsigned etk::worker_pool::size()
+{
+	std::lock_guard<std::mutex> lock(queue_mutex);
+	return workers.size()+1;
+}
+
+void etk::worker_pool::reserve(unsigned n)
+{
+	std::lock_guard<std::mutex> lock(queue_mutex);
+	// the calling thread always works too, so n threads need only n-1 workers
+	while (workers.size()+1 < n) {
+		workers.emplace_back(&worker_pool::worker_loop, this, unsigned(workers.size()));
+	}
+}
+
+void etk::worker_pool::batch::execute()
+{
+	gil_context outer_context = this_gil_context;
+	this_gil_context = gil_context(python_context);
+	while (true) {
+		size_t i = next.fetch_add(1);
+		if (i >= ntasks) break;
+		try {
+			(*task)(i);
+		} catch (...) {
+			std::lock_guard<std::mutex> lock(failure_mutex);
+			if (!failure) failure = std::current_exception();
+		}
+		if (remaining.fetch_sub(1)==1) {
+			std::lock_guard<std::mutex> lock(done_mutex);
+			done.notify_all();
+		}
+	}
+	this_gil_context = outer_context;
+}
+
+void etk::worker_pool::worker_loop(unsigned worker_number)
+{
+	#ifdef __linux__
+	if (pin_workers && allowed_cpus.size() > 1) {
+		// worker k is pinned to the core k+1 of those in the process mask, leaving
+		//  the first for the submitting thread; cores outside the mask (from
+		//  taskset, cgroups or a batch scheduler) are never used
+		cpu_set_t cpuset;
+		CPU_ZERO(&cpuset);
+		CPU_SET(allowed_cpus[(worker_number+1) % allowed_cpus.size()], &cpuset);
+		pthread_setaffinity_np(pthread_self(), sizeof(cpu_set_t), &cpuset);
+	}
+	#endif // def __linux__
+	
+	while (true) {
+		std::shared_ptr<batch> b;
+		{
+			std::unique_lock<std::mutex> lock(queue_mutex);
+			has_work.wait(lock, [this]{ return terminate || !batches.empty(); });
+			if (terminate) return;
+			b = batches.front();
+			if (b->exhausted()) {
+				// every task is claimed, the remaining ones are finishing elsewhere
+				batches.pop_front();
+				continue;
+			}
+		}
+		b->execute();
+	}
+}
+
+void etk::worker_pool::run(size_t ntasks, const std::function<void(size_t)>& task)
+{
+	if (ntasks==0) return;
+	std::shared_ptr<batch> b = std::make_shared<batch>(ntasks, &task,
+		this_gil_context==gil_released ? gil_released : gil_held_task);
+	if (ntasks>1) {
+		{
+			std::lock_guard<std::mutex> lock(queue_mutex);
+			batches.push_back(b);
+		}
+		has_work.notify_all();
+	}
+	b->execute();
+	{
+		std::unique_lock<std::mutex> lock(b->done_mutex);
+		b->done.wait(lock, [&b]{ return b->remaining.load()==0; });
+	}
+	if (b->failure) std::rethrow_exception(b->failure);
+}
+
+
 #endif // NOTHREAD
  
 
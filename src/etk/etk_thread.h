@@ -303,56 +303,112 @@ namespace etk {
 
 ////////////////////////////////////////////////////////////////////////////////
 #include <thread>
+#include <exception>
 #include <vector>
 #include <cmath>
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
 ////////////////////////////////////////////////////////////////////////////////
- 
+
+namespace etk {
+
+	// A process-wide pool of persistent worker threads.
+	//
+	// Work is submitted as a batch of numbered tasks; workers (and the submitting
+	// thread itself) claim task numbers from the batch with an atomic counter, so
+	// no lock is taken per task. The queue mutex is only touched once per batch
+	// submission and when an idle worker goes to sleep. Because the submitting
+	// thread also works on its own batch, nested submissions from inside a task
+	// always make progress.
+	class worker_pool {
+	
+		struct batch {
+			size_t ntasks;
+			const std::function<void(size_t)>* task;
+			std::atomic<size_t> next;
+			std::atomic<size_t> remaining;
+			std::mutex done_mutex;
+			std::condition_variable done;
+			int python_context; // taken on by the tasks, see etk::python_lock
+			std::exception_ptr failure; // the first exception thrown by a task
+			std::mutex failure_mutex;
+			
+			batch(size_t ntasks, const std::function<void(size_t)>* task, int python_context)
+			: ntasks(ntasks)
+			, task(task)
+			, next(0)
+			, remaining(ntasks)
+			, python_context(python_context)
+			, failure()
+			, failure_mutex()
+			{}
+			
+			inline bool exhausted() const { return next.load() >= ntasks; }
+			void execute();
+		};
+	
+		std::vector< std::thread > workers;
+		std::deque< std::shared_ptr<batch> > batches;
+		std::mutex queue_mutex;
+		std::condition_variable has_work;
+		bool terminate;
+		std::vector<int> allowed_cpus; // the affinity mask of the process, when the pool was made
+		
+		void worker_loop(unsigned worker_number);
+		
+		worker_pool();
+		~worker_pool();
+		
+	public:
+		worker_pool(const worker_pool&) = delete;
+		worker_pool& operator=(const worker_pool&) = delete;
+	
+		// The shared pool, created on first use.
+		static worker_pool& global();
+		
+		// When true (the default), workers started after this point are pinned to
+		// a single core each, on platforms that support thread affinity. Only the
+		// cores in the affinity mask the process was started with are used.
+		static bool pin_workers;
+		
+		// The default degree of parallelism, from the hardware.
+		static unsigned concurrency();
+		
+		// Make sure at least n threads (counting the calling thread) can work at once.
+		void reserve(unsigned n);
+		unsigned size();
+		
+		// Call task(i) once for each i in [0,ntasks), and return when all are done.
+		// If any task throws, the other tasks still run, and the first exception
+		// is thrown again from here.
+		void run(size_t ntasks, const std::function<void(size_t)>& task);
+	};
+
+}
+
 class ThreadPool {
  
 public:
  
 	template<typename ResourceBucket, typename ResourceBucketInitializer, typename Index, typename Callable>
 	static void ParallelFor(Index start, Index end, Callable func, ResourceBucketInitializer& bucketparent ) {
-		// Estimate number of threads in the pool
-		const static unsigned nb_threads_hint = std::thread::hardware_concurrency();
-		const static unsigned nb_threads = (nb_threads_hint == 0u ? 8u : nb_threads_hint);
- 
-		// Size of a slice for the range functions
-		Index n = end - start + 1;
-		Index slice = (Index) std::round(n / static_cast<double> (nb_threads));
-		slice = std::max(slice, Index(1));
- 
-		// [Helper] Inner loop
-		auto launchRange = [&func] (int k1, int k2, ResourceBucket& bucket) {
-			for (Index k = k1; k < k2; k++) {
-				func(k, bucket);
-			}
-		};
+		std::vector< std::pair<Index,Index> > ranges = SliceRange(start, end);
  
-		// Create pool and launch jobs
-		std::vector<std::thread> pool;
+		// One resource bucket per slice, so each bucket is only ever used by one thread at a time
 		std::vector<ResourceBucket> pool_resources;
-		pool.reserve(nb_threads);
-		pool_resources.reserve(nb_threads);
-		Index i1 = start;
-		Index i2 = std::min(start + slice, end);
-		for (unsigned i = 0; i + 1 < nb_threads && i1 < end; ++i) {
-			pool_resources.emplace_back(bucketparent);
-			pool.emplace_back(launchRange, i1, i2, std::ref(pool_resources.back()));
-			i1 = i2;
-			i2 = std::min(i2 + slice, end);
-		}
-		if (i1 < end) {
+		pool_resources.reserve(ranges.size());
+		for (size_t s=0; s<ranges.size(); s++) {
 			pool_resources.emplace_back(bucketparent);
-			pool.emplace_back(launchRange, i1, end, std::ref(pool_resources.back()));
 		}
  
-		// Wait for jobs to finish
-		for (std::thread &t : pool) {
-			if (t.joinable()) {
-				t.join();
+		etk::worker_pool::global().run(ranges.size(), [&] (size_t s) {
+			for (Index k = ranges[s].first; k < ranges[s].second; k++) {
+				func(k, pool_resources[s]);
 			}
-		}
+		});
 	}
  
  
@@ -360,45 +416,45 @@ public:
  
  	template<typename Index, typename Callable>
 	static void ParallelFor0(Index start, Index end, Callable func ) {
-		// Estimate number of threads in the pool
-		const static unsigned nb_threads_hint = std::thread::hardware_concurrency();
-		const static unsigned nb_threads = (nb_threads_hint == 0u ? 8u : nb_threads_hint);
+		std::vector< std::pair<Index,Index> > ranges = SliceRange(start, end);
+ 
+		etk::worker_pool::global().run(ranges.size(), [&] (size_t s) {
+			for (Index k = ranges[s].first; k < ranges[s].second; k++) {
+				func(k);
+			}
+		});
+	}
+ 
+ 
+ 
+ 
+	// Divide [start,end) into about one slice per available thread
+	template<typename Index>
+	static std::vector< std::pair<Index,Index> > SliceRange(Index start, Index end) {
+		const unsigned nb_threads = etk::worker_pool::concurrency();
+		etk::worker_pool::global().reserve(nb_threads);
  
 		// Size of a slice for the range functions
 		Index n = end - start + 1;
 		Index slice = (Index) std::round(n / static_cast<double> (nb_threads));
 		slice = std::max(slice, Index(1));
  
-		// [Helper] Inner loop
-		auto launchRange = [&func] (int k1, int k2) {
-			for (Index k = k1; k < k2; k++) {
-				func(k);
-			}
-		};
- 
-		// Create pool and launch jobs
-		std::vector<std::thread> pool;
-		pool.reserve(nb_threads);
+		std::vector< std::pair<Index,Index> > ranges;
+		ranges.reserve(nb_threads);
 		Index i1 = start;
 		Index i2 = std::min(start + slice, end);
 		for (unsigned i = 0; i + 1 < nb_threads && i1 < end; ++i) {
-			pool.emplace_back(launchRange, i1, i2);
+			ranges.emplace_back(i1, i2);
 			i1 = i2;
 			i2 = std::min(i2 + slice, end);
 		}
 		if (i1 < end) {
-			pool.emplace_back(launchRange, i1, end);
-		}
- 
-		// Wait for jobs to finish
-		for (std::thread &t : pool) {
-			if (t.joinable()) {
-				t.join();
-			}
+			ranges.emplace_back(i1, end);
 		}
+		return ranges;
 	}
  
-
+ 
  
  
  
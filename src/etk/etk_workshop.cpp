@@ -35,28 +35,23 @@ void etk::workshop::work(size_t firstcase, size_t numberofcases, boosted::mutex*
 void etk::workshop::startwork(etk::dispatcher* dispatcher, boosted::mutex* result_mutex)
 {
 	while (!release_workshop) {
-		etk::job thisjob = dispatcher->next_job();
-		boosted::unique_lock<boosted::mutex> LOCK(timecard);
-		if (thisjob.is_null() || release_workshop) {
+		size_t job_number;
+		etk::job thisjob = dispatcher->next_job(job_number);
+		if (thisjob.is_null()) {
 			break;
 		}
 		if (thisjob.is_skip()) {
-			LOCK.unlock();
 			continue;
 		}
+		boosted::unique_lock<boosted::mutex> LOCK(timecard);
+		current_job = job_number;
 		try {
 			work(thisjob.first,thisjob.length, result_mutex);
 		} catch(const etk::exception_t &err) {
 			dispatcher->etk_exception_on_job(thisjob.first, err);
-			LOCK.unlock();
-			continue;
 		} catch(const std::exception &err) {
 			dispatcher->std_exception_on_job(thisjob.first, err);
-			LOCK.unlock();
-			continue;
 		}
-		dispatcher->finished_job(thisjob.first);
-		LOCK.unlock();
 	}
 }
 
@@ -72,15 +67,20 @@ void etk::workshop::startwork(etk::dispatcher* dispatcher, boosted::mutex* resul
 
 
 
-etk::dispatcher::dispatcher(int nThreads, size_t nJobs, workshop_builder_t workshop_builder)
+etk::dispatcher::dispatcher(int nThreads, size_t nJobs, workshop_builder_t workshop_builder, case_stream* stream, const std::vector<job>* sample)
 : nThreads(nThreads)
 , nJobs(nJobs)
 , result_mutex()
 , workshops ()
-, threads ()
 , schedule_size(10)
 , workshop_builder(workshop_builder)
-, terminate(false)
+, jobs_waiting()
+, jobs_cursor(0)
+, jobs_limit(0)
+, stream(stream)
+, sample(sample)
+, blocks()
+, block_job_ends()
 , exception_message()
 , exception_count(0)
 , zeroprob_exception_count(0)
@@ -93,9 +93,7 @@ etk::dispatcher::dispatcher(int nThreads, size_t nJobs, workshop_builder_t works
 
 void etk::dispatcher::add_thread()
 {
-		workshops.push_back(workshop_builder());
-		boosted::shared_ptr<boosted::thread> thrd = boosted::make_shared<boosted::thread>(&workshop::startwork, workshops.back(), this, &result_mutex);
-		threads.push_back( thrd );
+	workshops.push_back(workshop_builder());
 }
 
 etk::dispatcher::~dispatcher()
@@ -103,16 +101,17 @@ etk::dispatcher::~dispatcher()
 	release();
 }
 
-void etk::dispatcher::dispatch(int nThreads, workshop_updater_t* updater)
+void etk::dispatcher::dispatch(int nThreads, workshop_updater_t* updater, job_partials* partials)
 {
 	exception_count = 0;
 	zeroprob_exception_count = 0;
-	if (nThreads != -9 && nThreads > threads.size()) {
-		for (int i=threads.size(); i<nThreads; i++) {
+	exception_message.clear();
+	if (nThreads != -9 && nThreads > workshops.size()) {
+		for (int i=workshops.size(); i<nThreads; i++) {
 			add_thread();
 		}
 	}
-	else if (nThreads != -9 && nThreads < threads.size()) {
+	else if (nThreads != -9 && nThreads < workshops.size()) {
 		release();
 		for (int i=0; i<nThreads; i++) {
 			add_thread();
@@ -124,11 +123,43 @@ void etk::dispatcher::dispatch(int nThreads, workshop_updater_t* updater)
 			(*updater)(workshops[i]);
 		}
 	}
-	request_work();
-	boosted::unique_lock<boosted::mutex> LOCK(workdone_mutex);
-	while (work_remains()) {
-		jobs_done.wait_for(LOCK, boosted::chrono::milliseconds(20));
+	if (nThreads != -9) this->nThreads = nThreads;
+	
+	// Each workshop is driven by exactly one pool task, so per-workshop
+	// state is never shared between threads within a dispatch.
+	etk::worker_pool& pool = etk::worker_pool::global();
+	pool.reserve(workshops.size());
+	std::function<void(size_t)> task = [this](size_t w){
+		workshops[w]->startwork(this, &result_mutex);
+	};
+	
+	// When reducing into partials, there is exactly one job per slot
+	if (sample && !sample->empty()) {
+		if (stream) {
+			OOPS("a sample of cases cannot be used with data read in blocks");
+		}
+		request_sample_work(partials ? partials->njobs() : 0);
+		pool.run(workshops.size(), task);
+	} else if (stream) {
+		request_block_work(partials ? partials->njobs() : 0);
+		size_t job_begin = 0;
+		for (size_t b=0; b<blocks.size(); b++) {
+			if (b+1<blocks.size()) {
+				stream->load_block(blocks[b].first, blocks[b].length, blocks[b+1].first, blocks[b+1].length);
+			} else {
+				stream->load_block(blocks[b].first, blocks[b].length, 0, 0);
+			}
+			jobs_cursor.store(job_begin);
+			jobs_limit = block_job_ends[b];
+			pool.run(workshops.size(), task);
+			job_begin = jobs_limit;
+			if (exception_count || zeroprob_exception_count) break;
+		}
+	} else {
+		request_work(partials ? partials->njobs() : 0);
+		pool.run(workshops.size(), task);
 	}
+	
 	if (exception_count) {
 		OOPS(exception_message);
 	}
@@ -139,19 +170,14 @@ void etk::dispatcher::dispatch(int nThreads, workshop_updater_t* updater)
 
 void etk::dispatcher::release()
 {
+	// Wait for any workshop still on the clock before letting it go
 	for (unsigned i=0; i<workshops.size(); i++) {
 		if (workshops[i]) {
 			workshops[i]->release_workshop = true;
+			boosted::unique_lock<boosted::mutex> LOCK(workshops[i]->timecard);
 		}
 	}
-	terminate = true;
-	has_jobs.notify_all();
-	for (unsigned i=0; i<threads.size(); i++) {
-		if (threads[i]->joinable()) threads[i]->join();
-	}
 	workshops.clear();
-	threads.clear();
-	terminate = false;
 }
 
 
@@ -161,18 +187,21 @@ void etk::dispatcher::release()
 
 
 
-void etk::dispatcher::request_work()
+void etk::dispatcher::request_work(size_t fixed_jobs)
 {
 	// Divide up all the discrete tasks into sets of work to complete.
-	queue_mutex.lock();
+	// A fixed number of jobs is used as given, even if some jobs are empty.
+	jobs_waiting.clear();
 	int n = nThreads*schedule_size;
 	if (n > nJobs) n = nJobs;
+	if (fixed_jobs) n = fixed_jobs;
 	if (n>0) {
 		size_t chunksize = nJobs/n;
 		size_t chunkleft = nJobs%n;
 		
 		size_t begin = 0;
 		
+		jobs_waiting.reserve(n);
 		for (int i=0; i<n; i++) {
 			if (chunkleft) {
 				jobs_waiting.push_back(etk::job(begin, chunksize+1));
@@ -184,92 +213,177 @@ void etk::dispatcher::request_work()
 			}
 		}
 	}
-	queue_mutex.unlock();
-	if (jobs_waiting.size()) has_jobs.notify_all();
+	jobs_cursor.store(0);
+	jobs_limit = jobs_waiting.size();
 }
 
-
-etk::job etk::dispatcher::next_job()
+void etk::dispatcher::request_sample_work(size_t fixed_jobs)
 {
-	etk::job ret(SIZE_T_MAX,SIZE_T_MAX);
-	
-	boosted::unique_lock<boosted::mutex> lock(queue_mutex);
-	
-	while (jobs_waiting.size()==0 && !terminate) {
-		has_jobs.wait(lock);
+	// Each range of the sample is one job, so a fixed number of jobs must match
+	if (fixed_jobs && fixed_jobs != sample->size()) {
+		OOPS("cannot divide a sample of ",sample->size()," case ranges among ",fixed_jobs," jobs");
 	}
+	jobs_waiting = *sample;
+	jobs_cursor.store(0);
+	jobs_limit = jobs_waiting.size();
+}
+
+void etk::dispatcher::request_block_work(size_t fixed_jobs)
+{
+	// As request_work, but no job crosses a block boundary. The jobs are
+	// shared out evenly among the blocks, with at least one each, so a fixed
+	// number of jobs still gives boundaries that do not depend on the threads.
+	jobs_waiting.clear();
+	blocks.clear();
+	block_job_ends.clear();
 	
-	if (terminate) {
-		return ret;
+	size_t nblocks = stream->n_blocks(nJobs);
+	size_t bsize = stream->block_cases();
+	size_t n = nThreads*schedule_size;
+	if (n > nJobs) n = nJobs;
+	if (fixed_jobs) {
+		if (fixed_jobs < nblocks) {
+			OOPS("cannot divide ",nblocks," case blocks among ",fixed_jobs," jobs");
+		}
+		n = fixed_jobs;
 	}
+	if (n < nblocks) n = nblocks;
 	
-	if (jobs_waiting.size()) {
-		ret.first = jobs_waiting.front().first;
-		ret.length = jobs_waiting.front().length;
-		jobs_waiting.pop_front();
-		if (!ret.is_skip()) jobs_out.insert(ret.first);
+	jobs_waiting.reserve(n);
+	for (size_t b=0; b<nblocks; b++) {
+		size_t block_first = b*bsize;
+		size_t block_length = bsize;
+		if (block_first+block_length > nJobs) block_length = nJobs-block_first;
+		blocks.push_back(etk::job(block_first, block_length));
+		
+		size_t block_jobs = n*(b+1)/nblocks - n*b/nblocks;
+		size_t chunksize = block_length/block_jobs;
+		size_t chunkleft = block_length%block_jobs;
+		size_t begin = block_first;
+		for (size_t i=0; i<block_jobs; i++) {
+			size_t len = chunksize;
+			if (chunkleft) {
+				len++;
+				chunkleft--;
+			}
+			jobs_waiting.push_back(etk::job(begin, len));
+			begin += len;
+		}
+		block_job_ends.push_back(jobs_waiting.size());
 	}
-	
-	return ret;
+	jobs_cursor.store(0);
+	jobs_limit = 0;
 }
 
-void etk::dispatcher::finished_job(const size_t& job_id)
+
+etk::job etk::dispatcher::next_job(size_t& job_number)
 {
-	boosted::unique_lock<boosted::mutex> lock(queue_mutex);
-	jobs_out.erase(job_id);
-	if (jobs_out.size()==0) {
-		// release threads waiting on job completion
-		lock.unlock();
-		jobs_done.notify_all();
+	job_number = jobs_cursor.fetch_add(1);
+	if (job_number >= jobs_limit) {
+		return etk::job(SIZE_T_MAX,SIZE_T_MAX);
 	}
+	return jobs_waiting[job_number];
 }
 
-void etk::dispatcher::etk_exception_on_job(const size_t& job_id, const etk::exception_t& err)
+void etk::dispatcher::etk_exception_on_job(const size_t& firstcase, const etk::exception_t& err)
 {
-	boosted::unique_lock<boosted::mutex> lock(queue_mutex);
 	boosted::unique_lock<boosted::mutex> elock(exception_mutex);
-	jobs_out.erase(job_id);
-	exception_message += std::string(err.what()) + "\n";
+	exception_message += "in the job starting at case " + std::to_string(firstcase) + ": " + err.what() + "\n";
 	
 	if (err.code()==OOPSCODE_ZEROPROB) {
 		zeroprob_exception_count++;
 	} else {
 		exception_count++;
 	}
-	elock.unlock();
-	if (jobs_out.size()==0) {
-		// release threads waiting on job completion
-		lock.unlock();
-		jobs_done.notify_all();
-	}
-	
-	
 }
 
 
-void etk::dispatcher::std_exception_on_job(const size_t& job_id, const std::exception& err)
+void etk::dispatcher::std_exception_on_job(const size_t& firstcase, const std::exception& err)
 {
-	boosted::unique_lock<boosted::mutex> lock(queue_mutex);
 	boosted::unique_lock<boosted::mutex> elock(exception_mutex);
-	jobs_out.erase(job_id);
-	exception_message += std::string(err.what()) + "\n";
+	exception_message += "in the job starting at case " + std::to_string(firstcase) + ": " + err.what() + "\n";
 	exception_count++;
-	elock.unlock();
-	if (jobs_out.size()==0) {
-		// release threads waiting on job completion
-		lock.unlock();
-		jobs_done.notify_all();
-	}
-	
-	
 }
 
 
 
-bool etk::dispatcher::work_remains() 
+
+
+
+
+etk::job_partials::job_partials()
+: _njobs(0)
+, _width(0)
+, _slots()
 {
-	boosted::unique_lock<boosted::mutex> local_lock(queue_mutex);
-	return (jobs_waiting.size()+jobs_out.size() > 0);
 }
 
+void etk::job_partials::resize(size_t njobs, size_t width)
+{
+	_njobs = njobs;
+	_width = width;
+	if (_slots.size() != njobs*width) {
+		_slots.resize(njobs*width);
+	}
+}
 
+const double* etk::job_partials::combine()
+{
+	if (_njobs==0) {
+		OOPS("no partials to combine");
+	}
+	// Each column is reduced by the same tree of pairwise sums, so splitting
+	// the columns into blocks for threading does not change any result.
+	const size_t block = 1024;
+	size_t nblocks = (_width+block-1)/block;
+	etk::worker_pool::global().run(nblocks, [&](size_t b) {
+		size_t col_begin = b*block;
+		size_t col_end = std::min(col_begin+block, _width);
+		for (size_t stride=1; stride<_njobs; stride*=2) {
+			for (size_t j=0; j+stride<_njobs; j+=2*stride) {
+				double* left = slot(j);
+				const double* right = slot(j+stride);
+				for (size_t i=col_begin; i<col_end; i++) {
+					left[i] += right[i];
+				}
+			}
+		}
+	});
+	return slot(0);
+}
+
+size_t etk::job_partials::njobs_for(size_t ncases, size_t width, size_t budget_bytes)
+{
+	// Plenty of jobs for load balancing, independent of the thread count
+	size_t n = 256;
+	if (width) {
+		size_t fits = budget_bytes / (width*sizeof(double));
+		if (n > fits) n = fits;
+	}
+	if (n > ncases) n = ncases;
+	if (n < 1) n = 1;
+	return n;
+}
+
+
+
+size_t etk::case_stream::n_blocks(size_t ncases) const
+{
+	size_t bsize = block_cases();
+	if (!bsize) OOPS("case_stream has an empty block size");
+	return (ncases + bsize - 1) / bsize;
+}
+
+void etk::case_stream::for_each_block(size_t ncases, const std::function<void(size_t,size_t)>& fn)
+{
+	size_t bsize = block_cases();
+	size_t nblocks = n_blocks(ncases);
+	for (size_t b=0; b<nblocks; b++) {
+		size_t first = b*bsize;
+		size_t length = std::min(bsize, ncases-first);
+		size_t next_first = first+length;
+		size_t next_length = (b+1<nblocks) ? std::min(bsize, ncases-next_first) : 0;
+		load_block(first, length, next_first, next_length);
+		fn(first, length);
+	}
+}
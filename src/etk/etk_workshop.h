@@ -44,7 +44,10 @@ namespace etk {
 		boosted::mutex timecard;
 		bool release_workshop;
 		
-		workshop(): release_workshop(false) {}
+		// The number of the job currently being worked, in dispatch order.
+		size_t current_job;
+		
+		workshop(): release_workshop(false), current_job(0) {}
 	};
 
 	typedef std::function< std::shared_ptr<workshop>()     >    workshop_builder_t;
@@ -70,6 +73,64 @@ namespace etk {
 
 
 
+	// Per-job partial sums for a dispatch that reduces into shared totals.
+	//
+	// Each job writes only its own slot, so workshops can send results without
+	// taking the result mutex, and combine() adds the slots together in a fixed
+	// pairwise tree over job numbers. As long as the number of jobs does not
+	// depend on the number of threads, the totals are bitwise reproducible no
+	// matter how many threads ran or which thread ran which job.
+	class job_partials {
+		size_t _njobs;
+		size_t _width;
+		std::vector<double> _slots;
+	public:
+		job_partials();
+		
+		void resize(size_t njobs, size_t width);
+		inline size_t njobs() const { return _njobs; }
+		inline size_t width() const { return _width; }
+		inline double* slot(size_t job) { return &_slots[job*_width]; }
+		
+		// Reduce all slots, and return a pointer to the total (which is held in slot 0).
+		// The slots are overwritten and must be refilled before the next combine.
+		const double* combine();
+		
+		// A thread-independent job count for ncases cases, with slots of the given
+		// width, that keeps the slot storage within about budget_bytes.
+		static size_t njobs_for(size_t ncases, size_t width, size_t budget_bytes=256*1024*1024);
+	};
+
+	// A source of case data too large to hold in memory all at once, which is
+	// presented one block of cases at a time.
+	//
+	// A dispatcher given a stream never lets a job cross a block boundary, and
+	// works the blocks in order, calling load_block before each one. The stream
+	// is also told which block comes next, so it can fetch that block in the
+	// background while the current one is being worked.
+	class case_stream {
+	public:
+		virtual ~case_stream() {}
+		
+		// The number of cases in each block (the last block may be short).
+		virtual size_t block_cases() const =0;
+		
+		// Make cases [first, first+length) available, and start fetching the
+		// following block, if next_length is not zero.
+		virtual void load_block(size_t first, size_t length, size_t next_first, size_t next_length) =0;
+		
+		size_t n_blocks(size_t ncases) const;
+		
+		// Call fn(first,length) on each block of ncases cases in order, with that block loaded.
+		void for_each_block(size_t ncases, const std::function<void(size_t,size_t)>& fn);
+	};
+
+	// Splits a range of cases into jobs and works them with a set of workshops.
+	//
+	// The workshops (and the per-thread state they hold) persist between calls to
+	// dispatch, but the threads do not belong to the dispatcher: each dispatch
+	// runs one task per workshop on the shared etk::worker_pool, and the
+	// workshops claim jobs with an atomic cursor instead of a locked queue.
 	class dispatcher {
 	
 		friend class workshop;
@@ -78,33 +139,35 @@ namespace etk {
 		size_t nJobs;
 		boosted::mutex result_mutex;
 		std::vector< boosted::shared_ptr<workshop> > workshops;
-		std::vector< boosted::shared_ptr<boosted::thread> > threads;
 		workshop_builder_t workshop_builder;
 
 		void add_thread();
 
-		bool terminate;
-
-		boosted::mutex queue_mutex;
-		std::deque<job> jobs_waiting;
-		std::set<size_t> jobs_out;
-		job next_job();
-		void finished_job(const size_t& job_id);
-		void etk_exception_on_job(const size_t& job_id, const etk::exception_t& err);
-		void std_exception_on_job(const size_t& job_id, const std::exception& err);
-		void request_work();
-		bool work_remains();
-		boosted::condition_variable has_jobs;
-		boosted::condition_variable jobs_done;
-
-		boosted::mutex workdone_mutex;
+		std::vector<job> jobs_waiting;
+		std::atomic<size_t> jobs_cursor;
+		size_t jobs_limit;
+		
+		case_stream* stream;
+		const std::vector<job>* sample;
+		std::vector<job> blocks;
+		std::vector<size_t> block_job_ends;
+		void request_block_work(size_t fixed_jobs);
+		job next_job(size_t& job_number);
+		void etk_exception_on_job(const size_t& firstcase, const etk::exception_t& err);
+		void std_exception_on_job(const size_t& firstcase, const std::exception& err);
+		void request_work(size_t fixed_jobs=0);
+		void request_sample_work(size_t fixed_jobs);
 		
 	  public:
 		int schedule_size;
 		
-		dispatcher(int nThreads, size_t nJobs, workshop_builder_t workshop_builder);
+		dispatcher(int nThreads, size_t nJobs, workshop_builder_t workshop_builder, case_stream* stream=nullptr, const std::vector<job>* sample=nullptr);
+		// When a sample is given and is not empty when dispatch is called, only
+		//  the case ranges in it are worked, one job for each, in place of all
+		//  nJobs cases. The sample is read at each dispatch, so its owner can
+		//  change it between calls. A sample cannot be used with a stream.
 		~dispatcher();
-		void dispatch(int nThreads=-9, workshop_updater_t* updater=nullptr);
+		void dispatch(int nThreads=-9, workshop_updater_t* updater=nullptr, job_partials* partials=nullptr);
 		void release();
 		
 		boosted::mutex exception_mutex;
@@ -122,6 +185,8 @@ namespace etk {
 
 #define USE_DISPATCH(x,threads,...) if (!(x)) {(x)=boosted::make_shared<etk::dispatcher>(threads,__VA_ARGS__);} else {} (x)->dispatch(threads)
 #define UPDATE_AND_DISPATCH(x,threads,updater,...) if (!(x)) {(x)=boosted::make_shared<etk::dispatcher>(threads,__VA_ARGS__);} else {} (x)->dispatch(threads, updater)
+#define REDUCE_AND_DISPATCH(x,threads,partials,...) if (!(x)) {(x)=boosted::make_shared<etk::dispatcher>(threads,__VA_ARGS__);} else {} (x)->dispatch(threads, nullptr, partials)
+#define UPDATE_REDUCE_AND_DISPATCH(x,threads,updater,partials,...) if (!(x)) {(x)=boosted::make_shared<etk::dispatcher>(threads,__VA_ARGS__);} else {} (x)->dispatch(threads, updater, partials)
 
 
 #endif // __TOOLBOX_WORKSHOPS__
@@ -20,6 +20,7 @@
 
 
 #include "elm_calculations.h"
+#include "etk_simd.h"
 
 void elm::__logit_utility
 ( etk::memarray&  U
@@ -30,7 +31,21 @@ void elm::__logit_utility
 , const double&   U_premultiplier
 )
 {
-	if (Data_CA && Data_CA->nVars()>0 /*&& Data_CA->fully_loaded()*/) {
+	if (Data_CA && Data_CA->nVars()>0 && Data_CA->dtype==NPY_FLOAT) {
+		// Single precision data, widened and summed in double
+		etk::simd::mixed_gemv_t gemv = etk::simd::mixed_gemv();
+		if (U.size2()==Data_CA->nAlts()) {
+			gemv(Data_CA->nCases() * Data_CA->nAlts(), Data_CA->nVars(), 1,
+				 Data_CA->floatvalues(0), Data_CA->nVars(),
+				 *(*Coef_CA), U_premultiplier, *U, 1);
+		} else {
+			for (unsigned a=0;a<Data_CA->nAlts();a++) {
+				gemv(Data_CA->nCases(), Data_CA->nVars(), 1,
+					 Data_CA->floatvalues(0)+(a*Data_CA->nVars()), Data_CA->nAlts()*Data_CA->nVars(),
+					 *(*Coef_CA), U_premultiplier, *U+a, U.size2());
+			}
+		}
+	} else if (Data_CA && Data_CA->nVars()>0 /*&& Data_CA->fully_loaded()*/) {
 		// Fast Linear Algebra		
 		if (U.size2()==Data_CA->nAlts()) {
 			cblas_dgemv(CblasRowMajor,CblasNoTrans,
@@ -74,7 +89,13 @@ void elm::__logit_utility
 		if (U_premultiplier) U.scale(U_premultiplier); else U.initialize(0.0);
 	}
 	
-	if (Data_CO && Data_CO->nVars()>0 /*&& Data_CO->fully_loaded()*/) {
+	if (Data_CO && Data_CO->nVars()>0 && Data_CO->dtype==NPY_FLOAT) {
+		// Single precision data, widened and summed in double
+		etk::simd::mixed_gemm(Data_CO->nCases(), (*Coef_CO).size2(), Data_CO->nVars(),
+							  1, Data_CO->floatvalues(0), Data_CO->nVars(),
+							  *(*Coef_CO), (*Coef_CO).size2(),
+							  1, *U, U.size2());
+	} else if (Data_CO && Data_CO->nVars()>0 /*&& Data_CO->fully_loaded()*/) {
 		// Fast Linear Algebra
 		cblas_dgemm(CblasRowMajor,CblasNoTrans,CblasNoTrans,
 					Data_CO->nCases(), (*Coef_CO).size2(), Data_CO->nVars(),
@@ -0,0 +1,176 @@
+/*
+ *  elm_incremental_utility.cpp
+ *
+ *  Copyright 2007-2017 Jeffrey Newman
+ *
+ *  Larch is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *  
+ *  Larch is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *  
+ *  You should have received a copy of the GNU General Public License
+ *  along with Larch.  If not, see <http://www.gnu.org/licenses/>.
+ *  
+ */
+
+#include <cstring>
+#include "etk.h"
+#include "elm_incremental_utility.h"
+
+// Each incremental update adds rounding error to the stored utility, so it is
+//  recomputed in full after this many updates.
+#define INCREMENTAL_UTILITY_REFRESH 64
+
+// A column update reads a strided column of the data, which costs about as much
+//  memory traffic as several rows of the full product; past this fraction of the
+//  coefficients changed, recomputing is quicker.
+#define INCREMENTAL_UTILITY_MAX_FRACTION 0.25
+
+
+namespace {
+
+	void _column_axpy(const size_t& n, const double& alpha, const elm::darray* x, const size_t& offset, const size_t& incx, double* y, const size_t& incy)
+	{
+		if (x->dtype==NPY_FLOAT) {
+			const float* xf = x->floatvalues(0) + offset;
+			for (size_t i=0; i<n; i++, xf+=incx, y+=incy) {
+				*y += alpha * double(*xf);
+			}
+		} else {
+			cblas_daxpy(n, alpha, x->values_constptr(0)+offset, incx, y, incy);
+		}
+	}
+
+	void _changed(const etk::ndarray* coef, const std::vector<double>& was, const size_t& n, std::vector<size_t>& changed)
+	{
+		const double* now = coef->ptr();
+		for (size_t i=0; i<n; i++) {
+			if (now[i]!=was[i]) changed.push_back(i);
+		}
+	}
+
+}
+
+
+elm::incremental_utility::incremental_utility()
+: _utility  ()
+, _coef_ca  ()
+, _coef_co  ()
+, _data_ca  ()
+, _data_co  ()
+, _updates  (0)
+, _valid    (false)
+, _current  (false)
+, _filling  (false)
+, _stat_updates  (0)
+, _stat_rebuilds (0)
+{
+}
+
+void elm::incremental_utility::reset()
+{
+	_utility.destroy();
+	_coef_ca.clear();
+	_coef_co.clear();
+	_data_ca.reset();
+	_data_co.reset();
+	_updates = 0;
+	_valid = false;
+	_current = false;
+	_filling = false;
+}
+
+bool elm::incremental_utility::prepare(const ca_co_packet& packet, const size_t& ncases, const size_t& nalts)
+{
+	_current = false;
+	_filling = false;
+	
+	bool usable = _valid
+		&& !(packet.Data_CE && packet.Data_CE->active())
+		&& packet.Data_CA == _data_ca
+		&& packet.Data_CO == _data_co
+		&& _utility.size1() == ncases
+		&& _utility.size2() == nalts
+		&& _updates < INCREMENTAL_UTILITY_REFRESH;
+	
+	size_t nca = (packet.Data_CA) ? packet.Data_CA->nVars() : 0;
+	size_t nco = (packet.Data_CO && packet.Data_CO->nVars()>0) ? packet.Coef_CO->size() : 0;
+	if (usable) {
+		usable = (_coef_ca.size()==nca) && (_coef_co.size()==nco);
+	}
+	
+	std::vector<size_t> changed_ca;
+	std::vector<size_t> changed_co;
+	if (usable) {
+		if (nca) _changed(packet.Coef_CA, _coef_ca, nca, changed_ca);
+		if (nco) _changed(packet.Coef_CO, _coef_co, nco, changed_co);
+		size_t n_changed = changed_ca.size()+changed_co.size();
+		if (n_changed > 1 && n_changed > INCREMENTAL_UTILITY_MAX_FRACTION*(nca+nco)) {
+			usable = false;
+		}
+	}
+	
+	if (!usable) {
+		_valid = false;
+		_utility.resize(ncases, nalts);
+		_filling = true;
+		_stat_rebuilds++;
+		return false;
+	}
+	
+	if (changed_ca.size() || changed_co.size()) {
+		// idCA: U[c,a] += d * X[c,a,v] for each alternative
+		size_t nalts_ca = packet.Data_CA ? packet.Data_CA->nAlts() : 0;
+		for (auto v: changed_ca) {
+			double d = packet.Coef_CA->ptr()[v] - _coef_ca[v];
+			for (size_t a=0; a<nalts_ca; a++) {
+				_column_axpy(ncases, d, &*packet.Data_CA, a*nca+v, nalts_ca*nca, _utility.ptr(0)+a, nalts);
+			}
+			_coef_ca[v] = packet.Coef_CA->ptr()[v];
+		}
+		// idCO: U[c,a] += d * X[c,v] for the alternative of the coefficient
+		size_t nvars_co = packet.Data_CO ? packet.Data_CO->nVars() : 0;
+		size_t ncols_co = packet.Coef_CO ? packet.Coef_CO->size2() : 0;
+		for (auto i: changed_co) {
+			size_t v = i / ncols_co;
+			size_t a = i % ncols_co;
+			double d = packet.Coef_CO->ptr()[i] - _coef_co[i];
+			_column_axpy(ncases, d, &*packet.Data_CO, v, nvars_co, _utility.ptr(0)+a, nalts);
+			_coef_co[i] = packet.Coef_CO->ptr()[i];
+		}
+		_updates++;
+	}
+	
+	_current = true;
+	_stat_updates++;
+	return true;
+}
+
+void elm::incremental_utility::record(const ca_co_packet& packet)
+{
+	size_t nca = (packet.Data_CA) ? packet.Data_CA->nVars() : 0;
+	size_t nco = (packet.Data_CO && packet.Data_CO->nVars()>0) ? packet.Coef_CO->size() : 0;
+	_coef_ca.assign(packet.Coef_CA->ptr(), packet.Coef_CA->ptr()+nca);
+	_coef_co.assign(packet.Coef_CO->ptr(), packet.Coef_CO->ptr()+nco);
+	_data_ca = packet.Data_CA;
+	_data_co = packet.Data_CO;
+	_updates = 0;
+	_valid = true;
+	_current = true;
+	_filling = false;
+}
+
+void elm::incremental_utility::load_rows(etk::ndarray* U, const size_t& firstcase, const size_t& numberofcases, const size_t& U_offset) const
+{
+	memcpy(U->ptr(firstcase-U_offset), _utility.ptr(firstcase), sizeof(double)*_utility.size2()*numberofcases);
+}
+
+void elm::incremental_utility::save_rows(const etk::ndarray* U, const size_t& firstcase, const size_t& numberofcases, const size_t& U_offset)
+{
+	memcpy(_utility.ptr(firstcase), U->ptr(firstcase-U_offset), sizeof(double)*_utility.size2()*numberofcases);
+}
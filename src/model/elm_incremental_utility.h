@@ -0,0 +1,81 @@
+/*
+ *  elm_incremental_utility.h
+ *
+ *  Copyright 2007-2017 Jeffrey Newman
+ *
+ *  Larch is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *  
+ *  Larch is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *  
+ *  You should have received a copy of the GNU General Public License
+ *  along with Larch.  If not, see <http://www.gnu.org/licenses/>.
+ *  
+ */
+
+#ifndef __ELM_INCREMENTAL_UTILITY_H__
+#define __ELM_INCREMENTAL_UTILITY_H__
+
+#include <vector>
+#include "etk_ndarray.h"
+#include "elm_packets.h"
+
+namespace elm {
+
+	// The linear utility X*b of every case and alternative, kept between
+	//  evaluations along with the coefficients it was computed for. When
+	//  only a few coefficients have changed since, it is brought up to date
+	//  with one axpy over the matching data column per changed coefficient,
+	//  instead of recomputing the whole product.
+	class incremental_utility {
+
+		etk::ndarray        _utility;
+		std::vector<double> _coef_ca;
+		std::vector<double> _coef_co;
+		elm::darray_ptr     _data_ca;
+		elm::darray_ptr     _data_co;
+		unsigned            _updates;
+		bool                _valid;
+		bool                _current;
+		bool                _filling;
+		size_t              _stat_updates;
+		size_t              _stat_rebuilds;
+
+	public:
+		incremental_utility();
+
+		bool prepare(const ca_co_packet& packet, const size_t& ncases, const size_t& nalts);
+		// Update the stored utility for the coefficients in packet, if that can
+		//  be done in place. Returns true if it is then current. Otherwise the
+		//  array is sized [ncases,nalts], and the caller computes the utility,
+		//  stores it with save_rows, and calls record when all cases are done.
+		
+		void record(const ca_co_packet& packet);
+		void reset();
+		
+		bool current() const { return _current; }
+		bool filling() const { return _filling; }
+		// Whether the stored utility can be read as is, or is waiting to be
+		//  filled by the caller of prepare.
+		
+		size_t stat_updates() const { return _stat_updates; }
+		size_t stat_rebuilds() const { return _stat_rebuilds; }
+		void reset_statistics() { _stat_updates = 0; _stat_rebuilds = 0; }
+		// The number of times prepare brought the stored utility up to date
+		//  in place, or left it to be recomputed in full. These are kept
+		//  through reset.
+		void load_rows(etk::ndarray* U, const size_t& firstcase, const size_t& numberofcases, const size_t& U_offset=0) const;
+		void save_rows(const etk::ndarray* U, const size_t& firstcase, const size_t& numberofcases, const size_t& U_offset=0);
+		// Copy rows between the stored utility and U, which must have the
+		//  same number of columns. Case c is in row c-U_offset of U, so that
+		//  U may hold only a block of cases.
+	};
+
+}
+
+#endif // __ELM_INCREMENTAL_UTILITY_H__
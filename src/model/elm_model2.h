@@ -42,8 +42,12 @@
 #include "elm_inputstorage.h"
 #include "elm_model2_options.h"
 #include "elm_packets.h"
+#include "elm_incremental_utility.h"
 #include "elm_darray.h"
 #include "larch_cache.h"
+#include "etk_workshop.h"
+#include "elm_workshop_mixed.h"
+#include "elm_workshop_segmented.h"
 
 namespace etk {
   class dispatcher;
@@ -119,6 +123,12 @@ namespace elm {
 				self.setUpMessage = "autoprovision yes (estimate)"
 				if self.logger(): self.logger().info("autoprovisioned data from database")
 		%}
+		%feature("pythonprepend") estimate_multistart %{
+			if self._ref_to_db is not None and self.is_provisioned()==0:
+				self.provision()
+				self.setUpMessage = "autoprovision yes (estimate_multistart)"
+				if self.logger(): self.logger().info("autoprovisioned data from database")
+		%}
 		#endif // def SWIG
 
 
@@ -298,6 +308,20 @@ namespace elm {
 		elm::darray_ptr  Data_Weight;
 		elm::darray_ptr  Data_Avail;
 
+		// When the out_of_core_block_mb option is set and UtilityCA is provisioned
+		//  from a binary darray file, it is read in blocks of cases as it is used,
+		//  and Data_UtilityCA points to this stream.
+		boosted::shared_ptr<elm::darray_stream> Data_UtilityCA_stream;
+		inline etk::case_stream* _case_stream() const {return Data_UtilityCA_stream.get();}
+		void _work_in_blocks(etk::workshop& w, boosted::mutex* result_mutex);
+
+		// The linear utility from the last evaluation, updated in place when only
+		//  a few utility coefficients change (see the incremental_utility option).
+		//  _utility_base prepares it for the current coefficients, or returns
+		//  nullptr if it cannot be used for this model.
+		elm::incremental_utility Utility_Base;
+		elm::incremental_utility* _utility_base(const size_t& nalts);
+
 
 	private:
 		void scan_for_multiple_choices();
@@ -359,10 +383,15 @@ namespace elm {
 
 	public:
 		virtual double objective();
+		virtual double objective_only();
 		virtual const etk::memarray& gradient (const bool& force_recalculate=false) ;
+		virtual bool case_sample(const double& fraction);
 
 
-//		virtual void calculate_hessian();
+		virtual void calculate_hessian();
+
+		virtual void objective_at(const double* points, const size_t& npoints, double* results);
+		virtual void gradient_at (const double* points, const size_t& npoints, double* results);
 
 		void calculate_probability();
 		void calculate_utility_only();
@@ -376,15 +405,24 @@ namespace elm {
 
 	public:
 		void clear_cache();
+		PyObject* cache_statistics() const;
+		void reset_cache_statistics();
+		// The number of times saved results were found (hits) or not (misses)
+		//  for each kind of result, and the size of the cache, as a dict. The
+		//  utility counts are of evaluations where the stored utility was
+		//  updated in place for changed coefficients, or recomputed in full.
 		
 		double loglike();
-//		double loglike_cached();
+		double loglike_cached();
 //		double loglike_nocache();
 //		double loglike(std::vector<double> v);
 //		double loglike_cached(std::vector<double> v);
 //		double loglike_nocache(std::vector<double> v);
 		std::shared_ptr<etk::ndarray> loglike_casewise();
 		std::shared_ptr<etk::ndarray> loglike_casewise(std::vector<double> v);
+	private:
+		void _case_loglike(etk::ndarray& ll_casewise);
+	public:
 		
 		std::shared_ptr<etk::ndarray> _gradient_casewise();
 		std::shared_ptr<etk::ndarray> _gradient_casewise(std::vector<double> v);
@@ -438,15 +476,22 @@ namespace elm {
 		void mnl_probability();
 //		void mnl_gradient   ();
 		void mnl_gradient_v2();
-		//void mnl_hessian    ();
+		void mnl_hessian    ();
 
 		void nl_probability();
 		void nl_gradient   ();
+		void nl_hessian    ();
 
 		void ngev_probability();
 		void ngev_probability_given_utility();
 		void ngev_gradient   ();
 
+		void mixed_probability();
+		void mixed_gradient   ();
+
+		void segmented_probability();
+		void segmented_gradient   ();
+
 		void calculate_hessian_and_save();
 		
 		//bool any_holdfast() ;
@@ -460,8 +505,39 @@ namespace elm {
 		boosted::shared_ptr<etk::dispatcher> probability_dispatcher;
 		boosted::shared_ptr<etk::dispatcher> probability_given_utility_dispatcher;
 		boosted::shared_ptr<etk::dispatcher> gradient_dispatcher;
+		boosted::shared_ptr<etk::dispatcher> hessian_dispatcher;
 		boosted::shared_ptr<etk::dispatcher> d_logsums_dispatcher;
 		boosted::shared_ptr<etk::dispatcher> loglike_dispatcher;
+		boosted::shared_ptr<etk::dispatcher> mixed_probability_dispatcher;
+		boosted::shared_ptr<etk::dispatcher> mixed_gradient_dispatcher;
+		boosted::shared_ptr<etk::dispatcher> segmented_probability_dispatcher;
+		boosted::shared_ptr<etk::dispatcher> segmented_gradient_dispatcher;
+		
+		// Gradient and BHHH partial sums, one slot per gradient job, which are
+		//  combined in a fixed order so results do not depend on the thread count.
+		//  The analytic hessian borrows the same storage for its own partial sums.
+		etk::job_partials gradient_partials;
+		
+		// The weighted log likelihood of each probability job, combined in the
+		//  same fixed order into fused_LogL.
+		etk::job_partials loglike_partials;
+		
+		// When case_sample has chosen a random subset of the cases, the ranges
+		//  of cases in it, which the MNL probability and gradient dispatchers
+		//  then work in place of all the cases. Empty when all cases are used.
+		std::vector<etk::job> _case_sample;
+		void prepare_gradient_partials();
+		void combine_gradient_partials();
+		void prepare_hessian_partials();
+		void combine_hessian_partials();
+		void prepare_loglike_partials();
+		
+		// A private copy of the coefficient and calculation arrays, so finite
+		//  difference points can be evaluated concurrently when the
+		//  parallel_finite_diff option is on.
+		struct evaluation_slot;
+		bool _parallel_evaluation_available(const bool& with_gradient);
+		void _parallel_evaluate_at(const double* points, const size_t& npoints, double* results, const bool& with_gradient);
 		
 		boosted::shared_ptr<etk::workshop> make_shared_workshop_accumulate_loglike ();
 		boosted::shared_ptr<etk::workshop> make_shared_workshop_mnl_probability ();
@@ -474,6 +550,18 @@ namespace elm {
 		// Private variables to use in likelihood accumulation
 		double accumulate_LogL;
 		etk::ndarray* PrToAccum;
+		
+		// The weighted log likelihood added up by the probability workshops
+		//  as they go (see the fused_block_kb option), from loglike_partials,
+		//  and whether it belongs to the probabilities most recently calculated.
+		double fused_LogL = 0.0;
+		bool   fused_LogL_current = false;
+		
+		// Set by objective_only while it runs. An MNL model then finds the log
+		//  likelihood without writing the probability array, and notes that
+		//  in _probability_skipped, until the probability is next calculated.
+		bool   _loglike_only = false;
+		bool   _probability_skipped = false;
 
 	protected:
 		
@@ -577,6 +665,8 @@ namespace elm {
 		void _setUp_QMNL();
 		void _setUp_NL();
 		void _setUp_NGEV();
+		void _setUp_mixed();
+		void _setUp_segments();
 
 	
 	public:
@@ -585,6 +675,60 @@ namespace elm {
 		void _parameter_push(const std::vector<double>& v);
 		void _parameter_log();
 
+//////// MARK: MIXED LOGIT /////////////////////////////////////////////////////////
+
+	protected:
+		// Each random term adds the draw in its dimension, times the scale
+		//  freedom, to the target freedom. Terms in the same dimension are
+		//  correlated. The slots are the same terms as freedom numbers, found
+		//  when the model is set up.
+		struct mixed_term {
+			std::string target;
+			std::string scale;
+			size_t      dimension;
+		};
+		std::vector<mixed_term>      Mixed_Terms;
+		std::vector<elm::mixed_slot> Mixed_Slots;
+		
+		etk::ndarray Mixed_Draws;     // [case, draw, dimension], standard normal
+		std::string  Mixed_Draws_key; // the shape, type and seed of Mixed_Draws
+		etk::ndarray Mixed_Delta_CA;  // [CA variable, dimension]
+		etk::ndarray Mixed_Delta_CO;  // [CO variable, alt, dimension]
+		
+		bool _mixed_active() const { return !Mixed_Terms.empty(); }
+		size_t _mixed_dimension_of(const std::string& mean_name) const;
+		void _setUp_mixed_draws();
+		void _setUp_mixed_deltas();
+		void _reset_mixed();
+
+//////// MARK: SEGMENTS //////////////////////////////////////////////////////////////
+
+	protected:
+		// The cases are split into segments by the value of Input_Segment, an
+		//  idCO column, and each segment has its own freedom for each of the
+		//  segment parameters, named param_name+"@"+code. The parameter arrays
+		//  of segment s are those of the utility with these names in place.
+		std::string              Input_Segment;
+		std::vector<long long>   Segment_Codes;
+		std::vector<std::string> Segment_Parameters;
+		
+		elm::darray_ptr          Data_SegmentCO;
+		std::vector<unsigned>    Segment_Of_Case;
+		std::vector<size_t>      Segment_Case_Order;     // the cases, stably sorted by segment
+		elm::darray_ptr          Segment_Of_Case_source; // the data it was found from
+		
+		elm::segment_params Segment_Params_CA;
+		elm::segment_params Segment_Params_CO;
+		elm::segment_coefs  Segment_Coef_CA;
+		elm::segment_coefs  Segment_Coef_CO;
+		
+		bool _segmented_active() const { return !Input_Segment.empty(); }
+		std::string _segment_freedom_name(const std::string& param_name, const long long& code) const;
+		void _setUp_segment_params();
+		void _setUp_segment_of_case();
+		void _pull_segment_coefs();
+		void _reset_segments();
+
 //////// MARK: RECORDED RESULTS //////////////////////////////////////////////////////
 
 	protected:
@@ -762,6 +906,29 @@ namespace elm {
 							   std::string freedom_name="", 
 							   const double& freedom_multiplier=1.0);
 
+		void mixed_normal   (const std::string& mean_name, std::string scale_name="");
+		void mixed_correlate(const std::string& target_name, const std::string& scale_name,
+							 const std::string& source_mean_name);
+		void mixed_clear    ();
+		unsigned mixed_dimensions() const;
+		// A mixed logit model lets the coefficient of a parameter vary across
+		//  the cases as a normal distribution, with the parameter as its mean
+		//  and a new scale parameter, named mean_name+"_sd" by default, as its
+		//  standard deviation. mixed_correlate adds the same draw, times
+		//  another scale parameter, to a second parameter, so the two are
+		//  correlated. The probabilities are simulated with option.mixed_draws
+		//  draws per case. Only MNL models can be mixed.
+
+		void segment_by       (const std::string& column_name, const std::vector<long long>& codes);
+		void segment_parameter(const std::string& param_name);
+		void segment_clear    ();
+		std::vector<long long> segment_codes() const;
+		// A segmented model splits the cases by the code in an idCO column,
+		//  and estimates every segment at once over the same data. Each segment
+		//  parameter is replaced by one freedom per segment, which starts from
+		//  its value, and the original is held fast. Only MNL models can be
+		//  segmented.
+
 	public:
 		#ifdef SWIG
 		%feature("shadow") Model2::Input_Graph() %{
@@ -814,6 +981,18 @@ NOSWIG(	PyObject*         logger (int z);)
 NOSWIG(	runstats estimate(std::vector<sherpa_pack>* opts); )
 		runstats estimate(std::vector<sherpa_pack> opts);
 		runstats estimate_tight(double magnitude=8);
+		// Once the model is set up, estimate, loglike, and the uncached
+		//  negative_d_loglike and bhhh release the Python interpreter lock,
+		//  so other Python threads can run, including other models. A single
+		//  model must still be used by only one thread at a time.
+
+		std::vector<runstats> estimate_multistart(const etk::ndarray* starts);
+NOSWIG(	std::vector<runstats> estimate_multistart(const etk::ndarray* starts, std::vector<sherpa_pack>* opts); )
+		std::vector<runstats> estimate_multistart(const etk::ndarray* starts, std::vector<sherpa_pack> opts);
+		// Estimate the model from each row of starts at the same time, each
+		//  on its own copy of the model that shares the data already provisioned
+		//  for this one, and finish at the best of them. The option.threads are
+		//  divided among the starts. Returns the run statistics of every start.
 
 		/// The _get* functions are used to get attributes of the model for saving/pickling
 		PyObject* _get_parameter() const;
@@ -851,6 +1030,11 @@ FOSWIG(	%rename(__repr__) representation; )
 	public:
 		Model2();
 		Model2(elm::Fountain& d);
+NOSWIG(	Model2(const Model2& dupe); )
+		// A copy of the specification, parameters, options and provisioned
+		//  data of dupe, which is shared and not copied, ready to be set up on
+		//  its own. Calculation arrays and results are not copied. This is
+		//  used for the concurrent starts of estimate_multistart.
 		~Model2();
 
 		void delete_data_fountain();
@@ -0,0 +1,420 @@
+/*
+ *  elm_model2_finite_diff.cpp
+ *
+ *  Copyright 2007-2017 Jeffrey Newman
+ *
+ *  Larch is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Larch is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with Larch.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+
+#include <cstring>
+#include <memory>
+#include <exception>
+#include "elm_model2.h"
+#include "elm_parameter2.h"
+#include "elm_names.h"
+#include "elm_workshop_mnl_prob.h"
+#include "elm_workshop_mnl_gradient.h"
+#include "elm_workshop_nl_probability.h"
+#include "elm_workshop_nl_gradient.h"
+#include "elm_workshop_ngev_probability.h"
+#include "elm_workshop_ngev_gradient.h"
+#include "elm_workshop_loglike.h"
+#include "etk_thread.h"
+#include <iostream>
+
+using namespace etk;
+using namespace elm;
+using namespace std;
+
+
+
+// Everything a probability, log likelihood, and gradient evaluation writes to
+//  is copied here, so several slots can work on different parameter vectors at
+//  the same time. The data, the parameter linkages, and the network structure
+//  are only read, and are shared with the model. Slots allocate arrays, so they
+//  must be created and destroyed in the calling thread.
+struct elm::Model2::evaluation_slot
+{
+	etk::ndarray Coef_UtilityCA  ;
+	etk::ndarray Coef_UtilityCO  ;
+	etk::ndarray Coef_SamplingCA ;
+	etk::ndarray Coef_SamplingCO ;
+	etk::ndarray Coef_QuantityCA ;
+	etk::ndarray Coef_QuantLogSum;
+	etk::ndarray Coef_LogSum     ;
+	etk::ndarray Coef_Edges      ;
+
+	etk::ndarray Utility;
+	etk::ndarray Probability;
+	etk::ndarray Cond_Prob;
+	etk::ndarray Allocation;
+	etk::ndarray Quantity;
+	etk::ndarray CaseLogLike;
+	etk::ndarray SamplingWeight;
+	etk::ndarray AdjProbability;
+
+	// The nest mu values are read through the cells, so the slot has its own
+	//  network pointing at its own Coef_LogSum.
+	VAS_System Xylem;
+
+	etk::memarray GCurrent;
+	etk::triangle Bhhh;
+
+	double LogL;
+	etk::ndarray* PrToAccum;
+	elm::darray_ptr Weight;
+	bool use_casewise_loglike;
+
+	boosted::mutex lock;
+	boosted::shared_ptr<etk::workshop> probability_w;
+	boosted::shared_ptr<etk::workshop> loglike_w;
+	boosted::shared_ptr<etk::workshop> gradient_w;
+
+	evaluation_slot(Model2& m, const bool& with_gradient);
+
+	elm::ca_co_packet utility_packet(Model2& m);
+	elm::ca_co_packet quantity_packet(Model2& m);
+	elm::ca_co_packet sampling_packet(Model2& m);
+	elm::ca_co_packet allocation_packet(Model2& m);
+
+	void pull_coefficients_from_freedoms(Model2& m, const double* fr);
+
+	// Returns the log likelihood at fr, and writes the gradient (as in GCurrent)
+	//  into grad if it is given.
+	double evaluate(Model2& m, const double* fr, double* grad);
+};
+
+
+
+static void _clone_array(etk::ndarray& to, const etk::ndarray& from)
+{
+	if (from.pool) to = from;
+}
+
+elm::Model2::evaluation_slot::evaluation_slot(Model2& m, const bool& with_gradient)
+: Xylem (m.Xylem)
+, LogL  (0.0)
+, PrToAccum (nullptr)
+, Weight (m.Data_Weight_active())
+, use_casewise_loglike (false)
+{
+	_clone_array(Coef_UtilityCA  , m.Coef_UtilityCA  );
+	_clone_array(Coef_UtilityCO  , m.Coef_UtilityCO  );
+	_clone_array(Coef_SamplingCA , m.Coef_SamplingCA );
+	_clone_array(Coef_SamplingCO , m.Coef_SamplingCO );
+	_clone_array(Coef_QuantityCA , m.Coef_QuantityCA );
+	_clone_array(Coef_QuantLogSum, m.Coef_QuantLogSum);
+	_clone_array(Coef_LogSum     , m.Coef_LogSum     );
+	_clone_array(Coef_Edges      , m.Coef_Edges      );
+
+	_clone_array(Utility       , m.Utility       );
+	_clone_array(Probability   , m.Probability   );
+	_clone_array(Cond_Prob     , m.Cond_Prob     );
+	_clone_array(Allocation    , m.Allocation    );
+	_clone_array(Quantity      , m.Quantity      );
+	_clone_array(CaseLogLike   , m.CaseLogLike   );
+	_clone_array(SamplingWeight, m.SamplingWeight);
+	if (m.AdjProbability.pool == m.Probability.pool) {
+		AdjProbability.same_memory_as(Probability);
+	} else {
+		_clone_array(AdjProbability, m.AdjProbability);
+	}
+
+	Xylem.repoint_parameters(*Coef_LogSum, NULL);
+
+	PrToAccum = (m.sampling_packet().relevant() ? &AdjProbability : &Probability);
+
+	if ((m.features & MODELFEATURES_ALLOCATION)||(m.features & MODELFEATURES_QUANTITATIVE)) {
+		probability_w = boosted::make_shared<workshop_ngev_probability>(m.nNodes
+								 , utility_packet(m), allocation_packet(m), sampling_packet(m), quantity_packet(m)
+								 , m.Params_LogSum
+								 , m.Params_QuantLogSum
+								 , Coef_QuantLogSum.ptr()
+								 , m.Data_Avail
+								 , &Probability
+								 , &Cond_Prob
+								 , &AdjProbability
+								 , &Xylem
+								 , m.option.mute_nan_warnings
+								 , &m.msg
+								 );
+		if (with_gradient) {
+			gradient_w = boosted::make_shared<workshop_ngev_gradient>(m.dF()
+								 , m.nNodes
+								 , utility_packet(m)
+								 , &m.Data_UtilityCE_manual
+								 , allocation_packet(m)
+								 , sampling_packet(m)
+								 , quantity_packet(m)
+								 , m.Params_LogSum
+								 , m.Params_QuantLogSum
+								 , Coef_QuantLogSum.ptr()
+								 , m.Data_Choice
+								 , Weight
+								 , &AdjProbability
+								 , &Probability
+								 , &Cond_Prob
+								 , &Xylem
+								 , &GCurrent
+								 , nullptr
+								 , &Bhhh
+								 , &m.msg
+								 , nullptr
+								 , nullptr
+								 );
+		}
+	} else if ((m.features & MODELFEATURES_NESTING)) {
+		probability_w = boosted::make_shared<workshop_nl_probability>(m.nNodes
+								 , utility_packet(m), sampling_packet(m)
+								 , m.Params_LogSum
+								 , m.Data_Avail
+								 , &Probability
+								 , &Cond_Prob
+								 , &AdjProbability
+								 , &Xylem
+								 , m.option.mute_nan_warnings
+								 , &m.msg
+								 );
+		if (with_gradient) {
+			gradient_w = boosted::make_shared<workshop_nl_gradient>(m.dF()
+								 , m.nNodes
+								 , utility_packet(m)
+								 , sampling_packet(m)
+								 , m.Params_LogSum
+								 , m.Data_Choice
+								 , Weight
+								 , &AdjProbability
+								 , &Probability
+								 , &Cond_Prob
+								 , &Xylem
+								 , &GCurrent
+								 , &Bhhh
+								 , &m.msg
+								 );
+		}
+	} else {
+		// MNL
+		use_casewise_loglike = true;
+		probability_w = boosted::make_shared<elm::mnl_prob_w>(
+								 &Probability, &CaseLogLike, utility_packet(m), m.Data_Avail, m.Data_Choice,
+								 0, &m.msg);
+		if (with_gradient) {
+			gradient_w = boosted::make_shared<workshop_mnl_gradient2>(m.dF()
+								 , m.nElementals
+								 , utility_packet(m)
+								 , quantity_packet(m)
+								 , m.Data_Choice
+								 , Weight
+								 , &Probability
+								 , &GCurrent
+								 , &Bhhh
+								 , &m.msg
+								 , &m.Data_MultiChoice
+								 );
+		}
+	}
+
+	loglike_w = boosted::make_shared<elm::loglike_w>(&PrToAccum, Xylem.n_elemental(),
+								 m.Data_Choice, Weight, &LogL, nullptr, m.option.mute_nan_warnings, &m.msg);
+
+	if (with_gradient) {
+		GCurrent.resize(m.dF());
+		Bhhh.resize(m.dF());
+	}
+}
+
+
+
+elm::ca_co_packet elm::Model2::evaluation_slot::utility_packet(Model2& m)
+{
+	return elm::ca_co_packet(&m.Params_UtilityCA	,
+							 &m.Params_UtilityCO	,
+							 &Coef_UtilityCA	,
+							 &Coef_UtilityCO	,
+							 m.Data_UtilityCA	,
+							 m.Data_UtilityCO	,
+							 (m.Data_UtilityCE_builtin.active() ? &m.Data_UtilityCE_builtin : nullptr)             ,
+							 &Utility			);
+}
+
+elm::ca_co_packet elm::Model2::evaluation_slot::quantity_packet(Model2& m)
+{
+	return elm::ca_co_packet(&m.Params_QuantityCA	,
+							 nullptr         	,
+							 &Coef_QuantityCA	,
+							 nullptr         	,
+							 m.Data_QuantityCA	,
+							 nullptr         	,
+							 nullptr            ,
+							 &Quantity			);
+}
+
+elm::ca_co_packet elm::Model2::evaluation_slot::sampling_packet(Model2& m)
+{
+	return elm::ca_co_packet(&m.Params_SamplingCA	,
+							 &m.Params_SamplingCO	,
+							 &Coef_SamplingCA	,
+							 &Coef_SamplingCO	,
+							 m.Data_SamplingCA	,
+							 m.Data_SamplingCO	,
+							 (m.Data_SamplingCE_builtin.active() ? &m.Data_SamplingCE_builtin : nullptr)             ,
+							 &SamplingWeight	);
+}
+
+elm::ca_co_packet elm::Model2::evaluation_slot::allocation_packet(Model2& m)
+{
+	return elm::ca_co_packet(nullptr	,
+							 &m.Params_Edges	,
+							 nullptr	,
+							 &Coef_Edges	,
+							 nullptr	,
+							 m.Data_Allocation	,
+							 nullptr            ,
+							 &Allocation	);
+}
+
+
+
+void elm::Model2::evaluation_slot::pull_coefficients_from_freedoms(Model2& m, const double* fr)
+{
+	m.pull_from_freedoms        (m.Params_UtilityCA  , *Coef_UtilityCA  , fr);
+	m.pull_from_freedoms        (m.Params_UtilityCO  , *Coef_UtilityCO  , fr);
+	m.pull_from_freedoms        (m.Params_SamplingCA , *Coef_SamplingCA , fr);
+	m.pull_from_freedoms        (m.Params_SamplingCO , *Coef_SamplingCO , fr);
+	m.pull_and_exp_from_freedoms(m.Params_QuantityCA , *Coef_QuantityCA , fr);
+	m.pull_from_freedoms        (m.Params_QuantLogSum, *Coef_QuantLogSum, fr);
+	m.pull_from_freedoms        (m.Params_LogSum     , *Coef_LogSum     , fr, true);
+	m.pull_from_freedoms        (m.Params_Edges      , *Coef_Edges      , fr);
+}
+
+
+
+double elm::Model2::evaluation_slot::evaluate(Model2& m, const double* fr, double* grad)
+{
+	pull_coefficients_from_freedoms(m, fr);
+	probability_w->work(0, m.nCases, &lock);
+
+	// Same order of preference as accumulate_log_likelihood
+	LogL = 0.0;
+	if (use_casewise_loglike && CaseLogLike.size()) {
+		if (Weight) {
+			LogL = cblas_ddot(m.nCases, *CaseLogLike, 1, Weight->values(0,0), 1);
+		} else {
+			LogL = CaseLogLike.sum();
+		}
+	}
+	if (!LogL) {
+		loglike_w->work(0, m.nCases, &lock);
+	}
+
+	if (grad) {
+		GCurrent.initialize(0.0);
+		Bhhh.initialize(0.0);
+		gradient_w->work(0, m.nCases, &lock);
+		cblas_dcopy(m.dF(), GCurrent.ptr(), 1, grad, 1);
+	}
+	return LogL;
+}
+
+
+
+
+
+
+bool elm::Model2::_parallel_evaluation_available(const bool& with_gradient)
+{
+	if (!option.parallel_finite_diff) return false;
+	if (option.threads < 2 || nCases==0) return false;
+	// All the slots would need the same block of data at the same time
+	if (_case_stream()) return false;
+	// Slots do not carry the draws of a mixed logit model
+	if (_mixed_active()) return false;
+	// nor the parameter arrays of each segment
+	if (_segmented_active()) return false;
+	// Slots only compute analytic gradients
+	if (with_gradient && option.force_finite_diff_grad) return false;
+	// MNL with quantities is not computed by a workshop
+	if (!(features & (MODELFEATURES_NESTING|MODELFEATURES_ALLOCATION|MODELFEATURES_QUANTITATIVE))
+		&& Input_QuantityCA.size()>0) return false;
+	return true;
+}
+
+
+void elm::Model2::_parallel_evaluate_at(const double* points, const size_t& npoints, double* results, const bool& with_gradient)
+{
+	// Bring the model's own arrays up to date, to serve as the templates for the slots.
+	freshen();
+	calculate_probability();
+
+	#ifndef __APPLE__
+	openblas_set_num_threads(1);
+	#endif
+
+	size_t nslots = npoints;
+	if (nslots > size_t(option.threads)) nslots = option.threads;
+
+	std::vector< std::unique_ptr<evaluation_slot> > slots;
+	for (size_t k=0; k<nslots; k++) {
+		slots.emplace_back(new evaluation_slot(*this, with_gradient));
+	}
+
+	std::mutex failure_mutex;
+	std::exception_ptr failure;
+
+	// Slot k takes points k, k+nslots, k+2*nslots, ...
+	etk::worker_pool& pool = etk::worker_pool::global();
+	pool.reserve(nslots);
+	pool.run(nslots, [&](size_t k){
+		try {
+			for (size_t p=k; p<npoints; p+=nslots) {
+				if (with_gradient) {
+					slots[k]->evaluate(*this, points+p*dF(), results+p*dF());
+				} else {
+					results[p] = slots[k]->evaluate(*this, points+p*dF(), nullptr);
+				}
+			}
+		} catch (...) {
+			std::lock_guard<std::mutex> lock(failure_mutex);
+			if (!failure) failure = std::current_exception();
+		}
+	});
+
+	if (failure) std::rethrow_exception(failure);
+
+	INFO(msg) << "Evaluated "<<npoints<<(with_gradient?" gradients":" log likelihoods")
+	          << " for finite differences (using "<<nslots<<" threads)";
+}
+
+
+
+void elm::Model2::objective_at(const double* points, const size_t& npoints, double* results)
+{
+	if (npoints>1 && _parallel_evaluation_available(false)) {
+		_parallel_evaluate_at(points, npoints, results, false);
+	} else {
+		sherpa::objective_at(points, npoints, results);
+	}
+}
+
+void elm::Model2::gradient_at(const double* points, const size_t& npoints, double* results)
+{
+	if (npoints>1 && _parallel_evaluation_available(true)) {
+		_parallel_evaluate_at(points, npoints, results, true);
+	} else {
+		sherpa::gradient_at(points, npoints, results);
+	}
+}
+
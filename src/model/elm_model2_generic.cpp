@@ -26,7 +26,10 @@
 #include <iostream>
 #include <iomanip>
 #include "elm_workshop_loglike.h"
+#include "etk_thread.h"
 #include <bitset>
+#include <memory>
+#include <exception>
 
 
 using namespace etk;
@@ -123,6 +126,96 @@ elm::Model2::Model2(elm::Fountain& datafile)
 	}
 }
 
+
+elm::Model2::Model2(const elm::Model2& dupe)
+: sherpa(dupe)
+, _Fount(dupe._Fount)
+, Data_UtilityCE_manual (dupe.Data_UtilityCE_manual)
+, Data_UtilityCA  (dupe.Data_UtilityCA)
+, Data_UtilityCO  (dupe.Data_UtilityCO)
+, Data_SamplingCA (dupe.Data_SamplingCA)
+, Data_SamplingCO (dupe.Data_SamplingCO)
+, Data_Allocation (dupe.Data_Allocation)
+, Data_QuantityCA (dupe.Data_QuantityCA)
+, Data_Choice     (dupe.Data_Choice)
+, Data_Weight     (dupe.Data_Weight)
+, Data_Avail      (dupe.Data_Avail)
+, _LL_null (NAN)
+, _LL_nil (NAN)
+, _LL_constants (NAN)
+, weight_scale_factor (1.0)
+, nCases (dupe.nCases)
+, _nCases_recall (dupe._nCases_recall)
+, nElementals (0)
+, nNests (0)
+, nNodes (0)
+, nThreads (dupe.nThreads)
+, availability_ca_variable (dupe.availability_ca_variable)
+, features (dupe.features)
+, option()
+, _is_setUp(0)
+, Input_Utility("utility",this)
+, Input_QuantityCA(COMPONENTLIST_TYPE_UTILITYCA, this)
+, Input_QuantityScale(dupe.Input_QuantityScale)
+, Input_LogSum(COMPONENTLIST_TYPE_LOGSUM, this)
+, Input_Edges(this)
+, Input_Sampling("samplingbias",this)
+, title(dupe.title)
+, _string_sender_ptr(nullptr)
+, top_logsums_out(nullptr)
+, casewise_grad_buffer(nullptr)
+, casewise_d_logsums(nullptr)
+{
+	option.copy(dupe.option);
+
+	// The containers are copied through their bases, so that they still
+	//  belong to this model.
+	static_cast<std::vector<LinearComponent>&>(Input_Utility.ca) = dupe.Input_Utility.ca;
+	static_cast<std::map<elm::cellcode,elm::ComponentList>&>(Input_Utility.co) = dupe.Input_Utility.co;
+	static_cast<std::vector<LinearComponent>&>(Input_QuantityCA) = dupe.Input_QuantityCA;
+	static_cast<std::map<elm::cellcode,elm::LinearComponent>&>(Input_LogSum) = dupe.Input_LogSum;
+	static_cast<std::map<elm::cellcodepair,elm::EdgeValue>&>(Input_Edges) = dupe.Input_Edges;
+	static_cast<std::vector<LinearComponent>&>(Input_Sampling.ca) = dupe.Input_Sampling.ca;
+	static_cast<std::map<elm::cellcode,elm::ComponentList>&>(Input_Sampling.co) = dupe.Input_Sampling.co;
+
+	Xylem.add_dna_sequence(dupe.Xylem);
+	elm::cellcode root = dupe.Xylem.root_cellcode();
+	Xylem.regrow( &Input_LogSum, &Input_Edges, _Fount, &root, &msg );
+	nElementals = Xylem.n_elemental();
+	nNests = Xylem.n_branches();
+	nNodes = Xylem.size();
+
+	Data_UtilityCE_builtin = dupe.Data_UtilityCE_builtin;
+	Data_SamplingCE_builtin = dupe.Data_SamplingCE_builtin;
+	Data_SegmentCO = dupe.Data_SegmentCO;
+	choseness_CA_variable = dupe.choseness_CA_variable;
+	cache_valid_ca = dupe.cache_valid_ca;
+	cache_valid_co = dupe.cache_valid_co;
+
+	Mixed_Terms = dupe.Mixed_Terms;
+	Input_Segment = dupe.Input_Segment;
+	Segment_Codes = dupe.Segment_Codes;
+	Segment_Parameters = dupe.Segment_Parameters;
+	Segment_Of_Case = dupe.Segment_Of_Case;
+	Segment_Case_Order = dupe.Segment_Case_Order;
+	Segment_Of_Case_source = dupe.Segment_Of_Case_source;
+
+	for (auto a=dupe.AliasInfo.begin(); a!=dupe.AliasInfo.end(); a++) {
+		alias_ref(a->second.name, a->second.refers_to, a->second.multiplier, true);
+	}
+
+	resize_allocated_memory();
+	for (unsigned i=0; i<dF(); i++) {
+		FCurrent[i]    = dupe.FCurrent[i];
+		FHoldfast.int8_at(i) = dupe.FHoldfast.int8_at(i);
+		FNullValues[i] = dupe.FNullValues[i];
+		FInitValues[i] = dupe.FInitValues[i];
+		FMax[i]        = dupe.FMax[i];
+		FMin[i]        = dupe.FMin[i];
+	}
+	ZBest = ZCurrent = -INF;
+}
+
 elm::ParameterList* elm::Model2::_self_as_ParameterListPtr()
 {
 	return this;
@@ -339,6 +432,109 @@ runstats elm::Model2::estimate(std::vector<sherpa_pack> opts)
 }
 
 
+std::vector<runstats> elm::Model2::estimate_multistart(const etk::ndarray* starts)
+{
+	return estimate_multistart(starts, NULL);
+}
+
+std::vector<runstats> elm::Model2::estimate_multistart(const etk::ndarray* starts, std::vector<sherpa_pack> opts)
+{
+	return estimate_multistart(starts, &opts);
+}
+
+std::vector<runstats> elm::Model2::estimate_multistart(const etk::ndarray* starts, std::vector<sherpa_pack>* opts)
+{
+	if (!starts || starts->ndim()!=2) OOPS("starting points must be given as a two dimensional array");
+	setUp();
+	if (starts->size2() != dF()) {
+		OOPS("each starting point needs ",dF()," parameter values, not ",starts->size2());
+	}
+	if (_case_stream()) {
+		OOPS("the starts of estimate_multistart cannot share an out-of-core data stream");
+	}
+	
+	size_t nStarts = starts->size1();
+	std::vector<runstats> runs (nStarts);
+	if (nStarts==0) return runs;
+	if (_mixed_active()) _setUp_mixed_draws();
+	
+	// Each start is estimated on its own copy of the model, which shares the
+	//  provisioned data and the mixed logit draws. The copies allocate arrays
+	//  and may ask the data fountain (perhaps in Python) about their needs, so
+	//  they are made and set up here, holding the GIL, and destroyed here after
+	//  the starts. The covariance is found only for the best start, at the end.
+	int threads_each = std::max(1, option.threads / int(nStarts));
+	std::vector< std::unique_ptr<Model2> > workers;
+	for (size_t k=0; k<nStarts; k++) {
+		workers.emplace_back(new Model2(*this));
+		Model2& w = *workers.back();
+		w.option.threads = threads_each;
+		w.option.calc_std_errors = false;
+		w.option.teardown_after_estimate = false;
+		for (unsigned i=0; i<dF(); i++) {
+			w.FCurrent[i] = (*starts)(k,i);
+		}
+		w.setUp();
+		w.freshen();
+		if (_mixed_active()) {
+			w.Mixed_Draws.same_memory_as(Mixed_Draws);
+			w.Mixed_Draws_key = Mixed_Draws_key;
+		}
+	}
+	for (size_t k=0; k<nStarts; k++) {
+		if (workers[k]->_is_setUp<1) OOPS("the model copy for start ",k," is not set up");
+	}
+	
+	std::vector<std::exception_ptr> failures (nStarts);
+	{
+		etk::gil_release NOGIL;
+		etk::worker_pool& pool = etk::worker_pool::global();
+		pool.reserve(unsigned(nStarts));
+		pool.run(nStarts, [&](size_t k) {
+			try {
+				runs[k] = workers[k]->estimate(opts);
+			} catch (...) {
+				failures[k] = std::current_exception();
+			}
+		});
+	}
+	for (size_t k=0; k<nStarts; k++) {
+		if (failures[k]) std::rethrow_exception(failures[k]);
+	}
+	
+	size_t best = 0;
+	for (size_t k=0; k<nStarts; k++) {
+		INFO(msg) << "start "<<k<<" of "<<nStarts<<" reached log likelihood "<<workers[k]->ZBest;
+		if (workers[k]->ZBest > workers[best]->ZBest) best = k;
+	}
+	
+	for (unsigned i=0; i<dF(); i++) {
+		FCurrent[i] = workers[best]->FCurrent[i];
+	}
+	if (option.calc_null_likelihood) {
+		_LL_null = workers[best]->_LL_null;
+	}
+	freshen();
+	ZBest = ZCurrent = objective();
+	gradient();
+	_latest_run = runs[best];
+	_latest_run.write(etk::cat("best of ",nStarts," starting points is number ",best));
+	
+	if (option.calc_std_errors) {
+		_latest_run.start_process("parameter covariance");
+		calculate_parameter_covariance(false);
+		_latest_run.end_process();
+	} else {
+		Hess.initialize(NAN);
+		invHess.initialize(NAN);
+	}
+	if (option.teardown_after_estimate) {
+		tearDown();
+	}
+	return runs;
+}
+
+
 runstats elm::Model2::estimate()
 {
 	return estimate(NULL);
@@ -377,6 +573,7 @@ runstats elm::Model2::_maximize_bhhh()
 		vector<sherpa_pack> packs;
 		packs.push_back( sherpa_pack('G', 0.000001, 1, 0,   1e-10, 4, 2, .5,    1, 0.001) );
 		_latest_run.results += maximize(_latest_run.iteration,&packs);
+		_latest_run.evaluations = iteration_evaluations;
 		
 		if (option.weight_autorescale) {
 			_latest_run.start_process("weight unrescale");
@@ -484,6 +681,9 @@ runstats elm::Model2::estimate(std::vector<sherpa_pack>* opts)
 		_latest_run.start_process("setup");
 		setUp();	
 		BUGGER(msg) << "Setup of model complete.";
+		
+		// Everything from here is native, other Python threads can run meanwhile
+		etk::gil_release NOGIL;
 		ZBest = -INF;
 		
 		flag_gradient_diagnostic = option.gradient_diagnostic; //Option_integer("gradient_diagnostic");
@@ -532,6 +732,7 @@ runstats elm::Model2::estimate(std::vector<sherpa_pack>* opts)
 		
 		_latest_run.start_process("maximize likelihood");
 		_latest_run.results += maximize(_latest_run.iteration,opts);
+		_latest_run.evaluations = iteration_evaluations;
 		
 		if (option.weight_autorescale) {
 			_latest_run.start_process("weight unrescale");
@@ -605,6 +806,26 @@ runstats elm::Model2::estimate(std::vector<sherpa_pack>* opts)
 
 
 
+void elm::Model2::calculate_hessian()
+{
+	// The analytic hessian covers MNL and NL models without sampling adjustments;
+	//  anything else falls back to finite differences of the analytic gradient.
+	if (option.force_finite_diff_grad || _mixed_active() || _segmented_active()
+		|| (features & (MODELFEATURES_ALLOCATION|MODELFEATURES_QUANTITATIVE))
+		|| sampling_packet().relevant()) {
+		sherpa::calculate_hessian();
+		return;
+	}
+	
+	objective();
+	if (features & MODELFEATURES_NESTING) {
+		nl_hessian();
+	} else {
+		mnl_hessian();
+	}
+}
+
+
 void elm::Model2::calculate_hessian_and_save()
 {
 	calculate_hessian();
@@ -633,7 +854,7 @@ void elm::Model2::calculate_parameter_covariance(bool update_freedoms)
 		MONITOR(msg) << "HESSIAN\n" << Hess.printSquare() ;
 		hessfull_to_hessfree(&Hess, &temp_free_hess) ;
 		MONITOR(msg) << "HESSIAN squeezed\n" << temp_free_hess.printSquare() ;
-		temp_free_hess.inv_bonafide();
+		temp_free_hess.inv_bonafide(&msg);
 		MONITOR(msg) << "invHESSIAN squeezed\n" << temp_free_hess.printSquare() ;
 		hessfree_to_hessfull(&invHess, &temp_free_hess) ;
 		MONITOR(msg) << "invHESSIAN\n" << invHess.printSquare() ;
@@ -679,7 +900,7 @@ void elm::Model2::calculate_parameter_covariance(bool update_freedoms)
 		// invert hessian
 		MONITOR(msg) << "HESSIAN\n" << Hess.printSquare() ;
 		invHess = Hess;
-		invHess.inv_bonafide();
+		invHess.inv_bonafide(&msg);
 		MONITOR(msg) << "invHESSIAN\n" << invHess.printSquare() ;
 
 		symmetric_matrix unpacked_bhhh;
@@ -1115,6 +1336,39 @@ std::string elm::Model2::save_buffer() const
 	}
 	sv << "\n";
 
+	// save mixed
+	BUGGER( msg ) << "save mixed";
+	for (size_t d=0; d<mixed_dimensions(); d++) {
+		bool first = true;
+		std::string mean_name;
+		for (auto t=Mixed_Terms.begin(); t!=Mixed_Terms.end(); t++) {
+			if (t->dimension!=d) continue;
+			if (first) {
+				sv << "self.mixed_normal("<<__base64encode_wrap(t->target)<<","<<__base64encode_wrap(t->scale)<<")\n";
+				mean_name = t->target;
+				first = false;
+			} else {
+				sv << "self.mixed_correlate("<<__base64encode_wrap(t->target)<<","<<__base64encode_wrap(t->scale)<<","<<__base64encode_wrap(mean_name)<<")\n";
+			}
+		}
+	}
+	sv << "\n";
+
+	// save segments
+	BUGGER( msg ) << "save segments";
+	if (_segmented_active()) {
+		sv << "self.segment_by("<<__base64encode_wrap(Input_Segment)<<",[";
+		for (auto code=Segment_Codes.begin(); code!=Segment_Codes.end(); code++) {
+			if (code!=Segment_Codes.begin()) sv << ",";
+			sv << *code;
+		}
+		sv << "])\n";
+		for (auto p=Segment_Parameters.begin(); p!=Segment_Parameters.end(); p++) {
+			sv << "self.segment_parameter("<<__base64encode_wrap(*p)<<")\n";
+		}
+		sv << "\n";
+	}
+
 	// save quantity
 	BUGGER( msg ) << "save quantity";
 	for (auto u=Input_QuantityCA.begin(); u!=Input_QuantityCA.end(); u++) {
@@ -1280,6 +1534,7 @@ std::shared_ptr<etk::ndarray> elm::Model2::negative_d_loglike_nocache() {
 	setUp();
 	freshen();
 	_parameter_update();
+	etk::gil_release NOGIL;
 	std::shared_ptr<etk::ndarray> g = make_shared<etk::ndarray>(gradient(true), false);
 	bool z = true;
 	for (auto i=0; i!=g->size(); i++) {
@@ -1319,6 +1574,7 @@ std::shared_ptr<etk::ndarray> elm::Model2::negative_d_loglike_nocache(const std:
 	//if (!$self->_is_setUp) OOPS("Model is not setup, try calling setUp() first.");
 	_parameter_update();
 	_parameter_push(v);
+	etk::gil_release NOGIL;
 	
 	std::shared_ptr<etk::ndarray> g;
 	try {
@@ -1367,7 +1623,13 @@ std::shared_ptr<etk::ndarray> elm::Model2::negative_d_loglike(const std::vector<
 
 std::shared_ptr<etk::ndarray> elm::Model2::_gradient_casewise() {
 
-	if ((features & MODELFEATURES_ALLOCATION)) {
+	if (_probability_skipped) objective();
+
+	if (_mixed_active()) {
+		OOPS("casewise gradients are not available for a mixed logit model");
+	} else if (_segmented_active()) {
+		OOPS("casewise gradients are not available for a segmented model");
+	} else if ((features & MODELFEATURES_ALLOCATION)) {
 		return _ngev_gradient_full_casewise();
 	} else if (features & MODELFEATURES_QUANTITATIVE) {
 		return _ngev_gradient_full_casewise();
@@ -1383,8 +1645,13 @@ std::shared_ptr<etk::ndarray> elm::Model2::_gradient_casewise(std::vector<double
 
 //	loglike(v);
 	loglike();
+	if (_probability_skipped) objective();
 
-	if ((features & MODELFEATURES_ALLOCATION)) {
+	if (_mixed_active()) {
+		OOPS("casewise gradients are not available for a mixed logit model");
+	} else if (_segmented_active()) {
+		OOPS("casewise gradients are not available for a segmented model");
+	} else if ((features & MODELFEATURES_ALLOCATION)) {
 		return _ngev_gradient_full_casewise();
 	} else if (features & MODELFEATURES_QUANTITATIVE) {
 		return _ngev_gradient_full_casewise();
@@ -1401,6 +1668,7 @@ std::shared_ptr<etk::ndarray> elm::Model2::_gradient_casewise(std::vector<double
 std::shared_ptr<etk::symmetric_matrix> elm::Model2::bhhh_nocache() {
 	setUp();
 	_parameter_update();
+	etk::gil_release NOGIL;
 	
 	std::shared_ptr<etk::ndarray> g = std::make_shared<etk::ndarray>(gradient(), false);
 	bool z = true;
@@ -1457,6 +1725,7 @@ std::shared_ptr<etk::symmetric_matrix> elm::Model2::bhhh_nocache(const std::vect
 	setUp();
 	_parameter_update();
 	_parameter_push(v);
+	etk::gil_release NOGIL;
 	
 	std::shared_ptr<etk::ndarray> g = std::make_shared<etk::ndarray>(gradient(), false);
 
@@ -1589,13 +1858,29 @@ double elm::Model2::bhhh_tolerance_nocache(const std::vector<double>& v)
 
 
 
+double elm::Model2::loglike_cached() {
+	double ll;
+	setUp(false);
+	_parameter_update();
+	if (FCurrent.size()<=0) {
+		OOPS_CACHE("error in recovering cached value for loglike at the current parameters (init fail)");
+	}
+	
+	if (_cached_results.read_cached_loglike(elm::array_compare(FCurrent.ptr(), FCurrent.size()), ll)) {
+		return ll;
+	} else {
+		OOPS_CACHE("there is no cached value for loglike at the current parameters");
+	}
+}
+
 double elm::Model2::loglike() {
 	
 	setUp(false);
+	etk::gil_release NOGIL;
 	double x (-INF);
 	const double* FCurrent_ptr = FCurrent.ptr();
 	size_t FCurrent_size = FCurrent.size();
-	x = objective();
+	x = objective_only();
 	if (isNan(x)) {
 		x = -INF;
 	}
@@ -1612,9 +1897,13 @@ std::shared_ptr<etk::ndarray> elm::Model2::loglike_casewise()
 
 	setUp();
 	_parameter_update();
-	objective();
+	objective_only();
 	
 	std::shared_ptr<ndarray> ll_casewise = make_shared<ndarray> (nCases);
+	if (_probability_skipped) {
+		_case_loglike(*ll_casewise);
+		return ll_casewise;
+	}
 	PrToAccum = (sampling_packet().relevant() ? &AdjProbability : &Probability);
 
 	loglike_w w (&PrToAccum, Xylem.n_elemental(),
@@ -1634,6 +1923,10 @@ std::shared_ptr<etk::ndarray> elm::Model2::loglike_casewise(std::vector<double>
 	loglike();
 	
 	std::shared_ptr<ndarray> ll_casewise = make_shared<ndarray> (nCases);
+	if (_probability_skipped) {
+		_case_loglike(*ll_casewise);
+		return ll_casewise;
+	}
 	PrToAccum = (sampling_packet().relevant() ? &AdjProbability : &Probability);
 
 	loglike_w w (&PrToAccum, Xylem.n_elemental(),
@@ -1646,6 +1939,16 @@ std::shared_ptr<etk::ndarray> elm::Model2::loglike_casewise(std::vector<double>
 	return ll_casewise;
 }
 
+void elm::Model2::_case_loglike(etk::ndarray& ll_casewise)
+{
+	// The MNL probability workshops leave the unweighted log likelihood of
+	// each case in CaseLogLike.
+	elm::darray_ptr weight = Data_Weight_active();
+	for (size_t c=0; c<nCases; c++) {
+		ll_casewise(c) = (weight ? CaseLogLike(c) * weight->value(c,0) : CaseLogLike(c));
+	}
+}
+
 void elm::Model2::clear_cache()
 {
 	_cached_results.clear();
@@ -1653,6 +1956,44 @@ void elm::Model2::clear_cache()
 	
 }
 
+PyObject* elm::Model2::cache_statistics() const
+{
+	const elm::cache_statistics& st = _cached_results.statistics();
+	std::vector< std::pair<const char*, size_t> > counts = {
+		{"loglike_hits",    st.loglike_hits   },
+		{"loglike_misses",  st.loglike_misses },
+		{"grad_hits",       st.grad_hits      },
+		{"grad_misses",     st.grad_misses    },
+		{"bhhh_hits",       st.bhhh_hits      },
+		{"bhhh_misses",     st.bhhh_misses    },
+		{"bhhh_tol_hits",   st.bhhh_tol_hits  },
+		{"bhhh_tol_misses", st.bhhh_tol_misses},
+		{"hess_hits",       st.hess_hits      },
+		{"hess_misses",     st.hess_misses    },
+		{"evictions",       st.evictions      },
+		{"entries",         _cached_results.size()  },
+		{"bytes",           _cached_results.bytes() },
+		{"budget_bytes",    _cached_results.budget()},
+		{"utility_updates", Utility_Base.stat_updates() },
+		{"utility_rebuilds",Utility_Base.stat_rebuilds()},
+	};
+	
+	etk::python_lock LOCK;
+	PyObject* P = PyDict_New();
+	for (auto& i: counts) {
+		PyObject* item = PyLong_FromSize_t(i.second);
+		PyDict_SetItemString(P,i.first,item);
+		Py_CLEAR(item);
+	}
+	return P;
+}
+
+void elm::Model2::reset_cache_statistics()
+{
+	_cached_results.reset_statistics();
+	Utility_Base.reset_statistics();
+}
+
 
 
 void elm::Model2::start_timing(const std::string& name)
@@ -0,0 +1,334 @@
+/*
+ *  elm_model2_mixed.cpp
+ *
+ *  Copyright 2007-2017 Jeffrey Newman
+ *
+ *  Larch is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Larch is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with Larch.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+
+#include <cstring>
+#include <sstream>
+#include <memory>
+#include "elm_model2.h"
+#include "elm_parameter2.h"
+#include "larch_modelparameter.h"
+#include "elm_workshop_mixed.h"
+#include "etk_random.h"
+#include <iostream>
+
+using namespace etk;
+using namespace elm;
+using namespace std;
+
+
+
+//////// MARK: MIXED LOGIT TERMS /////////////////////////////////////////////////////
+
+void elm::Model2::mixed_normal(const std::string& mean_name, std::string scale_name)
+{
+	if (!parameter_exists(mean_name)) {
+		OOPS_KeyError("Parameter ",mean_name," not found");
+	}
+	if (_mixed_dimension_of(mean_name)!=SIZE_MAX) {
+		OOPS("parameter ",mean_name," is already random");
+	}
+	if (scale_name=="") scale_name = mean_name+"_sd";
+	if (!parameter_exists(scale_name)) {
+		BUGGER(msg) << "automatically generating "<<scale_name<<" parameter because it does not already exist";
+		// A scale of zero is a saddle point of the simulated log likelihood,
+		//  so the scale does not start there.
+		parameter(scale_name, 0.1);
+	}
+	mixed_term x;
+	x.target = mean_name;
+	x.scale = scale_name;
+	x.dimension = mixed_dimensions();
+	Mixed_Terms.push_back(x);
+	_reset_mixed();
+}
+
+void elm::Model2::mixed_correlate(const std::string& target_name, const std::string& scale_name,
+								  const std::string& source_mean_name)
+{
+	if (!parameter_exists(target_name)) {
+		OOPS_KeyError("Parameter ",target_name," not found");
+	}
+	size_t dimension = _mixed_dimension_of(source_mean_name);
+	if (dimension==SIZE_MAX) {
+		OOPS("parameter ",source_mean_name," is not random, give it a distribution with mixed_normal first");
+	}
+	for (auto t=Mixed_Terms.begin(); t!=Mixed_Terms.end(); t++) {
+		if (t->target==target_name && t->dimension==dimension) {
+			OOPS("parameter ",target_name," already moves with the draws of ",source_mean_name);
+		}
+	}
+	if (!parameter_exists(scale_name)) {
+		BUGGER(msg) << "automatically generating "<<scale_name<<" parameter because it does not already exist";
+		parameter(scale_name, 0.0);
+	}
+	mixed_term x;
+	x.target = target_name;
+	x.scale = scale_name;
+	x.dimension = dimension;
+	Mixed_Terms.push_back(x);
+	_reset_mixed();
+}
+
+void elm::Model2::mixed_clear()
+{
+	Mixed_Terms.clear();
+	_reset_mixed();
+}
+
+unsigned elm::Model2::mixed_dimensions() const
+{
+	size_t n = 0;
+	for (auto t=Mixed_Terms.begin(); t!=Mixed_Terms.end(); t++) {
+		n = std::max(n, t->dimension+1);
+	}
+	return unsigned(n);
+}
+
+size_t elm::Model2::_mixed_dimension_of(const std::string& mean_name) const
+{
+	// The first term in each dimension is the one made by mixed_normal.
+	std::vector<bool> seen (mixed_dimensions(), false);
+	for (auto t=Mixed_Terms.begin(); t!=Mixed_Terms.end(); t++) {
+		if (seen[t->dimension]) continue;
+		seen[t->dimension] = true;
+		if (t->target==mean_name) return t->dimension;
+	}
+	return SIZE_MAX;
+}
+
+void elm::Model2::_reset_mixed()
+{
+	// The slots are found again at the next setUp, and the workshops, which
+	//  size their scratch space from the draws, are built again.
+	tearDown();
+	Mixed_Slots.clear();
+	Mixed_Draws_key.clear();
+	mixed_probability_dispatcher.reset();
+	mixed_gradient_dispatcher.reset();
+}
+
+
+
+//////// MARK: MIXED LOGIT SETUP /////////////////////////////////////////////////////
+
+void elm::Model2::_setUp_mixed()
+{
+	Mixed_Slots.clear();
+	if (!_mixed_active()) return;
+
+	// idce utility data also sets the model features, see setUp
+	if (features) {
+		OOPS("a mixed logit model must have an MNL kernel, without nests, quantities or idce data");
+	}
+	if (sampling_packet().relevant()) {
+		OOPS("a mixed logit model cannot have a sampling bias");
+	}
+	if (Data_UtilityCA && Data_UtilityCA->nVars() && Data_UtilityCA->nAlts()!=nElementals) {
+		OOPS("a mixed logit model needs idca data for all ",nElementals," alternatives");
+	}
+	if (Params_UtilityCO.size1() && Params_UtilityCO.size2()!=nElementals) {
+		OOPS("a mixed logit model needs idco utility for all ",nElementals," alternatives");
+	}
+
+	for (auto t=Mixed_Terms.begin(); t!=Mixed_Terms.end(); t++) {
+		if (!parameter_exists(t->target)) {
+			OOPS_KeyError("Parameter ",t->target," not found");
+		}
+		if (!parameter_exists(t->scale)) {
+			OOPS_KeyError("Parameter ",t->scale," not found");
+		}
+		elm::mixed_slot s;
+		s.target = FNames[t->target];
+		s.scale = FNames[t->scale];
+		s.dimension = t->dimension;
+		Mixed_Slots.push_back(s);
+	}
+}
+
+void elm::Model2::_setUp_mixed_draws()
+{
+	unsigned nDims = mixed_dimensions();
+	unsigned nDraws = unsigned(std::max(1, option.mixed_draws));
+
+	std::ostringstream key;
+	key << nCases << "," << nDraws << "," << nDims << "," << option.mixed_draw_type << "," << option.mixed_draw_seed;
+	if (key.str()==Mixed_Draws_key) return;
+
+	// Each dimension is its own quasi-random sequence, which runs through
+	//  the draws of each case in turn, and is turned into standard normal draws.
+	std::vector< std::shared_ptr<etk::recallable> > sequences;
+	if (option.mixed_draw_type=="halton") {
+		if (nDims > 100) OOPS("Halton draws are available for up to 100 dimensions");
+		for (unsigned d=0; d<nDims; d++) {
+			sequences.push_back(std::make_shared<etk::halton>(d));
+			// The start of each sequence is dropped, as the first points of
+			//  the higher primes are strongly correlated across dimensions.
+			sequences.back()->burn(10);
+		}
+	} else if (option.mixed_draw_type=="sobol") {
+		if (nDims >= etk::sobol::max_dimension) {
+			OOPS("Sobol draws are available for up to ",etk::sobol::max_dimension-1," dimensions");
+		}
+		for (unsigned d=0; d<nDims; d++) {
+			sequences.push_back(std::make_shared<etk::sobol>(d, unsigned(option.mixed_draw_seed)));
+		}
+	} else {
+		OOPS("unknown mixed_draw_type '",option.mixed_draw_type,"', use 'halton' or 'sobol'");
+	}
+
+	Mixed_Draws.resize(nCases, nDraws, nDims);
+	for (unsigned d=0; d<nDims; d++) {
+		for (unsigned c=0; c<nCases; c++) {
+			for (unsigned r=0; r<nDraws; r++) {
+				Mixed_Draws(c,r,d) = etk::normal_quantile(sequences[d]->next());
+			}
+		}
+	}
+	Mixed_Draws_key = key.str();
+
+	mixed_probability_dispatcher.reset();
+	mixed_gradient_dispatcher.reset();
+}
+
+void elm::Model2::_setUp_mixed_deltas()
+{
+	// The change in each utility coefficient for a unit draw in a dimension.
+	//  The coefficients are linear in the freedoms, except for constants, so
+	//  this is the coefficients at the moved freedoms less those at zero.
+	unsigned nDims = mixed_dimensions();
+	size_t nCA = Params_UtilityCA.length();
+	size_t nCO = Params_UtilityCO.length();
+
+	Mixed_Delta_CA.resize(Params_UtilityCA.size1(), nDims);
+	Mixed_Delta_CO.resize(Params_UtilityCO.size1(), Params_UtilityCO.size2(), nDims);
+
+	std::vector<double> zero_fr (dF(), 0.0);
+	std::vector<double> zero_CA (nCA, 0.0);
+	std::vector<double> zero_CO (nCO, 0.0);
+	pull_from_freedoms(Params_UtilityCA, zero_CA.data(), zero_fr.data());
+	pull_from_freedoms(Params_UtilityCO, zero_CO.data(), zero_fr.data());
+
+	std::vector<double> moved_fr (dF());
+	std::vector<double> moved_CA (nCA);
+	std::vector<double> moved_CO (nCO);
+	for (unsigned d=0; d<nDims; d++) {
+		std::fill(moved_fr.begin(), moved_fr.end(), 0.0);
+		for (auto t=Mixed_Slots.begin(); t!=Mixed_Slots.end(); t++) {
+			if (t->dimension==d) moved_fr[t->target] += ReadFCurrent()[t->scale];
+		}
+		std::fill(moved_CA.begin(), moved_CA.end(), 0.0);
+		std::fill(moved_CO.begin(), moved_CO.end(), 0.0);
+		pull_from_freedoms(Params_UtilityCA, moved_CA.data(), moved_fr.data());
+		pull_from_freedoms(Params_UtilityCO, moved_CO.data(), moved_fr.data());
+		for (size_t i=0; i<nCA; i++) {
+			Mixed_Delta_CA(i,d) = moved_CA[i] - zero_CA[i];
+		}
+		for (size_t i=0; i<nCO; i++) {
+			Mixed_Delta_CO(i/Params_UtilityCO.size2(), i%Params_UtilityCO.size2(), d) = moved_CO[i] - zero_CO[i];
+		}
+	}
+}
+
+
+
+//////// MARK: MIXED LOGIT CALCULATIONS //////////////////////////////////////////////
+
+void elm::Model2::mixed_probability()
+{
+	Probability.resize(nCases,Xylem.n_elemental());
+	Probability.initialize(0.0);
+	CaseLogLike.resize(nCases);
+	pull_coefficients_from_freedoms();
+	_setUp_mixed_draws();
+	_setUp_mixed_deltas();
+
+	#ifndef __APPLE__
+	openblas_set_num_threads(1);
+	#endif
+
+	boosted::function<boosted::shared_ptr<workshop> ()> workshop_builder =
+	[&](){
+		return boosted::make_shared<workshop_mixed_logit>
+		(dF()
+		 , nElementals
+		 , utility_packet()
+		 , &Mixed_Delta_CA
+		 , &Mixed_Delta_CO
+		 , &Mixed_Draws
+		 , &Mixed_Slots
+		 , Data_Avail
+		 , Data_Choice
+		 , Data_Weight_active()
+		 , &Probability
+		 , &CaseLogLike
+		 , &loglike_partials
+		 , nullptr
+		 , &msg
+		 );
+	};
+	prepare_loglike_partials();
+	REDUCE_AND_DISPATCH(mixed_probability_dispatcher,option.threads, &loglike_partials, nCases, workshop_builder, _case_stream());
+	fused_LogL = *loglike_partials.combine();
+	fused_LogL_current = true;
+}
+
+void elm::Model2::mixed_gradient()
+{
+	BUGGER(msg)<< "Beginning Mixed Logit Gradient Evaluation" ;
+	GCurrent.initialize(0.0);
+	if (Bhhh.size1() != dF()) {
+		Bhhh.resize(dF());
+	}
+	Bhhh.initialize(0.0);
+
+	// The workshops simulate the probabilities again as they go, rather than
+	//  keeping the probability of every draw of every case between calls.
+	boosted::function<boosted::shared_ptr<workshop> ()> workshop_builder =
+	[&](){
+		return boosted::make_shared<workshop_mixed_logit>
+		(dF()
+		 , nElementals
+		 , utility_packet()
+		 , &Mixed_Delta_CA
+		 , &Mixed_Delta_CO
+		 , &Mixed_Draws
+		 , &Mixed_Slots
+		 , Data_Avail
+		 , Data_Choice
+		 , Data_Weight_active()
+		 , nullptr
+		 , nullptr
+		 , nullptr
+		 , &gradient_partials
+		 , &msg
+		 );
+	};
+	prepare_gradient_partials();
+	REDUCE_AND_DISPATCH(mixed_gradient_dispatcher,option.threads, &gradient_partials, nCases, workshop_builder, _case_stream());
+	combine_gradient_partials();
+
+	std::ostringstream ret;
+	for (unsigned i=0; i<GCurrent.size(); i++) {
+		ret << "," << GCurrent[i];
+	}
+	INFO(msg) << "Mixed Grad->["<< ret.str().substr(1) <<"] (using "<<option.threads<<" threads)";
+}
+
@@ -30,6 +30,7 @@
 #include "larch_modelparameter.h"
 
 #include "elm_workshop_mnl_gradient.h"
+#include "elm_workshop_hessian.h"
 #include "elm_workshop_mnl_prob.h"
 #include "elm_workshop_loglike.h"
 #include "elm_workshop_nl_probability.h"
@@ -164,8 +165,14 @@ void elm::Model2::freshen()
 
 void elm::Model2::calculate_probability()
 {
-
-	if ((features & MODELFEATURES_ALLOCATION)||(features & MODELFEATURES_QUANTITATIVE)) {
+	fused_LogL_current = false;
+	_probability_skipped = false;
+
+	if (_mixed_active()) {
+		mixed_probability();
+	} else if (_segmented_active()) {
+		segmented_probability();
+	} else if ((features & MODELFEATURES_ALLOCATION)||(features & MODELFEATURES_QUANTITATIVE)) {
 		ngev_probability();
 	} else if ((features & MODELFEATURES_NESTING)) {
 		nl_probability();
@@ -205,6 +212,9 @@ void elm::Model2::calculate_utility_only()
 
 std::shared_ptr<etk::ndarray> elm::Model2::calc_utility() const
 {
+	if (_case_stream()) {
+		OOPS("calc_utility needs all the idCA data in memory, but it is being read in blocks (out_of_core_block_mb)");
+	}
 	return _calc_utility(Data_UtilityCO ? (&Data_UtilityCO->_repository) : nullptr,
 						 Data_UtilityCA ? (&Data_UtilityCA->_repository) : nullptr,
 						 Data_Avail ? &Data_Avail->_repository : nullptr);
@@ -419,15 +429,35 @@ boosted::shared_ptr<workshop> elm::Model2::make_shared_workshop_mnl_probability
 
 	return boosted::make_shared<elm::mnl_prob_w>(
 			&Probability, &CaseLogLike, utility_packet(), Data_Avail, Data_Choice,
-			0, &msg, &top_logsums_out);
+			0, &msg, &top_logsums_out, &Utility_Base,
+			&loglike_partials, Data_Weight_active(), size_t(std::max(0.0, option.fused_block_kb)*1024),
+			_probability_skipped);
 
 }
 
+elm::incremental_utility* elm::Model2::_utility_base(const size_t& nalts)
+{
+	if (!option.incremental_utility || _case_stream() || !_case_sample.empty() || Input_QuantityCA.size()>0) {
+		Utility_Base.reset();
+		return nullptr;
+	}
+	Utility_Base.prepare(utility_packet(), nCases, nalts);
+	return &Utility_Base;
+}
+
 
 void elm::Model2::mnl_probability()
 {
-	Probability.resize(nCases,Xylem.n_elemental());
-	Probability.initialize(0.0);
+	bool threaded = (option.threads>=1 && _ELM_USE_THREADS_ && Input_QuantityCA.size()==0);
+	
+	// When only the log likelihood is wanted, the threaded workshops can find
+	// it without writing the probability array.
+	_probability_skipped = (_loglike_only && threaded);
+	
+	if (!_probability_skipped) {
+		Probability.resize(nCases,Xylem.n_elemental());
+		Probability.initialize(0.0);
+	}
 	CaseLogLike.resize(nCases);
 	Workspace.resize(Xylem.n_elemental());
 	pull_coefficients_from_freedoms();
@@ -463,7 +493,7 @@ void elm::Model2::mnl_probability()
 //		BUGGER(msg) << "Data_Avail is NULL\n";
 //	}
 
-	if (option.threads>=1 && _ELM_USE_THREADS_ && Input_QuantityCA.size()==0) {
+	if (threaded) {
 //		BUGGER(msg) << "Using multithreading with "<<option.threads<<" threads in mnl_probability()\n";
 		#ifndef __APPLE__
 //		BUGGER(msg) << "Using non-APPLE compiled\n";
@@ -488,15 +518,29 @@ void elm::Model2::mnl_probability()
 //		#endif
 //		BUGGER_(&msg, "mongo... \n");
 		
+		elm::incremental_utility* base = _utility_base(Xylem.n_elemental());
 		boosted::function<boosted::shared_ptr<workshop> ()> workshop_builder =
 			boosted::bind(&elm::Model2::make_shared_workshop_mnl_probability, this);
-		USE_DISPATCH(probability_dispatcher,option.threads, nCases, workshop_builder);
+		workshop_updater_t workshop_updater = [&](std::shared_ptr<workshop> w)
+		{
+			(dynamic_cast<mnl_prob_w*>(&*w))->configure(&loglike_partials, Data_Weight_active(),
+				size_t(std::max(0.0, option.fused_block_kb)*1024), _probability_skipped);
+		};
+		prepare_loglike_partials();
+		UPDATE_REDUCE_AND_DISPATCH(probability_dispatcher,option.threads, &workshop_updater, &loglike_partials, nCases, workshop_builder, _case_stream(), &_case_sample);
+		fused_LogL = *loglike_partials.combine();
+		fused_LogL_current = true;
+		if (base && base->filling()) base->record(utility_packet());
 		top_logsums_out_recalculated();
 		
 	} else {
 		unsigned c;
 		unsigned a;
 	
+		if (_case_stream()) {
+			OOPS("idCA data read in blocks (out_of_core_block_mb) is not supported for this model");
+		}
+	
 		if (Input_QuantityCA.size()>0) {
 			BUGGER(msg) << "Not using multithreading but using quantity\n";
 			__logit_utility(Probability, Data_QuantityCA, nullptr, &Coef_QuantityCA, nullptr, 0);
@@ -526,7 +570,16 @@ void elm::Model2::mnl_probability()
 //			}
 		} else {
 			BUGGER(msg) << "Not using multithreading or quantity\n";
-			__logit_utility(Probability, Data_UtilityCA, Data_UtilityCO, &Coef_UtilityCA, &Coef_UtilityCO, 0);
+			elm::incremental_utility* base = _utility_base(Probability.size2());
+			if (base && base->current()) {
+				base->load_rows(&Probability, 0, nCases);
+			} else {
+				__logit_utility(Probability, Data_UtilityCA, Data_UtilityCO, &Coef_UtilityCA, &Coef_UtilityCO, 0);
+				if (base) {
+					base->save_rows(&Probability, 0, nCases);
+					base->record(utility_packet());
+				}
+			}
 		}
 	
 	
@@ -840,6 +893,15 @@ double elm::Model2::accumulate_log_likelihood() /*const*/
 	
 	accumulate_LogL = 0.0;
 
+	if (fused_LogL_current) {
+		fused_LogL_current = false;
+		accumulate_LogL = fused_LogL;
+		if (accumulate_LogL) {
+			INFO(msg) << "LL(["<< ReadFCurrentAsString() <<"])->"<<accumulate_LogL<< "  (accumulated with probability)";
+			return accumulate_LogL;
+		}
+	}
+
 	if (CaseLogLike.size()) {
 		if (Data_Weight_active()) {
 			accumulate_LogL = cblas_ddot(nCases, *CaseLogLike, 1, Data_Weight_active()->values(0,0), 1);
@@ -941,7 +1003,7 @@ std::shared_ptr<etk::ndarray> elm::Model2::_mnl_gradient_full_casewise()
 			 , &*gradient_casewise
 			 );
 
-	w.work(0, nCases, &local_lock);
+	_work_in_blocks(w, &local_lock);
 
 
 	BUGGER(msg)<< "End MNL Gradient v2 Evaluation" ;
@@ -953,6 +1015,80 @@ std::shared_ptr<etk::ndarray> elm::Model2::_mnl_gradient_full_casewise()
 
 
 
+void elm::Model2::prepare_gradient_partials()
+{
+	size_t width = dF() + dF()*dF();
+	size_t njobs = job_partials::njobs_for(nCases, width);
+	// Jobs do not cross blocks of streamed data, so there must be a job for each
+	if (_case_stream()) njobs = std::max(njobs, _case_stream()->n_blocks(nCases));
+	// A sample of cases is worked as one job for each range in it
+	if (!_case_sample.empty()) njobs = _case_sample.size();
+	gradient_partials.resize(njobs, width);
+}
+
+void elm::Model2::combine_gradient_partials()
+{
+	const double* total = gradient_partials.combine();
+	cblas_daxpy(dF(), 1, total, 1, *GCurrent, 1);
+	cblas_daxpy(dF()*dF(), 1, total+dF(), 1, *Bhhh, 1);
+}
+
+void elm::Model2::prepare_hessian_partials()
+{
+	size_t width = dF()*dF();
+	size_t njobs = job_partials::njobs_for(nCases, width);
+	// Jobs do not cross blocks of streamed data, so there must be a job for each
+	if (_case_stream()) njobs = std::max(njobs, _case_stream()->n_blocks(nCases));
+	gradient_partials.resize(njobs, width);
+}
+
+void elm::Model2::combine_hessian_partials()
+{
+	cblas_daxpy(dF()*dF(), 1, gradient_partials.combine(), 1, *Hess, 1);
+}
+
+void elm::Model2::prepare_loglike_partials()
+{
+	size_t njobs = job_partials::njobs_for(nCases, 1);
+	// Jobs do not cross blocks of streamed data, so there must be a job for each
+	if (_case_stream()) njobs = std::max(njobs, _case_stream()->n_blocks(nCases));
+	// A sample of cases is worked as one job for each range in it
+	if (!_case_sample.empty()) njobs = _case_sample.size();
+	loglike_partials.resize(njobs, 1);
+}
+
+bool elm::Model2::case_sample(const double& fraction)
+{
+	_case_sample.clear();
+	FatGCurrent.initialize(NAN); // tell gradient it needs to recalculate
+	if (fraction >= 1) return true;
+	
+	// Only the threaded MNL workshops work by ranges of cases
+	if (features || _mixed_active() || _segmented_active() || Input_QuantityCA.size()>0 || option.threads<1 || !_ELM_USE_THREADS_
+		|| _case_stream() || option.force_finite_diff_grad || sampling_packet().relevant()) {
+		return false;
+	}
+	if (!(fraction > 0) || nCases==0) return false;
+	
+	// The cases are cut into ranges of about the size of a gradient job, and
+	//  a random subset of the ranges is kept, so each range stays contiguous
+	size_t njobs = job_partials::njobs_for(nCases, dF() + dF()*dF());
+	size_t nranges = std::min(size_t(nCases), size_t(ceil(double(njobs)/fraction)));
+	unsigned nkeep = unsigned(std::max(1.0, ceil(fraction*nranges)));
+	etk::autoindex_int shuffled;
+	shuffled.make_strap(unsigned(nranges));
+	shuffled.set_knife(nkeep);
+	for (size_t r=0; r<nranges; r++) {
+		if (shuffled.knifed(unsigned(r))) continue;
+		size_t first = r*nCases/nranges;
+		size_t last = (r+1)*nCases/nranges;
+		_case_sample.push_back(etk::job(first, last-first));
+	}
+	INFO(msg) << "using a random sample of "<<_case_sample.size()<<" of "<<nranges<<" ranges of cases";
+	return true;
+}
+
+
 void elm::Model2::mnl_gradient_v2() 
 {
 	periodic Sup (5);
@@ -977,9 +1113,12 @@ void elm::Model2::mnl_gradient_v2()
 		 , &Bhhh
 		 , &msg
 		 , &Data_MultiChoice
+		 , &gradient_partials
 		 );
 	};
-	USE_DISPATCH(gradient_dispatcher,option.threads, nCases, workshop_builder);
+	prepare_gradient_partials();
+	REDUCE_AND_DISPATCH(gradient_dispatcher,option.threads, &gradient_partials, nCases, workshop_builder, _case_stream(), &_case_sample);
+	combine_gradient_partials();
 
 	std::ostringstream ret;
 	for (unsigned i=0; i<GCurrent.size(); i++) {
@@ -992,6 +1131,37 @@ void elm::Model2::mnl_gradient_v2()
 
 
 
+void elm::Model2::mnl_hessian()
+{
+	BUGGER(msg)<< "Beginning MNL Hessian Evaluation" ;
+	if (Hess.size1() != dF()) {
+		Hess.resize(dF());
+	}
+	Hess.initialize(0.0);
+	
+	boosted::function<boosted::shared_ptr<workshop> ()> workshop_builder =
+	[&](){
+		return boosted::make_shared<workshop_mnl_hessian>
+		(dF()
+		 , nElementals
+		 , utility_packet()
+		 , Data_Choice
+		 , Data_Weight_active()
+		 , &Probability
+		 , &Hess
+		 , &msg
+		 , &gradient_partials
+		 );
+	};
+	prepare_hessian_partials();
+	REDUCE_AND_DISPATCH(hessian_dispatcher,option.threads, &gradient_partials, nCases, workshop_builder, _case_stream());
+	combine_hessian_partials();
+
+	BUGGER(msg)<< "End MNL Hessian Evaluation" ;
+}
+
+
+
 
 
 
@@ -1027,7 +1197,7 @@ PyObject* elm::Model2::d_logsums()
 	});
 	
 	
-	USE_DISPATCH(d_logsums_dispatcher,option.threads, nCases, workshop_builder);
+	USE_DISPATCH(d_logsums_dispatcher,option.threads, nCases, workshop_builder, _case_stream());
 
 	BUGGER(msg)<< "End d_logsums Evaluation" ;
 	return _get_casewise_d_logsums();
@@ -1315,6 +1485,8 @@ double elm::Model2::loglike_given_utility( )
 	pull_coefficients_from_freedoms();
 	freshen(); // TODO : is this really needed here?
 	
+	fused_LogL_current = false;
+	_probability_skipped = false;
 	ngev_probability_given_utility();
 	
 	LL_= accumulate_log_likelihood();
@@ -1324,6 +1496,7 @@ double elm::Model2::loglike_given_utility( )
 	if (_string_sender_ptr) {
 		ostringstream update;
 		update << "Model Objective Eval = "<< LL_;
+		etk::python_lock LOCK;
 		_string_sender_ptr->write(update.str());
 	}
 	
@@ -1408,6 +1581,7 @@ double elm::Model2::objective ()
 	if (_string_sender_ptr) {
 		ostringstream update;
 		update << "Model Objective Eval = "<< LL_;
+		etk::python_lock LOCK;
 		_string_sender_ptr->write(update.str());
 	}
 	
@@ -1417,6 +1591,21 @@ double elm::Model2::objective ()
 }
 
 
+double elm::Model2::objective_only ()
+{
+	_loglike_only = true;
+	double LL_;
+	try {
+		LL_ = objective();
+	} catch (...) {
+		_loglike_only = false;
+		throw;
+	}
+	_loglike_only = false;
+	return LL_;
+}
+
+
 const etk::memarray& elm::Model2::gradient (const bool& force_recalculate)
 {
 	if (FatGCurrent == ReadFCurrent() && !option.force_recalculate && !force_recalculate) {
@@ -1426,7 +1615,11 @@ const etk::memarray& elm::Model2::gradient (const bool& force_recalculate)
 			negative_finite_diff_gradient_(GCurrent);
 		} else {
 			objective();
-			if ((features & MODELFEATURES_ALLOCATION)) {
+			if (_mixed_active()) {
+				mixed_gradient();
+			} else if (_segmented_active()) {
+				segmented_gradient();
+			} else if ((features & MODELFEATURES_ALLOCATION)) {
 				ngev_gradient();
 			} else if (features & MODELFEATURES_QUANTITATIVE) {
 				ngev_gradient();
@@ -25,6 +25,7 @@
 #include "elm_sql_scrape.h"
 #include "elm_names.h"
 #include "elm_workshop_nl_gradient.h"
+#include "elm_workshop_hessian.h"
 #include "elm_workshop_nl_probability.h"
 #include "elm_workshop_ngev_gradient.h"
 #include "elm_workshop_ngev_probability.h"
@@ -208,6 +209,7 @@ boosted::shared_ptr<workshop> elm::Model2::make_shared_workshop_nl_gradient ()
 									 , &GCurrent
 									 , &Bhhh
 									 , &msg
+									 , &gradient_partials
 									 );}
 
 boosted::shared_ptr<workshop> elm::Model2::make_shared_workshop_ngev_probability ()
@@ -295,7 +297,7 @@ std::shared_ptr<etk::ndarray> elm::Model2::_ngev_gradient_full_casewise(bool sin
 				 , &local_lock
 				 );
 
-		w.work(0, nCases, &local_lock);
+		_work_in_blocks(w, &local_lock);
 	} else {
 		
 		_set_casewise_grad_buffer(gradient_casewise->get_object());
@@ -377,7 +379,7 @@ std::shared_ptr<etk::ndarray> elm::Model2::_ngev_d_prob()
 	};
 
 	
-	UPDATE_AND_DISPATCH(gradient_dispatcher,option.threads, &workshop_updater, nCases, workshop_builder);
+	UPDATE_AND_DISPATCH(gradient_dispatcher,option.threads, &workshop_updater, nCases, workshop_builder, _case_stream());
 
 
 	
@@ -473,7 +475,8 @@ void elm::Model2::nl_probability()
 	if (nThreads<=1) nThreads = 1;
 	 
 //	BUGGER(msg) << "Number of threads in nl_probability =" << nThreads;
-	if (nThreads>=2 && _ELM_USE_THREADS_) {
+	// Data read in blocks is only available through the dispatcher
+	if ((nThreads>=2 || _case_stream()) && _ELM_USE_THREADS_) {
 		
 		#ifdef __APPLE__
 		boosted::function<boosted::shared_ptr<workshop> ()> workshop_builder =
@@ -498,13 +501,22 @@ void elm::Model2::nl_probability()
 			(dynamic_cast<workshop_nl_probability*>(&*w))->reassign_py_output(top_logsums_out);
 		};
 
-		UPDATE_AND_DISPATCH(probability_dispatcher,option.threads, &workshop_updater, nCases, workshop_builder);
+		UPDATE_AND_DISPATCH(probability_dispatcher,option.threads, &workshop_updater, nCases, workshop_builder, _case_stream());
 		top_logsums_out_recalculated();
 	
 	} else {
 	
-	Utility.initialize(0.0);
-	__logit_utility(Utility, Data_UtilityCA, Data_UtilityCO, &Coef_UtilityCA, &Coef_UtilityCO, 0);
+	elm::incremental_utility* base = _utility_base(Utility.size2());
+	if (base && base->current()) {
+		base->load_rows(&Utility, 0, nCases);
+	} else {
+		Utility.initialize(0.0);
+		__logit_utility(Utility, Data_UtilityCA, Data_UtilityCO, &Coef_UtilityCA, &Coef_UtilityCO, 0);
+		if (base) {
+			base->save_rows(&Utility, 0, nCases);
+			base->record(utility_packet());
+		}
+	}
 
 	elm::ca_co_packet sampling_packet_ = sampling_packet();
 	bool use_sampling = sampling_packet_.relevant();
@@ -520,8 +532,11 @@ void elm::Model2::nl_probability()
 				Utility(c,a) = -INF;
 			} 		
 		}
-		
-		__casewise_nl_utility(Utility.ptr(c), Xylem, *Workspace);
+	}
+	
+	__blockwise_nl_utility(Utility.ptr(), Utility.size2(), nCases, Xylem);
+	
+	for (c=0;c<nCases;c++) {
 		__casewise_nl_probability(Utility.ptr(c), Cond_Prob.ptr(c), Probability.ptr(c), Xylem);
 
 		if (use_sampling) {
@@ -664,7 +679,7 @@ void elm::Model2::ngev_probability()
 			(dynamic_cast<workshop_ngev_probability*>(&*w))->reassign_py_output(top_logsums_out);
 		};
 		
-		UPDATE_AND_DISPATCH(probability_dispatcher,option.threads, &workshop_updater, nCases, workshop_builder);
+		UPDATE_AND_DISPATCH(probability_dispatcher,option.threads, &workshop_updater, nCases, workshop_builder, _case_stream());
 		top_logsums_out_recalculated();
 	
 	} else {
@@ -673,7 +688,7 @@ void elm::Model2::ngev_probability()
 		if (!local_prob_workshop) {
 			local_prob_workshop = make_shared_workshop_ngev_probability ();
 		}
-		local_prob_workshop->work(0, nCases, nullptr);
+		_work_in_blocks(*local_prob_workshop, nullptr);
 		top_logsums_out_recalculated();
 	
 	}
@@ -746,7 +761,9 @@ void elm::Model2::nl_gradient()
 
 		boosted::function<boosted::shared_ptr<workshop> ()> workshop_builder =
 			boosted::bind(&elm::Model2::make_shared_workshop_nl_gradient, this);
-		USE_DISPATCH(gradient_dispatcher,option.threads, nCases, workshop_builder);
+		prepare_gradient_partials();
+		REDUCE_AND_DISPATCH(gradient_dispatcher,option.threads, &gradient_partials, nCases, workshop_builder, _case_stream());
+		combine_gradient_partials();
 		
 //	} else {
 //
@@ -766,6 +783,39 @@ void elm::Model2::nl_gradient()
 	INFO(msg) << "NL Grad->["<< ret.str().substr(1) <<"] (using "<<option.threads<<" threads)";
 }
 
+
+void elm::Model2::nl_hessian()
+{
+	BUGGER(msg)<< "Beginning NL Hessian Evaluation" ;
+	if (Hess.size1() != dF()) {
+		Hess.resize(dF());
+	}
+	Hess.initialize(0.0);
+	
+	boosted::function<boosted::shared_ptr<workshop> ()> workshop_builder =
+	[&](){
+		return boosted::make_shared<workshop_nl_hessian>
+		(dF()
+		 , nNodes
+		 , utility_packet()
+		 , Params_LogSum
+		 , Data_Choice
+		 , Data_Weight_active()
+		 , &Probability
+		 , &Cond_Prob
+		 , &Xylem
+		 , &Hess
+		 , &msg
+		 , &gradient_partials
+		 );
+	};
+	prepare_hessian_partials();
+	REDUCE_AND_DISPATCH(hessian_dispatcher,option.threads, &gradient_partials, nCases, workshop_builder, _case_stream());
+	combine_hessian_partials();
+
+	BUGGER(msg)<< "End NL Hessian Evaluation" ;
+}
+
 void elm::Model2::ngev_gradient()
 {
 	periodic Sup (5);
@@ -781,7 +831,7 @@ void elm::Model2::ngev_gradient()
 	
 	boosted::function<boosted::shared_ptr<workshop> ()> workshop_builder =
 		boosted::bind(&elm::Model2::make_shared_workshop_ngev_gradient, this);
-	USE_DISPATCH(gradient_dispatcher,option.threads, nCases, workshop_builder);
+	USE_DISPATCH(gradient_dispatcher,option.threads, nCases, workshop_builder, _case_stream());
 	
 	BUGGER(msg)<< "End NGEV Gradient Evaluation" ;
 
@@ -52,7 +52,15 @@ elm::model_options_t::model_options_t(
 			bool enforce_constraints,
 			double idca_avail_ratio_floor,
 			bool autocreate_parameters,
-			bool ignore_bad_constraints
+			bool ignore_bad_constraints,
+			bool parallel_finite_diff,
+			double out_of_core_block_mb,
+			bool incremental_utility,
+			double cache_budget_mb,
+			double fused_block_kb,
+			int mixed_draws,
+			std::string mixed_draw_type,
+			int mixed_draw_seed
 		)
 : gradient_diagnostic   (gradient_diagnostic)
 , hessian_diagnostic    (hessian_diagnostic)
@@ -76,8 +84,16 @@ elm::model_options_t::model_options_t(
 , idca_avail_ratio_floor(idca_avail_ratio_floor)
 , autocreate_parameters (autocreate_parameters)
 , ignore_bad_constraints(ignore_bad_constraints)
+, parallel_finite_diff  (parallel_finite_diff)
+, out_of_core_block_mb  (out_of_core_block_mb)
+, incremental_utility   (incremental_utility)
+, cache_budget_mb       (cache_budget_mb)
+, fused_block_kb        (fused_block_kb)
+, mixed_draws           (mixed_draws)
+, mixed_draw_type       (mixed_draw_type)
+, mixed_draw_seed       (mixed_draw_seed)
 {
-	boosted::lock_guard<boosted::mutex> LOCK(etk::python_global_mutex);
+	etk::python_lock LOCK;
 //#ifdef __APPLE__
 	if (this->threads<=0) {
 //		PyObject* multiprocessing_module = PyImport_ImportModule("multiprocessing");
@@ -126,7 +142,15 @@ void elm::model_options_t::__call__(
 			int enforce_constraints,
 			double idca_avail_ratio_floor,
 			int autocreate_parameters,
-			int ignore_bad_constraints
+			int ignore_bad_constraints,
+			int parallel_finite_diff,
+			double out_of_core_block_mb,
+			int incremental_utility,
+			double cache_budget_mb,
+			double fused_block_kb,
+			int mixed_draws,
+			std::string mixed_draw_type,
+			int mixed_draw_seed
 		)
 {
 	if (gradient_diagnostic     != -9 ) (this->gradient_diagnostic     = gradient_diagnostic     );
@@ -151,6 +175,14 @@ void elm::model_options_t::__call__(
 	if (idca_avail_ratio_floor  != -9 ) (this->idca_avail_ratio_floor  = idca_avail_ratio_floor  );
 	if (autocreate_parameters   != -9 ) (this->autocreate_parameters   = autocreate_parameters   );
 	if (ignore_bad_constraints  != -9 ) (this->ignore_bad_constraints  = ignore_bad_constraints  );
+	if (parallel_finite_diff    != -9 ) (this->parallel_finite_diff    = parallel_finite_diff    );
+	if (out_of_core_block_mb    != -9 ) (this->out_of_core_block_mb    = out_of_core_block_mb    );
+	if (incremental_utility     != -9 ) (this->incremental_utility     = incremental_utility     );
+	if (cache_budget_mb         != -9 ) (this->cache_budget_mb         = cache_budget_mb         );
+	if (fused_block_kb          != -9 ) (this->fused_block_kb          = fused_block_kb          );
+	if (mixed_draws             != -9 ) (this->mixed_draws             = mixed_draws             );
+	if (mixed_draw_type         !="-9") (this->mixed_draw_type         = mixed_draw_type         );
+	if (mixed_draw_seed         != -9 ) (this->mixed_draw_seed         = mixed_draw_seed         );
 	
 }
 
@@ -177,6 +209,14 @@ void elm::model_options_t::copy(const model_options_t& other)
 	this->idca_avail_ratio_floor  = other.idca_avail_ratio_floor  ;
 	this->autocreate_parameters   = other.autocreate_parameters   ;
 	this->ignore_bad_constraints  = other.ignore_bad_constraints  ;
+	this->parallel_finite_diff    = other.parallel_finite_diff    ;
+	this->out_of_core_block_mb    = other.out_of_core_block_mb    ;
+	this->incremental_utility     = other.incremental_utility     ;
+	this->cache_budget_mb         = other.cache_budget_mb         ;
+	this->fused_block_kb          = other.fused_block_kb          ;
+	this->mixed_draws             = other.mixed_draws             ;
+	this->mixed_draw_type         = other.mixed_draw_type         ;
+	this->mixed_draw_seed         = other.mixed_draw_seed         ;
 }
 
 
@@ -206,6 +246,14 @@ std::string elm::model_options_t::__repr__() const
 	x << "     idca_avail_ratio_floor= "<<idca_avail_ratio_floor  <<",\n";
 	x << "      autocreate_parameters= "<<autocreate_parameters   <<",\n";
 	x << "     ignore_bad_constraints= "<<ignore_bad_constraints  <<",\n";
+	x << "       parallel_finite_diff= "<<parallel_finite_diff    <<",\n";
+	x << "       out_of_core_block_mb= "<<out_of_core_block_mb    <<",\n";
+	x << "        incremental_utility= "<<incremental_utility     <<",\n";
+	x << "            cache_budget_mb= "<<cache_budget_mb         <<",\n";
+	x << "             fused_block_kb= "<<fused_block_kb          <<",\n";
+	x << "                mixed_draws= "<<mixed_draws             <<",\n";
+	x << "            mixed_draw_type= "<<mixed_draw_type         <<",\n";
+	x << "            mixed_draw_seed= "<<mixed_draw_seed         <<",\n";
 	x << ")";
 	return x.str();
 }
@@ -235,6 +283,14 @@ std::string elm::model_options_t::_save_buffer() const
 	x << "self.option.idca_avail_ratio_floor= " << idca_avail_ratio_floor                  <<"\n";
 	x << "self.option.autocreate_parameters= "  <<(autocreate_parameters   ?"True":"False")<<"\n";
 	x << "self.option.ignore_bad_constraints="  <<(ignore_bad_constraints  ?"True":"False")<<"\n";
+	x << "self.option.parallel_finite_diff= "   <<(parallel_finite_diff    ?"True":"False")<<"\n";
+	x << "self.option.out_of_core_block_mb= "   << out_of_core_block_mb                    <<"\n";
+	x << "self.option.incremental_utility= "    <<(incremental_utility     ?"True":"False")<<"\n";
+	x << "self.option.cache_budget_mb= "        << cache_budget_mb                         <<"\n";
+	x << "self.option.fused_block_kb= "         << fused_block_kb                          <<"\n";
+	x << "self.option.mixed_draws= "            << mixed_draws                             <<"\n";
+	x << "self.option.mixed_draw_type= '"       << mixed_draw_type                         <<"'\n";
+	x << "self.option.mixed_draw_seed= "        << mixed_draw_seed                         <<"\n";
 	return x.str();
 }
 
@@ -263,6 +319,14 @@ std::string elm::model_options_t::__str__() const
 	x << "      idca_avail_ratio_floor: "<<idca_avail_ratio_floor<<"\n";
 	x << "       autocreate_parameters: "<<(autocreate_parameters ?"True":"False")<<"\n";
 	x << "      ignore_bad_constraints: "<<(ignore_bad_constraints?"True":"False")<<"\n";
+	x << "        parallel_finite_diff: "<<(parallel_finite_diff  ?"True":"False")<<"\n";
+	x << "        out_of_core_block_mb: "<< out_of_core_block_mb  <<"\n";
+	x << "         incremental_utility: "<<(incremental_utility   ?"True":"False")<<"\n";
+	x << "             cache_budget_mb: "<< cache_budget_mb       <<"\n";
+	x << "              fused_block_kb: "<< fused_block_kb        <<"\n";
+	x << "                 mixed_draws: "<< mixed_draws           <<"\n";
+	x << "             mixed_draw_type: "<< mixed_draw_type       <<"\n";
+	x << "             mixed_draw_seed: "<< mixed_draw_seed       <<"\n";
 	return x.str();
 }
 
@@ -54,6 +54,50 @@ stored values. Primarily for debugging, it is recommended to leave this option o
 "Disable logging warnings of not-a-number error messages, which can occur sometimes in \
 likelihood maximization.";
 
+%feature("docstring") elm::model_options_t::parallel_finite_diff
+"Evaluate the perturbed parameter vectors of finite difference gradients and hessians \
+concurrently, using up to `threads` worker threads. Each thread works on its own copy \
+of the model's calculation arrays, so this uses more memory.";
+
+%feature("docstring") elm::model_options_t::out_of_core_block_mb
+"When positive, idCA utility data provisioned from a binary darray file (by giving its \
+file name instead of an array) is not held in memory, but read from the file in blocks \
+of about this many megabytes as the model is calculated. The next block is read in the \
+background while the current one is used, so at most two blocks are in memory at once. \
+Zero (the default) holds all the data in memory.";
+
+%feature("docstring") elm::model_options_t::incremental_utility
+"Keep the linear utility of each case and alternative between evaluations of an MNL or \
+NL model, and when only a few utility coefficients have changed (as in a finite \
+difference step or a line search along one parameter), update it for those coefficients \
+alone instead of recomputing it from all the data. This uses memory for one more array \
+the size of the probability array.";
+
+%feature("docstring") elm::model_options_t::cache_budget_mb
+"The most memory, in megabytes, used to keep log likelihoods, gradients and BHHH \
+matrices already computed at other parameter values. When full, the results used \
+least recently are dropped. See Model.cache_statistics for how often saved results \
+are found.";
+
+%feature("docstring") elm::model_options_t::fused_block_kb
+"When positive, the threaded MNL log likelihood is computed in blocks of cases whose \
+data and probabilities take about this many kilobytes, carrying each block through \
+utility, probability and weighted log likelihood before starting the next, so each \
+block is read while it is still in cache. The default (256) suits a typical L2 \
+cache. Zero computes the utility of all the cases in a thread's share first.";
+
+%feature("docstring") elm::model_options_t::mixed_draws
+"The number of draws per case used to simulate the probabilities of a mixed logit \
+model (see Model.mixed_normal).";
+
+%feature("docstring") elm::model_options_t::mixed_draw_type
+"How the draws for a mixed logit model are made: 'halton' for Halton sequences, or \
+'sobol' for scrambled Sobol sequences, which do better with many random parameters.";
+
+%feature("docstring") elm::model_options_t::mixed_draw_seed
+"The seed for scrambling the Sobol sequences of a mixed logit model. Halton draws \
+do not use it.";
+
 %feature("docstring") elm::model_options_t::calc_std_errors
 "Calculate the standard errors of the parameter estimates in conjunction with an \
 estimation. These values can sometimes take a long time to generate, so if you \
@@ -89,6 +133,16 @@ namespace elm {
 		bool enforce_constraints;
 		bool autocreate_parameters;
 		bool ignore_bad_constraints;
+		bool parallel_finite_diff;
+		
+		double out_of_core_block_mb;
+		bool incremental_utility;
+		double cache_budget_mb;
+		double fused_block_kb;
+		
+		int mixed_draws;
+		std::string mixed_draw_type;
+		int mixed_draw_seed;
 		
 		double idca_avail_ratio_floor;
 		
@@ -117,7 +171,15 @@ namespace elm {
 			bool enforce_constraints=true,
 			double idca_avail_ratio_floor=0.1,
 			bool autocreate_parameters=true,
-			bool ignore_bad_constraints=false
+			bool ignore_bad_constraints=false,
+			bool parallel_finite_diff=false,
+			double out_of_core_block_mb=0,
+			bool incremental_utility=true,
+			double cache_budget_mb=64,
+			double fused_block_kb=256,
+			int mixed_draws=100,
+			std::string mixed_draw_type="halton",
+			int mixed_draw_seed=0
 		);
 	
 		// Re-constructor
@@ -143,7 +205,15 @@ namespace elm {
 			int enforce_constraints=-9,
 			double idca_avail_ratio_floor=-9,
 			int autocreate_parameters=-9,
-			int ignore_bad_constraints=-9
+			int ignore_bad_constraints=-9,
+			int parallel_finite_diff=-9,
+			double out_of_core_block_mb=-9,
+			int incremental_utility=-9,
+			double cache_budget_mb=-9,
+			double fused_block_kb=-9,
+			int mixed_draws=-9,
+			std::string mixed_draw_type="-9",
+			int mixed_draw_seed=-9
 		);
 
 		void copy(const model_options_t& other);
@@ -0,0 +1,312 @@
+/*
+ *  elm_model2_segmented.cpp
+ *
+ *  Copyright 2007-2017 Jeffrey Newman
+ *
+ *  Larch is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Larch is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with Larch.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+
+#include <cstring>
+#include <sstream>
+#include <algorithm>
+#include <map>
+#include "elm_model2.h"
+#include "elm_parameter2.h"
+#include "larch_modelparameter.h"
+#include "elm_workshop_segmented.h"
+#include <iostream>
+
+using namespace etk;
+using namespace elm;
+using namespace std;
+
+
+
+//////// MARK: SEGMENTS //////////////////////////////////////////////////////////////
+
+void elm::Model2::segment_by(const std::string& column_name, const std::vector<long long>& codes)
+{
+	if (column_name.empty()) {
+		OOPS("segment_by needs the name of an idco column");
+	}
+	if (codes.empty()) {
+		OOPS("segment_by needs at least one segment code");
+	}
+	std::vector<long long> sorted (codes);
+	std::sort(sorted.begin(), sorted.end());
+	if (std::adjacent_find(sorted.begin(), sorted.end())!=sorted.end()) {
+		OOPS("segment codes must be unique");
+	}
+	if (!Segment_Parameters.empty() && (column_name!=Input_Segment || codes!=Segment_Codes)) {
+		OOPS("the model already has segment parameters, call segment_clear before segmenting it again");
+	}
+	Input_Segment = column_name;
+	Segment_Codes = codes;
+	_reset_segments();
+}
+
+void elm::Model2::segment_parameter(const std::string& param_name)
+{
+	if (!_segmented_active()) {
+		OOPS("the model is not segmented, call segment_by first");
+	}
+	if (!parameter_exists(param_name)) {
+		OOPS_KeyError("Parameter ",param_name," not found");
+	}
+	if (std::find(Segment_Parameters.begin(), Segment_Parameters.end(), param_name)!=Segment_Parameters.end()) {
+		OOPS("parameter ",param_name," is already segmented");
+	}
+	// Each segment starts from the value of the parameter, which is then held
+	//  fast, as the utility of every segment now uses the segment's own.
+	double value = parameter_value(param_name);
+	for (auto code=Segment_Codes.begin(); code!=Segment_Codes.end(); code++) {
+		std::string segment_name = _segment_freedom_name(param_name, *code);
+		if (!parameter_exists(segment_name)) {
+			BUGGER(msg) << "automatically generating "<<segment_name<<" parameter because it does not already exist";
+			parameter(segment_name, value);
+		}
+	}
+	parameter(param_name, NAN, NAN, NAN, NAN, NAN, 1);
+	Segment_Parameters.push_back(param_name);
+	_reset_segments();
+}
+
+void elm::Model2::segment_clear()
+{
+	// The segment freedoms are left in the model, as for the scales of a
+	//  mixed logit model, but the parameters they replaced are freed again.
+	for (auto p=Segment_Parameters.begin(); p!=Segment_Parameters.end(); p++) {
+		if (parameter_exists(*p)) {
+			parameter(*p, NAN, NAN, NAN, NAN, NAN, 0);
+		}
+	}
+	Input_Segment.clear();
+	Segment_Codes.clear();
+	Segment_Parameters.clear();
+	_reset_segments();
+}
+
+std::vector<long long> elm::Model2::segment_codes() const
+{
+	return Segment_Codes;
+}
+
+std::string elm::Model2::_segment_freedom_name(const std::string& param_name, const long long& code) const
+{
+	std::ostringstream x;
+	x << param_name << "@" << code;
+	return x.str();
+}
+
+void elm::Model2::_reset_segments()
+{
+	// The segment data is a different column, or none, so it is provisioned
+	//  again, and the parameter arrays are found again at the next setUp.
+	tearDown();
+	Data_SegmentCO.reset();
+	Segment_Of_Case.clear();
+	Segment_Case_Order.clear();
+	Segment_Of_Case_source.reset();
+	Segment_Params_CA.clear();
+	Segment_Params_CO.clear();
+	Segment_Coef_CA.clear();
+	Segment_Coef_CO.clear();
+	segmented_probability_dispatcher.reset();
+	segmented_gradient_dispatcher.reset();
+}
+
+
+
+//////// MARK: SEGMENTS SETUP ////////////////////////////////////////////////////////
+
+void elm::Model2::_setUp_segments()
+{
+	if (!_segmented_active()) return;
+
+	// idce utility data also sets the model features, see setUp
+	if (features) {
+		OOPS("a segmented model must have an MNL kernel, without nests, quantities or idce data");
+	}
+	if (_mixed_active()) {
+		OOPS("a segmented model cannot also be a mixed logit model");
+	}
+	if (sampling_packet().relevant()) {
+		OOPS("a segmented model cannot have a sampling bias");
+	}
+	if (Data_UtilityCA && Data_UtilityCA->nVars() && Data_UtilityCA->nAlts()!=nElementals) {
+		OOPS("a segmented model needs idca data for all ",nElementals," alternatives");
+	}
+	if (Params_UtilityCO.size1() && Params_UtilityCO.size2()!=nElementals) {
+		OOPS("a segmented model needs idco utility for all ",nElementals," alternatives");
+	}
+	for (auto p=Segment_Parameters.begin(); p!=Segment_Parameters.end(); p++) {
+		for (auto code=Segment_Codes.begin(); code!=Segment_Codes.end(); code++) {
+			if (!parameter_exists(_segment_freedom_name(*p, *code))) {
+				OOPS_KeyError("Parameter ",_segment_freedom_name(*p, *code)," not found");
+			}
+		}
+	}
+	if (Segment_Params_CA.size()!=Segment_Codes.size()) {
+		_setUp_segment_params();
+	}
+}
+
+void elm::Model2::_setUp_segment_of_case()
+{
+	if (!Data_SegmentCO) {
+		OOPS("the segment data ",Input_Segment," is not provisioned");
+	}
+	if (Segment_Of_Case_source==Data_SegmentCO && Segment_Of_Case.size()==nCases
+		&& Segment_Case_Order.size()==nCases) return;
+
+	std::map<long long, unsigned> slot;
+	for (unsigned s=0; s<Segment_Codes.size(); s++) {
+		slot[Segment_Codes[s]] = s;
+	}
+	Segment_Of_Case.resize(nCases);
+	for (unsigned c=0; c<nCases; c++) {
+		double value = Data_SegmentCO->value(c,0);
+		auto s = slot.find((long long)value);
+		if (s==slot.end() || double(s->first)!=value) {
+			OOPS("case ",c," has ",Input_Segment,"=",value,", which is not one of the segment codes");
+		}
+		Segment_Of_Case[c] = s->second;
+	}
+
+	// The workshops take the cases in this order, so however the segments are
+	//  interleaved in the data, each job has at most one run per segment.
+	std::vector<size_t> start (Segment_Codes.size()+1, 0);
+	for (unsigned c=0; c<nCases; c++) {
+		start[Segment_Of_Case[c]+1]++;
+	}
+	for (size_t s=1; s<start.size(); s++) {
+		start[s] += start[s-1];
+	}
+	Segment_Case_Order.resize(nCases);
+	for (unsigned c=0; c<nCases; c++) {
+		Segment_Case_Order[start[Segment_Of_Case[c]]++] = c;
+	}
+	Segment_Of_Case_source = Data_SegmentCO;
+
+	segmented_probability_dispatcher.reset();
+	segmented_gradient_dispatcher.reset();
+}
+
+void elm::Model2::_pull_segment_coefs()
+{
+	size_t nSegments = Segment_Codes.size();
+	if (Segment_Params_CA.size()!=nSegments) {
+		_setUp_segment_params();
+	}
+	Segment_Coef_CA.resize(nSegments);
+	Segment_Coef_CO.resize(nSegments);
+	for (size_t s=0; s<nSegments; s++) {
+		if (!Segment_Coef_CA[s]) Segment_Coef_CA[s] = boosted::make_shared<etk::ndarray>();
+		if (!Segment_Coef_CO[s]) Segment_Coef_CO[s] = boosted::make_shared<etk::ndarray>();
+		Segment_Coef_CA[s]->resize_if_needed(*Segment_Params_CA[s]);
+		Segment_Coef_CO[s]->resize_if_needed(*Segment_Params_CO[s]);
+		pull_from_freedoms(*Segment_Params_CA[s], **Segment_Coef_CA[s], *ReadFCurrent());
+		pull_from_freedoms(*Segment_Params_CO[s], **Segment_Coef_CO[s], *ReadFCurrent());
+	}
+}
+
+
+
+//////// MARK: SEGMENTS CALCULATIONS /////////////////////////////////////////////////
+
+void elm::Model2::segmented_probability()
+{
+	Probability.resize(nCases,Xylem.n_elemental());
+	CaseLogLike.resize(nCases);
+	pull_coefficients_from_freedoms();
+	_setUp_segment_of_case();
+	_pull_segment_coefs();
+
+	#ifndef __APPLE__
+	openblas_set_num_threads(1);
+	#endif
+
+	boosted::function<boosted::shared_ptr<workshop> ()> workshop_builder =
+	[&](){
+		return boosted::make_shared<workshop_segmented_logit>
+		(dF()
+		 , nElementals
+		 , utility_packet()
+		 , &Segment_Params_CA
+		 , &Segment_Params_CO
+		 , &Segment_Coef_CA
+		 , &Segment_Coef_CO
+		 , &Segment_Of_Case
+		 , (_case_stream() ? nullptr : &Segment_Case_Order)
+		 , Data_Avail
+		 , Data_Choice
+		 , Data_Weight_active()
+		 , &Probability
+		 , &CaseLogLike
+		 , &loglike_partials
+		 , nullptr
+		 , &msg
+		 );
+	};
+	prepare_loglike_partials();
+	REDUCE_AND_DISPATCH(segmented_probability_dispatcher,option.threads, &loglike_partials, nCases, workshop_builder, _case_stream());
+	fused_LogL = *loglike_partials.combine();
+	fused_LogL_current = true;
+}
+
+void elm::Model2::segmented_gradient()
+{
+	BUGGER(msg)<< "Beginning Segmented Gradient Evaluation" ;
+	GCurrent.initialize(0.0);
+	if (Bhhh.size1() != dF()) {
+		Bhhh.resize(dF());
+	}
+	Bhhh.initialize(0.0);
+
+	// The probabilities of every segment were found by the objective, which
+	//  gradient calls first, so they are only read here.
+	boosted::function<boosted::shared_ptr<workshop> ()> workshop_builder =
+	[&](){
+		return boosted::make_shared<workshop_segmented_logit>
+		(dF()
+		 , nElementals
+		 , utility_packet()
+		 , &Segment_Params_CA
+		 , &Segment_Params_CO
+		 , &Segment_Coef_CA
+		 , &Segment_Coef_CO
+		 , &Segment_Of_Case
+		 , (_case_stream() ? nullptr : &Segment_Case_Order)
+		 , Data_Avail
+		 , Data_Choice
+		 , Data_Weight_active()
+		 , &Probability
+		 , nullptr
+		 , nullptr
+		 , &gradient_partials
+		 , &msg
+		 );
+	};
+	prepare_gradient_partials();
+	REDUCE_AND_DISPATCH(segmented_gradient_dispatcher,option.threads, &gradient_partials, nCases, workshop_builder, _case_stream());
+	combine_gradient_partials();
+
+	std::ostringstream ret;
+	for (unsigned i=0; i<GCurrent.size(); i++) {
+		ret << "," << GCurrent[i];
+	}
+	INFO(msg) << "Segmented Grad->["<< ret.str().substr(1) <<"] (using "<<option.threads<<" threads)";
+}
@@ -327,6 +327,50 @@ void elm::Model2::_setUp_utility_data_and_params(bool check_validity)
 	BUGGER(msg) << "Params_UtilityCA \n" << Params_UtilityCA.__str__();
 	BUGGER(msg) << "Params_UtilityCO \n" << Params_UtilityCO.__str__();
 
+	if (_segmented_active()) {
+		_setUp_segment_params();
+	}
+}
+
+void elm::Model2::_setUp_segment_params()
+{
+	BUGGER(msg) << "--Params_Segments--\n";
+
+	// Each segment has the utility of the model, with the segment parameters
+	//  renamed to its own freedoms. The data names, and so the slots, are the
+	//  same as those of Params_UtilityCA and Params_UtilityCO.
+	Segment_Params_CA.resize(Segment_Codes.size());
+	Segment_Params_CO.resize(Segment_Codes.size());
+	for (size_t s=0; s<Segment_Codes.size(); s++) {
+		elm::ComponentList    ca (Input_Utility.ca);
+		elm::LinearCOBundle_1 co (Input_Utility.co);
+		for (auto p=Segment_Parameters.begin(); p!=Segment_Parameters.end(); p++) {
+			std::string segment_name = _segment_freedom_name(*p, Segment_Codes[s]);
+			for (auto i=ca.begin(); i!=ca.end(); i++) {
+				if (i->param_name==*p) i->param_name = segment_name;
+			}
+			for (auto top_i=co.begin(); top_i!=co.end(); top_i++) {
+				for (auto i=top_i->second.begin(); i!=top_i->second.end(); i++) {
+					if (i->param_name==*p) i->param_name = segment_name;
+				}
+			}
+		}
+		if (!Segment_Params_CA[s]) Segment_Params_CA[s] = boosted::make_shared<elm::paramArray>();
+		if (!Segment_Params_CO[s]) Segment_Params_CO[s] = boosted::make_shared<elm::paramArray>();
+		_setUp_linear_data_and_params
+		(	*this
+		 ,	_fountain()
+		 ,	Xylem
+		 ,	&ca
+		 ,	&co
+		 ,	&*Segment_Params_CA[s]
+		 ,	&*Segment_Params_CO[s]
+		 ,	&msg
+		 ,  nullptr
+		 ,  nullptr
+		 ,  false
+		);
+	}
 }
 
 void elm::Model2::_setUp_quantity_data_and_params(bool check_validity)
@@ -449,9 +493,14 @@ void elm::Model2::restore_scale_weights()
 	weight_scale_factor = 1.0;
 	
 	gradient_dispatcher.reset();
+	hessian_dispatcher.reset();
 	d_logsums_dispatcher.reset();
 	probability_dispatcher.reset();
 	loglike_dispatcher.reset();
+	mixed_probability_dispatcher.reset();
+	mixed_gradient_dispatcher.reset();
+	segmented_probability_dispatcher.reset();
+	segmented_gradient_dispatcher.reset();
 }
 
 double elm::Model2::get_weight_scale_factor() const
@@ -502,6 +551,7 @@ void elm::Model2::_pull_graph_from_db()
 
 void elm::Model2::setUp(bool and_load_data, bool force, bool cache, bool check_validity)
 {
+	_cached_results.set_budget(size_t(option.cache_budget_mb*1024*1024));
 	
 	if (!force) {
 		if (_is_setUp>=1) {
@@ -570,6 +620,8 @@ void elm::Model2::setUp(bool and_load_data, bool force, bool cache, bool check_v
 	}
 	
 	_setUp_coef_and_grad_arrays();
+	_setUp_mixed();
+	_setUp_segments();
 	
 	
 	boosted::shared_ptr< const std::vector<long long> > local_alt_codes;
@@ -609,10 +661,16 @@ void elm::Model2::tearDown()
 	
 	probability_dispatcher.reset();
 	gradient_dispatcher.reset();
+	hessian_dispatcher.reset();
 	d_logsums_dispatcher.reset();
 	loglike_dispatcher.reset();
+	mixed_probability_dispatcher.reset();
+	mixed_gradient_dispatcher.reset();
+	segmented_probability_dispatcher.reset();
+	segmented_gradient_dispatcher.reset();
 	
 	clear_cache();
+	Utility_Base.reset();
 	
 	CaseLogLike.destroy();
 	Data_UtilityCE_manual.clear();
@@ -625,6 +683,8 @@ void elm::Model2::tearDown()
 	Params_QuantLogSum.clear();
 	Params_LogSum     .clear();
 	Params_Edges      .clear();
+	Segment_Params_CA .clear();
+	Segment_Params_CO .clear();
 
 	cache_valid_ca.clear();
 	cache_valid_co.clear();
@@ -635,11 +695,14 @@ void elm::Model2::tearDown()
 void elm::Model2::unprovision()
 {
 	Data_UtilityCA.reset();
+	Data_UtilityCA_stream.reset();
 	Data_UtilityCO.reset();
+	Utility_Base.reset();
 	Data_SamplingCA.reset();
 	Data_SamplingCO.reset();
 	Data_Allocation.reset();
 	Data_QuantityCA.reset();
+	Data_SegmentCO.reset();
 //	Data_QuantLogSum.reset();
 //	Data_LogSum.reset();
 	
@@ -708,11 +771,37 @@ void elm::Model2::provision(const std::map< std::string, boosted::shared_ptr<con
 		ret += uca;
 	}
 	
+	boosted::shared_ptr<elm::darray_stream> stream;
+	if (Data_UtilityCA && option.out_of_core_block_mb>0) {
+		if (Data_UtilityCA->source_file.empty()) {
+			WARN(msg) << "out_of_core_block_mb is set, but UtilityCA was not provisioned from a darray file, so it is held in memory";
+		} else {
+			stream = boosted::make_shared<elm::darray_stream>(Data_UtilityCA->source_file, size_t(option.out_of_core_block_mb*1024*1024));
+			Data_UtilityCA = stream;
+		}
+	}
+	if (stream || Data_UtilityCA_stream) {
+		// Dispatchers keep the stream they were built with
+		probability_dispatcher.reset();
+		gradient_dispatcher.reset();
+		hessian_dispatcher.reset();
+		d_logsums_dispatcher.reset();
+		mixed_probability_dispatcher.reset();
+		mixed_gradient_dispatcher.reset();
+		segmented_probability_dispatcher.reset();
+		segmented_gradient_dispatcher.reset();
+	}
+	Data_UtilityCA_stream = stream;
+	
+	// results saved for the old data no longer apply
+	clear_cache();
+	
 	ret += _subprovision("UtilityCO", Data_UtilityCO, input, need, ncases);
 	ret += _subprovision("QuantityCA", Data_QuantityCA, input, need, ncases);
 	ret += _subprovision("SamplingCA", Data_SamplingCA, input, need, ncases);
 	ret += _subprovision("SamplingCO", Data_SamplingCO, input, need, ncases);
 	ret += _subprovision("Allocation", Data_Allocation, input, need, ncases);
+	ret += _subprovision("SegmentCO", Data_SegmentCO, input, need, ncases);
 
 	ret += _subprovision("Avail",  Data_Avail , input, need, ncases);
 	ret += _subprovision("Choice", Data_Choice, input, need, ncases);
@@ -751,12 +840,14 @@ std::map<std::string, darray_req> elm::Model2::needs() const
 	if (u_ca.size()) {
 		requires["UtilityCA"] = darray_req (3,NPY_DOUBLE,Xylem.n_elemental());
 		requires["UtilityCA"].set_variables(u_ca);
+		requires["UtilityCA"].widen_float = true;
 	}
 	
 	etk::strvec u_co = __identify_needs(Input_Utility.co);
 	if (u_co.size()) {
 		requires["UtilityCO"] = darray_req (2,NPY_DOUBLE);
 		requires["UtilityCO"].set_variables(u_co);
+		requires["UtilityCO"].widen_float = true;
 	}
 
 	etk::strvec q_ca = __identify_needs(Input_QuantityCA);
@@ -784,6 +875,11 @@ std::map<std::string, darray_req> elm::Model2::needs() const
 		requires["Allocation"].set_variables(allo);
 	}
 	
+	if (_segmented_active()) {
+		requires["SegmentCO"] = darray_req (2,NPY_DOUBLE);
+		requires["SegmentCO"].set_variables(std::vector<std::string>(1,Input_Segment));
+	}
+	
 	requires["Avail"] = darray_req (3,NPY_BOOL);
 	requires["Weight"] = darray_req (2,NPY_DOUBLE);
 	requires["Choice"] = darray_req (3,NPY_DOUBLE);
@@ -835,6 +931,7 @@ int elm::Model2::is_provisioned(bool ex) const
 	i |= _is_subprovisioned("SamplingCA", Data_SamplingCA, requires, ex);
 	i |= _is_subprovisioned("SamplingCO", Data_SamplingCO, requires, ex);
 	i |= _is_subprovisioned("Allocation", Data_Allocation, requires, ex);
+	i |= _is_subprovisioned("SegmentCO", Data_SegmentCO, requires, ex);
 	
 	i |= _is_subprovisioned("Avail", Data_Avail, requires, ex);
 	i |= _is_subprovisioned("Weight", Data_Weight, requires, ex);
@@ -857,6 +954,7 @@ const elm::darray* elm::Model2::Data(const std::string& label)
 	if (label=="SamplingCA") return Data_SamplingCA ? (&*Data_SamplingCA) : nullptr;
 	if (label=="SamplingCO") return Data_SamplingCO ? (&*Data_SamplingCO) : nullptr;
 	if (label=="Allocation") return Data_Allocation ? (&*Data_Allocation) : nullptr;
+	if (label=="SegmentCO") return Data_SegmentCO ?   (&*Data_SegmentCO) : nullptr;
 
 	if (label=="Avail" ) return Data_Avail ?  (&*Data_Avail ) : nullptr;
 	if (label=="Choice") return Data_Choice ? (&*Data_Choice) : nullptr;
@@ -874,6 +972,7 @@ elm::darray* elm::Model2::DataEdit(const std::string& label)
 	if (label=="SamplingCA") return Data_SamplingCA ? const_cast<elm::darray*>(&*Data_SamplingCA) : nullptr;
 	if (label=="SamplingCO") return Data_SamplingCO ? const_cast<elm::darray*>(&*Data_SamplingCO) : nullptr;
 	if (label=="Allocation") return Data_Allocation ? const_cast<elm::darray*>(&*Data_Allocation) : nullptr;
+	if (label=="SegmentCO") return Data_SegmentCO ?   const_cast<elm::darray*>(&*Data_SegmentCO) : nullptr;
 
 	if (label=="Avail" ) return Data_Avail ?  const_cast<elm::darray*>(&*Data_Avail ) : nullptr;
 	if (label=="Choice") return Data_Choice ? const_cast<elm::darray*>(&*Data_Choice) : nullptr;
@@ -961,3 +1060,13 @@ const etk::ndarray* elm::Model2::Coef(const std::string& label)
 
 
 
+void elm::Model2::_work_in_blocks(etk::workshop& w, boosted::mutex* result_mutex)
+{
+	if (_case_stream()) {
+		_case_stream()->for_each_block(nCases, [&](size_t first, size_t length){
+			w.work(first, length, result_mutex);
+		});
+	} else {
+		w.work(0, nCases, result_mutex);
+	}
+}
@@ -22,6 +22,7 @@
 #include "elm_packets.h"
 #include "elm_sql_scrape.h"
 #include "elm_darray.h"
+#include "etk_simd.h"
 
 
 elm::ca_co_packet::ca_co_packet(
@@ -69,34 +70,39 @@ void elm::ca_co_packet::logit_partial
 ( const unsigned&      firstcase
 , const unsigned&      numberofcases
 , const double&        U_premultiplier
+, const unsigned&      outcome_offset
 )
 {
 	if (Data_CE) {
 
 
 		if (U_premultiplier) {
-			cblas_dscal(Outcome->size2()*Outcome->size3()*numberofcases, U_premultiplier, Outcome->ptr(firstcase), 1);
+			cblas_dscal(Outcome->size2()*Outcome->size3()*numberofcases, U_premultiplier, Outcome->ptr(firstcase-outcome_offset), 1);
 		} else {
-			memset(Outcome->ptr(firstcase), 0, sizeof(double)*Outcome->size2()*Outcome->size3()*numberofcases);
+			memset(Outcome->ptr(firstcase-outcome_offset), 0, sizeof(double)*Outcome->size2()*Outcome->size3()*numberofcases);
 		}
 
 	
-		size_t rowmarker = Data_CE->_casestarts->int64_at(firstcase);
-		long long caseindex = Data_CE->_caseindexes->int64_at(rowmarker);
-		while (caseindex < firstcase+numberofcases) {
-			*(Outcome->ptr(caseindex, Data_CE->_altindexes->int64_at(rowmarker))) = cblas_ddot(Data_CE->nvars(), Coef_CA->ptr(), 1, Data_CE->_data_array->ptr(rowmarker), 1);
-			rowmarker++;
-			if (rowmarker<Data_CE->nrows()) {
-				caseindex = Data_CE->_caseindexes->int64_at(rowmarker);
-			} else {
-				break;
-			}
-		}
+		Data_CE->utility_rows(firstcase, numberofcases, Coef_CA->ptr(), Outcome, outcome_offset);
 	
 	} else {
 
 
-		if (Data_CA && Data_CA->nVars()>0) {
+		if (Data_CA && Data_CA->nVars()>0 && Data_CA->dtype==NPY_FLOAT) {
+			// Single precision data, widened and summed in double
+			etk::simd::mixed_gemv_t gemv = etk::simd::mixed_gemv();
+			if (Outcome->size2()==Data_CA->nAlts()) {
+				gemv(numberofcases * Data_CA->nAlts(), Data_CA->nVars(), 1,
+					 Data_CA->floatvalues(firstcase), Data_CA->nVars(),
+					 Coef_CA->ptr(), U_premultiplier, Outcome->ptr(firstcase-outcome_offset), 1);
+			} else {
+				for (unsigned a=0;a<Data_CA->nAlts();a++) {
+					gemv(numberofcases, Data_CA->nVars(), 1,
+						 Data_CA->floatvalues(firstcase)+(a*Data_CA->nVars()), Data_CA->nAlts()*Data_CA->nVars(),
+						 Coef_CA->ptr(), U_premultiplier, Outcome->ptr(firstcase-outcome_offset)+a, Outcome->size2());
+				}
+			}
+		} else if (Data_CA && Data_CA->nVars()>0) {
 			// Fast Linear Algebra		
 			if (Outcome->size2()==Data_CA->nAlts()) {
 				cblas_dgemv(CblasRowMajor,CblasNoTrans, 
@@ -104,7 +110,7 @@ void elm::ca_co_packet::logit_partial
 							1,
 							Data_CA->values(firstcase,numberofcases),Data_CA->nVars(),
 							Coef_CA->ptr(),1,
-							U_premultiplier, Outcome->ptr(firstcase),1);
+							U_premultiplier, Outcome->ptr(firstcase-outcome_offset),1);
 			} else {
 				for (unsigned a=0;a<Data_CA->nAlts();a++) {
 					cblas_dgemv(CblasRowMajor,CblasNoTrans,
@@ -112,29 +118,36 @@ void elm::ca_co_packet::logit_partial
 								1, 
 								Data_CA->values(firstcase,numberofcases)+(a*Data_CA->nVars()), Data_CA->nAlts()*Data_CA->nVars(), 
 								Coef_CA->ptr(),1, 
-								U_premultiplier, Outcome->ptr(firstcase)+a, Outcome->size2() );
+								U_premultiplier, Outcome->ptr(firstcase-outcome_offset)+a, Outcome->size2() );
 				}
 			}		
 		}
 		if ((Data_CA && Data_CA->nVars()==0) || (!Data_CA)) {
 			if (U_premultiplier) {
-				cblas_dscal(Outcome->size2()*Outcome->size3()*numberofcases, U_premultiplier, Outcome->ptr(firstcase), 1);
+				cblas_dscal(Outcome->size2()*Outcome->size3()*numberofcases, U_premultiplier, Outcome->ptr(firstcase-outcome_offset), 1);
 			} else {
-				memset(Outcome->ptr(firstcase), 0, sizeof(double)*Outcome->size2()*Outcome->size3()*numberofcases);
+				memset(Outcome->ptr(firstcase-outcome_offset), 0, sizeof(double)*Outcome->size2()*Outcome->size3()*numberofcases);
 			}
 		}
 	}
 	if (Data_CO && Data_CO->nVars()>0) {
 		// Fast Linear Algebra
 		
-		if (Coef_CO->size2()>0) {
+		if (Coef_CO->size2()>0 && Data_CO->dtype==NPY_FLOAT) {
+
+		etk::simd::mixed_gemm(numberofcases, Coef_CO->size2(), Data_CO->nVars(),
+							  1, Data_CO->floatvalues(firstcase), Data_CO->nVars(),
+							  Coef_CO->ptr(), Coef_CO->size2(),
+							  1, Outcome->ptr(firstcase-outcome_offset), Outcome->size2());
+
+		} else if (Coef_CO->size2()>0) {
 		
 		cblas_dgemm(CblasRowMajor,CblasNoTrans,CblasNoTrans,
 					numberofcases,Coef_CO->size2(), Data_CO->nVars(),
 					1,
 					Data_CO->values(firstcase,numberofcases), Data_CO->nVars(),
 					Coef_CO->ptr(), Coef_CO->size2(),
-					1,Outcome->ptr(firstcase),Outcome->size2());
+					1,Outcome->ptr(firstcase-outcome_offset),Outcome->size2());
 			
 		} else {
 			OOPS("Coef_CO->size2()=",Coef_CO->size2()," while Data_CO->nVars()=",Data_CO->nVars());
@@ -61,7 +61,10 @@ namespace elm {
 		( const unsigned&      firstcase
 		, const unsigned&      numberofcases
 		, const double&        U_premultiplier=0.0
+		, const unsigned&      outcome_offset=0
 		);
+		// The utility of case c is written to row c-outcome_offset of Outcome,
+		//  so that Outcome may hold only a block of cases.
 		void logit_partial_deriv
 		( const unsigned&      c
 		, etk::memarray_raw*   dUtilCA
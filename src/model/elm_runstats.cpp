@@ -24,6 +24,7 @@
 #include <sstream>
 #include <cmath>
 #include "etk.h"
+#include "etk_python.h"
 #include <iostream>
 
 #ifdef __APPLE__
@@ -62,12 +63,12 @@ elm::runstats::runstats(long startTimeSec, long startTimeUSec,
 				 int number_threads,
 				 int number_cpu)
 : iteration (iteration)
-, _notes ()
 , results (results)
 , timestamp (timestamp)
-, processor(processor)
 , number_threads(number_threads)
 , number_cpu_cores(number_cpu)
+, processor(processor)
+, _notes ()
 , _other_attr(PyDict_New())
 {
 	if (this->processor=="?") this->processor=etk::discovered_platform_description;
@@ -81,26 +82,51 @@ elm::runstats::runstats(long startTimeSec, long startTimeUSec,
 
 elm::runstats::runstats(const runstats& other)
 : iteration (other.iteration)
-, _notes (other._notes)
 , results (other.results)
 , timestamp (other.timestamp)
+, number_threads(other.number_threads)
+, number_cpu_cores(other.number_cpu_cores)
 , processor(other.processor)
 , process_label(other.process_label)
 , process_starttime(other.process_starttime)
 , process_endtime(other.process_endtime)
-, number_threads(other.number_threads)
-, _other_attr(PyDict_Copy(other._other_attr))
+, _notes (other._notes)
+, evaluations(other.evaluations)
+, _other_attr(nullptr)
 {
 	if (this->processor=="?") this->processor=etk::discovered_platform_description;
+	// Run statistics are copied out of the concurrent starts of a multistart
+	etk::python_lock LOCK;
+	_other_attr = PyDict_Copy(other._other_attr);
+}
+
+elm::runstats& elm::runstats::operator=(const runstats& other)
+{
+	if (this == &other) return *this;
+	iteration = other.iteration;
+	_notes = other._notes;
+	results = other.results;
+	timestamp = other.timestamp;
+	processor = other.processor;
+	process_label = other.process_label;
+	process_starttime = other.process_starttime;
+	process_endtime = other.process_endtime;
+	evaluations = other.evaluations;
+	number_threads = other.number_threads;
+	number_cpu_cores = other.number_cpu_cores;
+	etk::python_lock LOCK;
+	Py_CLEAR(_other_attr);
+	_other_attr = PyDict_Copy(other._other_attr);
+	return *this;
 }
 
 elm::runstats::runstats(PyObject* dictionary)
 : iteration (0)
-, _notes ()
 , results ()
 , timestamp ()
-, processor ()
 , number_threads(0)
+, processor ()
+, _notes ()
 , _other_attr(PyDict_New())
 {
 	read_from_dictionary(dictionary);
@@ -108,6 +134,7 @@ elm::runstats::runstats(PyObject* dictionary)
 
 elm::runstats::~runstats()
 {
+	etk::python_lock LOCK;
 	Py_CLEAR(_other_attr);
 }
 
@@ -154,6 +181,7 @@ void elm::runstats::restart()
 	process_endtime.clear();
 	process_starttime.clear();
 	process_label.clear();
+	evaluations.clear();
 }
 
 
@@ -238,6 +266,7 @@ PyObject* elm::runstats::dictionary() const
 	etk::py_add_to_dict(P, "process_label", process_label);
 	etk::py_add_to_dict(P, "process_starttime", process_starttime);
 	etk::py_add_to_dict(P, "process_endtime", process_endtime);
+	etk::py_add_to_dict(P, "evaluations", evaluations);
 
 	etk::py_add_to_dict(P, "_other_attr", _other_attr);
 
@@ -321,6 +350,8 @@ void elm::runstats::read_from_dictionary(PyObject* input_obj)
 	if (x!=0) OOPS("error in reading run_stats process_starttime");
 	x=etk::py_read_from_dict(P, "process_endtime", process_endtime);
 	if (x!=0) OOPS("error in reading run_stats process_endtime");
+	x=etk::py_read_from_dict(P, "evaluations", evaluations);
+	if (x!=0) evaluations.clear();
 
 	x=etk::py_copydict_from_dict(P, "_other_attr", _other_attr);
 	if (x!=0) OOPS("error in reading run_stats _other_attr");
@@ -419,6 +450,7 @@ PyObject* elm::runstats::__getstate__() const
 	etk::py_add_to_dict(P, "process_label", process_label);
 	etk::py_add_to_dict(P, "process_starttime", process_starttime);
 	etk::py_add_to_dict(P, "process_endtime", process_endtime);
+	etk::py_add_to_dict(P, "evaluations", evaluations);
 	
 	return P;
 }
@@ -63,6 +63,10 @@ namespace elm {
 
 		std::vector<std::string> _notes;
 		
+		std::vector<int> evaluations;
+		// The number of objective evaluations made by the line search (or the
+		//  trust region step) in each iteration of the optimization.
+		
 		double elapsed_time() const;
 		double runtime_seconds() const;
 		std::string runtime() const;
@@ -77,6 +81,7 @@ namespace elm {
 				 int number_threads=-9,
 				 int number_cpu=-9);
 		runstats(const runstats& other);
+		runstats& operator=(const runstats& other);
 		runstats(PyObject* dictionary);
 		~runstats();
 
@@ -135,5 +140,9 @@ namespace elm {
 
 }
 
+#ifdef SWIG
+%template(RunStatisticsList) std::vector<elm::runstats>;
+#endif // def SWIG
+
 #endif
 
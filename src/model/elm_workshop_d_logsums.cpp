@@ -46,6 +46,8 @@ elm::d_logsums_w::d_logsums_w(  etk::ndarray* U
 {
 	//	BUGGER_(msg_, "CONSTRUCT elm::d_logsums_w::d_logsums_w()\n");
 	
+	etk::python_lock LOCK;
+	
 	// check that logsums out is at least the correct size
 	if (d_logsums_casewise) {
 		if (PyArray_DIM(*d_logsums_casewise, 0) < Probability->size1() ) {
@@ -62,6 +64,7 @@ elm::d_logsums_w::d_logsums_w(  etk::ndarray* U
 
 elm::d_logsums_w::~d_logsums_w()
 {
+	etk::python_lock LOCK;
 	Py_CLEAR(*d_logsums_casewise);
 }
 
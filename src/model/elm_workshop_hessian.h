@@ -0,0 +1,195 @@
+/*
+ *  elm_workshop_hessian.h
+ *
+ *  Copyright 2007-2017 Jeffrey Newman
+ *
+ *  Larch is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Larch is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with Larch.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef __ELM_WORKSHOP_HESSIAN_H__
+#define __ELM_WORKSHOP_HESSIAN_H__
+
+
+#include <cstring>
+#include "elm_model2.h"
+#include "elm_parameter2.h"
+#include "elm_names.h"
+#include "etk_workshop.h"
+#include "elm_darray.h"
+#include <iostream>
+
+
+namespace elm {
+
+	// Write the derivative of the utility of elemental alternative a in case c,
+	//  with respect to the freedoms, into dUtilF [dF]. Utility is linear in the
+	//  CA and CO parameters, so this does not depend on the parameter values.
+	void __casewise_dUtility_dFreedoms
+	( const elm::ca_co_packet& UtilPacket
+	, const unsigned&    c
+	, const unsigned&    a
+	, etk::memarray_raw& Fused   // [nCA] scratch
+	, double*            dUtilF  // [dF]
+	, const unsigned&    dF
+	);
+
+	// Analytic hessian of the negative log likelihood for MNL models.
+	//
+	// For each case, the hessian is the (choice weighted) covariance of the
+	//  utility derivatives over the alternatives, under the model probabilities.
+	//  All the work is done in freedom space, so only the upper triangle of a
+	//  [dF,dF] matrix is accumulated.
+	class workshop_mnl_hessian
+	: public etk::workshop
+	{
+
+	  public:
+		boosted::mutex* _lock;
+
+		// Fused Parameter Block Size
+		size_t nCA;
+
+		unsigned dF;
+		unsigned nElementals;
+
+		// These are memory arrays bound to this workshop.
+		etk::memarray_raw Fused;         // [nCA]
+		etk::memarray_raw dUtil;         // [nElementals, dF]
+		etk::memarray_raw MeanDUtil;     // [dF]
+		etk::memarray_raw workshopHess;  // [dF, dF], upper triangle
+
+		// The principle output accumulator of the workshop.
+		//  The lock needs to be acquired before writing to it.
+		etk::symmetric_matrix* _Hess;
+
+		// If given, results are written without locking to this job's slot here instead.
+		etk::job_partials* _partials;
+
+		const etk::memarray* _Probability;
+
+		elm::ca_co_packet UtilPacket;
+
+		elm::darray_ptr Data_Choice;
+		elm::darray_ptr Data_Weight;
+
+		etk::logging_service* msg_;
+
+		workshop_mnl_hessian
+		(  const unsigned&   dF
+		 , const unsigned&   nElementals
+		 , elm::ca_co_packet UtilPK
+		 , elm::darray_ptr     Data_Choice
+		 , elm::darray_ptr     Data_Weight
+		 , const etk::memarray* Probability
+		 , etk::symmetric_matrix* Hess
+		 , etk::logging_service* msgr
+		 , etk::job_partials* partials=nullptr
+		 );
+
+		~workshop_mnl_hessian();
+
+		void case_hessian_mnl(const unsigned& c);
+
+		void workshop_mnl_hessian_do(const unsigned& firstcase, const unsigned& numberofcases);
+		void workshop_mnl_hessian_send();
+
+		virtual void work(size_t firstcase, size_t numberofcases, boosted::mutex* result_mutex);
+	};
+
+
+
+	// Analytic hessian of the negative log likelihood for NL models.
+	//
+	// The log likelihood of a case is written as a sum over the edges of the
+	//  network of (choice weight below the edge) * (log conditional probability
+	//  of the edge). The first and second derivatives of each node's utility are
+	//  rolled up from the elementals to the root in one pass, in freedom space,
+	//  and the edge terms are accumulated as they are reached.
+	class workshop_nl_hessian
+	: public etk::workshop
+	{
+
+	  public:
+		boosted::mutex* _lock;
+
+		// Fused Parameter Block Size
+		size_t nCA;
+
+		unsigned dF;
+		unsigned nNodes;
+		unsigned nNests;   // including the root
+		unsigned nElementals;
+
+		// These are memory arrays bound to this workshop.
+		etk::memarray_raw Fused;         // [nCA]
+		etk::memarray_raw dUtil;         // [nNodes, dF]
+		etk::memarray_raw ChoWgt;        // [nNodes] choice weight at or below each node
+		etk::memarray_raw MuPush;        // [nNests, dF] derivative of each nest's mu
+		etk::memarray_raw dLogSum;       // [nNests, dF] accumulates derivative of V/mu
+		etk::memarray_raw d2LogSum;      // [nNests, dF, dF] accumulates second derivative of V/mu
+		etk::memarray_raw d2Util;        // [dF, dF] second derivative of the current node's utility
+		etk::memarray_raw d2Ratio;       // [dF, dF] second derivative of V/mu(parent) of the current node
+		etk::memarray_raw Ratio;         // [dF] derivative of V/mu(parent) of the current node
+		etk::memarray_raw CaseHess;      // [dF, dF] hessian of the case log likelihood
+		etk::memarray_raw workshopHess;  // [dF, dF]
+		std::vector<bool> MuFree;        // [nNests]
+
+		etk::symmetric_matrix* _Hess;
+		etk::job_partials* _partials;
+
+		const paramArray* Params_LogSum;
+
+		const etk::memarray* _Probability;
+		const etk::memarray* _Cond_Prob;
+		const VAS_System* _Xylem;
+
+		elm::ca_co_packet UtilPacket;
+
+		elm::darray_ptr Data_Choice;
+		elm::darray_ptr Data_Weight;
+
+		etk::logging_service* msg_;
+
+		workshop_nl_hessian
+		(  const unsigned&   dF
+		 , const unsigned&   nNodes
+		 , elm::ca_co_packet UtilPK
+		 , const paramArray& Params_LogSum
+		 , elm::darray_ptr     Data_Choice
+		 , elm::darray_ptr     Data_Weight
+		 , const etk::memarray* Probability
+		 , const etk::memarray* Cond_Prob
+		 , const VAS_System* Xylem
+		 , etk::symmetric_matrix* Hess
+		 , etk::logging_service* msgr
+		 , etk::job_partials* partials=nullptr
+		 );
+
+		virtual ~workshop_nl_hessian();
+
+		void prepare_mu_derivatives();
+		void case_hessian_nl(const unsigned& c);
+
+		void workshop_nl_hessian_do(const unsigned& firstcase, const unsigned& numberofcases);
+		void workshop_nl_hessian_send();
+
+		virtual void work(size_t firstcase, size_t numberofcases, boosted::mutex* result_mutex);
+	};
+
+
+
+}
+#endif // __ELM_WORKSHOP_HESSIAN_H__
+
@@ -0,0 +1,258 @@
+/*
+ *  elm_workshop_mixed.cpp
+ *
+ *  Copyright 2007-2017 Jeffrey Newman
+ *
+ *  Larch is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Larch is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with Larch.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+
+#include <cstring>
+#include <cmath>
+#include <algorithm>
+#include "etk.h"
+#include "elm_parameter2.h"
+
+#include "elm_workshop_mixed.h"
+
+
+
+
+elm::workshop_mixed_logit::workshop_mixed_logit
+(  const unsigned& dF
+ , const unsigned& nElementals
+ , elm::ca_co_packet UtilPack
+ , const etk::ndarray* Delta_CA
+ , const etk::ndarray* Delta_CO
+ , const etk::ndarray* Draws
+ , const std::vector<mixed_slot>* Slots
+ , elm::darray_ptr Data_AV
+ , elm::darray_ptr Data_Ch
+ , elm::darray_ptr Data_Wt
+ , etk::ndarray* Probability
+ , etk::ndarray* CaseLogLike
+ , etk::job_partials* LogL
+ , etk::job_partials* partials
+ , etk::logging_service* msgr
+ )
+: dF          (dF)
+, nElementals (nElementals)
+, nDraws      (Draws->size2())
+, nDims       (Draws->size3())
+, block       (std::max<size_t>(1, 32768 / std::max<size_t>(1, nElementals*(Draws->size3()+1))))
+, UtilPacket  (UtilPack)
+, Delta_CA    (Delta_CA)
+, Delta_CO    (Delta_CO)
+, Draws       (Draws)
+, Slots       (Slots)
+, Data_AV     (Data_AV)
+, Data_Ch     (Data_Ch)
+, Data_Wt     (Data_Wt)
+, Probability (Probability)
+, CaseLogLike (CaseLogLike)
+, LogL        (LogL)
+, _partials   (partials)
+, MeanUtility ()
+, DrawUtility (block, nElementals, Draws->size3())
+, DrawProb    (Draws->size2(), nElementals)
+, SimProb     (nElementals)
+, Resid       (Draws->size2(), nElementals)
+, DimResid    (Draws->size3()+1, nElementals)
+, DimGrad     (Draws->size3()+1, dF)
+, Grad_UtilityCA (UtilPack.Params_CA->size1(),UtilPack.Params_CA->size2(),UtilPack.Params_CA->size3())
+, Grad_UtilityCO (UtilPack.Params_CO->size1(),UtilPack.Params_CO->size2(),UtilPack.Params_CO->size3())
+, CaseGrad        (dF)
+, workshopGCurrent(dF)
+, workshopBHHH    (dF, dF)
+, logit_row   (etk::simd::masked_logit_row())
+, msg_        (msgr)
+{
+	// The utility at the mean is written by the packet into an ndarray, which
+	// is sized here rather than in work, which runs on a worker thread.
+	MeanUtility.resize(block, nElementals);
+	Grad_UtilityCA.initialize(0.0);
+	Grad_UtilityCO.initialize(0.0);
+}
+
+elm::workshop_mixed_logit::~workshop_mixed_logit()
+{
+}
+
+
+
+
+double elm::workshop_mixed_logit::case_simulate(const size_t& c, const size_t& row)
+{
+	// U [draw, alt] is the utility at the mean plus the draws times the
+	// change in utility for each dimension.
+	double* U = *DrawProb;
+	for (unsigned r=0; r<nDraws; r++) {
+		memcpy(U+r*nElementals, MeanUtility.ptr(row), nElementals*sizeof(double));
+	}
+	cblas_dgemm(CblasRowMajor, CblasNoTrans, CblasTrans,
+				nDraws, nElementals, nDims,
+				1, Draws->ptr(c), nDims,
+				DrawUtility.ptr(row), nDims,
+				1, U, nElementals);
+
+	const bool*   av = Data_AV->boolvalues_constptr(c);
+	const double* ch = Data_Ch->values_constptr(c);
+	double draw_loglike;
+	SimProb.initialize(0.0);
+	for (unsigned r=0; r<nDraws; r++) {
+		logit_row(U+r*nElementals, av, ch, nElementals, draw_loglike);
+		cblas_daxpy(nElementals, 1.0/nDraws, U+r*nElementals, 1, *SimProb, 1);
+	}
+
+	double caseloglike = 0.0;
+	for (unsigned a=0; a<nElementals; a++) {
+		if (ch[a]) caseloglike += ch[a] * log(SimProb[a]);
+	}
+	if (Probability) {
+		cblas_dcopy(nElementals, *SimProb, 1, Probability->ptr(c), 1);
+	}
+	if (CaseLogLike) {
+		CaseLogLike->at(c) = caseloglike;
+	}
+	return caseloglike;
+}
+
+
+void elm::workshop_mixed_logit::case_gradient(const size_t& c, const double& wgt)
+{
+	const double* ch = Data_Ch->values_constptr(c);
+
+	// The derivative of the simulated log likelihood with respect to the
+	// utility of alternative a at draw r is e[r,a]/R, where
+	// e[r,a] = w[r,a] - P[r,a] sum_b w[r,b], and w[r,a] = ch[a] P[r,a] / S[a].
+	for (unsigned r=0; r<nDraws; r++) {
+		const double* P = DrawProb.ptr(r);
+		double* e = Resid.ptr(r);
+		double W = 0.0;
+		for (unsigned a=0; a<nElementals; a++) {
+			e[a] = (ch[a] && SimProb[a]>0) ? ch[a]*P[a]/SimProb[a] : 0.0;
+			W += e[a];
+		}
+		for (unsigned a=0; a<nElementals; a++) {
+			e[a] -= P[a]*W;
+		}
+	}
+
+	// Row 0 of DimResid is the mean of e over draws, for the mean
+	// coefficients, and row 1+d is the mean of e times the draw in
+	// dimension d, for the coefficients that move with that dimension.
+	memset(DimResid.ptr(0), 0, nElementals*sizeof(double));
+	for (unsigned r=0; r<nDraws; r++) {
+		cblas_daxpy(nElementals, 1.0/nDraws, Resid.ptr(r), 1, DimResid.ptr(0), 1);
+	}
+	cblas_dgemm(CblasRowMajor, CblasTrans, CblasNoTrans,
+				nDims, nElementals, nDraws,
+				1.0/nDraws, Draws->ptr(c), nDims,
+				*Resid, nElementals,
+				0, DimResid.ptr(1), nElementals);
+
+	DimGrad.initialize(0.0);
+	for (unsigned k=0; k<=nDims; k++) {
+		if (UtilPacket.Data_CA && UtilPacket.Data_CA->nVars()) {
+			cblas_dgemv(CblasRowMajor,CblasTrans,nElementals,UtilPacket.Data_CA->nVars(),
+						1,UtilPacket.Data_CA->values(c,1),UtilPacket.Data_CA->nVars(),DimResid.ptr(k),1,0,*Grad_UtilityCA,1);
+		}
+		if (UtilPacket.Data_CO && UtilPacket.Data_CO->nVars()) {
+			Grad_UtilityCO.initialize();
+			cblas_dger(CblasRowMajor,UtilPacket.Data_CO->nVars(),nElementals,1,
+					   UtilPacket.Data_CO->values(c,1),1,DimResid.ptr(k),1,*Grad_UtilityCO,nElementals);
+		}
+		elm::push_to_freedoms2(*(UtilPacket.Params_CA), *Grad_UtilityCA, DimGrad.ptr(k));
+		elm::push_to_freedoms2(*(UtilPacket.Params_CO), *Grad_UtilityCO, DimGrad.ptr(k));
+	}
+
+	// The gradient is held negative, as for the other kernels. A scale
+	// freedom moves its target by the draw, so it takes the target's
+	// gradient from the row of its dimension.
+	cblas_dcopy(dF, DimGrad.ptr(0), 1, *CaseGrad, 1);
+	for (auto t=Slots->begin(); t!=Slots->end(); t++) {
+		CaseGrad[t->scale] += DimGrad(1+t->dimension, t->target);
+	}
+	cblas_dscal(dF, -1, *CaseGrad, 1);
+
+	cblas_dsyr(CblasRowMajor,CblasUpper, dF,wgt,*CaseGrad, 1, *workshopBHHH, dF);
+	cblas_daxpy(dF,wgt,*CaseGrad,1,*workshopGCurrent,1);
+}
+
+
+
+
+void elm::workshop_mixed_logit::work(size_t firstcase, size_t numberofcases, boosted::mutex* result_mutex)
+{
+	size_t nCA = (UtilPacket.Data_CA ? UtilPacket.Data_CA->nVars() : 0);
+	size_t nCO = (UtilPacket.Data_CO ? UtilPacket.Data_CO->nVars() : 0);
+
+	double LogL_local = 0.0;
+	if (_partials) {
+		workshopGCurrent.initialize(0.0);
+		workshopBHHH.initialize(0.0);
+	}
+
+	for (size_t blockfirst=firstcase; blockfirst<firstcase+numberofcases; blockfirst+=block) {
+		size_t blocklength = std::min(block, firstcase+numberofcases-blockfirst);
+
+		// Utility at the mean coefficients
+		UtilPacket.Outcome = &MeanUtility;
+		UtilPacket.logit_partial(blockfirst, blocklength, 0.0, blockfirst);
+
+		// Change in utility for a unit draw in each dimension
+		if (nCA) {
+			if (UtilPacket.Data_CA->dtype==NPY_FLOAT) {
+				etk::simd::mixed_gemm(blocklength*nElementals, nDims, nCA,
+									  1, UtilPacket.Data_CA->floatvalues(blockfirst), nCA,
+									  Delta_CA->ptr(), nDims,
+									  0, *DrawUtility, nDims);
+			} else {
+				cblas_dgemm(CblasRowMajor, CblasNoTrans, CblasNoTrans,
+							blocklength*nElementals, nDims, nCA,
+							1, UtilPacket.Data_CA->values(blockfirst,blocklength), nCA,
+							Delta_CA->ptr(), nDims,
+							0, *DrawUtility, nDims);
+			}
+		} else {
+			memset(*DrawUtility, 0, blocklength*nElementals*nDims*sizeof(double));
+		}
+		if (nCO) {
+			cblas_dgemm(CblasRowMajor, CblasNoTrans, CblasNoTrans,
+						blocklength, nElementals*nDims, nCO,
+						1, UtilPacket.Data_CO->values(blockfirst,blocklength), nCO,
+						Delta_CO->ptr(), nElementals*nDims,
+						1, *DrawUtility, nElementals*nDims);
+		}
+
+		for (size_t c=blockfirst; c<blockfirst+blocklength; c++) {
+			double wgt = (Data_Wt ? Data_Wt->value(c,0) : 1.0);
+			LogL_local += wgt * case_simulate(c, c-blockfirst);
+			if (_partials) {
+				case_gradient(c, wgt);
+			}
+		}
+	}
+
+	if (LogL) {
+		*LogL->slot(current_job) = LogL_local;
+	}
+	if (_partials) {
+		double* slot = _partials->slot(current_job);
+		cblas_dcopy(dF, *workshopGCurrent, 1, slot, 1);
+		cblas_dcopy(dF*dF, *workshopBHHH, 1, slot+dF, 1);
+	}
+}
+
@@ -0,0 +1,123 @@
+/*
+ *  elm_workshop_mixed.h
+ *
+ *  Copyright 2007-2017 Jeffrey Newman
+ *
+ *  Larch is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Larch is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with Larch.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef __ELM_WORKSHOP_MIXED_H__
+#define __ELM_WORKSHOP_MIXED_H__
+
+#include "etk.h"
+#include "etk_workshop.h"
+#include "elm_darray.h"
+#include "elm_packets.h"
+#include "etk_simd.h"
+
+namespace elm {
+
+	// A random coefficient term of a mixed logit model, with freedoms as
+	//  slots in the freedom array: the draw in this dimension, times the
+	//  scale freedom, is added to the target freedom.
+	struct mixed_slot {
+		size_t target;
+		size_t scale;
+		size_t dimension;
+	};
+
+	// Simulates the probabilities of an MNL kernel whose coefficients vary
+	//  with standard normal draws, R draws for each case, and the log
+	//  likelihood of the simulated probabilities. When partials are given,
+	//  the gradient of the simulated log likelihood and its BHHH matrix are
+	//  also found, and written to the job's slot.
+	//
+	// The utility of an alternative at a draw is its utility at the mean
+	//  coefficients plus, for each dimension, the draw times the change in
+	//  utility for a unit draw. Both are found for a block of cases at a time
+	//  with matrix products, so the work for each draw does not depend on the
+	//  number of data variables.
+	class workshop_mixed_logit
+	: public etk::workshop
+	{
+		unsigned dF;
+		unsigned nElementals;
+		unsigned nDraws;
+		unsigned nDims;
+		size_t   block;
+
+		elm::ca_co_packet UtilPacket;
+		const etk::ndarray* Delta_CA;
+		const etk::ndarray* Delta_CO;
+		const etk::ndarray* Draws;
+		const std::vector<mixed_slot>* Slots;
+
+		elm::darray_ptr Data_AV;
+		elm::darray_ptr Data_Ch;
+		elm::darray_ptr Data_Wt;
+
+		etk::ndarray* Probability;
+		etk::ndarray* CaseLogLike;
+		etk::job_partials* LogL;
+		etk::job_partials* _partials;
+
+		etk::ndarray      MeanUtility;  // [case in block, alt]
+		etk::memarray_raw DrawUtility;  // [case in block, alt, dimension]
+		etk::memarray_raw DrawProb;     // [draw, alt]
+		etk::memarray_raw SimProb;      // [alt]
+		etk::memarray_raw Resid;        // [draw, alt]
+		etk::memarray_raw DimResid;     // [1+dimension, alt]
+		etk::memarray_raw DimGrad;      // [1+dimension, freedom]
+		etk::memarray_raw Grad_UtilityCA;
+		etk::memarray_raw Grad_UtilityCO;
+		etk::memarray_raw CaseGrad;
+		etk::memarray_raw workshopGCurrent;
+		etk::memarray_raw workshopBHHH;
+
+		etk::simd::masked_logit_row_t logit_row;
+		etk::logging_service* msg_;
+
+		double case_simulate(const size_t& c, const size_t& row);
+		void   case_gradient(const size_t& c, const double& wgt);
+
+	public:
+		virtual void work(size_t firstcase, size_t numberofcases, boosted::mutex* result_mutex);
+		workshop_mixed_logit(  const unsigned& dF
+							 , const unsigned& nElementals
+							 , elm::ca_co_packet UtilPack
+							 , const etk::ndarray* Delta_CA
+							 , const etk::ndarray* Delta_CO
+							 , const etk::ndarray* Draws
+							 , const std::vector<mixed_slot>* Slots
+							 , elm::darray_ptr Data_AV
+							 , elm::darray_ptr Data_Ch
+							 , elm::darray_ptr Data_Wt
+							 , etk::ndarray* Probability
+							 , etk::ndarray* CaseLogLike
+							 , etk::job_partials* LogL
+							 , etk::job_partials* partials=nullptr
+							 , etk::logging_service* msgr=nullptr
+							 );
+		// Delta_CA is [CA variable, dimension] and Delta_CO is [CO variable,
+		//  alt, dimension], the change in each utility coefficient for a unit
+		//  draw. Draws is [case, draw, dimension]. When Probability and
+		//  CaseLogLike are given, the simulated probability and log likelihood
+		//  of each case are written to them, and when LogL is given the
+		//  weighted log likelihood of each job is written to its slot.
+		~workshop_mixed_logit();
+	};
+
+}
+#endif // __ELM_WORKSHOP_MIXED_H__
@@ -67,6 +67,9 @@ namespace elm {
 		etk::memarray* _GCurrent;
 		etk::symmetric_matrix* _Bhhh;
 		
+		// If given, results are written without locking to this job's slot here instead,
+		//  and the Model combines the slots after the dispatch.
+		etk::job_partials* _partials;
 
 		
 		// These are memory arrays that are shared among multiple places.
@@ -103,6 +106,7 @@ namespace elm {
 		 , etk::symmetric_matrix* Bhhh
 		 , etk::logging_service* msgr
 		 , const etk::bitarray* Data_MultiChoice
+		 , etk::job_partials* partials=nullptr
 		 );
 		
 		~workshop_mnl_gradient2();
@@ -48,6 +48,7 @@ elm::workshop_mnl_gradient2::workshop_mnl_gradient2
  , etk::symmetric_matrix* Bhhh
  , etk::logging_service* msgr
  , const etk::bitarray* _Data_MultiChoice
+ , etk::job_partials* partials
  )
 : dF           (dF)
 , nElementals  (nElementals)
@@ -64,6 +65,7 @@ elm::workshop_mnl_gradient2::workshop_mnl_gradient2
 , _Probability    (Probability)
 , _GCurrent (GCurrent)
 , _Bhhh     (Bhhh)
+, _partials (partials)
 , msg_     (nullptr)
 , nCA (UtilPK.Params_CA->length())
 , nCO (UtilPK.Params_CO->length())
@@ -115,12 +117,7 @@ void elm::workshop_mnl_gradient2::case_gradient_mnl
 	if (UtilPacket.Data_CE && UtilPacket.Data_CE->active()) {
 	
 		Grad_UtilityCA.initialize();
-		size_t rowticker = UtilPacket.Data_CE->_casestarts->int64_at(c);
-		while ((rowticker<UtilPacket.Data_CE->_caseindexes->size1()) && (UtilPacket.Data_CE->_caseindexes->int64_at(rowticker)==c) ) {
-			cblas_daxpy(UtilPacket.Data_CE->nvars(), Workspace[UtilPacket.Data_CE->_altindexes->int64_at(rowticker)],
-						UtilPacket.Data_CE->_data_array->ptr(rowticker), 1, *Grad_UtilityCA, 1);
-			rowticker++;
-		}
+		UtilPacket.Data_CE->gradient_rows(c, *Workspace, 1, *Grad_UtilityCA);
 	
 	} else {
 		if (UtilPacket.Data_CA && UtilPacket.Data_CA->nVars()) {
@@ -173,12 +170,7 @@ void elm::workshop_mnl_gradient2::case_gradient_mnl_multichoice
 		if (UtilPacket.Data_CE && UtilPacket.Data_CE->active()) {
 			
 			Grad_UtilityCA.initialize();
-			size_t rowticker = UtilPacket.Data_CE->_casestarts->int64_at(c);
-			while ((rowticker<UtilPacket.Data_CE->_caseindexes->size1()) && (UtilPacket.Data_CE->_caseindexes->int64_at(rowticker)==c) ) {
-				cblas_daxpy(UtilPacket.Data_CE->nvars(), -Workspace[UtilPacket.Data_CE->_altindexes->int64_at(rowticker)],
-							UtilPacket.Data_CE->_data_array->ptr(rowticker), 1, *Grad_UtilityCA, 1);
-				rowticker++;
-			}
+			UtilPacket.Data_CE->gradient_rows(c, *Workspace, -1, *Grad_UtilityCA);
 			
 		} else {
 			if (UtilPacket.Data_CA && UtilPacket.Data_CA->nVars()) {
@@ -220,7 +212,11 @@ void elm::workshop_mnl_gradient2::work(size_t firstcase, size_t numberofcases, b
 void elm::workshop_mnl_gradient2::workshop_mnl_gradient_send
 ()
 {
-	if (_lock) {
+	if (_partials) {
+		double* slot = _partials->slot(current_job);
+		cblas_dcopy(dF, *workshopGCurrent, 1, slot, 1);
+		cblas_dcopy(dF*dF, *workshopBHHH, 1, slot+dF, 1);
+	} else if (_lock) {
 		std::lock_guard<std::mutex> lock_while_in_shope(*_lock);
 		*_GCurrent += workshopGCurrent;
 		*_Bhhh += workshopBHHH;
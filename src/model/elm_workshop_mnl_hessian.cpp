@@ -0,0 +1,180 @@
+/*
+ *  elm_workshop_mnl_hessian.cpp
+ *
+ *  Copyright 2007-2017 Jeffrey Newman
+ *
+ *  Larch is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Larch is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with Larch.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+
+#include <cstring>
+#include <cmath>
+#include "elm_model2.h"
+#include "elm_parameter2.h"
+#include "elm_names.h"
+#include <iostream>
+
+#include "elm_workshop_hessian.h"
+
+
+using namespace etk;
+using namespace elm;
+using namespace std;
+
+
+
+void elm::__casewise_dUtility_dFreedoms
+( const elm::ca_co_packet& UtilPacket
+, const unsigned&    c
+, const unsigned&    a
+, etk::memarray_raw& Fused
+, double*            dUtilF
+, const unsigned&    dF
+)
+{
+	memset(dUtilF, 0, dF*sizeof(double));
+
+	// idCA
+	size_t nCA = UtilPacket.Params_CA->length();
+	if (nCA) {
+		Fused.initialize(0.0);
+		if (UtilPacket.Data_CE && UtilPacket.Data_CE->active()) {
+			UtilPacket.Data_CE->export_into(*Fused,c,a,nCA);
+		} else if (UtilPacket.Data_CA) {
+			UtilPacket.Data_CA->ExportData(*Fused,c,a,UtilPacket.Data_CA->nAlts());
+		}
+		elm::push_to_freedoms2(*UtilPacket.Params_CA, *Fused, dUtilF);
+	}
+
+	// idCO : only the parameters in the column for this alternative are touched,
+	//  so push those directly instead of exporting the mostly empty fused block.
+	const paramArray& Params_CO = *UtilPacket.Params_CO;
+	if (Params_CO.length() && UtilPacket.Data_CO) {
+		const double* x = UtilPacket.Data_CO->values(c,1);
+		size_t nvars = UtilPacket.Data_CO->nVars();
+		for (size_t v=0; v<nvars; v++) {
+			if (!x[v]) continue;
+			const parametexr par = Params_CO(v,a);
+			if (par) par->pushvalue(dUtilF, x[v]);
+		}
+	}
+}
+
+
+
+
+elm::workshop_mnl_hessian::workshop_mnl_hessian
+(  const unsigned&   dF
+ , const unsigned&   nElementals
+ , elm::ca_co_packet UtilPK
+ , elm::darray_ptr     Data_Choice
+ , elm::darray_ptr     Data_Weight
+ , const etk::memarray* Probability
+ , etk::symmetric_matrix* Hess
+ , etk::logging_service* msgr
+ , etk::job_partials* partials
+ )
+: _lock       (nullptr)
+, nCA         (UtilPK.Params_CA->length())
+, dF          (dF)
+, nElementals (nElementals)
+, Fused       (UtilPK.Params_CA->length())
+, dUtil       (nElementals, dF)
+, MeanDUtil   (dF)
+, workshopHess(dF, dF)
+, _Hess       (Hess)
+, _partials   (partials)
+, _Probability(Probability)
+, UtilPacket  (UtilPK)
+, Data_Choice (Data_Choice)
+, Data_Weight (Data_Weight)
+, msg_        (msgr)
+{
+}
+
+elm::workshop_mnl_hessian::~workshop_mnl_hessian()
+{
+}
+
+
+
+void elm::workshop_mnl_hessian::case_hessian_mnl(const unsigned& c)
+{
+	const double* Pr  = _Probability->ptr(c);
+	const double* Cho = Data_Choice->values(c,1);
+
+	// The second derivative of log(P) is the same for every alternative,
+	//  so the choices only contribute their total weight.
+	double wgt = 0;
+	for (unsigned a=0; a<nElementals; a++) {
+		wgt += Cho[a];
+	}
+	if (Data_Weight) wgt *= Data_Weight->value(c,0);
+	if (wgt==0) return;
+
+	MeanDUtil.initialize(0.0);
+	for (unsigned a=0; a<nElementals; a++) {
+		if (!Pr[a]) {
+			memset(dUtil.ptr(a), 0, dF*sizeof(double));
+			continue;
+		}
+		__casewise_dUtility_dFreedoms(UtilPacket, c, a, Fused, dUtil.ptr(a), dF);
+		cblas_daxpy(dF, Pr[a], dUtil.ptr(a), 1, *MeanDUtil, 1);
+	}
+
+	// Center and scale each row, so that the covariance is a single rank-k update
+	for (unsigned a=0; a<nElementals; a++) {
+		if (!Pr[a]) continue;
+		cblas_daxpy(dF, -1, *MeanDUtil, 1, dUtil.ptr(a), 1);
+		cblas_dscal(dF, sqrt(wgt*Pr[a]), dUtil.ptr(a), 1);
+	}
+	cblas_dsyrk(CblasRowMajor, CblasUpper, CblasTrans, dF, nElementals,
+				1, *dUtil, dF, 1, *workshopHess, dF);
+}
+
+
+
+void elm::workshop_mnl_hessian::workshop_mnl_hessian_do(const unsigned& firstcase, const unsigned& numberofcases)
+{
+	workshopHess.initialize(0.0);
+	size_t lastcase = firstcase + numberofcases;
+	for (unsigned c=firstcase; c<lastcase; c++) {
+		case_hessian_mnl(c);
+	}
+}
+
+
+
+void elm::workshop_mnl_hessian::workshop_mnl_hessian_send()
+{
+	if (_partials) {
+		cblas_dcopy(dF*dF, *workshopHess, 1, _partials->slot(current_job), 1);
+	} else if (_lock) {
+		std::lock_guard<std::mutex> lock_while_in_shope(*_lock);
+		cblas_daxpy(dF*dF, 1, *workshopHess, 1, **_Hess, 1);
+	} else {
+		OOPS("No lock in elm::workshop_mnl_hessian::workshop_mnl_hessian_send");
+	}
+}
+
+
+
+void elm::workshop_mnl_hessian::work(size_t firstcase, size_t numberofcases, boosted::mutex* result_mutex)
+{
+	workshop_mnl_hessian_do(firstcase,numberofcases);
+	_lock = result_mutex;
+	workshop_mnl_hessian_send();
+}
+
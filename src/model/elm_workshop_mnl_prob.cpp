@@ -20,10 +20,13 @@
 
 
 #include <cstring>
+#include <algorithm>
+#include <cstdint>
 #include "etk.h"
 #include <iostream>
 
 #include "elm_workshop_mnl_prob.h"
+#include "etk_simd.h"
 
 
 
@@ -36,231 +39,147 @@ elm::mnl_prob_w::mnl_prob_w(  etk::ndarray* U
 							, const double& U_premultiplier
 							, etk::logging_service* msgr
 							, PyArrayObject** logsums_out
+							, elm::incremental_utility* UtilBase
+							, etk::job_partials* LogL
+							, elm::darray_ptr Data_Wt
+							, const size_t& block_bytes
+							, const bool& loglike_only
 							)
 : Probability(U)
 , CaseLogLike(CLL)
 , Data_AV(Data_AV)
 , Data_Ch(Data_Ch)
+, Data_Wt(Data_Wt)
 , U_premultiplier(U_premultiplier)
-, msg_(msgr)
-, UtilPacket(UtilPack)
 , logsums_out(logsums_out)
+, UtilPacket(UtilPack)
+, UtilBase(UtilBase)
+, LogL(nullptr)
+, block_bytes(0)
+, loglike_only(false)
+, Scratch()
+, msg_(msgr)
 {
 	//	BUGGER_(msg_, "CONSTRUCT elm::mnl_prob_w::mnl_prob_w()\n");
 	
 	// check that logsums out is at least the correct size
-	if (*logsums_out) {
-		if (PyArray_DIM(*logsums_out, 0) < Probability->size1() ) {
+	if (logsums_out && *logsums_out) {
+		if (PyArray_DIM(*logsums_out, 0) < CaseLogLike->size1() ) {
+			etk::python_lock LOCK;
 			Py_CLEAR(*logsums_out);
 		}
 	}
+	
+	configure(LogL, Data_Wt, block_bytes, loglike_only);
 }
 
 elm::mnl_prob_w::~mnl_prob_w()
 {
 }
 
+void elm::mnl_prob_w::configure(etk::job_partials* LogL, elm::darray_ptr Data_Wt, const size_t& block_bytes, const bool& loglike_only)
+{
+	this->LogL = LogL;
+	this->Data_Wt = Data_Wt;
+	this->block_bytes = block_bytes;
+	this->loglike_only = loglike_only;
+	
+	// The scratch array is allocated here rather than in work, which runs on
+	// a worker thread.
+	if (loglike_only) {
+		unsigned nElementals = _n_elementals();
+		if (nElementals) {
+			Scratch.resize(std::min<size_t>(_block_cases(nElementals), CaseLogLike->size1()), nElementals);
+		}
+	}
+}
 
-void elm::mnl_prob_w::work(size_t firstcase, size_t numberofcases, boosted::mutex* result_mutex)
+unsigned elm::mnl_prob_w::_n_elementals() const
 {
-	unsigned nElementals = 0;
 	if (UtilPacket.Data_CA && UtilPacket.Data_CA->nVars()>0) {
-		nElementals = UtilPacket.Data_CA->nAlts();
+		return UtilPacket.Data_CA->nAlts();
 	} else if (UtilPacket.Data_CE && UtilPacket.Data_CE->nalts()>0) {
-		nElementals = UtilPacket.Data_CE->nalts();
+		return UtilPacket.Data_CE->nalts();
 	} else if (UtilPacket.Data_CO && UtilPacket.Coef_CO->size2()>0) {
-		nElementals = UtilPacket.Coef_CO->size2();
-	} else {
-		return;
-		OOPS("no useful data!");
-	};
+		return UtilPacket.Coef_CO->size2();
+	}
+	return 0;
+}
 
-	// UTILITY //
+size_t elm::mnl_prob_w::_block_cases(const unsigned& nElementals) const
+{
+	// The cases are taken in blocks small enough that the utility written for
+	// a block is still in cache when it is turned into probability and log
+	// likelihood. Without a block size, the whole range is one block, except
+	// when only the log likelihood is wanted, as then the utility is held in
+	// scratch space that should stay small.
+	size_t bytes = (block_bytes || !loglike_only) ? block_bytes : 256*1024;
+	if (!bytes) {
+		return SIZE_MAX;
+	}
+	size_t case_bytes = nElementals * (sizeof(double) + sizeof(bool) + sizeof(double));
+	if (UtilPacket.Data_CA) case_bytes += UtilPacket.Data_CA->nAlts() * UtilPacket.Data_CA->nVars() * sizeof(double);
+	if (UtilPacket.Data_CO) case_bytes += UtilPacket.Data_CO->nVars() * sizeof(double);
+	return std::max<size_t>(1, bytes / std::max<size_t>(1, case_bytes));
+}
 
-	UtilPacket.Outcome = Probability;
-	UtilPacket.logit_partial(firstcase, numberofcases);
 
-//	if (Data_CA && Data_CA->nVars()>0 /* && Data_CA->fully_loaded()*/) {
-//		// Fast Linear Algebra
-//		if (Probability->size2()==Data_CA->nAlts()) {
-//			cblas_dgemv(CblasRowMajor,CblasNoTrans, 
-//						numberofcases * Data_CA->nAlts(), Data_CA->nVars(), 
-//						1,
-//						Data_CA->values(firstcase,0),Data_CA->nVars(),
-//						Coef_CA->ptr(),1,
-//						U_premultiplier, Probability->ptr(firstcase),1);
-//		} else {
-//			for (unsigned a=0;a<Data_CA->nAlts();a++) {
-//				if (Probability->size2()<=0){
-//					OOPS("IncY Zero");
-//				}
-//				cblas_dgemv(CblasRowMajor,CblasNoTrans,
-//							numberofcases,Data_CA->nVars(),
-//							1, 
-//							Data_CA->values(firstcase,0)+(a*Data_CA->nVars()), Data_CA->nAlts()*Data_CA->nVars(), 
-//							Coef_CA->ptr(),1, 
-//							U_premultiplier, Probability->ptr(firstcase)+a, Probability->size2() );
-//			}
-//		}		
-//	} else if (Data_CA && Data_CA->nVars()>0) {
-//		// Slow case-by-case
-//		for (unsigned c=firstcase; c<firstcase+numberofcases; c++) {
-//			if (Probability->size2()==Data_CA->nAlts()) {
-//				cblas_dgemv(CblasRowMajor,CblasNoTrans, 
-//							Data_CA->nAlts(), Data_CA->nVars(), 
-//							1,
-//							Data_CA->values(c,1),Data_CA->nVars(),
-//							Coef_CA->ptr(),1,
-//							U_premultiplier, Probability->ptr(c),1);
-//			} else {
-//				for (unsigned a=0;a<Data_CA->nAlts();a++) {
-//					if (Probability->size2()<=0){
-//						OOPS("IncY Zero");
-//					}
-//					cblas_dgemv(CblasRowMajor,CblasNoTrans,
-//								1,Data_CA->nVars(),
-//								1, 
-//								Data_CA->values(c,1)+(a*Data_CA->nVars()), Data_CA->nAlts()*Data_CA->nVars(), 
-//								Coef_CA->ptr(),1, 
-//								U_premultiplier, Probability->ptr(c)+a, Probability->size2() );
-//				}
-//			}
-//		}
-//	}
-//	if (!Data_CA || Data_CA->nVars()==0) {
-//		if (U_premultiplier) {
-//			cblas_dscal(Probability->size2()*Probability->size3()*numberofcases, U_premultiplier, Probability->ptr(firstcase), 1);
-//		} else {
-//			memset(Probability->ptr(firstcase), 0, sizeof(double)*Probability->size2()*Probability->size3()*numberofcases);
-//		}
-//	}
-//	
-//	if (Data_CO && Data_CO->nVars()>0 /*&& Data_CO->fully_loaded()*/) {
-//		// Fast Linear Algebra		
-//		cblas_dgemm(CblasRowMajor,CblasNoTrans,CblasNoTrans,
-//					numberofcases,Coef_CO->size2(), Data_CO->nVars(),
-//					1,
-//					Data_CO->values_constptr(firstcase), Data_CO->nVars(),
-//					Coef_CO->ptr(), Coef_CO->size2(),
-//					1,Probability->ptr(firstcase),Probability->size2());
-//	} else if (Data_CO && Data_CO->nVars()>0) {
-//		// Slow case-by-case
-//		for (unsigned c=firstcase; c<firstcase+numberofcases; c++) {
-//			if (Data_CO->nVars())
-//				cblas_dgemm(CblasRowMajor,CblasNoTrans,CblasNoTrans,
-//							1,Coef_CO->size2(), Data_CO->nVars(),
-//							1,
-//							Data_CO->values(c,1), Data_CO->nVars(),
-//							Coef_CO->ptr(), Coef_CO->size2(),
-//							1,Probability->ptr(c),Probability->size2());
-//		}
-//	}
+void elm::mnl_prob_w::work(size_t firstcase, size_t numberofcases, boosted::mutex* result_mutex)
+{
+	unsigned nElementals = _n_elementals();
+	if (!nElementals) {
+		if (LogL) *LogL->slot(current_job) = 0.0;
+		return;
+		OOPS("no useful data!");
+	}
 
-	// PROBABILITY //
-	
-//	if (firstcase==126) std::cerr <<"Util[129]="<<Probability->printrow(129) <<"\n";
-	
+	size_t block = std::min(_block_cases(nElementals), numberofcases);
+	if (loglike_only && Scratch.size1() < block) {
+		OOPS("the scratch array for this workshop is too small");
+	}
 	
-	for (unsigned c=firstcase; c<firstcase+numberofcases; c++) {
-		double sum_prob = 0.0;
-		double sum_choice = 0.0;
-		CaseLogLike->at(c) = 0.0;
-		double shifter = 0.0;
-		double min_av_utility = INF;
-//		double min_ch_utility = INF;
-//		double max_ch_utility = -INF;
-		double max_av_utility = -INF;
-		for (unsigned a=0;a<nElementals;a++) {
-			if (Data_AV->boolvalue(c,a)) {
-				double p = Probability->at(c,a);
-				if (p > max_av_utility) max_av_utility = p;
-				if (p < min_av_utility) min_av_utility = p;
-//				if (Data_Ch->value(c,a)) {
-//					if (p < min_ch_utility) min_ch_utility = p;
-//					if (p > max_ch_utility) max_ch_utility = p;
-//				}
-			}
-		}
-		if (max_av_utility>700 || min_av_utility<-700) {
-			shifter = 700-max_av_utility;
-		}
-		
-
-		
-//			std::cerr << "Shifter Breaks on "<<c<<"\n";
-//			std::cerr << " max_av_utility= "<<max_av_utility<<"\n";
-//			std::cerr << " min_av_utility= "<<min_av_utility<<"\n";
-//			std::cerr << " shifter       = "<<shifter<<"\n";
-		for (unsigned a=0;a<nElementals;a++) {
-			if (!Data_AV->boolvalue(c,a)) {
-				Probability->at(c,a) = 0.0;
-			} else {
-				double* p = Probability->ptr(c,a);
-				double what_3 = *p;
-//					std::cerr << "   u["<<a<<"]= "<<*p<<"\n";
-				*p += shifter;
-				double what_2 = *p;
-				double data_ch_value_ca = Data_Ch->value(c,a);
-				if (data_ch_value_ca) {
-					CaseLogLike->at(c) += (*p) * data_ch_value_ca;
-					sum_choice += data_ch_value_ca;
-				}
-				
-				double what_1 = *p;
-				
-				*p = exp(*p);
-				sum_prob += *p;
-
-//				if (isNan(sum_prob)) {
-//					std::cerr << "nan sum_prob\n";
-//				}
-
+	// The row kernel masks out unavailable alternatives, applies the +/-700
+	// shifter, exponentiates and normalizes a whole case at a time, using the
+	// widest vector instructions this processor supports.
+	etk::simd::masked_logit_row_t logit_row = etk::simd::masked_logit_row();
 
-//					std::cerr << "  Availability for case 0 alt "<<a<<" is YES, exp(Utility)=\t"<<*p<<"\n";
-			}
-		}
-
-
-//			std::cerr << "  sum_prob="<<sum_prob<<"\n";
-//			std::cerr << "  sum_choice="<<sum_choice<<"\n";
+	double LogL_local = 0.0;
+	
+	for (size_t blockfirst=firstcase; blockfirst<firstcase+numberofcases; blockfirst+=block) {
+		size_t blocklength = std::min(block, firstcase+numberofcases-blockfirst);
 
-//
-//		if (isNan(sum_prob)) {
-//			std::cerr << "nan sum_prob\n";
-//		}
-		
-//		if (c==565) std::cerr << "Data_AV[565,0:3]="<<Data_AV->boolvalue(565,0)<<Data_AV->boolvalue(565,1)<<Data_AV->boolvalue(565,2)<<"\n";
-//		if (c==565) std::cerr << "sum_prob="<<sum_prob<<"\n";
+		// UTILITY //
 
-		double* logsum = nullptr;
-		double fallback_logsum = 0;
-		if (*logsums_out) {
-			logsum = (double*) PyArray_GETPTR1(*logsums_out, c);
+		// When only the log likelihood is wanted, the utility of the block is
+		// held in the scratch array, with the block's first case in row zero.
+		etk::ndarray* Outcome = (loglike_only ? &Scratch : Probability);
+		size_t outcome_offset = (loglike_only ? blockfirst : 0);
+		if (UtilBase && UtilBase->current()) {
+			UtilBase->load_rows(Outcome, blockfirst, blocklength, outcome_offset);
 		} else {
-			logsum = &fallback_logsum;
+			UtilPacket.Outcome = Outcome;
+			UtilPacket.logit_partial(blockfirst, blocklength, 0.0, outcome_offset);
+			if (UtilBase && UtilBase->filling()) UtilBase->save_rows(Outcome, blockfirst, blocklength, outcome_offset);
 		}
-		*logsum = log(sum_prob);
 
-//		if ((firstcase==0) && (c==0)) {
-//			std::cerr << "breaker \n";
-//		}
-
-		if (sum_prob) {
-			for (unsigned a=0;a<nElementals;a++) {
-				Probability->at(c,a) /= sum_prob;
-//				if (shifter) {
-//					std::cerr << "  pr["<<a<<"]="<<Probability->at(c,a)<<"\n";
-//				}
+		// PROBABILITY //
+	
+		for (size_t c=blockfirst; c<blockfirst+blocklength; c++) {
+			double* U = (loglike_only ? Scratch.ptr(c-blockfirst) : Probability->ptr(c));
+			double logsum = logit_row(U, Data_AV->boolvalues_constptr(c), Data_Ch->values_constptr(c),
+									  nElementals, CaseLogLike->at(c));
+			if (logsums_out && *logsums_out) {
+				*(double*) PyArray_GETPTR1(*logsums_out, c) = logsum;
 			}
-			if (sum_choice) {
-				CaseLogLike->at(c) -= (*logsum) * sum_choice;
-//				if (shifter) {
-//					std::cerr << "  CaseLogLike="<<CaseLogLike->at(c)<<"\n";
-//				}
+			if (LogL) {
+				LogL_local += (Data_Wt ? CaseLogLike->at(c) * Data_Wt->value(c,0) : CaseLogLike->at(c));
 			}
 		}
-		
-		
+	
+	}
+	
+	if (LogL) {
+		*LogL->slot(current_job) = LogL_local;
 	}
 	
 //	if (firstcase==0) BUGGER_(msg_, "Prob[0]="<<Probability->printrow(0));
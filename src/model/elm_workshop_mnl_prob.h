@@ -26,6 +26,7 @@
 #include "etk_workshop.h"
 #include "elm_darray.h"
 #include "elm_packets.h"
+#include "elm_incremental_utility.h"
 
 namespace elm {
 
@@ -36,15 +37,25 @@ namespace elm {
 		etk::ndarray* CaseLogLike;
 		elm::darray_ptr Data_AV;
 		elm::darray_ptr Data_Ch;
+		elm::darray_ptr Data_Wt;
 		double        U_premultiplier;
 
 		PyArrayObject** logsums_out;
 
 		elm::ca_co_packet UtilPacket;
+		elm::incremental_utility* UtilBase;
+
+		etk::job_partials* LogL;
+		size_t        block_bytes;
+		bool          loglike_only;
+		etk::ndarray  Scratch;
 
 		
 		etk::logging_service* msg_;
 		
+		unsigned _n_elementals() const;
+		size_t   _block_cases(const unsigned& nElementals) const;
+		
 	public:
 		virtual void work(size_t firstcase, size_t numberofcases, boosted::mutex* result_mutex);
 		mnl_prob_w(  etk::ndarray* U
@@ -55,8 +66,24 @@ namespace elm {
 				   , const double& U_premultiplier
 				   , etk::logging_service* msgr=nullptr
 				   , PyArrayObject** logsums_out=nullptr
+				   , elm::incremental_utility* UtilBase=nullptr
+				   , etk::job_partials* LogL=nullptr
+				   , elm::darray_ptr Data_Wt=nullptr
+				   , const size_t& block_bytes=0
+				   , const bool& loglike_only=false
 				   );
+		// When LogL is given, the weighted log likelihood of the cases of each
+		//  job is written to that job's slot in it. When block_bytes is given, the cases are taken in blocks whose
+		//  data and probabilities take about that many bytes, and each block is
+		//  carried through utility, probability and log likelihood in turn while
+		//  it is still in cache. When loglike_only is set, the utility of each
+		//  block is held in a scratch array for this workshop and U is not
+		//  written; only the case log likelihoods and logsums are kept.
 		~mnl_prob_w();
+		
+		void configure(etk::job_partials* LogL, elm::darray_ptr Data_Wt, const size_t& block_bytes, const bool& loglike_only);
+		// Workshops are kept by the dispatcher between evaluations, so these
+		//  settings are given again before each one.
 	}; 
 
 
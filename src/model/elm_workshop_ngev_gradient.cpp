@@ -193,65 +193,55 @@ void elm::workshop_ngev_gradient::case_dProbability_dFusedParameters( const unsi
 	dProb.initialize(0.0);
 	size_t Offset_Phi = offset_alloc();
 
-	unsigned i,u,ou;
-	for (i=(*Xylem).size()-1; i!=0; ) {
+	const VAS_Plan& P = Xylem->plan();
+	unsigned i,u,ou,u0,u1;
+	for (i=P.n_cells-1; i!=0; ) {
 		i--;
-		size_t xylem_a_upsize = (*Xylem)[i]->upsize();
-		for (u=0; u<xylem_a_upsize; u++) {
+		u0 = P.up_start[i];
+		u1 = P.up_start[i+1];
+		size_t xylem_a_upsize = u1-u0;
+		for (u=u0; u<u1; u++) {
 			
-			auto xylem_i_upcell_u = (*Xylem)[i]->upcell(u);
-			auto xylem_i_upcell_u_slot = xylem_i_upcell_u->slot();
+			unsigned up = P.up_cell[u];
+			double up_mu = P.mu(up);
 			
-			// if (c==0) std::cerr << "case_dProbability_dFusedParameters\n";
-			// if (c==0) std::cerr << "i="<<i<<"\n";
-			// if (c==0) std::cerr << "u="<<u<<"\n";
-			// if (c==0) std::cerr << "xylem_i_upcell_u_slot="<<xylem_i_upcell_u_slot<<"\n";
-
-
 			// scratch = dUtil[down] - dUtil[up]
 			cblas_dcopy(nPar, dUtil.ptr(i), 1, scratch, 1);
-			cblas_daxpy(nPar, -1, dUtil.ptr(xylem_i_upcell_u_slot), 1, scratch, 1);
+			cblas_daxpy(nPar, -1, dUtil.ptr(up), 1, scratch, 1);
 			
 			// for competitive edges, adjust phi
 			// scratch += X_Phi()[edge] - sum over competes(Alloc[compete]*X_Phi[compete])
-			if (Alloc && (*Xylem)[i]->upedge(u)->is_competitive()) {
-				auto allocslot_upedge_u = (*Xylem)[i]->upedge(u)->alloc_slot();
-				// if (c==0) std::cerr << "allocslot_upedge_u="<<allocslot_upedge_u<<"\n";
-
-				// if (c==0) std::cerr << "WorkspaceX1 "<<Workspace.printSize()<<"\n" << Workspace.printall() ;
+			if (Alloc && P.up_alloc[u]!=UINT_MAX) {
+				unsigned allocslot_upedge_u = P.up_alloc[u];
 				
 				AllocPacket.Data_CO->OverlayData(scratch+Offset_Phi, c, allocslot_upedge_u, 1.0, xylem_a_upsize);
-				// if (c==0) std::cerr <<  "WorkspaceXa "<<Workspace.printSize()<<"\n" << Workspace.printall() ;
-				for (ou=0; ou<xylem_a_upsize; ou++)  {
-					auto slot = (*Xylem)[i]->upedge(ou)->alloc_slot();
+				for (ou=u0; ou<u1; ou++)  {
+					unsigned slot = P.up_alloc[ou];
 					AllocPacket.Data_CO->OverlayData(scratch+Offset_Phi, c, slot, -Alloc[slot], xylem_a_upsize);
-					// if (c==0) std::cerr <<  "WorkspaceXb "<<Workspace.printSize()<<"\n" << Workspace.printall()  ;
 				}
-
-				// if (c==0) std::cerr <<  "WorkspaceX2 "<<Workspace.printSize()<<"\n" << Workspace.printall() ;
 				
 				// adjust Mu for hierarchical structure, competitive
-				scratch[xylem_i_upcell_u->mu_offset()+offset_mu()] += (Util[xylem_i_upcell_u_slot]
+				scratch[P.mu_offset[up]+offset_mu()] += (Util[up]
 														   - Util[i] 
 														   - log(Alloc[allocslot_upedge_u])
-														   ) / xylem_i_upcell_u->mu();
+														   ) / up_mu;
 				
 			} else {
 				
 				// adjust Mu for hierarchical structure, noncompete
-				scratch[xylem_i_upcell_u->mu_offset()+offset_mu()] += (Util[xylem_i_upcell_u_slot]
+				scratch[P.mu_offset[up]+offset_mu()] += (Util[up]
 														   - Util[i] 
-														   ) / xylem_i_upcell_u->mu();
+														   ) / up_mu;
 			}
 			
 			// scratch *= Pr[up]/mu[up]
-			cblas_dscal(nPar, Pr[xylem_i_upcell_u_slot]/xylem_i_upcell_u->mu(), scratch, 1);
+			cblas_dscal(nPar, Pr[up]/up_mu, scratch, 1);
 			
 			// scratch += dProb[up]
-			cblas_daxpy(nPar, 1.0, dProb.ptr(xylem_i_upcell_u_slot), 1, scratch, 1);
+			cblas_daxpy(nPar, 1.0, dProb.ptr(up), 1, scratch, 1);
 			
 			// dProb += scratch * CPr
-			cblas_daxpy(nPar, CPr[(*Xylem)[i]->upedge(u)->edge_slot()], scratch, 1, dProb.ptr(i), 1);
+			cblas_daxpy(nPar, CPr[P.up_edge[u]], scratch, 1, dProb.ptr(i), 1);
 		}
 	}
 
@@ -25,6 +25,8 @@
 #include "elm_sql_scrape.h"
 #include "elm_names.h"
 #include <iostream>
+#include <algorithm>
+#include "etk_simd.h"
 
 #include "elm_workshop_ngev_probability.h"
 
@@ -44,50 +46,97 @@ void elm::__casewise_ngev_utility
 , double* top_logsum    // pointer to one value
 ) 
 {
+	const VAS_Plan& P = Xy.plan();
 	unsigned i; 
 	double max = -INF;
-	double q;
-	unsigned k;
-	for (i=Xy.n_elemental(); i<Xy.size(); i++) {
+	double q, mu;
+	unsigned k, k0, k1;
+	for (i=P.n_elemental; i<P.n_cells; i++) {
+		k0 = P.dn_start[i];
+		k1 = P.dn_start[i+1];
 		max = -INF;
-		for (k=0; k<Xy[i]->dnsize(); k++) {
-			if (Xy[i]->dnedge(k)->is_competitive()) {
-				q = Alloc[Xy[i]->dnedge(k)->alloc_slot()];
+		for (k=k0; k<k1; k++) {
+			if (Alloc && P.dn_alloc[k]!=UINT_MAX) {
+				q = Alloc[P.dn_alloc[k]];
 				if (q) {
-					Work[k] = U[Xy[i]->dncell(k)->slot()] + log( q );
+					Work[k-k0] = U[P.dn_cell[k]] + log( q );
 				} else {
-					Work[k] = -INF;
+					Work[k-k0] = -INF;
 				}
 			} else {
-				Work[k] = U[Xy[i]->dncell(k)->slot()];
+				Work[k-k0] = U[P.dn_cell[k]];
 			}
-			if (Work[k] > max) max = Work[k];
-		}			
-		if (Xy[i]->mu() == 0) { // When Mu is zero, special calculation
+			if (Work[k-k0] > max) max = Work[k-k0];
+		}
+		mu = P.mu(i);
+		if (mu == 0) { // When Mu is zero, special calculation
 			U[i] = max;
-			//OOPS("error: zero value for Mu");
 		} else { // Mu is not zero
 			if (max == -INF) max = 0;
-			max /= Xy[i]->mu();
+			max /= mu;
 			U[i] = 0;
-			for (k=0; k<Xy[i]->dnsize(); k++) {
+			for (k=0; k<k1-k0; k++) {
 				if (Work[k] == -INF) continue;
-				Work[k] /= Xy[i]->mu();
-				Work[k] -= max;
-				Work[k] = exp(Work[k]);
-				U[i] += Work[k];
+				U[i] += exp(Work[k]/mu - max);
 			}
 			if (U[i]) {
 				U[i] = log(U[i]);
 				U[i] += max;
-				U[i] *= Xy[i]->mu();
+				U[i] *= mu;
 			} else {
 				U[i] = -INF;
 			}
 		}
 	}
 	if (top_logsum) {
-		*top_logsum = U[Xy.size()-1];
+		*top_logsum = U[P.n_cells-1];
+	}
+}
+
+
+void elm::__blockwise_ngev_utility
+( double* U
+, const size_t& ldU
+, const double* Alloc
+, const size_t& ldA
+, const size_t& nCases
+, const VAS_System& Xy
+)
+{
+	const VAS_Plan& P = Xy.plan();
+	etk::simd::logsum_tile_t logsum_tile = etk::simd::logsum_tile();
+	static thread_local std::vector<double> tile;
+	double out [NEST_BLOCK_CASES];
+	double q;
+	
+	for (size_t first=0; first<nCases; first+=NEST_BLOCK_CASES) {
+		size_t n = std::min(size_t(NEST_BLOCK_CASES), nCases-first);
+		double* Ub = U + first*ldU;
+		const double* Ab = Alloc ? Alloc + first*ldA : nullptr;
+		for (unsigned i=P.n_elemental; i<P.n_cells; i++) {
+			unsigned k0 = P.dn_start[i];
+			unsigned k1 = P.dn_start[i+1];
+			tile.resize((k1-k0)*n);
+			for (unsigned k=k0; k<k1; k++) {
+				double* t = tile.data() + (k-k0)*n;
+				const double* u = Ub + P.dn_cell[k];
+				if (Ab && P.dn_alloc[k]!=UINT_MAX) {
+					const double* alloc = Ab + P.dn_alloc[k];
+					for (size_t c=0; c<n; c++) {
+						q = alloc[c*ldA];
+						t[c] = q ? u[c*ldU] + log( q ) : -INF;
+					}
+				} else {
+					for (size_t c=0; c<n; c++) {
+						t[c] = u[c*ldU];
+					}
+				}
+			}
+			logsum_tile(tile.data(), k1-k0, n, n, P.mu(i), out);
+			for (size_t c=0; c<n; c++) {
+				Ub[c*ldU+i] = out[c];
+			}
+		}
 	}
 }
 
@@ -100,9 +149,10 @@ void elm::__casewise_ngev_probability
  const VAS_System& Xy	// nesting structure
 )
 {
+	const VAS_Plan& P = Xy.plan();
 	unsigned i;
-	unsigned u;
-	unsigned nN = Xy.size();
+	unsigned u, u0, u1, up;
+	unsigned nN = P.n_cells;
 	
 	// Total Probability of the root
 	Pr[nN-1] = 1.0;
@@ -111,26 +161,22 @@ void elm::__casewise_ngev_probability
 	for (i=nN-1; i!=0; ) {
 		i--;
 		Pr[i] = 0;
-		if (Xy[i]->upsize() > 1) {
-			for (u=0; u< Xy[i]->upsize(); u++) {
-				if (U[i]!=-INF) {
-					if (Alloc) {
-						CPr[Xy[i]->upedge(u)->edge_slot()] = exp((U[i] + log(Alloc[Xy[i]->upedge(u)->alloc_slot()]) - U[Xy[i]->upcell(u)->slot()]) / Xy[i]->upcell(u)->mu());
-					} else {
-						CPr[Xy[i]->upedge(u)->edge_slot()] = exp((U[i] - U[Xy[i]->upcell(u)->slot()]) / Xy[i]->upcell(u)->mu());
-					}
+		u0 = P.up_start[i];
+		u1 = P.up_start[i+1];
+		// The allocation only applies where there is more than one up edge
+		bool allocate = (Alloc && u1-u0>1);
+		for (u=u0; u<u1; u++) {
+			up = P.up_cell[u];
+			if (U[i]!=-INF) {
+				if (allocate) {
+					CPr[P.up_edge[u]] = exp((U[i] + log(Alloc[P.up_alloc[u]]) - U[up]) / P.mu(up));
 				} else {
-					CPr[Xy[i]->upedge(u)->edge_slot()] = 0.0;
+					CPr[P.up_edge[u]] = exp((U[i] - U[up]) / P.mu(up));
 				}
-				Pr[i] += CPr[Xy[i]->upedge(u)->edge_slot()] * Pr[Xy[i]->upcell(u)->slot()];
+			} else {
+				CPr[P.up_edge[u]] = 0.0;
 			}
-		} else {
-			u=0; 
-			if (U[i]!=-INF)
-				CPr[Xy[i]->upedge(u)->edge_slot()] = exp((U[i] - U[Xy[i]->upcell(u)->slot()]) / Xy[i]->upcell(u)->mu());
-			else
-				CPr[Xy[i]->upedge(u)->edge_slot()] = 0.0;
-			Pr[i] += CPr[Xy[i]->upedge(u)->edge_slot()] * Pr[Xy[i]->upcell(u)->slot()];			
+			Pr[i] += CPr[P.up_edge[u]] * Pr[up];
 		}
 	}
 }
@@ -205,6 +251,7 @@ elm::workshop_ngev_probability::workshop_ngev_probability
 	Workspace.resize(nNodes);
 	// check that logsums out is at least the correct size
 	if (logsums_out) {
+		etk::python_lock LOCK;
 		Py_XINCREF(logsums_out);
 		if (PyArray_DIM(logsums_out, 0) < Probability->size1() ) {
 			Py_CLEAR(logsums_out);
@@ -216,12 +263,14 @@ elm::workshop_ngev_probability::workshop_ngev_probability
 
 elm::workshop_ngev_probability::~workshop_ngev_probability()
 {
+	etk::python_lock LOCK;
 	Py_CLEAR(logsums_out);
 }
 
 
 void elm::workshop_ngev_probability::reassign_py_output(PyArrayObject* new_logsums_out)
 {
+	etk::python_lock LOCK;
 	Py_CLEAR(logsums_out);
 	if (new_logsums_out) {
 		Py_XINCREF(new_logsums_out);
@@ -315,9 +364,16 @@ void elm::workshop_ngev_probability::workshop_ngev_probability_calc
 				(*Utility)(c,a) = -INF;
 			} 		
 		}
-
-		
-		__casewise_ngev_utility(Utility->ptr(c), Allocation->size()?Allocation->ptr(c):nullptr, *Xylem, *Workspace, (double*)((logsums_out)?PyArray_GETPTR1(logsums_out, c):nullptr));
+	}
+	
+	__blockwise_ngev_utility(Utility->ptr(firstcase), Utility->size2(),
+							 Allocation->size()?Allocation->ptr(firstcase):nullptr, Allocation->size()?Allocation->size2():0,
+							 numberofcases, *Xylem);
+	
+	for (unsigned c=firstcase;c<lastcase;c++) {
+		if (logsums_out) {
+			*(double*)PyArray_GETPTR1(logsums_out, c) = (*Utility)(c, Xylem->size()-1);
+		}
 		__casewise_ngev_probability(Utility->ptr(c), Cond_Prob->ptr(c), Probability->ptr(c), Allocation->size()?Allocation->ptr(c):nullptr, *Xylem);
 		if (use_sampling) {
 			case_logit_add_sampling(c);
@@ -548,10 +604,11 @@ void elm::workshop_ngev_probability_given_utility::workshop_ngev_probability_cal
 		SampPacket.logit_partial(firstcase, numberofcases);
 	}
 	
+	__blockwise_ngev_utility(Utility->ptr(firstcase), Utility->size2(),
+							 Allocation->size()?Allocation->ptr(firstcase):nullptr, Allocation->size()?Allocation->size2():0,
+							 numberofcases, *Xylem);
+	
 	for (unsigned c=firstcase;c<lastcase;c++) {
-
-		
-		__casewise_ngev_utility(Utility->ptr(c), Allocation->size()?Allocation->ptr(c):nullptr, *Xylem, *Workspace);
 		__casewise_ngev_probability(Utility->ptr(c), Cond_Prob->ptr(c), Probability->ptr(c), Allocation->size()?Allocation->ptr(c):nullptr, *Xylem);
 		if (use_sampling) {
 			case_logit_add_sampling(c);
@@ -50,6 +50,17 @@ void __casewise_ngev_probability
 , const VAS_System& Xy	// nesting structure
 );
 
+void __blockwise_ngev_utility
+( double* U		        // pointer to utility array of the first case [nCases, ldU space]
+, const size_t& ldU     // distance between the utilities of successive cases
+, const double* Alloc	// pointer to allocative array of the first case [nCases, ldA space], or nullptr
+, const size_t& ldA     // distance between the allocations of successive cases
+, const size_t& nCases  // number of cases
+, const VAS_System& Xy  // nesting structure
+) ;
+// Does the same as __casewise_ngev_utility for a run of cases, one nest at a
+//  time for a block of cases together, using the vector logsum kernel.
+
 
 
 class workshop_ngev_probability 
@@ -107,12 +107,16 @@ void elm::workshop_nl_gradient::case_dProbability_dFusedParameters( const unsign
 	
 	dProb.initialize(0.0);
 			
-	unsigned i,u;
-	for (i=Xylem->size()-1; i!=0; ) {
+	const VAS_Plan& P = Xylem->plan();
+	unsigned i,u,up;
+	double up_mu;
+	for (i=P.n_cells-1; i!=0; ) {
 		i--;
-		u=0;
+		u=P.up_start[i];
+		up=P.up_cell[u];
+		up_mu=P.mu(up);
 		
-		if (i<Xylem->n_elemental()) {
+		if (i<P.n_elemental) {
 			if (Cho) {
 				if ((Pr[i]==0)&&(Cho[i]>0)) {
 					throw(ZeroProbWhenChosen(cat("Zero probability case_dProbability_dFusedParameters c=",c)));
@@ -125,22 +129,22 @@ void elm::workshop_nl_gradient::case_dProbability_dFusedParameters( const unsign
 		
 		// scratch = dUtil[down] - dUtil[up]
 		cblas_dcopy(nPar, dUtil.ptr(i), 1, scratch, 1);
-		cblas_daxpy(nPar, -1, dUtil.ptr((*Xylem)[i]->upcell(u)->slot()), 1, scratch, 1);
+		cblas_daxpy(nPar, -1, dUtil.ptr(up), 1, scratch, 1);
 
 		// adjust Mu for hierarchical structure
-		scratch[(*Xylem)[i]->upcell(u)->mu_offset()+nCA+nCO] += (Util[(*Xylem)[i]->upcell(u)->slot()]
+		scratch[P.mu_offset[up]+nCA+nCO] += (Util[up]
 														- Util[i] 
-														) / (*Xylem)[i]->upcell(u)->mu();
+														) / up_mu;
 		
 		
 		// scratch *= Pr[up]/mu[up]
-		cblas_dscal(nPar, Pr[(*Xylem)[i]->upcell(u)->slot()]/(*Xylem)[i]->upcell(u)->mu(), scratch, 1);
+		cblas_dscal(nPar, Pr[up]/up_mu, scratch, 1);
 		
 		// scratch += dProb[up]
-		cblas_daxpy(nPar, 1.0, dProb.ptr((*Xylem)[i]->upcell(u)->slot()), 1, scratch, 1);
+		cblas_daxpy(nPar, 1.0, dProb.ptr(up), 1, scratch, 1);
 		
 		// dProb += scratch * CPr
-		cblas_daxpy(nPar, CPr[(*Xylem)[i]->upedge(u)->edge_slot()], scratch, 1, dProb.ptr(i), 1);
+		cblas_daxpy(nPar, CPr[P.up_edge[u]], scratch, 1, dProb.ptr(i), 1);
 		
 	}
 }
@@ -763,6 +767,7 @@ elm::workshop_nl_gradient::workshop_nl_gradient
  , etk::memarray* GCurrent
  , etk::symmetric_matrix* Bhhh
  , etk::logging_service* msgr
+ , etk::job_partials* partials
 )
 : dF         (dF)
 , nNodes     (nNodes)
@@ -793,6 +798,7 @@ elm::workshop_nl_gradient::workshop_nl_gradient
 , _GCurrent(GCurrent)
 , _Bhhh(Bhhh)
 , _lock(nullptr)
+, _partials(partials)
 , msg_ (msgr)
 {
 }
@@ -872,7 +878,11 @@ void elm::workshop_nl_gradient::workshop_nl_gradient_do(
 void elm::workshop_nl_gradient::workshop_nl_gradient_send
 ()
 {
-	if (_lock) {
+	if (_partials) {
+		double* slot = _partials->slot(current_job);
+		cblas_dcopy(dF, *workshopGCurrent, 1, slot, 1);
+		cblas_dcopy(dF*dF, *workshopBHHH, 1, slot+dF, 1);
+	} else if (_lock) {
 		std::lock_guard<std::mutex> lock_while_in_shope(*_lock);
 		*_GCurrent += workshopGCurrent;
 		*_Bhhh += workshopBHHH;
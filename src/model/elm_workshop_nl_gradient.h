@@ -148,6 +148,7 @@ public:
 	etk::memarray* _GCurrent;
 	etk::symmetric_matrix* _Bhhh;
 	boosted::mutex* _lock;
+	etk::job_partials* _partials;
 	
 	int threadnumber;
 	etk::logging_service* msg_;
@@ -172,6 +173,7 @@ public:
 	 , etk::memarray* GCurrent
 	 , etk::symmetric_matrix* Bhhh
 	 , etk::logging_service* msgr
+	 , etk::job_partials* partials=nullptr
 	 );
 	
 	virtual ~workshop_nl_gradient();
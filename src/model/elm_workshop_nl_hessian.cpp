@@ -0,0 +1,250 @@
+/*
+ *  elm_workshop_nl_hessian.cpp
+ *
+ *  Copyright 2007-2017 Jeffrey Newman
+ *
+ *  Larch is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Larch is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with Larch.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+
+#include <cstring>
+#include "elm_model2.h"
+#include "elm_parameter2.h"
+#include "elm_names.h"
+#include <iostream>
+
+#include "elm_workshop_hessian.h"
+
+
+using namespace etk;
+using namespace elm;
+using namespace std;
+
+
+
+// Notation, for a node k below nest n, with V the utility at a node,
+//  mu the logsum parameter of n, and m = d(mu)/d(freedoms):
+//
+//   L_n              = V_n / mu = log sum_k exp(V_k/mu)
+//   CPr_k            = exp(V_k/mu - L_n)
+//   d(V_k/mu)        = dV_k/mu - V_k m/mu^2
+//   d2(V_k/mu)       = d2V_k/mu - (dV_k m' + m dV_k')/mu^2 + 2 V_k m m'/mu^3
+//   dL_n             = sum_k CPr_k d(V_k/mu)
+//   d2L_n            = sum_k CPr_k [d2(V_k/mu) + d(V_k/mu) d(V_k/mu)'] - dL_n dL_n'
+//   dV_n             = L_n m + mu dL_n
+//   d2V_n            = mu d2L_n + m dL_n' + dL_n m'
+//
+// The case log likelihood is sum_k W_k log(CPr_k) over all edges, where W_k is
+//  the total choice weight at or below k, so its hessian is
+//   sum_k W_k d2(V_k/mu) - sum_n W_n d2L_n.
+// Utility at the elementals is linear in the parameters, so d2V is zero there.
+
+
+
+elm::workshop_nl_hessian::workshop_nl_hessian
+(  const unsigned&   dF
+ , const unsigned&   nNodes
+ , elm::ca_co_packet UtilPK
+ , const paramArray& Params_LogSum
+ , elm::darray_ptr     Data_Choice
+ , elm::darray_ptr     Data_Weight
+ , const etk::memarray* Probability
+ , const etk::memarray* Cond_Prob
+ , const VAS_System* Xylem
+ , etk::symmetric_matrix* Hess
+ , etk::logging_service* msgr
+ , etk::job_partials* partials
+ )
+: _lock       (nullptr)
+, nCA         (UtilPK.Params_CA->length())
+, dF          (dF)
+, nNodes      (nNodes)
+, nNests      (nNodes-Xylem->n_elemental())
+, nElementals (Xylem->n_elemental())
+, Fused       (UtilPK.Params_CA->length())
+, dUtil       (nNodes, dF)
+, ChoWgt      (nNodes)
+, MuPush      (nNodes-Xylem->n_elemental(), dF)
+, dLogSum     (nNodes-Xylem->n_elemental(), dF)
+, d2LogSum    (nNodes-Xylem->n_elemental(), dF*dF)
+, d2Util      (dF, dF)
+, d2Ratio     (dF, dF)
+, Ratio       (dF)
+, CaseHess    (dF, dF)
+, workshopHess(dF, dF)
+, MuFree      (nNodes-Xylem->n_elemental(), false)
+, _Hess       (Hess)
+, _partials   (partials)
+, Params_LogSum(&Params_LogSum)
+, _Probability(Probability)
+, _Cond_Prob  (Cond_Prob)
+, _Xylem      (Xylem)
+, UtilPacket  (UtilPK)
+, Data_Choice (Data_Choice)
+, Data_Weight (Data_Weight)
+, msg_        (msgr)
+{
+}
+
+elm::workshop_nl_hessian::~workshop_nl_hessian()
+{
+}
+
+
+
+void elm::workshop_nl_hessian::prepare_mu_derivatives()
+{
+	MuPush.initialize(0.0);
+	for (unsigned j=0; j<nNests; j++) {
+		const parametexr par = (*Params_LogSum)[(*_Xylem)[j+nElementals]->mu_offset()];
+		if (par) par->pushvalue(MuPush.ptr(j), 1.0);
+		MuFree[j] = false;
+		for (unsigned f=0; f<dF; f++) {
+			if (MuPush(j,f)) {
+				MuFree[j] = true;
+				break;
+			}
+		}
+	}
+}
+
+
+
+void elm::workshop_nl_hessian::case_hessian_nl(const unsigned& c)
+{
+	const double* Pr   = _Probability->ptr(c);
+	const double* CPr  = _Cond_Prob->ptr(c);
+	const double* Util = UtilPacket.Outcome->ptr(c);
+	const double* Cho  = Data_Choice->values(c);
+	const unsigned root = nNodes-1;
+
+	double wgt = 1.0;
+	if (Data_Weight) wgt = Data_Weight->value(c,0);
+	if (wgt==0) return;
+
+	ChoWgt.initialize(0.0);
+	for (unsigned a=0; a<nElementals; a++) {
+		ChoWgt[a] = Cho[a];
+	}
+	for (unsigned a=0; a<root; a++) {
+		if (ChoWgt[a]) ChoWgt[(*_Xylem)[a]->upcell(0)->slot()] += ChoWgt[a];
+	}
+	if (!ChoWgt[root]) return;
+
+	dLogSum.initialize(0.0);
+	d2LogSum.initialize(0.0);
+	CaseHess.initialize(0.0);
+
+	// Children always have lower slots than their parent, so in slot order every
+	//  nest is complete by the time it is reached.
+	for (unsigned a=0; a<nNodes; a++) {
+		if (a<root && !Pr[a]) continue;
+
+		const bool elemental = (a<nElementals);
+		const double V = Util[a];
+
+		if (elemental) {
+			__casewise_dUtility_dFreedoms(UtilPacket, c, a, Fused, dUtil.ptr(a), dF);
+		} else {
+			const unsigned j = a-nElementals;
+			const double mu = (*_Xylem)[a]->mu();
+			const double* dL = dLogSum.ptr(j);
+			double* d2L = d2LogSum.ptr(j);
+
+			// finish d2L by removing the outer product of the mean
+			cblas_dsyr(CblasRowMajor, CblasUpper, dF, -1, dL, 1, d2L, dF);
+			if (ChoWgt[a]) cblas_daxpy(dF*dF, -ChoWgt[a], d2L, 1, *CaseHess, 1);
+			if (a==root) break;
+
+			double* dV = dUtil.ptr(a);
+			memset(dV, 0, dF*sizeof(double));
+			cblas_daxpy(dF, mu, dL, 1, dV, 1);
+			cblas_dcopy(dF*dF, d2L, 1, *d2Util, 1);
+			cblas_dscal(dF*dF, mu, *d2Util, 1);
+			if (MuFree[j]) {
+				cblas_daxpy(dF, V/mu, MuPush.ptr(j), 1, dV, 1);
+				cblas_dsyr2(CblasRowMajor, CblasUpper, dF, 1, MuPush.ptr(j), 1, dL, 1, *d2Util, dF);
+			}
+		}
+
+		// Roll this node up into its parent
+		const VAS_Cell* up = (*_Xylem)[a]->upcell(0);
+		const unsigned jp = up->slot()-nElementals;
+		const double mu = up->mu();
+		const double p = CPr[(*_Xylem)[a]->upedge(0)->edge_slot()];
+		const double* dV = dUtil.ptr(a);
+		const double* dmu = MuPush.ptr(jp);
+
+		cblas_dcopy(dF, dV, 1, *Ratio, 1);
+		cblas_dscal(dF, 1/mu, *Ratio, 1);
+		if (MuFree[jp]) cblas_daxpy(dF, -V/(mu*mu), dmu, 1, *Ratio, 1);
+
+		if (!elemental || MuFree[jp]) {
+			if (elemental) {
+				d2Ratio.initialize(0.0);
+			} else {
+				cblas_dcopy(dF*dF, *d2Util, 1, *d2Ratio, 1);
+				cblas_dscal(dF*dF, 1/mu, *d2Ratio, 1);
+			}
+			if (MuFree[jp]) {
+				cblas_dsyr2(CblasRowMajor, CblasUpper, dF, -1/(mu*mu), dV, 1, dmu, 1, *d2Ratio, dF);
+				cblas_dsyr (CblasRowMajor, CblasUpper, dF, 2*V/(mu*mu*mu), dmu, 1, *d2Ratio, dF);
+			}
+			cblas_daxpy(dF*dF, p, *d2Ratio, 1, d2LogSum.ptr(jp), 1);
+			if (ChoWgt[a]) cblas_daxpy(dF*dF, ChoWgt[a], *d2Ratio, 1, *CaseHess, 1);
+		}
+		cblas_daxpy(dF, p, *Ratio, 1, dLogSum.ptr(jp), 1);
+		cblas_dsyr(CblasRowMajor, CblasUpper, dF, p, *Ratio, 1, d2LogSum.ptr(jp), dF);
+	}
+
+	// CaseHess is for the log likelihood, accumulate the negative
+	cblas_daxpy(dF*dF, -wgt, *CaseHess, 1, *workshopHess, 1);
+}
+
+
+
+void elm::workshop_nl_hessian::workshop_nl_hessian_do(const unsigned& firstcase, const unsigned& numberofcases)
+{
+	workshopHess.initialize(0.0);
+	prepare_mu_derivatives();
+	unsigned lastcase = firstcase+numberofcases;
+	for (unsigned c=firstcase; c<lastcase; c++) {
+		case_hessian_nl(c);
+	}
+}
+
+
+
+void elm::workshop_nl_hessian::workshop_nl_hessian_send()
+{
+	if (_partials) {
+		cblas_dcopy(dF*dF, *workshopHess, 1, _partials->slot(current_job), 1);
+	} else if (_lock) {
+		std::lock_guard<std::mutex> lock_while_in_shope(*_lock);
+		cblas_daxpy(dF*dF, 1, *workshopHess, 1, **_Hess, 1);
+	} else {
+		OOPS("No lock in elm::workshop_nl_hessian::workshop_nl_hessian_send");
+	}
+}
+
+
+
+void elm::workshop_nl_hessian::work(size_t firstcase, size_t numberofcases, boosted::mutex* result_mutex)
+{
+	workshop_nl_hessian_do(firstcase,numberofcases);
+	_lock = result_mutex;
+	workshop_nl_hessian_send();
+}
+
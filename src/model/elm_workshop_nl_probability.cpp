@@ -25,6 +25,8 @@
 #include "elm_sql_scrape.h"
 #include "elm_names.h"
 #include <iostream>
+#include <algorithm>
+#include "etk_simd.h"
 
 #include "elm_workshop_nl_probability.h"
 
@@ -43,40 +45,75 @@ void elm::__casewise_nl_utility
 , double* top_logsum_value
 ) 
 {
+	const VAS_Plan& P = Xy.plan();
 	unsigned i; 
 	double max = -INF;
-	unsigned k;
-	for (i=Xy.n_elemental(); i<Xy.size(); i++) {
+	double mu;
+	unsigned k, k0, k1;
+	for (i=P.n_elemental; i<P.n_cells; i++) {
+		k0 = P.dn_start[i];
+		k1 = P.dn_start[i+1];
 		max = -INF;
-		for (k=0; k<Xy[i]->dnsize(); k++) {
-			Work[k] = U[Xy[i]->dncell(k)->slot()];
-			if (Work[k] > max) max = Work[k];
-		}			
-		if (Xy[i]->mu() == 0) { // When Mu is zero, special calculation
+		for (k=k0; k<k1; k++) {
+			Work[k-k0] = U[P.dn_cell[k]];
+			if (Work[k-k0] > max) max = Work[k-k0];
+		}
+		mu = P.mu(i);
+		if (mu == 0) { // When Mu is zero, special calculation
 			U[i] = max;
-			//OOPS("error: zero value for Mu");
 		} else { // Mu is not zero
 			if (max == -INF) max = 0;
-			max /= Xy[i]->mu();
+			max /= mu;
 			U[i] = 0;
-			for (k=0; k<Xy[i]->dnsize(); k++) {
+			for (k=0; k<k1-k0; k++) {
 				if (Work[k] == -INF) continue;
-				Work[k] /= Xy[i]->mu();
-				Work[k] -= max;
-				Work[k] = exp(Work[k]);
-				U[i] += Work[k];
+				U[i] += exp(Work[k]/mu - max);
 			}
 			if (U[i]) {
 				U[i] = log(U[i]);
 				U[i] += max;
-				U[i] *= Xy[i]->mu();
+				U[i] *= mu;
 			} else {
 				U[i] = -INF;
 			}
 		}
 	}
 	if (top_logsum_value) {
-		*top_logsum_value = U[Xy.size()-1];
+		*top_logsum_value = U[P.n_cells-1];
+	}
+}
+
+void elm::__blockwise_nl_utility
+( double* U
+, const size_t& ldU
+, const size_t& nCases
+, const VAS_System& Xy
+)
+{
+	const VAS_Plan& P = Xy.plan();
+	etk::simd::logsum_tile_t logsum_tile = etk::simd::logsum_tile();
+	static thread_local std::vector<double> tile;
+	double out [NEST_BLOCK_CASES];
+	
+	for (size_t first=0; first<nCases; first+=NEST_BLOCK_CASES) {
+		size_t n = std::min(size_t(NEST_BLOCK_CASES), nCases-first);
+		double* Ub = U + first*ldU;
+		for (unsigned i=P.n_elemental; i<P.n_cells; i++) {
+			unsigned k0 = P.dn_start[i];
+			unsigned k1 = P.dn_start[i+1];
+			tile.resize((k1-k0)*n);
+			for (unsigned k=k0; k<k1; k++) {
+				double* t = tile.data() + (k-k0)*n;
+				const double* u = Ub + P.dn_cell[k];
+				for (size_t c=0; c<n; c++) {
+					t[c] = u[c*ldU];
+				}
+			}
+			logsum_tile(tile.data(), k1-k0, n, n, P.mu(i), out);
+			for (size_t c=0; c<n; c++) {
+				Ub[c*ldU+i] = out[c];
+			}
+		}
 	}
 }
 
@@ -87,9 +124,10 @@ void elm::__casewise_nl_probability
 , const VAS_System& Xy	// nesting structure
 )
 {
+	const VAS_Plan& P = Xy.plan();
 	unsigned i;
-	unsigned u;
-	unsigned nN = Xy.size();
+	unsigned u, up, e;
+	unsigned nN = P.n_cells;
 	
 	// Total Probability of the root
 	Pr[nN-1] = 1.0;
@@ -98,22 +136,24 @@ void elm::__casewise_nl_probability
 	for (i=nN-1; i!=0; ) {
 		i--;
 		Pr[i] = 0;
-		u=0; 
+		u = P.up_start[i];
+		up = P.up_cell[u];
+		e = P.up_edge[u];
 		if (U[i]!=-INF) {
-			if (Xy[i]->upcell(u)->mu() == 0) {
-				if (U[i] == U[Xy[i]->upcell(u)->slot()]) {
-					CPr[Xy[i]->upedge(u)->edge_slot()] = 1.0;
+			if (P.mu(up) == 0) {
+				if (U[i] == U[up]) {
+					CPr[e] = 1.0;
 					// TODO: count number of other nodes with identical maximum utility (a pathological case)
 				} else {
-					CPr[Xy[i]->upedge(u)->edge_slot()] = 0.0;
+					CPr[e] = 0.0;
 				}
 			} else {
-				CPr[Xy[i]->upedge(u)->edge_slot()] = exp((U[i] - U[Xy[i]->upcell(u)->slot()]) / Xy[i]->upcell(u)->mu());
+				CPr[e] = exp((U[i] - U[up]) / P.mu(up));
 			}
 		} else {
-			CPr[Xy[i]->upedge(u)->edge_slot()] = 0.0;
+			CPr[e] = 0.0;
 		}
-		Pr[i] += CPr[Xy[i]->upedge(u)->edge_slot()] * Pr[Xy[i]->upcell(u)->slot()];			
+		Pr[i] += CPr[e] * Pr[up];
 	}
 }
 
@@ -177,6 +217,7 @@ elm::workshop_nl_probability::workshop_nl_probability
 {
 	Workspace.resize(nNodes);
 	if (logsums_out) {
+		etk::python_lock LOCK;
 		Py_XINCREF(logsums_out);
 		if (PyArray_DIM(logsums_out, 0) < Probability->size1() ) {
 			Py_CLEAR(logsums_out);
@@ -188,11 +229,13 @@ elm::workshop_nl_probability::workshop_nl_probability
 
 elm::workshop_nl_probability::~workshop_nl_probability()
 {
+	etk::python_lock LOCK;
 	Py_CLEAR(logsums_out);
 }
 
 void elm::workshop_nl_probability::reassign_py_output(PyArrayObject* new_logsums_out)
 {
+	etk::python_lock LOCK;
 	Py_CLEAR(logsums_out);
 	if (new_logsums_out) {
 		Py_XINCREF(new_logsums_out);
@@ -238,9 +281,14 @@ void elm::workshop_nl_probability::workshop_nl_probability_calc
 				(*Utility)(c,a) = -INF;
 			} 		
 		}
-
-		
-		__casewise_nl_utility(Utility->ptr(c), *Xylem, *Workspace, (double*)((logsums_out)?PyArray_GETPTR1(logsums_out, c):nullptr));
+	}
+	
+	__blockwise_nl_utility(Utility->ptr(firstcase), Utility->size2(), numberofcases, *Xylem);
+	
+	for (unsigned c=firstcase;c<lastcase;c++) {
+		if (logsums_out) {
+			*(double*)PyArray_GETPTR1(logsums_out, c) = (*Utility)(c, Xylem->size()-1);
+		}
 		__casewise_nl_probability(Utility->ptr(c), Cond_Prob->ptr(c), Probability->ptr(c), *Xylem);
 		if (use_sampling) {
 			case_logit_add_sampling(c);
@@ -48,6 +48,15 @@ void __casewise_nl_probability
 , const VAS_System& Xy	// nesting structure
 );
 
+void __blockwise_nl_utility
+( double* U		        // pointer to utility array of the first case [nCases, ldU space]
+, const size_t& ldU     // distance between the utilities of successive cases
+, const size_t& nCases  // number of cases
+, const VAS_System& Xy  // nesting structure
+) ;
+// Does the same as __casewise_nl_utility for a run of cases, one nest at a
+//  time for a block of cases together, using the vector logsum kernel.
+
 
 
 class workshop_nl_probability 
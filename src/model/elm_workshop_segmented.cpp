@@ -0,0 +1,231 @@
+/*
+ *  elm_workshop_segmented.cpp
+ *
+ *  Copyright 2007-2017 Jeffrey Newman
+ *
+ *  Larch is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Larch is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with Larch.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+
+#include <cstring>
+#include <algorithm>
+#include "etk.h"
+
+#include "elm_workshop_segmented.h"
+
+
+
+
+elm::workshop_segmented_logit::workshop_segmented_logit
+(  const unsigned& dF
+ , const unsigned& nElementals
+ , elm::ca_co_packet UtilPack
+ , const segment_params* Params_CA
+ , const segment_params* Params_CO
+ , const segment_coefs* Coef_CA
+ , const segment_coefs* Coef_CO
+ , const std::vector<unsigned>* Segment
+ , const std::vector<size_t>* Order
+ , elm::darray_ptr Data_AV
+ , elm::darray_ptr Data_Ch
+ , elm::darray_ptr Data_Wt
+ , etk::ndarray* Probability
+ , etk::ndarray* CaseLogLike
+ , etk::job_partials* LogL
+ , etk::job_partials* partials
+ , etk::logging_service* msgr
+ )
+: dF          (dF)
+, nElementals (nElementals)
+, UtilPacket  (UtilPack)
+, Params_CA   (Params_CA)
+, Params_CO   (Params_CO)
+, Coef_CA     (Coef_CA)
+, Coef_CO     (Coef_CO)
+, Segment     (Segment)
+, Order       (Order)
+, Data_AV     (Data_AV)
+, Data_Ch     (Data_Ch)
+, Data_Wt     (Data_Wt)
+, Probability (Probability)
+, CaseLogLike (CaseLogLike)
+, LogL        (LogL)
+, _partials   (partials)
+, Workspace      (nElementals)
+, Grad_UtilityCA (UtilPack.Params_CA->size1(),UtilPack.Params_CA->size2(),UtilPack.Params_CA->size3())
+, Grad_UtilityCO (UtilPack.Params_CO->size1(),UtilPack.Params_CO->size2(),UtilPack.Params_CO->size3())
+, CaseGrad        (dF)
+, workshopGCurrent(dF)
+, workshopBHHH    (dF, dF)
+, RunCA           ()
+, RunCO           ()
+, RunUtility      ()
+, logit_row   (etk::simd::masked_logit_row())
+, msg_        (msgr)
+{
+	Grad_UtilityCA.initialize(0.0);
+	Grad_UtilityCO.initialize(0.0);
+}
+
+elm::workshop_segmented_logit::~workshop_segmented_logit()
+{
+}
+
+
+
+
+void elm::workshop_segmented_logit::case_gradient(const size_t& c, const unsigned& s)
+{
+	double wgt = 1.0;
+	if (Data_Wt) wgt = Data_Wt->value(c,0);
+
+	// The derivative of the log likelihood with respect to utility is the
+	// choice less the probability times the total of the choices.
+	const double* ch = Data_Ch->values_constptr(c);
+	double totalchoice = 0.0;
+	for (unsigned a=0; a<nElementals; a++) totalchoice += ch[a];
+	cblas_dcopy(nElementals,ch,1,*Workspace,1);
+	cblas_daxpy(nElementals,-totalchoice,Probability->ptr(c),1,*Workspace,1);
+
+	if (UtilPacket.Data_CA && UtilPacket.Data_CA->nVars()) {
+		cblas_dgemv(CblasRowMajor,CblasTrans,nElementals,UtilPacket.Data_CA->nVars(),
+					-1,UtilPacket.Data_CA->values(c,1),UtilPacket.Data_CA->nVars(),*Workspace,1,0,*Grad_UtilityCA,1);
+	}
+	if (UtilPacket.Data_CO && UtilPacket.Data_CO->nVars()) {
+		Grad_UtilityCO.initialize();
+		cblas_dger(CblasRowMajor,UtilPacket.Data_CO->nVars(),nElementals,-1,
+				   UtilPacket.Data_CO->values(c,1),1,*Workspace,1,*Grad_UtilityCO,nElementals);
+	}
+
+	// The segment's own parameter arrays carry the coefficients to its freedoms
+	CaseGrad.initialize();
+	elm::push_to_freedoms2(*(*Params_CA)[s], *Grad_UtilityCA, *CaseGrad);
+	elm::push_to_freedoms2(*(*Params_CO)[s], *Grad_UtilityCO, *CaseGrad);
+
+	cblas_dsyr(CblasRowMajor,CblasUpper, dF,wgt,*CaseGrad, 1, *workshopBHHH, dF);
+	cblas_daxpy(dF,wgt,*CaseGrad,1,*workshopGCurrent,1);
+}
+
+
+
+
+void elm::workshop_segmented_logit::run_utility(const size_t& firstposition, const size_t& n, const unsigned& s)
+{
+	// The rows of the cases at these positions are copied (and widened, for
+	//  single precision data) into one block, whose utility is then found with
+	//  one product against the segment's coefficients.
+	RunUtility.resize(n, nElementals);
+	const elm::darray* CA = UtilPacket.Data_CA ? &*UtilPacket.Data_CA : nullptr;
+	const elm::darray* CO = UtilPacket.Data_CO ? &*UtilPacket.Data_CO : nullptr;
+
+	if (CA && CA->nVars()) {
+		size_t row = size_t(nElementals)*CA->nVars();
+		RunCA.resize(n, nElementals, CA->nVars());
+		for (size_t p=0; p<n; p++) {
+			size_t c = _case(firstposition+p);
+			if (CA->dtype==NPY_FLOAT) {
+				const float* x = CA->floatvalues(c);
+				std::copy(x, x+row, RunCA.ptr(p));
+			} else {
+				memcpy(RunCA.ptr(p), CA->values_constptr(c), row*sizeof(double));
+			}
+		}
+		cblas_dgemv(CblasRowMajor,CblasNoTrans, n*nElementals, CA->nVars(),
+					1, RunCA.ptr(), CA->nVars(), (*Coef_CA)[s]->ptr(), 1,
+					0, RunUtility.ptr(), 1);
+	} else {
+		RunUtility.initialize(0.0);
+	}
+
+	if (CO && CO->nVars()) {
+		size_t row = CO->nVars();
+		RunCO.resize(n, CO->nVars());
+		for (size_t p=0; p<n; p++) {
+			size_t c = _case(firstposition+p);
+			if (CO->dtype==NPY_FLOAT) {
+				const float* x = CO->floatvalues(c);
+				std::copy(x, x+row, RunCO.ptr(p));
+			} else {
+				memcpy(RunCO.ptr(p), CO->values_constptr(c), row*sizeof(double));
+			}
+		}
+		cblas_dgemm(CblasRowMajor,CblasNoTrans,CblasNoTrans, n, nElementals, CO->nVars(),
+					1, RunCO.ptr(), CO->nVars(), (*Coef_CO)[s]->ptr(), nElementals,
+					1, RunUtility.ptr(), nElementals);
+	}
+}
+
+
+void elm::workshop_segmented_logit::work(size_t firstcase, size_t numberofcases, boosted::mutex* result_mutex)
+{
+	// firstcase and numberofcases count positions in Order, not cases
+	size_t lastcase = firstcase + numberofcases;
+
+	if (_partials) {
+		workshopGCurrent.initialize(0.0);
+		workshopBHHH.initialize(0.0);
+		for (size_t p=firstcase; p<lastcase; p++) {
+			size_t c = _case(p);
+			case_gradient(c, (*Segment)[c]);
+		}
+		double* slot = _partials->slot(current_job);
+		cblas_dcopy(dF, *workshopGCurrent, 1, slot, 1);
+		cblas_dcopy(dF*dF, *workshopBHHH, 1, slot+dF, 1);
+		return;
+	}
+
+	double LogL_local = 0.0;
+
+	// Cases are taken in runs of the same segment, so the utility of a run
+	// is found with a single product against that segment's coefficients.
+	// A run of contiguous cases is read in place.
+	size_t runfirst = firstcase;
+	while (runfirst < lastcase) {
+		unsigned s = (*Segment)[_case(runfirst)];
+		size_t runlast = runfirst+1;
+		bool contiguous = true;
+		while (runlast < lastcase && (*Segment)[_case(runlast)]==s) {
+			if (_case(runlast)!=_case(runlast-1)+1) contiguous = false;
+			runlast++;
+		}
+
+		if (contiguous) {
+			elm::ca_co_packet SegmentPacket (UtilPacket);
+			SegmentPacket.Params_CA = &*(*Params_CA)[s];
+			SegmentPacket.Params_CO = &*(*Params_CO)[s];
+			SegmentPacket.Coef_CA = &*(*Coef_CA)[s];
+			SegmentPacket.Coef_CO = &*(*Coef_CO)[s];
+			SegmentPacket.Outcome = Probability;
+			SegmentPacket.logit_partial(_case(runfirst), runlast-runfirst);
+		} else {
+			run_utility(runfirst, runlast-runfirst, s);
+			for (size_t p=runfirst; p<runlast; p++) {
+				cblas_dcopy(nElementals, RunUtility.ptr(p-runfirst), 1, Probability->ptr(_case(p)), 1);
+			}
+		}
+
+		for (size_t p=runfirst; p<runlast; p++) {
+			size_t c = _case(p);
+			logit_row(Probability->ptr(c), Data_AV->boolvalues_constptr(c), Data_Ch->values_constptr(c),
+					  nElementals, CaseLogLike->at(c));
+			LogL_local += (Data_Wt ? CaseLogLike->at(c) * Data_Wt->value(c,0) : CaseLogLike->at(c));
+		}
+		runfirst = runlast;
+	}
+
+	if (LogL) {
+		*LogL->slot(current_job) = LogL_local;
+	}
+}
@@ -0,0 +1,114 @@
+/*
+ *  elm_workshop_segmented.h
+ *
+ *  Copyright 2007-2017 Jeffrey Newman
+ *
+ *  Larch is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Larch is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with Larch.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef __ELM_WORKSHOP_SEGMENTED_H__
+#define __ELM_WORKSHOP_SEGMENTED_H__
+
+#include "etk.h"
+#include "etk_workshop.h"
+#include "elm_darray.h"
+#include "elm_packets.h"
+#include "elm_parameter2.h"
+#include "etk_simd.h"
+
+namespace elm {
+
+	typedef std::vector< boosted::shared_ptr<elm::paramArray> > segment_params;
+	typedef std::vector< boosted::shared_ptr<etk::ndarray> >    segment_coefs;
+
+	// Works an MNL model whose utility coefficients differ by segment, with
+	//  all the segments' cases in the same data arrays. Segment[c] gives the
+	//  segment of case c, and each segment has its own parameter arrays and
+	//  coefficients, in the same shape as those of the utility packet.
+	//
+	// The jobs are over positions in Order, the cases sorted by segment, so a
+	//  job has one run of cases for each segment in it; without an Order (as
+	//  when the data is streamed), the positions are the cases themselves.
+	//
+	// Without partials, the utility of each run of cases in the same segment
+	//  is found with that segment's coefficients, and turned into probability
+	//  and log likelihood. The data of a run that is not contiguous is first
+	//  gathered into one block. With partials, the probability already found
+	//  is read, and the gradient and BHHH matrix are written to the job's slot.
+	class workshop_segmented_logit
+	: public etk::workshop
+	{
+		unsigned dF;
+		unsigned nElementals;
+
+		elm::ca_co_packet UtilPacket;
+		const segment_params* Params_CA;
+		const segment_params* Params_CO;
+		const segment_coefs*  Coef_CA;
+		const segment_coefs*  Coef_CO;
+		const std::vector<unsigned>* Segment;
+		const std::vector<size_t>*   Order;
+
+		elm::darray_ptr Data_AV;
+		elm::darray_ptr Data_Ch;
+		elm::darray_ptr Data_Wt;
+
+		etk::ndarray* Probability;
+		etk::ndarray* CaseLogLike;
+		etk::job_partials* LogL;
+		etk::job_partials* _partials;
+
+		etk::memarray_raw Workspace;
+		etk::memarray_raw Grad_UtilityCA;
+		etk::memarray_raw Grad_UtilityCO;
+		etk::memarray_raw CaseGrad;
+		etk::memarray_raw workshopGCurrent;
+		etk::memarray_raw workshopBHHH;
+		etk::memarray_raw RunCA;
+		etk::memarray_raw RunCO;
+		etk::memarray_raw RunUtility;
+
+		etk::simd::masked_logit_row_t logit_row;
+		etk::logging_service* msg_;
+
+		inline size_t _case(const size_t& position) const { return Order ? (*Order)[position] : position; }
+		void case_gradient(const size_t& c, const unsigned& s);
+		void run_utility(const size_t& firstposition, const size_t& n, const unsigned& s);
+
+	public:
+		virtual void work(size_t firstcase, size_t numberofcases, boosted::mutex* result_mutex);
+		workshop_segmented_logit(  const unsigned& dF
+								 , const unsigned& nElementals
+								 , elm::ca_co_packet UtilPack
+								 , const segment_params* Params_CA
+								 , const segment_params* Params_CO
+								 , const segment_coefs* Coef_CA
+								 , const segment_coefs* Coef_CO
+								 , const std::vector<unsigned>* Segment
+								 , const std::vector<size_t>* Order
+								 , elm::darray_ptr Data_AV
+								 , elm::darray_ptr Data_Ch
+								 , elm::darray_ptr Data_Wt
+								 , etk::ndarray* Probability
+								 , etk::ndarray* CaseLogLike
+								 , etk::job_partials* LogL
+								 , etk::job_partials* partials=nullptr
+								 , etk::logging_service* msgr=nullptr
+								 );
+		~workshop_segmented_logit();
+	};
+
+}
+#endif // __ELM_WORKSHOP_SEGMENTED_H__
@@ -20,6 +20,8 @@
 
 #include "larch_cache.h"
 #include <iostream>
+#include <cstring>
+#include <cstdint>
 
 using namespace elm;
 
@@ -35,6 +37,7 @@ array_compare::array_compare(const double* ptr, const size_t& len, bool make_cop
 		}
 		firstpointer = &(holder[0]);
 	}
+	_hash();
 }
 
 array_compare::array_compare(const std::vector<double>& array)
@@ -42,7 +45,7 @@ array_compare::array_compare(const std::vector<double>& array)
 , firstpointer (&(array[0]))
 , length (array.size())
 {
-
+	_hash();
 }
 
 array_compare::array_compare(const std::vector<double>& array, bool make_copy)
@@ -50,19 +53,34 @@ array_compare::array_compare(const std::vector<double>& array, bool make_copy)
 , firstpointer (&(holder[0]))
 , length (holder.size())
 {
-
+	_hash();
 }
 
 array_compare::array_compare(const array_compare& other)
 : holder (other.length)
 , firstpointer (&(holder[0]))
 , length (other.length)
+, hashvalue (other.hashvalue)
 {
 	for (size_t i=0; i<length; i++) {
 		holder[i] = other.firstpointer[i];
 	}
 }
 
+// FNV-1a over the bits of each value. Equal vectors always hash the same
+//  except for 0.0 and -0.0, which only costs a cache miss.
+void array_compare::_hash()
+{
+	uint64_t h = 14695981039346656037ULL;
+	for (size_t i=0; i<length; i++) {
+		uint64_t bits;
+		memcpy(&bits, firstpointer+i, sizeof(bits));
+		h ^= bits;
+		h *= 1099511628211ULL;
+	}
+	hashvalue = size_t(h ^ length);
+}
+
 
 
 bool array_compare::operator==(const array_compare& other) const
@@ -153,30 +171,121 @@ void array_compare::print_to_cerr() const
 result_cache::result_cache()
 { }
 
+cache_statistics::cache_statistics()
+: loglike_hits   (0)
+, loglike_misses (0)
+, grad_hits      (0)
+, grad_misses    (0)
+, bhhh_hits      (0)
+, bhhh_misses    (0)
+, bhhh_tol_hits  (0)
+, bhhh_tol_misses(0)
+, hess_hits      (0)
+, hess_misses    (0)
+, evictions      (0)
+{ }
 
+cache_set::entry::entry(const array_compare& key)
+: key     (key)
+, results ()
+, bytes   (0)
+{ }
 
 
 
 
+cache_set::cache_set(const size_t& budget_bytes)
+: _lru    ()
+, _index  ()
+, _bytes  (0)
+, _budget (budget_bytes)
+, _stats  ()
+{ }
 
-
+cache_set::entry_iter cache_set::_find(const array_compare& key) const
+{
+	auto range = _index.equal_range(key.hash());
+	for (auto i=range.first; i!=range.second; i++) {
+		if (i->second->key == key) {
+			// most recently used moves to the front
+			_lru.splice(_lru.begin(), _lru, i->second);
+			return i->second;
+		}
+	}
+	return _lru.end();
+}
 
 const result_cache* cache_set::_get_results(const array_compare& key) const
 {
-	auto iter = _saved_results.find(key);
-	if (iter == _saved_results.end()) {
+	auto e = _find(key);
+	if (e == _lru.end()) {
 		return nullptr;
 	}
-	return &iter->second;
+	return &e->results;
 }
 
 result_cache* cache_set::_get_results(const array_compare& key)
 {
-	auto iter = _saved_results.find(key);
-	if (iter == _saved_results.end()) {
+	auto e = _find(key);
+	if (e == _lru.end()) {
 		return nullptr;
 	}
-	return &iter->second;
+	return &e->results;
+}
+
+result_cache* cache_set::_put_results(const array_compare& key)
+{
+	auto e = _find(key);
+	if (e == _lru.end()) {
+		_lru.emplace_front(key);
+		e = _lru.begin();
+		_index.emplace(key.hash(), e);
+	}
+	return &e->results;
+}
+
+// Recount the memory held by the front entry, which was just saved to,
+//  then drop the least recently used entries until within the budget.
+void cache_set::_account(entry_iter e)
+{
+	const result_cache& r = e->results;
+	size_t b = sizeof(entry) + e->key.size()*sizeof(double);
+	if (r._stored_ll)       b += sizeof(double);
+	if (r._stored_bhhh_tol) b += sizeof(double);
+	if (r._stored_grad)     b += r._stored_grad->size()*sizeof(double);
+	if (r._stored_hess)     b += r._stored_hess->size()*sizeof(double);
+	if (r._stored_bhhh)     b += r._stored_bhhh->size()*sizeof(double);
+	_bytes += b;
+	_bytes -= e->bytes;
+	e->bytes = b;
+	
+	while (_bytes > _budget && _lru.size() > 1) {
+		_evict(std::prev(_lru.end()));
+	}
+}
+
+void cache_set::_evict(entry_iter e)
+{
+	auto range = _index.equal_range(e->key.hash());
+	for (auto i=range.first; i!=range.second; i++) {
+		if (i->second == e) {
+			_index.erase(i);
+			break;
+		}
+	}
+	_bytes -= e->bytes;
+	_lru.erase(e);
+	_stats.evictions++;
+}
+
+void cache_set::set_budget(const size_t& budget_bytes)
+{
+	_budget = budget_bytes;
+}
+
+void cache_set::reset_statistics()
+{
+	_stats = cache_statistics();
 }
 
 
@@ -184,30 +293,24 @@ result_cache* cache_set::_get_results(const array_compare& key)
 bool cache_set::read_cached_loglike(const array_compare& key, double& ll) const
 {
 	auto x = _get_results(key);
-	if (!x) {
-		return false;
-	}
-	
-	if (x->_stored_ll) {
+	if (x && x->_stored_ll) {
 		ll = *x->_stored_ll;
+		_stats.loglike_hits++;
 		return true;
 	}
-	
+	_stats.loglike_misses++;
 	return false;
 }
 
 bool cache_set::read_cached_bhhh_tol(const array_compare& key, double& bhhh_tol) const
 {
 	auto x = _get_results(key);
-	if (!x) {
-		return false;
-	}
-	
-	if (x->_stored_bhhh_tol) {
+	if (x && x->_stored_bhhh_tol) {
 		bhhh_tol = *x->_stored_bhhh_tol;
+		_stats.bhhh_tol_hits++;
 		return true;
 	}
-	
+	_stats.bhhh_tol_misses++;
 	return false;
 }
 
@@ -216,11 +319,15 @@ bool cache_set::read_cached_grad   (const array_compare& key, std::shared_ptr<et
 	auto x = _get_results(key);
 	if (!x) {
 		grad = nullptr;
+		_stats.grad_misses++;
 		return false;
 	}
 	
 	if (x->_stored_grad) {
 		grad = x->_stored_grad;
+		_stats.grad_hits++;
+	} else {
+		_stats.grad_misses++;
 	}
 	return true;
 }
@@ -231,11 +338,15 @@ bool cache_set::read_cached_bhhh   (const array_compare& key, etk::symmetric_mat
 	auto x = _get_results(key);
 	if (!x) {
 		bhhh = nullptr;
+		_stats.bhhh_misses++;
 		return false;
 	}
 	
 	if (x->_stored_bhhh) {
 		*bhhh = *x->_stored_bhhh;
+		_stats.bhhh_hits++;
+	} else {
+		_stats.bhhh_misses++;
 	}
 	return true;
 }
@@ -245,12 +356,16 @@ bool cache_set::read_cached_bhhh   (const array_compare& key, std::shared_ptr<et
 	auto x = _get_results(key);
 	if (!x) {
 		bhhh = nullptr;
+		_stats.bhhh_misses++;
 		return false;
 	}
 	
 	if (x->_stored_bhhh) {
 		bhhh = std::make_shared<etk::symmetric_matrix>();
 		*bhhh = *x->_stored_bhhh;
+		_stats.bhhh_hits++;
+	} else {
+		_stats.bhhh_misses++;
 	}
 	return true;
 }
@@ -261,11 +376,15 @@ bool cache_set::read_cached_hess   (const array_compare& key, etk::symmetric_mat
 	auto x = _get_results(key);
 	if (!x) {
 		hess = nullptr;
+		_stats.hess_misses++;
 		return false;
 	}
 	
 	if (x->_stored_hess) {
 		*hess = *x->_stored_hess;
+		_stats.hess_hits++;
+	} else {
+		_stats.hess_misses++;
 	}
 	return true;
 }
@@ -275,45 +394,52 @@ bool cache_set::read_cached_hess   (const array_compare& key, etk::symmetric_mat
 // These functions save the thing
 void cache_set::set_cached_loglike(const array_compare& key, const double& ll)
 {
-	result_cache* x = &_saved_results[key];
+	result_cache* x = _put_results(key);
 	x->_stored_ll = std::make_shared<double>(ll);
+	_account(_lru.begin());
 }
 
 void cache_set::set_cached_bhhh_tol(const array_compare& key, const double& bhhh_tol)
 {
-	result_cache* x = &_saved_results[key];
+	result_cache* x = _put_results(key);
 	x->_stored_bhhh_tol = std::make_shared<double>(bhhh_tol);
+	_account(_lru.begin());
 }
 
 
 void cache_set::set_cached_grad   (const array_compare& key, std::shared_ptr<etk::ndarray>& grad)
 {
-	result_cache* x = &_saved_results[key];
+	result_cache* x = _put_results(key);
 	x->_stored_grad = grad;
+	_account(_lru.begin());
 }
 
 
 void cache_set::set_cached_bhhh   (const array_compare& key, const etk::symmetric_matrix& bhhh)
 {
-	result_cache* x = &_saved_results[key];
+	result_cache* x = _put_results(key);
 //	x->_bhhh = bhhh;
 //	x->my_bhhh = &x->_bhhh;
 	
 	x->_stored_bhhh = std::make_shared<etk::symmetric_matrix>(bhhh.size1());
 	*x->_stored_bhhh = bhhh;
+	_account(_lru.begin());
 }
 
 
 void cache_set::set_cached_hess   (const array_compare& key, const etk::symmetric_matrix& hess)
 {
-	result_cache* x = &_saved_results[key];
+	result_cache* x = _put_results(key);
 
 	x->_stored_hess = std::make_shared<etk::symmetric_matrix>(hess.size1());
 	*x->_stored_hess = hess;
+	_account(_lru.begin());
 }
 
 void cache_set::clear()
 {
-	_saved_results.clear();
+	_index.clear();
+	_lru.clear();
+	_bytes = 0;
 }
 
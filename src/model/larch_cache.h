@@ -22,7 +22,8 @@
 #define __LARCH_CACHE_H__
 
 #include <vector>
-#include <map>
+#include <list>
+#include <unordered_map>
 #include "etk_ndarray.h"
 
 namespace elm {
@@ -31,6 +32,9 @@ namespace elm {
 		std::vector<double> holder;
 		const double*       firstpointer;
 		size_t              length;
+		size_t              hashvalue;
+		
+		void _hash();
 		
 	public:
 		array_compare(const double* ptr, const size_t& len, bool make_copy=false);
@@ -46,6 +50,9 @@ namespace elm {
 		bool operator>=(const array_compare& other) const;
 		
 		void print_to_cerr() const;
+		
+		size_t hash() const { return hashvalue; }
+		size_t size() const { return length; }
 	};
 
 
@@ -65,15 +72,52 @@ namespace elm {
 	};
 
 
+	struct cache_statistics {
+		size_t loglike_hits;
+		size_t loglike_misses;
+		size_t grad_hits;
+		size_t grad_misses;
+		size_t bhhh_hits;
+		size_t bhhh_misses;
+		size_t bhhh_tol_hits;
+		size_t bhhh_tol_misses;
+		size_t hess_hits;
+		size_t hess_misses;
+		size_t evictions;
+		
+		cache_statistics();
+	};
+
+
+	// Results saved by parameter vector. Entries are found by a hash of the
+	//  vector, and the least recently used are dropped when the results held
+	//  take more memory than the budget.
 	class cache_set
 	{
+		struct entry {
+			array_compare key;
+			result_cache  results;
+			size_t        bytes;
+			entry(const array_compare& key);
+		};
+		typedef std::list<entry>::iterator entry_iter;
 		
-		std::map< array_compare, result_cache > _saved_results;
+		mutable std::list<entry> _lru; // most recently used first
+		mutable std::unordered_multimap< size_t, entry_iter > _index;
+		size_t _bytes;
+		size_t _budget;
+		mutable cache_statistics _stats;
 		
 		const result_cache* _get_results(const array_compare& key) const;
 		result_cache* _get_results(const array_compare& key);
+		entry_iter _find(const array_compare& key) const;
+		result_cache* _put_results(const array_compare& key);
+		void _account(entry_iter e);
+		void _evict(entry_iter e);
 		
 	public:
+		cache_set(const size_t& budget_bytes=64*1024*1024);
+		
 		// these functions return true if the thing is saved,
 		// and put a pointer to the thing into the 2nd argument.
 		bool read_cached_loglike (const array_compare& key, double& ll) const;
@@ -91,6 +135,15 @@ namespace elm {
 		void set_cached_hess    (const array_compare& key, const etk::symmetric_matrix& hess);
 		
 		void clear();
+		
+		void set_budget(const size_t& budget_bytes);
+		// A smaller budget takes effect when the next result is saved.
+		
+		size_t size() const { return _lru.size(); }
+		size_t bytes() const { return _bytes; }
+		size_t budget() const { return _budget; }
+		const cache_statistics& statistics() const { return _stats; }
+		void reset_statistics();
 	};
 
 
@@ -21,6 +21,7 @@
 
 #define NOMINMAX
 #include <limits>
+#include <algorithm>
 #include "sherpa.h"
 #include "sherpa_freedom.h"
 #include <iostream>
@@ -32,11 +33,25 @@ using namespace etk;
 using namespace std;
 
 
+// The interpreter lock may have been released while maximizing, so it is
+//  taken back to look for a user interrupt.
+static bool _interrupted()
+{
+	etk::python_lock LOCK;
+	return PyErr_CheckSignals();
+}
+
+
 double sherpa::objective() 
 { 
 	OOPS("error(sherpa): default objective");
 	return 0; 
 }
+
+double sherpa::objective_only()
+{
+	return objective();
+}
 const etk::memarray& sherpa::gradient(const bool& force_recalculate)
 { 
 	negative_finite_diff_gradient_(GLastTurn);
@@ -48,54 +63,88 @@ void sherpa::calculate_hessian()
 	finite_diff_hessian(Hess);
 }
 
+bool sherpa::case_sample(const double& fraction)
+{
+	return (fraction >= 1);
+}
+
 
-void sherpa::negative_finite_diff_gradient_(memarray& fGrad)
+// Each freedom i gets two finite difference points, FCurrent jiggled up in row 2i
+//  and down in row 2i+1, so all 2*dF evaluations can be requested at once.
+static void _finite_diff_points(const memarray& FCurrent, const size_t& dF, std::vector<double>& points, std::vector<double>& jiggles)
 {
-	unsigned i;	
-	double jiggle;
-	if (fGrad.size() < dF()) OOPS("error(sherpa): not enough finite diff array space");
-	
-	for (i=0;i<dF();i++) {
-		jiggle = FCurrent[i] * PERTURBATION_SIZE;
+	points.resize(2*dF*dF);
+	jiggles.resize(dF);
+	for (size_t i=0;i<dF;i++) {
+		double jiggle = FCurrent[i] * PERTURBATION_SIZE;
 		if (!jiggle) jiggle = PERTURBATION_SIZE;
+		jiggles[i] = jiggle;
 		
-		FCurrent[i] += jiggle;
-		freshen();
-		fGrad[i] = objective();
-		FCurrent[i] -= jiggle;
-		
-		FCurrent[i] -= jiggle;
+		double* up   = &points[(2*i  )*dF];
+		double* down = &points[(2*i+1)*dF];
+		cblas_dcopy(dF, FCurrent.ptr(), 1, up,   1);
+		cblas_dcopy(dF, FCurrent.ptr(), 1, down, 1);
+		up  [i] += jiggle;
+		down[i] -= jiggle;
+	}
+}
+
+void sherpa::objective_at(const double* points, const size_t& npoints, double* results)
+{
+	std::vector<double> saved (FCurrent.ptr(), FCurrent.ptr()+dF());
+	for (size_t p=0; p<npoints; p++) {
+		cblas_dcopy(dF(), points+p*dF(), 1, FCurrent.ptr(), 1);
 		freshen();
-		fGrad[i] -= objective();
-		FCurrent[i] += jiggle;
+		results[p] = objective();
+	}
+	cblas_dcopy(dF(), &saved[0], 1, FCurrent.ptr(), 1);
+	freshen();
+}
+
+void sherpa::gradient_at(const double* points, const size_t& npoints, double* results)
+{
+	std::vector<double> saved (FCurrent.ptr(), FCurrent.ptr()+dF());
+	for (size_t p=0; p<npoints; p++) {
+		cblas_dcopy(dF(), points+p*dF(), 1, FCurrent.ptr(), 1);
 		freshen();
-		
-		fGrad[i] /= -2*jiggle;
+		objective();
+		gradient();
+		cblas_dcopy(dF(), GCurrent.ptr(), 1, results+p*dF(), 1);
+	}
+	cblas_dcopy(dF(), &saved[0], 1, FCurrent.ptr(), 1);
+	freshen();
+}
+
+
+void sherpa::negative_finite_diff_gradient_(memarray& fGrad)
+{
+	if (fGrad.size() < dF()) OOPS("error(sherpa): not enough finite diff array space");
+	
+	std::vector<double> points;
+	std::vector<double> jiggles;
+	_finite_diff_points(FCurrent, dF(), points, jiggles);
+	
+	std::vector<double> values (2*dF());
+	if (dF()) objective_at(&points[0], 2*dF(), &values[0]);
+	
+	for (unsigned i=0;i<dF();i++) {
+		fGrad[i] = (values[2*i] - values[2*i+1]) / (-2*jiggles[i]);
 	}
 }
 
 void sherpa::finite_diff_gradient_(memarray& fGrad)
 {
-	unsigned i;	
-	double jiggle;
 	if (fGrad.size() < dF()) OOPS("error(sherpa): not enough finite diff array space");
 	
-	for (i=0;i<dF();i++) {
-		jiggle = FCurrent[i] * PERTURBATION_SIZE;
-		if (!jiggle) jiggle = PERTURBATION_SIZE;
-		
-		FCurrent[i] += jiggle;
-		freshen();
-		fGrad[i] = objective();
-		FCurrent[i] -= jiggle;
-		
-		FCurrent[i] -= jiggle;
-		freshen();
-		fGrad[i] -= objective();
-		FCurrent[i] += jiggle;
-		freshen();
-		
-		fGrad[i] /= 2*jiggle;
+	std::vector<double> points;
+	std::vector<double> jiggles;
+	_finite_diff_points(FCurrent, dF(), points, jiggles);
+	
+	std::vector<double> values (2*dF());
+	if (dF()) objective_at(&points[0], 2*dF(), &values[0]);
+	
+	for (unsigned i=0;i<dF();i++) {
+		fGrad[i] = (values[2*i] - values[2*i+1]) / (2*jiggles[i]);
 	}
 }
 
@@ -106,28 +155,18 @@ void sherpa::finite_diff_hessian (triangle& fHESS)
 	
 	memarray temp_fHess (dF(),dF());
 	unsigned i,j;
-	double jiggle;
-		
+	
+	std::vector<double> points;
+	std::vector<double> jiggles;
+	_finite_diff_points(ReadFCurrent(), dF(), points, jiggles);
+	
+	std::vector<double> grads (2*dF()*dF());
+	if (dF()) gradient_at(&points[0], 2*dF(), &grads[0]);
+	
 	for (i=0;i<dF();i++) {
-		jiggle = ReadFCurrent()[i] * PERTURBATION_SIZE;
-		if (!jiggle) jiggle = PERTURBATION_SIZE;
-		
-		FCurrent[i] += jiggle;
-		freshen();
-		objective();
-		gradient(); 
-		cblas_dcopy(dF(), GCurrent.ptr(),1, temp_fHess.ptr()+i,dF());    
-		FCurrent[i] -= jiggle;
-		
-		FCurrent[i] -= jiggle;
-		freshen();
-		objective();
-		gradient();     
-		cblas_daxpy(dF(), -1, GCurrent.ptr(),1, temp_fHess.ptr()+i,dF());
-		FCurrent[i] += jiggle;
-		freshen();
-		
-		if (jiggle) cblas_dscal(dF(), 1/(2*jiggle), temp_fHess.ptr()+i,dF());						
+		cblas_dcopy(dF(), &grads[(2*i  )*dF()],1, temp_fHess.ptr()+i,dF());
+		cblas_daxpy(dF(), -1, &grads[(2*i+1)*dF()],1, temp_fHess.ptr()+i,dF());
+		cblas_dscal(dF(), 1/(2*jiggles[i]), temp_fHess.ptr()+i,dF());
 		//MONITOR(msg) << "xHESSIAN\n" << temp_fHess.printrows(0,dF()) ;
 	}
 	
@@ -271,6 +310,7 @@ void sherpa::_reset_to_best_known_value()
 	// ZCurrent = ZBest;
 	FCurrent = FBest;
 	freshen();
+	_evaluations++;
 	ZCurrent = objective();
 }
 
@@ -283,7 +323,7 @@ void sherpa::_reset_to_best_known_value()
 // ----------------------------------------------------------------------------
 double sherpa::_line_search_evaluation(double& step)
 {
-	if (PyErr_CheckSignals()) PYTHON_INTERRUPT;
+	if (_interrupted()) PYTHON_INTERRUPT;
 
 	double* FLastTurn_ptr = FLastTurn.ptr()+1;
 	double* FDirection_ptr = FDirection.ptr()+1;
@@ -309,7 +349,8 @@ double sherpa::_line_search_evaluation(double& step)
 		}
 	}
 //	freshen();
-	ZCurrent = objective();
+	_evaluations++;
+	ZCurrent = objective_only();
 	return _check_for_improvement();
 }
 
@@ -378,6 +419,143 @@ int sherpa::_line_search (sherpa_pack& method)
 	
 }
 
+// The quadratic form x'Mx, for a symmetric matrix with its upper triangle filled
+static double _quadratic_form(etk::triangle& M, const double* x, const size_t& n)
+{
+	puddle Mx (n);
+	#ifdef SYMMETRIC_PACKED
+	cblas_dspmv(CblasRowMajor,CblasUpper, n, 1,
+				*M, x,1, 0, *Mx,1);
+	#else
+	cblas_dsymv(CblasRowMajor,CblasUpper, n, 1,
+				*M, M.size1(), x,1, 0, *Mx,1);
+	#endif
+	return cblas_ddot(n, x,1, *Mx,1);
+}
+
+int sherpa::_trust_region_step (sherpa_pack& method)
+{
+	MONITOR(msg) << "Turn(["<< ReadFLastTurnAsString() <<"])";
+	
+	// The model of the improvement is m(p) = g'p - p'Bp/2, where g is the
+	//  ascent gradient (-GCurrent) and B is the BHHH matrix. The ascent
+	//  direction found for this iteration is the step that maximizes it.
+	size_t n = dF();
+	std::vector<double> newton (FDirection.ptr(), FDirection.ptr()+n);
+	std::vector<double> g (n);
+	for (size_t i=0; i<n; i++) g[i] = -GCurrent[i];
+	
+	// Holdfast parameters take no part in the step, so their entries are
+	//  zeroed and the model is built on the BHHH of the free parameters.
+	bool holdfast = any_holdfast();
+	std::vector<size_t> free_slot;
+	for (size_t i=0; i<n; i++) {
+		if (FHoldfast.int8_at(i)) {
+			g[i] = 0;
+			newton[i] = 0;
+		} else {
+			free_slot.push_back(i);
+		}
+	}
+	size_t nfree = free_slot.size();
+	if (nfree==0) return LINE_SEARCH_FAIL;
+	double newton_len = cblas_dnrm2(n, &newton[0],1);
+	double g_len = cblas_dnrm2(n, &g[0],1);
+	double newton_gain = cblas_ddot(n, &g[0],1, &newton[0],1);
+	if (!(newton_len > 0) || !(newton_gain > 0)) return LINE_SEARCH_FAIL;
+	
+	// The Cauchy point maximizes the model along the gradient. If the BHHH
+	//  matrix was not used for the direction (it is missing, or the search
+	//  fell back to BFGS and the matrix is stale), the dogleg is not available,
+	//  and the ascent direction is cut back to the trust radius instead.
+	bool dogleg = (_direction_from_bhhh && Bhhh.size1()==n && !Bhhh.all_zero());
+	etk::triangle free_bhhh;
+	std::vector<double> free_x (nfree);
+	auto model_curvature = [&](const double* x) -> double {
+		if (!holdfast) return _quadratic_form(Bhhh, x, n);
+		for (size_t f=0; f<nfree; f++) free_x[f] = x[free_slot[f]];
+		return _quadratic_form(free_bhhh, &free_x[0], nfree);
+	};
+	std::vector<double> cauchy (n, 0.0);
+	if (dogleg) {
+		if (holdfast) {
+			free_bhhh.resize(nfree);
+			hessfull_to_hessfree(&Bhhh, &free_bhhh);
+		}
+		double gBg = model_curvature(&g[0]);
+		dogleg = (gBg > 0);
+		if (dogleg) {
+			for (size_t i=0; i<n; i++) cauchy[i] = g[i] * (g_len*g_len/gBg);
+		}
+	}
+	
+	if (isNan(_trust_radius)) _trust_radius = method.Initial_Step * newton_len;
+	_trust_radius = std::min(_trust_radius, method.Max_Step * newton_len);
+	
+	int status = LINE_SEARCH_NO_IMPROVEMENT;
+	bool first = true;
+	while (status==LINE_SEARCH_NO_IMPROVEMENT || status==LINE_SEARCH_ERROR_NAN) {
+		double predicted;
+		double cauchy_len = cblas_dnrm2(n, &cauchy[0],1);
+		if (newton_len <= _trust_radius) {
+			for (size_t i=0; i<n; i++) FDirection[i] = newton[i];
+			predicted = newton_gain / 2;
+		} else if (!dogleg) {
+			double s = _trust_radius / newton_len;
+			for (size_t i=0; i<n; i++) FDirection[i] = newton[i] * s;
+			predicted = newton_gain * (s - s*s/2);
+		} else {
+			if (cauchy_len >= _trust_radius) {
+				for (size_t i=0; i<n; i++) FDirection[i] = g[i] * (_trust_radius/g_len);
+			} else {
+				// Walk from the Cauchy point toward the ascent direction until
+				//  the step reaches the trust radius
+				double dd=0, cd=0, cc=0;
+				for (size_t i=0; i<n; i++) {
+					double d = newton[i]-cauchy[i];
+					dd += d*d;
+					cd += cauchy[i]*d;
+					cc += cauchy[i]*cauchy[i];
+				}
+				double t = (-cd + sqrt(cd*cd - dd*(cc-_trust_radius*_trust_radius))) / dd;
+				for (size_t i=0; i<n; i++) FDirection[i] = cauchy[i] + t*(newton[i]-cauchy[i]);
+			}
+			predicted = cblas_ddot(n, &g[0],1, FDirection.ptr(),1) - model_curvature(FDirection.ptr())/2;
+		}
+		double step_len = cblas_dnrm2(n, FDirection.ptr(),1);
+		
+		double unit (1.0);
+		double improvement = _line_search_evaluation(unit);
+		double rho = improvement / predicted;
+		
+		if (isNan(ZCurrent)) {
+			status = LINE_SEARCH_ERROR_NAN;
+			rho = 0;
+		}
+		if (rho < 0.25) {
+			_trust_radius = step_len * method.Step_Retract_Factor;
+		} else if (rho > 0.75 && step_len > 0.99*_trust_radius) {
+			_trust_radius = std::min(_trust_radius * method.Step_Extend_Factor, method.Max_Step * newton_len);
+		}
+		
+		if (improvement > 0 && !isNan(ZCurrent)) {
+			status = (first ? LINE_SEARCH_SUCCESS_BIG : LINE_SEARCH_SUCCESS_SMALL);
+			INFO(msg)<< "  using "<<algorithm_name(method.Algorithm)
+			         <<", trust region step found improvement to "
+			         << ZCurrent <<" (+"<<improvement<<", "<<rho<<" of predicted) using radius="<<step_len ;
+		} else {
+			BUGGER(msg)<< "trust region step found degradation to "<< ZCurrent <<" using radius="<<step_len ;
+			if (_trust_radius < method.Min_Step * newton_len) status = LINE_SEARCH_FAIL;
+		}
+		first = false;
+	}
+	
+	if (status <= 0) {
+		_reset_to_best_known_value();
+	}
+	return status;
+}
+
 // TODO: Identify when maximization has every parameter but one alternating sign direction over many iterations
 
 int sherpa::_bhhh_update (etk::symmetric_matrix* use_bhhh)
@@ -401,7 +579,7 @@ int sherpa::_bhhh_update (etk::symmetric_matrix* use_bhhh)
 		
 		// invert hessian
 		hessfull_to_hessfree(&invHessTemp, &temp_free_hess) ;
-		temp_free_hess.inv();
+		temp_free_hess.inv(&msg);
 		hessfree_to_hessfull(&invHessTemp, &temp_free_hess) ;
 
 	} else {
@@ -431,7 +609,7 @@ int sherpa::_bfgs_update ()
 	if (isNan(Denom)) return -1;
 	if (fabs(Denom) > 1e30) return -1;
 	
-	ndarray HdG (dF());
+	puddle HdG (dF());
 	#ifdef SYMMETRIC_PACKED
 	cblas_dspmv(CblasRowMajor,CblasUpper, dF(), 1,
 				*invHessTemp, *GMotion,1, 0, *HdG,1);
@@ -444,7 +622,7 @@ int sherpa::_bfgs_update ()
 				dF(), -Denom, *HdG,1, *FMotion,1, *invHessTemp, invHessTemp.size1());
 	#endif
 	
-	DenomB = (GMotion * HdG);
+	DenomB = cblas_ddot(dF(), *GMotion,1, *HdG,1);
 	DenomB *= Denom;
 	DenomB += 1;
 	DenomB *= Denom;
@@ -494,7 +672,7 @@ int sherpa::_dfp_update ()
 
 int sherpa::_dfpj_update ()
 {
-	memarray HdG (dF());
+	puddle HdG (dF());
 	invHessTemp = invHess;
 	
     double Denom, Numerat;
@@ -517,7 +695,7 @@ int sherpa::_dfpj_update ()
 				0,
 				*HdG,1);
 	#endif
-	HdG += FMotion;
+	cblas_daxpy(dF(), 1, *FMotion,1, *HdG,1);
 	
 	#ifdef SYMMETRIC_PACKED
 	cblas_dspr2(CblasRowMajor, CblasUpper,
@@ -533,7 +711,7 @@ int sherpa::_dfpj_update ()
 				*invHessTemp,invHessTemp.size1());
 	#endif
 	
-	Numerat = (HdG * GMotion) * Denom * Denom * -1;
+	Numerat = cblas_ddot(dF(), *HdG,1, *GMotion,1) * Denom * Denom * -1;
 	if (isInf(Numerat)) return -1;
 	if (isNan(Numerat)) return -1;
 	#ifdef SYMMETRIC_PACKED
@@ -550,6 +728,7 @@ int sherpa::_find_ascent_direction (char& Method)
 {
 	MONITOR(msg)<< "Seeking ascent direction" ;
 	int status (0);
+	_direction_from_bhhh = false;
 	switch (Method) {
 			
 			// Analytic or finite difference Hessian
@@ -558,7 +737,7 @@ int sherpa::_find_ascent_direction (char& Method)
 			MONITOR(msg)<< "using hessian to seek ascent direction" ;
 			calculate_hessian();
 			invHessTemp = Hess;
-			invHessTemp.inv();
+			invHessTemp.inv(&msg);
 			break; 
 			
 			// BFGS (Broyden-Fletcher-Goldfarb-Shanno) Algorithm	
@@ -601,6 +780,7 @@ int sherpa::_find_ascent_direction (char& Method)
 		default:
 			MONITOR(msg)<< "using BHHH to seek ascent direction" ;
 			status = _bhhh_update(&Bhhh);
+			_direction_from_bhhh = (status>=0);
 			if (status<0) {
 				WARN(msg)<< "BHHH is missing, so using BFGS to seek ascent direction" ;
 				status = _bfgs_update();
@@ -660,6 +840,63 @@ void sherpa::_initial_evaluation()
 	_basecamp();
 }
 
+// ----------------------------------------------------------------------------
+//	_minibatch_phase
+//
+//		Takes BHHH steps on random samples of cases, growing the sample at each
+//		iteration, until the sample is the whole or the steps are small. The
+//		objective is then evaluated on all the cases again, so the normal
+//		iterations can finish from where this leaves off.
+// ----------------------------------------------------------------------------
+void sherpa::_minibatch_phase(sherpa_pack& Norgay, unsigned& iteration_number)
+{
+	double fraction = Norgay.Batch_Fraction;
+	double growth = std::max(Norgay.Batch_Growth, 1.0+1e-6);
+	if (!(fraction > 0) || fraction >= 1) return;
+	if (!case_sample(fraction)) {
+		WARN(msg)<< "cannot sample the cases of this model, so "<<Norgay.AlgorithmName()<<" uses all of them";
+		return;
+	}
+	try {
+		while (fraction < 1 && iteration_number < max_iterations) {
+			iteration_number++;
+			MONITOR(msg)<< "ITERATION NUMBER "<<iteration_number<< " USES A SAMPLE OF "<<fraction<<" OF THE CASES" ;
+			
+			// Objective values on different samples cannot be compared, so the
+			//  line search only needs to improve on this sample
+			ZCurrent = objective();
+			gradient();
+			ZBest = ZCurrent;
+			FBest = ReadFCurrent();
+			_basecamp();
+			
+			char bhhh = 'G';
+			int direction_status = _find_ascent_direction(bhhh);
+			double tolerance = -(FDirection*GCurrent) / fraction;
+			if (isNan(tolerance) || direction_status<0) break;
+			INFO(msg)<< "Iteration "<< iteration_number <<": Sampled Convergence Measure = "<<tolerance;
+			if (fabs(tolerance) < Norgay.threshold()) break;
+			
+			_line_search(Norgay);
+			
+			fraction *= growth;
+			if (fraction < 1) case_sample(fraction);
+			if (_interrupted()) PYTHON_INTERRUPT;
+		}
+	} catch (...) {
+		case_sample(1.0);
+		throw;
+	}
+	case_sample(1.0);
+	
+	ZCurrent = objective();
+	gradient();
+	ZBest = ZCurrent;
+	FBest = ReadFCurrent();
+	_basecamp();
+	INFO(msg)<< "after sampled iterations, the objective on all cases is "<<ZCurrent;
+}
+
 #define return_outcome(x) outcome.best_obj_value=ZCurrent; outcome.result=(x); return outcome
 
 sherpa_result sherpa::_maximize_pack(sherpa_pack& Norgay, unsigned& iteration_number)
@@ -671,6 +908,13 @@ sherpa_result sherpa::_maximize_pack(sherpa_pack& Norgay, unsigned& iteration_nu
 	// Initial Evaluation
 	if (!iteration_number) _initial_evaluation();
 	
+	// The mini-batch algorithm starts on samples of cases, and then finishes
+	//  as BHHH on all of them
+	if (Norgay.Algorithm=='M' || Norgay.Algorithm=='m') _minibatch_phase(Norgay, iteration_number);
+	
+	// Each pack begins with a trust radius sized from its initial step
+	_trust_radius = NAN;
+	
 	double tolerance; 
 	int status;
 	string ret;
@@ -749,7 +993,13 @@ sherpa_result sherpa::_maximize_pack(sherpa_pack& Norgay, unsigned& iteration_nu
 			flag_hessian_diagnostic--;
 		}
 		
-		status = _line_search(Norgay);
+		_evaluations = 0;
+		if (Norgay.Algorithm=='T' || Norgay.Algorithm=='t') {
+			status = _trust_region_step(Norgay);
+		} else {
+			status = _line_search(Norgay);
+		}
+		iteration_evaluations.push_back(int(_evaluations));
 		
 		Recorded_Objective_Values.push_back(ZCurrent);
 		
@@ -819,7 +1069,7 @@ sherpa_result sherpa::_maximize_pack(sherpa_pack& Norgay, unsigned& iteration_nu
 			<<Norgay.Honeymoon - local_iteration << " iterations remaining)" ;
 		}
 	
-		if (PyErr_CheckSignals()) PYTHON_INTERRUPT;
+		if (_interrupted()) PYTHON_INTERRUPT;
 	}
 	
 	return_outcome( SHERPA_FATAL );
@@ -871,9 +1121,21 @@ string sherpa::maximize(unsigned& iteration_number, vector<sherpa_pack>* opts)
 	
 	if (!current_pack) OOPS("error in maximization -- no optimization pack found");
 	
+	// The line search and trust region step retract until the step is below
+	//  Min_Step, which never happens unless each retraction shrinks it.
+	for (auto p=opts->begin(); p!=opts->end(); p++) {
+		if (!(p->Step_Retract_Factor > 0 && p->Step_Retract_Factor < 1)) {
+			OOPS("error in maximization -- the step retract factor of ",p->AlgorithmName()," is ",p->Step_Retract_Factor,", it must be between 0 and 1");
+		}
+		if (!(p->Min_Step > 0)) {
+			OOPS("error in maximization -- the minimum step of ",p->AlgorithmName()," is ",p->Min_Step,", it must be positive");
+		}
+	}
+	
 	_initialize();
 	
 	invHess.initialize_identity();
+	iteration_evaluations.clear();
 	
 	while (current_pack) {
 		status = _maximize_pack(*current_pack, iteration_number);
@@ -1133,18 +1395,17 @@ string sherpa::printStatus(int which, double total_tol) const
 
 
 sherpa::sherpa()
-: weakself(nullptr)
-, ParameterList()
+: ParameterList()
+, weakself(nullptr)
 , flag_gradient_diagnostic (0)
 , flag_hessian_diagnostic (0)
+, _trust_radius(NAN)
+, _evaluations(0)
+, _direction_from_bhhh(false)
+, iteration_evaluations()
 , ZCurrent (NAN)
 , ZBest (NAN)
 , ZLastTurn (NAN)
-, Bhhh ()
-, Hess ()
-, invHess ()
-, invHessTemp ()
-, robustCovariance ()
 , FCurrent()
 , _FCurrent_latest_objective()
 , FBest()
@@ -1159,17 +1420,29 @@ sherpa::sherpa()
 , GPrevTurn()
 , GMotion()
 , FatGCurrent()
-, max_iterations(1000)
+, Bhhh ()
+, Hess ()
+, invHess ()
+, invHessTemp ()
+, robustCovariance ()
 , hessian_matrix()
+, max_iterations(1000)
 {
 	
 }
 
 sherpa::sherpa(const sherpa& dupe)
-: weakself(nullptr)
-, ParameterList(dupe)
+: ParameterList(dupe)
+, weakself(nullptr)
 , flag_gradient_diagnostic (0)
 , flag_hessian_diagnostic (0)
+, _trust_radius(NAN)
+, _evaluations(0)
+, _direction_from_bhhh(false)
+, iteration_evaluations()
+, ZCurrent (NAN)
+, ZBest (NAN)
+, ZLastTurn (NAN)
 , max_iterations(dupe.max_iterations)
 {
 	
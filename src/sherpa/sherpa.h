@@ -78,13 +78,30 @@ public:
 	PyObject* weakself;
 
 	virtual double objective();
+	virtual double objective_only();
+	// As objective, but nothing other than the value is needed afterwards, as
+	//  in a line search. The default is to call objective.
 	virtual const etk::memarray& gradient(const bool& force_recalculate=false);
 	virtual void calculate_hessian();
+	virtual bool case_sample(const double& fraction);
+	// Evaluate the objective and gradient only on a new random sample of about
+	//  this fraction of the cases, or on all of them when the fraction is 1 or
+	//  more. Returns false if this cannot be done, as in the default, which
+	//  only accepts the full sample.
 	
 	void negative_finite_diff_gradient_(etk::memarray& fGrad);
 	void finite_diff_gradient_(etk::memarray& fGrad);
 	void finite_diff_hessian (etk::triangle& fHESS);
 	
+	// Evaluate the objective, or the gradient (as in GCurrent), at each of npoints
+	//  parameter vectors of length dF() packed in points, writing npoints values
+	//  (or npoints rows of dF() values) to results. The finite difference methods
+	//  get all their evaluations from these, so a derived class can override them
+	//  to evaluate the points concurrently. The defaults step FCurrent through the
+	//  points one at a time, and put it back afterwards.
+	virtual void objective_at(const double* points, const size_t& npoints, double* results);
+	virtual void gradient_at (const double* points, const size_t& npoints, double* results);
+	
 	double gradient_diagnostic (bool shout=false);
 	double hessian_diagnostic () ;
 	int flag_gradient_diagnostic;
@@ -110,6 +127,16 @@ private:
 	//		 1	Found improvement at smaller than initial step
 	//		-1	Did not find an improvement at minimum step value
 	//		-2	A function evaluation returned NaN even at minimum step value
+	int _trust_region_step (sherpa_pack& method);
+	//	_trust_region_step() is called in place of line_search for the trust
+	//		region algorithm, and returns the same values. It takes the dogleg
+	//		step between the Cauchy point and the ascent direction within the
+	//		trust radius, using the BHHH matrix as the model hessian.
+	double _trust_radius;
+	unsigned _evaluations;
+	bool _direction_from_bhhh;
+	//	_direction_from_bhhh is set by _find_ascent_direction when the BHHH
+	//		matrix gave the direction, and not a fallback to BFGS.
 	
 protected:
 	// Direction finding schemes, return 0 for good values, <0 if there is a problem
@@ -124,6 +151,11 @@ public:
 	void full_evaluation(int with_derivs=0);
 private:
 	sherpa_result _maximize_pack(sherpa_pack& Norgay, unsigned& iteration_number);
+	void _minibatch_phase(sherpa_pack& Norgay, unsigned& iteration_number);
+protected:
+	std::vector<int> iteration_evaluations;
+	// The number of objective evaluations made by the line search or trust
+	//  region step in each iteration of the latest maximization.
 public:
 	std::string maximize(unsigned& iteration_number, std::vector<sherpa_pack>* opts=NULL);
 	
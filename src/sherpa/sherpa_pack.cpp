@@ -45,6 +45,12 @@ std::string algorithm_name(const char& algo)
 		case 'G':	
 		case 'g':
 			return "BHHH";
+		case 'M':
+		case 'm':
+			return "Mini-batch BHHH";
+		case 'T':
+		case 't':
+			return "Trust Region BHHH";
 	}
 	return "Incognito";
 }
@@ -52,7 +58,8 @@ std::string algorithm_name(const char& algo)
 
 sherpa_pack::sherpa_pack(char algo, double thresh, double ini, unsigned slow, 
 						 double min, double max, double ext, double ret,
-						 unsigned honey, double pat, unsigned maxiter, unsigned miniter)
+						 unsigned honey, double pat, unsigned maxiter, unsigned miniter,
+						 double batch, double growth)
 : Min_Step (min)
 , Max_Step (max)
 , Step_Extend_Factor (ext)
@@ -66,6 +73,8 @@ sherpa_pack::sherpa_pack(char algo, double thresh, double ini, unsigned slow,
 , Patience (pat)
 , Max_NumIter(maxiter)
 , Min_NumIter(miniter)
+, Batch_Fraction(batch)
+, Batch_Growth(growth)
 {
 	if (algorithm_name(algo)=="Incognito") {
 		Algorithm = 'G';
@@ -123,6 +132,10 @@ std::string sherpa_pack::print_pack() const
 	ret << " initialstep=" << Initial_Step;
 	ret << " algorithm="<< Algorithm;
 	ret << " tolthreshold=" << tolerance_threshold;
+	if (Algorithm=='M' || Algorithm=='m') {
+		ret << " batch=" << Batch_Fraction;
+		ret << " growth=" << Batch_Growth;
+	}
 	return ret.str();
 }
 
@@ -158,6 +171,16 @@ std::string sherpa_pack::AlgorithmName() const
 		case 's':
 			return "Steepest Ascent";
 			
+			// BHHH directions with dogleg trust region steps in place of a line search
+		case 'T':
+		case 't':
+			return "Trust Region BHHH (dogleg)";
+			
+			// BHHH on growing random samples of cases, then on all of them
+		case 'M':
+		case 'm':
+			return "Mini-batch BHHH";
+			
 			// BHHH (Berndt-Hall-Hall-Hausman) Algorithm
 		case 'G':
 		case 'g':
@@ -41,7 +41,8 @@ public:
 	
 	sherpa_pack(char algo='G', double thresh=0.0001, double ini=1, unsigned slow=0, 
 				double min=1e-10, double max=4, double ext=2, double ret=.5,
-				unsigned honey=3, double pat=1., unsigned maxiter=UINT_MAX, unsigned miniter=0);
+				unsigned honey=3, double pat=1., unsigned maxiter=UINT_MAX, unsigned miniter=0,
+				double batch=0.01, double growth=2.0);
 	virtual ~sherpa_pack();
 	
 	double Min_Step;
@@ -59,6 +60,12 @@ public:
 	bool   Fail;
 	unsigned Slowness;
 	
+	double Batch_Fraction;
+	double Batch_Growth;
+	// For the mini-batch algorithm ('M'), the fraction of cases in the first
+	//  random sample, and the factor by which it grows at each iteration until
+	//  the full sample is used.
+	
 	virtual double get_step();
 	virtual void tell_step(const double& step);
 	
@@ -67,6 +74,7 @@ public:
 	virtual std::string print_pack() const;
 	
 	std::string AlgorithmName() const;
+	double threshold() const { return tolerance_threshold; }
 	
 	std::string __repr__() const;
 	
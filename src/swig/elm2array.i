@@ -67,6 +67,7 @@
 {
 	if (PyArray_Check($input)) {
 		$1 = ( (PyArray_TYPE((PyArrayObject*)$input)== NPY_DOUBLE)
+			  ||(PyArray_TYPE((PyArrayObject*)$input)== NPY_FLOAT )
 			  ||(PyArray_TYPE((PyArrayObject*)$input)== NPY_BOOL  )
 			  ||(PyArray_TYPE((PyArrayObject*)$input)== NPY_INT64 )
 			  ) ? 1 : 0;
@@ -461,11 +462,12 @@
 	} else {
 		if (PyArray_Check($input)) {
 			if (  (PyArray_TYPE((PyArrayObject*)$input)!= NPY_DOUBLE)
+				&&(PyArray_TYPE((PyArrayObject*)$input)!= NPY_FLOAT )
 				&&(PyArray_TYPE((PyArrayObject*)$input)!= NPY_BOOL  )
 				&&(PyArray_TYPE((PyArrayObject*)$input)!= NPY_INT64 )
 				&&(PyArray_TYPE((PyArrayObject*)$input)!= NPY_INT8  )
 				) {
-				PyErr_SetString(ptrToLarchError, const_cast<char*>("function requires array type DOUBLE or BOOL or INT64 or INT8"));
+				PyErr_SetString(ptrToLarchError, const_cast<char*>("function requires array type DOUBLE or FLOAT or BOOL or INT64 or INT8"));
 				SWIG_fail;
 			}
 			try {
@@ -489,11 +491,12 @@
 	} else {
 		if (PyArray_Check($input)) {
 		if (  (PyArray_TYPE((PyArrayObject*)$input)!= NPY_DOUBLE)
+			&&(PyArray_TYPE((PyArrayObject*)$input)!= NPY_FLOAT )
 			&&(PyArray_TYPE((PyArrayObject*)$input)!= NPY_BOOL  )
 			&&(PyArray_TYPE((PyArrayObject*)$input)!= NPY_INT64 )
 			&&(PyArray_TYPE((PyArrayObject*)$input)!= NPY_INT8  )
 			) {
-			PyErr_SetString(ptrToLarchError, const_cast<char*>("function requires array type DOUBLE or BOOL or INT64 or INT8"));
+			PyErr_SetString(ptrToLarchError, const_cast<char*>("function requires array type DOUBLE or FLOAT or BOOL or INT64 or INT8"));
 			SWIG_fail;
 		}
 		try {
@@ -523,12 +526,13 @@
 		while (PyDict_Next($input, &pos, &thekey, &thearray)) {
 			if (PyArray_Check(thearray)) {
 				if (  (PyArray_TYPE((PyArrayObject*)thearray)!= NPY_DOUBLE)
+					&&(PyArray_TYPE((PyArrayObject*)thearray)!= NPY_FLOAT )
 					&&(PyArray_TYPE((PyArrayObject*)thearray)!= NPY_BOOL  )
 					&&(PyArray_TYPE((PyArrayObject*)thearray)!= NPY_INT64 )
 					) {
 					$1 = 0;
 				}
-			} else {$1 = 0;}
+			} else if (!PyUnicode_Check(thearray)) {$1 = 0;}
 			if (!PyUnicode_Check(thekey)) { $1 = 0; }
 		}
 	}
@@ -547,10 +551,11 @@
 
 		if (PyArray_Check(thearray)) {
 		if (  (PyArray_TYPE((PyArrayObject*)thearray)!= NPY_DOUBLE)
+			&&(PyArray_TYPE((PyArrayObject*)thearray)!= NPY_FLOAT )
 			&&(PyArray_TYPE((PyArrayObject*)thearray)!= NPY_BOOL  )
 			&&(PyArray_TYPE((PyArrayObject*)thearray)!= NPY_INT64 )
 			) {
-			std::string explain = "function requires all array types to be DOUBLE or BOOL or INT64, '";
+			std::string explain = "function requires all array types to be DOUBLE or FLOAT or BOOL or INT64, '";
 			explain+= PyString_ExtractCppString(thekey);
 			explain+= "' is not";
 			PyErr_SetString(ptrToLarchError, const_cast<char*>(explain.c_str()));
@@ -567,8 +572,21 @@
 			SWIG_fail;
 		}
 		$1 = &temp;
+		} else if (PyUnicode_Check(thearray)) {
+		// a string is the name of a binary darray file
+		try {
+			temp[PyString_ExtractCppString(thekey)] = elm::darray::map_file(PyString_ExtractCppString(thearray));
+		} catch (const std::exception& e) {
+			std::string explain = e.what();
+			explain+= "(on '";
+			explain+= PyString_ExtractCppString(thekey);
+			explain+= "')";
+			PyErr_SetString(ptrToLarchError, const_cast<char*>(explain.c_str()));
+			SWIG_fail;
+		}
+		$1 = &temp;
 		} else {
-			PyErr_SetString(ptrToLarchError, const_cast<char*>("function requires array"));
+			PyErr_SetString(ptrToLarchError, const_cast<char*>("function requires array or darray file name"));
 			SWIG_fail;
 		}
 
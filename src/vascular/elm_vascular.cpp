@@ -573,11 +573,66 @@ int VAS_System::add_cell(const cellcode& cod, const string& nam, const bool& mus
 	return s;
 }
 
+VAS_Plan::VAS_Plan()
+:	n_cells     (0)
+,	n_elemental (0)
+,	mu_begins   (NULL)
+{ }
+
+void VAS_Plan::clear()
+{
+	n_cells = 0;
+	n_elemental = 0;
+	dn_start.clear();
+	dn_cell.clear();
+	dn_alloc.clear();
+	up_start.clear();
+	up_cell.clear();
+	up_edge.clear();
+	up_alloc.clear();
+	mu_offset.clear();
+	mu_begins = NULL;
+}
+
+void VAS_Plan::build(const Vasc_CellVec& cells, const unsigned& n_elem, const double* mu_ptr)
+{
+	clear();
+	n_cells = cells.size();
+	n_elemental = n_elem;
+	mu_begins = mu_ptr;
+	
+	dn_start.reserve(n_cells+1);
+	up_start.reserve(n_cells+1);
+	mu_offset.reserve(n_cells);
+	for (unsigned i=0; i<n_cells; i++) {
+		dn_start.push_back(dn_cell.size());
+		for (unsigned k=0; k<cells[i].dnsize(); k++) {
+			const VAS_Edge* e = cells[i].dnedge(k);
+			dn_cell.push_back(e->d()->slot());
+			dn_alloc.push_back(e->is_competitive() ? e->alloc_slot() : UINT_MAX);
+		}
+		up_start.push_back(up_cell.size());
+		for (unsigned u=0; u<cells[i].upsize(); u++) {
+			const VAS_Edge* e = cells[i].upedge(u);
+			up_cell.push_back(e->u()->slot());
+			up_edge.push_back(e->edge_slot());
+			up_alloc.push_back(e->is_competitive() ? e->alloc_slot() : UINT_MAX);
+		}
+		mu_offset.push_back(cells[i]._parameter_offset);
+	}
+	dn_start.push_back(dn_cell.size());
+	up_start.push_back(up_cell.size());
+}
+
+
+
+
 void VAS_System::ungrow()
 {
 	_cells.clear();
 	_edges.clear();
 	_anatomy.clear();
+	_plan.clear();
 	_touch = true;
 }
 
@@ -824,6 +879,9 @@ void VAS_System::regrow( ComponentCellcodeMap* nodes, LinearCOBundle_2* edges, F
 	}
 	_allocation_breaks.push_back(_n_competitive_allocations);
 	
+	REGROW_LOG(msg, "Flattening the vascular plan...");
+	_plan.build(_cells, _n_elemental, _mu_begins);
+	
 	REGROW_LOG(msg, "Vascular system regrow complete.");
 	
 	REGROW_LOG(msg, display());
@@ -1171,6 +1229,7 @@ void VAS_System::clear()
 	_cells.clear();
 	_edges.clear();
 	_anatomy.clear();
+	_plan.clear();
 	_touch = true;
 		
 	_mu_offset=NULL;
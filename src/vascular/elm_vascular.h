@@ -212,6 +212,7 @@ namespace elm {
 		
 		VAS_Cell (const cellcode& c, const unsigned& slot);
 		friend class VAS_System;
+		friend class VAS_Plan;
 	};
 	typedef std::vector<VAS_Cell*> Vasc_CellPVec;
 	typedef std::vector<VAS_Cell>  Vasc_CellVec;
@@ -220,6 +221,41 @@ namespace elm {
 
 	typedef std::map<cellcode,VAS_Cell*> cellmap;
 
+
+	// Vascular Plan
+	//  A flat copy of a grown vascular system, made when it is regrown. The
+	//  cells are numbered by slot, which is already an ascending order (each
+	//  cell comes after all of its successors), and the edges of each cell
+	//  are held in contiguous index arrays, so the nesting tree can be
+	//  evaluated for each case in tight loops over arrays instead of by
+	//  following pointers between cells and edges.
+	class VAS_Plan
+	{
+	public:
+		unsigned n_cells;
+		unsigned n_elemental;
+		
+		std::vector<unsigned> dn_start;  // [n_cells+1] down edges of cell i are dn_start[i] up to dn_start[i+1]
+		std::vector<unsigned> dn_cell;   // slot of the successor on each down edge
+		std::vector<unsigned> dn_alloc;  // allocation slot of each down edge, or UINT_MAX if not competitive
+		
+		std::vector<unsigned> up_start;  // [n_cells+1] up edges of cell i are up_start[i] up to up_start[i+1]
+		std::vector<unsigned> up_cell;   // slot of the predecessor on each up edge
+		std::vector<unsigned> up_edge;   // edge slot of each up edge
+		std::vector<unsigned> up_alloc;  // allocation slot of each up edge, or UINT_MAX if not competitive
+		
+		std::vector<unsigned> mu_offset; // parameter offset of the mu of each cell, or UINT_MAX
+		const double*         mu_begins; // mu values of the branches, in slot order, or NULL if all are 1
+		
+		inline double mu(const unsigned& i) const { return (mu_begins && i>=n_elemental) ? mu_begins[i-n_elemental] : 1.0; }
+		inline unsigned dnsize(const unsigned& i) const { return dn_start[i+1]-dn_start[i]; }
+		inline unsigned upsize(const unsigned& i) const { return up_start[i+1]-up_start[i]; }
+		
+		void build(const Vasc_CellVec& cells, const unsigned& n_elemental, const double* mu_begins);
+		void clear();
+		VAS_Plan();
+	};
+
 	class VAS_System
 	{
 		VAS_dna					_genome;
@@ -245,7 +281,12 @@ namespace elm {
 		unsigned    _n_competitive_allocations;
 		std::vector<unsigned> _allocation_breaks;
 		
+		VAS_Plan    _plan;
+		
 	public:
+		const VAS_Plan& plan() const { return _plan; }
+		// The flat plan of the system as last grown.
+
 		VAS_dna genome() const {return _genome;}
 	
 		void touch() {_touch = true;}